@@ -148,7 +148,10 @@ trap "rm -f $dir/HCLG.fst.$$" EXIT HUP INT PIPE TERM
 if [[ ! -s $dir/HCLG.fst || $dir/HCLG.fst -ot $dir/HCLGa.fst ]]; then
   add-self-loops --self-loop-scale=$loopscale --reorder=true $model $dir/HCLGa.fst | \
     $prepare_grammar_command | \
-    fstconvert --fst_type=const > $dir/HCLG.fst.$$ || exit 1;
+    fstconvert --fst_type=const --fst_align > $dir/HCLG.fst.$$ || exit 1;
+  # --fst_align lets decoders memory-map HCLG.fst rather than reading it into
+  # memory (see ReadFstKaldiGeneric()).  We write a new file and rename it,
+  # since the file must not be modified while decoders are mapping it.
   mv $dir/HCLG.fst.$$ $dir/HCLG.fst
   if [ $tscale == 1.0 -a $loopscale == 1.0 ]; then
     # No point doing this test if transition-scale not 1, as it is bound to fail.
@@ -18,12 +18,208 @@
 // limitations under the License.
 
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include "chain/chain-denominator.h"
 #include "chain/chain-kernels-ansi.h"
 
 namespace kaldi {
 namespace chain {
 
+/**
+   This class runs a function in a fixed set of threads, repeatedly; it is used
+   to split up the per-frame work of the CPU forward-backward, where starting
+   new threads on each frame would cost too much.  The threads last as long as
+   the DenominatorComputation.
+*/
+class DenominatorComputation::CpuThreads {
+ public:
+  explicit CpuThreads(int32 num_threads):
+      num_threads_(num_threads), func_(NULL), generation_(0),
+      num_running_(0), stop_(false) {
+    KALDI_ASSERT(num_threads > 1);
+    for (int32 i = 1; i < num_threads; i++)
+      threads_.push_back(std::thread(&CpuThreads::WorkerThread, this, i));
+  }
+
+  int32 NumThreads() const { return num_threads_; }
+
+  // Calls func(i) for 0 <= i < NumThreads() in parallel (i == 0 in the calling
+  // thread), and returns when they have all returned.
+  void Run(const std::function<void(int32)> &func) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      func_ = &func;
+      num_running_ = num_threads_ - 1;
+      generation_++;
+      start_.notify_all();
+    }
+    RunOne(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_running_ > 0)
+      done_.wait(lock);
+    func_ = NULL;
+    if (!error_.empty()) {
+      std::string error = error_;
+      error_.clear();
+      KALDI_ERR << "Error in denominator computation thread: " << error;
+    }
+  }
+
+  ~CpuThreads() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+      start_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+  }
+
+ private:
+  void RunOne(int32 i) {
+    try {
+      (*func_)(i);
+    } catch (const std::exception &e) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (error_.empty())
+        error_ = e.what();
+    }
+  }
+
+  void WorkerThread(int32 i) {
+    int64 generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_ && generation_ == generation)
+          start_.wait(lock);
+        if (stop_)
+          return;
+        generation = generation_;
+      }
+      RunOne(i);
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (--num_running_ == 0)
+        done_.notify_all();
+    }
+  }
+
+  int32 num_threads_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  // The following are protected by mutex_.
+  const std::function<void(int32)> *func_;
+  int64 generation_;  // Incremented by each call to Run().
+  int32 num_running_;  // The number of worker threads yet to finish func_.
+  bool stop_;
+  std::string error_;
+};
+
+
+// The CPU version of the alpha computation of AlphaGeneralFrame(), for HMM
+// states h_begin <= h < h_end.  The loop over sequences is the innermost one,
+// so that it works on contiguous data.  The arithmetic for each element is the
+// same whatever h_begin and h_end are, so the results don't depend on how the
+// work is split up.
+static void AlphaGeneralFrameCpu(const Int32Pair *backward_transitions,
+                                 const DenominatorGraphTransition *transitions,
+                                 int32 num_sequences, int32 num_hmm_states,
+                                 const BaseFloat *prob_data, int32 prob_stride,
+                                 const BaseFloat *prev_alpha_dash,
+                                 int32 h_begin, int32 h_end,
+                                 BaseFloat *this_alpha) {
+  std::vector<double> tot_alpha(num_sequences);
+  // Let arbitrary_scale be the inverse of the alpha-sum value that we store in
+  // the same place we'd store the alpha for the state numbered
+  // 'num_hmm_states'. We multiply this into all the transition-probabilities
+  // from the previous frame to this frame, in both the forward and backward
+  // passes, in order to keep the alphas in a good numeric range.  This won't
+  // affect the posteriors, but when computing the total likelihood we'll need
+  // to compensate for it later on.
+  const BaseFloat *prev_alpha_sum =
+      prev_alpha_dash + num_hmm_states * num_sequences;
+  for (int32 h = h_begin; h < h_end; h++) {
+    double *tot = &(tot_alpha[0]);
+    for (int32 s = 0; s < num_sequences; s++)
+      tot[s] = 0.0;
+    const DenominatorGraphTransition
+        *trans_iter = transitions + backward_transitions[h].first,
+        *trans_end = transitions + backward_transitions[h].second;
+    for (; trans_iter != trans_end; ++trans_iter) {
+      BaseFloat transition_prob = trans_iter->transition_prob;
+      const BaseFloat *prob = prob_data + trans_iter->pdf_id * prob_stride,
+          *this_prev_alpha = prev_alpha_dash +
+          trans_iter->hmm_state * num_sequences;
+      for (int32 s = 0; s < num_sequences; s++)
+        tot[s] += this_prev_alpha[s] * transition_prob * prob[s];
+    }
+    BaseFloat *alpha = this_alpha + h * num_sequences;
+    for (int32 s = 0; s < num_sequences; s++) {
+      BaseFloat arbitrary_scale = 1.0 / prev_alpha_sum[s];
+      KALDI_ASSERT(tot[s] - tot[s] == 0);
+      alpha[s] = tot[s] * arbitrary_scale;
+    }
+  }
+}
+
+// The CPU version of the computation of BetaDashGeneralFrame(), for sequences
+// s_begin <= s < s_end.  As for AlphaGeneralFrameCpu(), the arithmetic is the
+// same for any split of the sequences.
+static void BetaDashGeneralFrameCpu(
+    const Int32Pair *forward_transitions,
+    const DenominatorGraphTransition *transitions,
+    int32 num_sequences, int32 num_hmm_states,
+    const BaseFloat *prob_data, int32 prob_stride,
+    const BaseFloat *this_alpha_dash, const BaseFloat *next_beta,
+    int32 s_begin, int32 s_end,
+    BaseFloat *this_beta_dash,
+    BaseFloat *log_prob_deriv_data, int32 deriv_stride) {
+  int32 n = s_end - s_begin;
+  if (n <= 0)
+    return;
+  std::vector<double> tot_variable_factor(n);
+  std::vector<BaseFloat> occupation_factor(n);
+  // inv_arbitrary_scale is the alpha-sum stored where the alpha for state
+  // 'num_hmm_states' would be.
+  const BaseFloat *inv_arbitrary_scale =
+      this_alpha_dash + num_hmm_states * num_sequences + s_begin;
+  prob_data += s_begin;
+  next_beta += s_begin;
+  log_prob_deriv_data += s_begin;
+  for (int32 h = 0; h < num_hmm_states; h++) {
+    double *tot = &(tot_variable_factor[0]);
+    BaseFloat *occupation = &(occupation_factor[0]);
+    const BaseFloat *alpha_dash = this_alpha_dash + h * num_sequences + s_begin;
+    for (int32 s = 0; s < n; s++) {
+      tot[s] = 0.0;
+      occupation[s] = alpha_dash[s] / inv_arbitrary_scale[s];
+    }
+    const DenominatorGraphTransition
+        *trans_iter = transitions + forward_transitions[h].first,
+        *trans_end = transitions + forward_transitions[h].second;
+    for (; trans_iter != trans_end; ++trans_iter) {
+      BaseFloat transition_prob = trans_iter->transition_prob;
+      int32 pdf_id = trans_iter->pdf_id;
+      const BaseFloat *beta = next_beta + trans_iter->hmm_state * num_sequences,
+          *prob = prob_data + pdf_id * prob_stride;
+      BaseFloat *deriv = log_prob_deriv_data + pdf_id * deriv_stride;
+      for (int32 s = 0; s < n; s++) {
+        BaseFloat variable_factor = transition_prob * beta[s] * prob[s];
+        tot[s] += variable_factor;
+        deriv[s] += variable_factor * occupation[s];
+      }
+    }
+    BaseFloat *beta_dash = this_beta_dash + h * num_sequences + s_begin;
+    for (int32 s = 0; s < n; s++)
+      beta_dash[s] = tot[s] / inv_arbitrary_scale[s];
+  }
+}
+
 
 DenominatorComputation::DenominatorComputation(
     const ChainTrainingOptions &opts,
@@ -47,7 +243,8 @@ DenominatorComputation::DenominatorComputation(
     tot_prob_(num_sequences_, kUndefined),
     tot_log_prob_(num_sequences_, kUndefined),
     log_correction_term_(num_sequences_, kUndefined),
-    ok_(true) {
+    ok_(true),
+    cpu_threads_(NULL) {
   // We don't let leaky_hmm_coefficient be exactly zero (although that would
   // make sense mathematically, corresponding to "turning off" the leaky HMM),
   // because that would lead to underflow and eventually NaN's or inf's
@@ -87,6 +284,43 @@ DenominatorComputation::DenominatorComputation(
   // this avoids NaNs appearing in the forward-backward computation, which
   // is not done in log space.
   exp_nnet_output_transposed_.ApplyExpLimited(-30.0, 30.0);
+
+  bool use_gpu = false;
+#if HAVE_CUDA == 1
+  use_gpu = CuDevice::Instantiate().Enabled();
+#endif
+  if (opts_.denominator_threads > 1 && !use_gpu) {
+    int32 num_threads = opts_.denominator_threads,
+        num_hmm_states = den_graph_.NumStates();
+    cpu_threads_ = new CpuThreads(num_threads);
+    // The backward transitions of the states are stored one after the other,
+    // in order, so backward_transitions[h].first - begin is the number of
+    // transitions into states before h.
+    const Int32Pair *backward_transitions = den_graph_.BackwardTransitions();
+    int64 begin = backward_transitions[0].first,
+        num_transitions = backward_transitions[num_hmm_states - 1].second -
+        begin;
+    alpha_thread_states_.resize(num_threads + 1);
+    alpha_thread_states_[0] = 0;
+    alpha_thread_states_[num_threads] = num_hmm_states;
+    for (int32 i = 1; i < num_threads; i++) {
+      int64 target = begin + num_transitions * i / num_threads;
+      // Find the first h with backward_transitions[h].first >= target.
+      int32 lo = alpha_thread_states_[i - 1], hi = num_hmm_states;
+      while (lo < hi) {
+        int32 mid = (lo + hi) / 2;
+        if (backward_transitions[mid].first < target)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      alpha_thread_states_[i] = lo;
+    }
+  }
+}
+
+DenominatorComputation::~DenominatorComputation() {
+  delete cpu_threads_;
 }
 
 
@@ -152,33 +386,18 @@ void DenominatorComputation::AlphaGeneralFrame(int32 t) {
 #endif
   {
     int32 prob_stride = probs.Stride();
-    for (int32 h = 0; h < num_hmm_states; h++) {
-      for (int32 s = 0; s < num_sequences; s++) {
-        double this_tot_alpha = 0.0;
-        const DenominatorGraphTransition
-            *trans_iter = transitions + backward_transitions[h].first,
-            *trans_end = transitions + backward_transitions[h].second;
-        for (; trans_iter != trans_end; ++trans_iter) {
-          BaseFloat transition_prob = trans_iter->transition_prob;
-          int32 pdf_id = trans_iter->pdf_id,
-              prev_hmm_state = trans_iter->hmm_state;
-          BaseFloat prob = prob_data[pdf_id * prob_stride + s],
-              this_prev_alpha = prev_alpha_dash[prev_hmm_state * num_sequences + s];
-          this_tot_alpha += this_prev_alpha * transition_prob * prob;
-        }
-        // Let arbitrary_scale be the inverse of the alpha-sum value that we
-        // store in the same place we'd store the alpha for the state numbered
-        // 'num_hmm_states'. We multiply this into all the
-        // transition-probabilities from the previous frame to this frame, in
-        // both the forward and backward passes, in order to keep the alphas in
-        // a good numeric range.  This won't affect the posteriors, but when
-        // computing the total likelihood we'll need to compensate for it later
-        // on.
-        BaseFloat arbitrary_scale =
-            1.0 / prev_alpha_dash[num_hmm_states * num_sequences + s];
-        KALDI_ASSERT(this_tot_alpha - this_tot_alpha == 0);
-        this_alpha[h * num_sequences + s] = this_tot_alpha * arbitrary_scale;
-      }
+    if (cpu_threads_ == NULL) {
+      AlphaGeneralFrameCpu(backward_transitions, transitions, num_sequences,
+                           num_hmm_states, prob_data, prob_stride,
+                           prev_alpha_dash, 0, num_hmm_states, this_alpha);
+    } else {
+      cpu_threads_->Run([&](int32 i) {
+          AlphaGeneralFrameCpu(backward_transitions, transitions,
+                               num_sequences, num_hmm_states, prob_data,
+                               prob_stride, prev_alpha_dash,
+                               alpha_thread_states_[i],
+                               alpha_thread_states_[i + 1], this_alpha);
+        });
     }
   }
 }
@@ -393,31 +612,25 @@ void DenominatorComputation::BetaDashGeneralFrame(int32 t) {
          deriv_stride = log_prob_deriv.Stride();
     const BaseFloat *prob_data = probs.Data();
     BaseFloat *log_prob_deriv_data = log_prob_deriv.Data();
-    for (int32 h = 0; h < num_hmm_states; h++) {
-      for (int32 s = 0; s < num_sequences; s++) {
-        BaseFloat this_alpha_dash_prob = this_alpha_dash[h * num_sequences + s],
-            inv_arbitrary_scale =
-            this_alpha_dash[num_hmm_states * num_sequences + s];
-        double tot_variable_factor = 0.0;
-        BaseFloat occupation_factor = this_alpha_dash_prob /
-            inv_arbitrary_scale;
-        const DenominatorGraphTransition
-            *trans_iter = transitions + forward_transitions[h].first,
-            *trans_end = transitions + forward_transitions[h].second;
-        for (; trans_iter != trans_end; ++trans_iter) {
-          BaseFloat transition_prob = trans_iter->transition_prob;
-          int32 pdf_id = trans_iter->pdf_id,
-              next_hmm_state = trans_iter->hmm_state;
-          BaseFloat variable_factor = transition_prob *
-              next_beta[next_hmm_state * num_sequences + s] *
-              prob_data[pdf_id * prob_stride + s];
-          tot_variable_factor += variable_factor;
-          BaseFloat occupation_prob = variable_factor * occupation_factor;
-          log_prob_deriv_data[pdf_id * deriv_stride + s] += occupation_prob;
-        }
-        this_beta_dash[h * num_sequences + s] =
-            tot_variable_factor / inv_arbitrary_scale;
-      }
+    if (cpu_threads_ == NULL) {
+      BetaDashGeneralFrameCpu(forward_transitions, transitions, num_sequences,
+                              num_hmm_states, prob_data, prob_stride,
+                              this_alpha_dash, next_beta, 0, num_sequences,
+                              this_beta_dash, log_prob_deriv_data,
+                              deriv_stride);
+    } else {
+      // The threads divide up the sequences, so they write to different
+      // elements of log_prob_deriv_data.
+      int32 num_threads = cpu_threads_->NumThreads();
+      cpu_threads_->Run([&](int32 i) {
+          BetaDashGeneralFrameCpu(forward_transitions, transitions,
+                                  num_sequences, num_hmm_states, prob_data,
+                                  prob_stride, this_alpha_dash, next_beta,
+                                  num_sequences * i / num_threads,
+                                  num_sequences * (i + 1) / num_threads,
+                                  this_beta_dash, log_prob_deriv_data,
+                                  deriv_stride);
+        });
     }
   }
 }
@@ -210,6 +210,8 @@ class DenominatorComputation {
                          int32 num_sequences,
                          const CuMatrixBase<BaseFloat> &nnet_output);
 
+  ~DenominatorComputation();
+
   // Does the forward computation, and returns the total log-like summed over
   // all sequences.  You will have to scale this by any supervision weighting
   // factor, manually.  Note: this log-like will be negated before it
@@ -256,6 +258,10 @@ class DenominatorComputation {
   // Sets ok_ to false if a bad problem is detected.
   void BetaGeneralFrameDebug(int32 t);
 
+  // Runs the CPU versions of AlphaGeneralFrame() and BetaDashGeneralFrame() in
+  // several threads; defined in the .cc file.
+  class CpuThreads;
+
   const ChainTrainingOptions &opts_;
   const DenominatorGraph &den_graph_;
 
@@ -308,6 +314,17 @@ class DenominatorComputation {
   CuVector<BaseFloat> log_correction_term_;
 
   bool ok_;
+
+  // Only set up if opts_.denominator_threads > 1 and we are not using a GPU.
+  CpuThreads *cpu_threads_;
+  // If cpu_threads_ != NULL, the HMM states handled by thread i in
+  // AlphaGeneralFrame() are alpha_thread_states_[i] <= h <
+  // alpha_thread_states_[i+1]; the ranges have about the same number of
+  // transitions.  (In BetaDashGeneralFrame() the threads divide up the
+  // sequences instead, as they all add to the same derivatives.)
+  std::vector<int32> alpha_thread_states_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DenominatorComputation);
 };
 
 
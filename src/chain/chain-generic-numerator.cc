@@ -21,6 +21,7 @@
 #include "chain/chain-generic-numerator.h"
 #include "chain/chain-kernels-ansi.h"
 
+#include <atomic>
 #include <iterator>
 #include <limits>
 
@@ -32,6 +33,48 @@ namespace chain {
 // (similar to NumeratorComputation) to compute the numerator derivatives
 // for end-to-end training 'supervision's.
 
+void GenericNumeratorComputation::ArcList::Init(
+    const std::vector<std::vector<DenominatorGraphTransition> > &transitions) {
+  int32 num_states = transitions.size();
+  offsets.resize(num_states + 1);
+  offsets[0] = 0;
+  for (int32 h = 0; h < num_states; h++)
+    offsets[h + 1] = offsets[h] + transitions[h].size();
+  int32 num_arcs = offsets[num_states];
+  states.resize(num_arcs);
+  pdf_ids.resize(num_arcs);
+  log_probs.resize(num_arcs);
+  for (int32 h = 0; h < num_states; h++) {
+    for (size_t i = 0; i < transitions[h].size(); i++) {
+      const DenominatorGraphTransition &tr = transitions[h][i];
+      int32 a = offsets[h] + i;
+      states[a] = tr.hmm_state;
+      pdf_ids[a] = tr.pdf_id;
+      log_probs[a] = tr.transition_prob;
+    }
+  }
+}
+
+// Returns the log of the sum of exp(x[i]) for 0 <= i < n, and as a side
+// effect sets x[i] to exp(x[i] - *max), where *max is the largest x[i].
+// If n == 0 or all the x[i] are -infinity, returns -infinity and sets
+// *max to -infinity, leaving x unchanged.
+static inline BaseFloat LogSumExpInPlace(BaseFloat *x, int32 n,
+                                         BaseFloat *max) {
+  BaseFloat max_x = -std::numeric_limits<BaseFloat>::infinity();
+  for (int32 i = 0; i < n; i++)
+    max_x = std::max(max_x, x[i]);
+  *max = max_x;
+  if (max_x == -std::numeric_limits<BaseFloat>::infinity())
+    return max_x;
+  BaseFloat sum = 0.0;
+  for (int32 i = 0; i < n; i++) {
+    x[i] = Exp(x[i] - max_x);
+    sum += x[i];
+  }
+  return max_x + Log(sum);
+}
+
 GenericNumeratorComputation::GenericNumeratorComputation(
     const GenericNumeratorComputationOptions &opts,
     const Supervision &supervision,
@@ -72,14 +115,8 @@ GenericNumeratorComputation::GenericNumeratorComputation(
   final_probs_.Resize(num_sequences, max_num_hmm_states);
 
   // Initialize incoming transitions for easy access
-  in_transitions_.resize(num_sequences);  // indexed by seq, state
-  out_transitions_.resize(num_sequences);  // indexed by seq, state
-  for (int seq = 0; seq < num_sequences; seq++) {
-    in_transitions_[seq] = vector<vector<DenominatorGraphTransition> >(
-        supervision_.e2e_fsts[seq].NumStates());
-    out_transitions_[seq] = vector<vector<DenominatorGraphTransition> >(
-        supervision_.e2e_fsts[seq].NumStates());
-  }
+  in_arcs_.resize(num_sequences);  // indexed by seq
+  out_arcs_.resize(num_sequences);  // indexed by seq
 
   offsets_.Resize(num_sequences);
   std::unordered_map<int32, MatrixIndexT> pdf_to_index;
@@ -88,6 +125,10 @@ GenericNumeratorComputation::GenericNumeratorComputation(
   pdf_to_index.reserve(view_stride);
   nnet_output_stride_ = pdf_stride;
   for (int seq = 0; seq < num_sequences; seq++) {
+    // the transitions into and out of each state.
+    vector<vector<DenominatorGraphTransition> > in_transitions(
+        supervision_.e2e_fsts[seq].NumStates()),
+        out_transitions(supervision_.e2e_fsts[seq].NumStates());
     for (int32 s = 0; s < supervision_.e2e_fsts[seq].NumStates(); s++) {
       final_probs_(seq, s)= -supervision_.e2e_fsts[seq].Final(s).Value();
       BaseFloat offset = 0.0;
@@ -122,12 +163,45 @@ GenericNumeratorComputation::GenericNumeratorComputation(
 
         transition.pdf_id = pdf_to_index[pdf_id];
         transition.hmm_state = s;
-        in_transitions_[seq][arc.nextstate].push_back(transition);
+        in_transitions[arc.nextstate].push_back(transition);
         transition.hmm_state = arc.nextstate;
-        out_transitions_[seq][s].push_back(transition);
+        out_transitions[s].push_back(transition);
       }
     }
+    in_arcs_[seq].Init(in_transitions);
+    out_arcs_[seq].Init(out_transitions);
   }
+
+  std::vector<std::pair<int32, int32> > num_arcs_and_seq(num_sequences);
+  for (int seq = 0; seq < num_sequences; seq++)
+    num_arcs_and_seq[seq] = std::make_pair(-in_arcs_[seq].NumArcs(), seq);
+  std::sort(num_arcs_and_seq.begin(), num_arcs_and_seq.end());
+  sequence_order_.resize(num_sequences);
+  for (int i = 0; i < num_sequences; i++)
+    sequence_order_[i] = num_arcs_and_seq[i].second;
+}
+
+
+int32 GenericNumeratorComputation::NumThreads() const {
+  int32 num_threads = opts_.num_threads > 0 ? opts_.num_threads :
+      std::thread::hardware_concurrency();
+  return std::max(1, std::min(num_threads, supervision_.num_sequences));
+}
+
+void GenericNumeratorComputation::RunSequences(
+    int32 num_threads, const std::function<void(int32, int32)> &func) const {
+  std::atomic<int32> next(0);
+  auto thread_func = [&] (int32 thread) {
+    int32 i;
+    while ((i = next++) < supervision_.num_sequences)
+      func(thread, sequence_order_[i]);
+  };
+  std::vector<std::thread> workers;
+  for (int32 thread = 1; thread < num_threads; ++thread)
+    workers.push_back(std::thread(thread_func, thread));
+  thread_func(0);  // the calling thread is thread 0.
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
 }
 
 
@@ -171,14 +245,25 @@ void GenericNumeratorComputation::CopySpecificPdfsIndirect(
 // The alpha computation for some 0 < t <= num_time_steps_.
 BaseFloat GenericNumeratorComputation::AlphaRemainingFrames(int seq,
                                               const Matrix<BaseFloat> &probs,
-                                              Matrix<BaseFloat> *alpha) {
+                                              Matrix<BaseFloat> *alpha,
+                                              std::vector<BaseFloat> *scratch) {
   NVTX_RANGE(__func__);
   // Define some variables to make things nicer
   const int32 num_sequences = supervision_.num_sequences,
-              num_frames = supervision_.frames_per_sequence;
+              num_frames = supervision_.frames_per_sequence,
+              num_states = supervision_.e2e_fsts[seq].NumStates();
 
   KALDI_ASSERT(seq >= 0 && seq < num_sequences);
 
+  const ArcList &arcs = in_arcs_[seq];
+  const int32 num_arcs = arcs.NumArcs(),
+      *offsets = arcs.offsets.data(),
+      *prev_states = arcs.states.data(),
+      *pdf_ids = arcs.pdf_ids.data();
+  const BaseFloat *transition_probs = arcs.log_probs.data();
+  scratch->resize(num_arcs);
+  BaseFloat *scores = scratch->data();
+
   // variables for log_likelihood computation
   double log_scale_product = 0,
          log_prob_product = 0;
@@ -188,16 +273,13 @@ BaseFloat GenericNumeratorComputation::AlphaRemainingFrames(int seq,
     BaseFloat *alpha_t = alpha->RowData(t);
     const BaseFloat *alpha_tm1 = alpha->RowData(t - 1);
 
-    for (int32 h = 0; h < supervision_.e2e_fsts[seq].NumStates(); h++) {
-      for (auto tr = in_transitions_[seq][h].begin();
-          tr != in_transitions_[seq][h].end(); ++tr) {
-        BaseFloat transition_prob = tr->transition_prob;
-        int32 pdf_id = tr->pdf_id,
-              prev_hmm_state = tr->hmm_state;
-        BaseFloat prob = probs_tm1[pdf_id];
-        alpha_t[h] = LogAdd(alpha_t[h],
-            alpha_tm1[prev_hmm_state] + transition_prob + prob);
-      }
+    for (int32 a = 0; a < num_arcs; a++)
+      scores[a] = alpha_tm1[prev_states[a]] + transition_probs[a] +
+          probs_tm1[pdf_ids[a]];
+    for (int32 h = 0; h < num_states; h++) {
+      BaseFloat max;
+      alpha_t[h] = LogSumExpInPlace(scores + offsets[h],
+                                    offsets[h + 1] - offsets[h], &max);
     }
     double sum = alpha_tm1[alpha->NumCols() - 1];
     SubMatrix<BaseFloat> alpha_t_mat(*alpha, t, 1, 0,
@@ -248,52 +330,37 @@ bool GenericNumeratorComputation::ForwardBackward(
   CopySpecificPdfsIndirect(nnet_output_, index_to_pdf_, &probs);
 
   derivs.Resize(probs.NumRows(), probs.NumCols());
-  derivs.Set(-std::numeric_limits<BaseFloat>::infinity());
 
-  // Set total number of workers to the available hardware concurrency
-  unsigned int nthreads = opts_.num_threads > 0 ? opts_.num_threads :
-                              std::thread::hardware_concurrency();
-  // Naive load balancing, each thread gets a chunk of the sequences to process
-  unsigned int num_sequences_per_thread =
-    (num_sequences + nthreads - 1) / nthreads;
+  int32 nthreads = NumThreads();
 
   // Allocate one alpha and beta matrix per thread to avoid contention
   std::vector<Matrix<BaseFloat>> alpha(nthreads);
   std::vector<Matrix<BaseFloat>> beta(nthreads);
+  std::vector<std::vector<BaseFloat> > scratch(nthreads);
 
-  // Per thread partial values and boolean
-  std::vector<BaseFloat> partial_loglike_mt(nthreads, static_cast<BaseFloat>(0));
-  std::vector<bool> ok_mt(nthreads, true);
+  // Per sequence values, so that the total doesn't depend on which thread
+  // did which sequence.
+  std::vector<BaseFloat> partial_loglike_seq(num_sequences, 0.0);
+  std::vector<char> ok_seq(num_sequences, 1);
 
-  // Lambda function for each thread's portion of the computation
-  auto thread_lambda = [&] (int thread, int num_sequences, int num_sequences_per_thread) {
-    int seq_st = thread * num_sequences_per_thread;
-    int seq_en = seq_st + num_sequences_per_thread;
-    seq_en = (seq_en <= num_sequences) ? seq_en : num_sequences;
-    for (int seq = seq_st; seq < seq_en; ++seq) {
+  RunSequences(nthreads, [&] (int32 thread, int32 seq) {
       // Forward part
       AlphaFirstFrame(seq, &alpha[thread]);
-      partial_loglike_mt[thread] += AlphaRemainingFrames(seq, probs, &alpha[thread]);
+      partial_loglike_seq[seq] = AlphaRemainingFrames(seq, probs,
+                                                      &alpha[thread],
+                                                      &scratch[thread]);
 
       // Backward part
       BetaLastFrame(seq, alpha[thread], &beta[thread]);
-      BetaRemainingFrames(seq, probs, alpha[thread], &beta[thread], &derivs);
+      BetaRemainingFrames(seq, probs, alpha[thread], &beta[thread], &derivs,
+                          &scratch[thread]);
       if (GetVerboseLevel() >= 1)
-        ok_mt[thread] = ok_mt[thread] && CheckValues(seq, probs, alpha[thread], beta[thread], derivs);
-    }
-    return;
-  };
-
-  std::vector<std::thread> workers(nthreads);
-  for (int thread = 0; thread < nthreads; ++thread)
-    // Launch all threads
-    workers[thread] = std::thread(thread_lambda, thread, num_sequences, num_sequences_per_thread);
-  for (int thread = 0; thread < nthreads; ++thread) {
-    // Join threads back in
-    workers[thread].join();
-    // Reduce thread values to a single value
-    partial_loglike += partial_loglike_mt[thread];
-    ok = ok && ok_mt[thread];
+        ok_seq[seq] = CheckValues(seq, probs, alpha[thread], beta[thread],
+                                  derivs);
+    });
+  for (int32 seq = 0; seq < num_sequences; ++seq) {
+    partial_loglike += partial_loglike_seq[seq];
+    ok = ok && ok_seq[seq];
   }
 
   // Transfer and add the derivatives to the values in the matrix
@@ -307,17 +374,25 @@ BaseFloat GenericNumeratorComputation::ComputeObjf() {
   BaseFloat partial_loglike = 0;
   const int32 num_sequences = supervision_.num_sequences;
 
-  Matrix<BaseFloat> alpha;
   Matrix<BaseFloat> probs;
 
   // We selectively copy only those pdfs we need
   CopySpecificPdfsIndirect(nnet_output_, index_to_pdf_, &probs);
 
-  for (int seq = 0; seq < num_sequences; ++seq) {
-    // Forward part
-    AlphaFirstFrame(seq, &alpha);
-    partial_loglike += AlphaRemainingFrames(seq, probs, &alpha);
-  }
+  int32 nthreads = NumThreads();
+  std::vector<Matrix<BaseFloat>> alpha(nthreads);
+  std::vector<std::vector<BaseFloat> > scratch(nthreads);
+  std::vector<BaseFloat> partial_loglike_seq(num_sequences, 0.0);
+
+  RunSequences(nthreads, [&] (int32 thread, int32 seq) {
+      // Forward part
+      AlphaFirstFrame(seq, &alpha[thread]);
+      partial_loglike_seq[seq] = AlphaRemainingFrames(seq, probs,
+                                                      &alpha[thread],
+                                                      &scratch[thread]);
+    });
+  for (int32 seq = 0; seq < num_sequences; ++seq)
+    partial_loglike += partial_loglike_seq[seq];
   return partial_loglike;
 }
 
@@ -352,7 +427,8 @@ void GenericNumeratorComputation::BetaRemainingFrames(int seq,
                                                 const Matrix<BaseFloat> &probs,
                                                 const Matrix<BaseFloat> &alpha,
                                                 Matrix<BaseFloat> *beta,
-                                                Matrix<BaseFloat> *derivs) {
+                                                Matrix<BaseFloat> *derivs,
+                                                std::vector<BaseFloat> *scratch) {
   NVTX_RANGE(__func__);
   const int32
       num_sequences = supervision_.num_sequences,
@@ -360,40 +436,46 @@ void GenericNumeratorComputation::BetaRemainingFrames(int seq,
       num_states = supervision_.e2e_fsts[seq].NumStates();
   KALDI_ASSERT(seq >= 0 && seq < num_sequences);
 
+  const ArcList &arcs = out_arcs_[seq];
+  const int32 num_arcs = arcs.NumArcs(),
+      *offsets = arcs.offsets.data(),
+      *next_states = arcs.states.data(),
+      *pdf_ids = arcs.pdf_ids.data();
+  const BaseFloat *transition_probs = arcs.log_probs.data();
+  scratch->resize(num_arcs);
+  BaseFloat *variable_factors = scratch->data();
+
   for (int t = num_frames - 1; t >= 0; --t) {
     const BaseFloat *alpha_t = alpha.RowData(t),
         *beta_tp1 = beta->RowData((t + 1) % 2),
         *probs_t = probs.RowData(t);
-    BaseFloat *log_prob_deriv_t = derivs->RowData(t),
+    BaseFloat *deriv_t = derivs->RowData(t),
         *beta_t = beta->RowData(t % 2);
 
     BaseFloat inv_arbitrary_scale = alpha_t[num_states];
-    for (int32 h = 0; h < supervision_.e2e_fsts[seq].NumStates(); h++) {
-      BaseFloat tot_variable_factor;
-      tot_variable_factor = -std::numeric_limits<BaseFloat>::infinity();
-      for (auto tr = out_transitions_[seq][h].begin();
-               tr != out_transitions_[seq][h].end(); ++tr) {
-        BaseFloat transition_prob = tr->transition_prob;
-        int32 pdf_id = tr->pdf_id,
-            next_hmm_state = tr->hmm_state;
-        BaseFloat variable_factor = transition_prob +
-            beta_tp1[next_hmm_state] +
-            probs_t[pdf_id] - inv_arbitrary_scale;
-        tot_variable_factor = LogAdd(tot_variable_factor,
-                                     variable_factor);
-
-        BaseFloat occupation_prob = variable_factor + alpha_t[h];
-        log_prob_deriv_t[pdf_id] = LogAdd(log_prob_deriv_t[pdf_id],
-                                           occupation_prob);
-      }
-      beta_t[h] = tot_variable_factor;
+    for (int32 a = 0; a < num_arcs; a++)
+      variable_factors[a] = transition_probs[a] + beta_tp1[next_states[a]] +
+          probs_t[pdf_ids[a]] - inv_arbitrary_scale;
+    for (int32 h = 0; h < num_states; h++) {
+      int32 begin = offsets[h], end = offsets[h + 1];
+      // After this, variable_factors[a] is exp(variable_factor - max).
+      BaseFloat max;
+      beta_t[h] = LogSumExpInPlace(variable_factors + begin, end - begin,
+                                   &max);
+      // The occupation prob of arc a is
+      // exp(variable_factor + alpha_t[h]) = variable_factors[a] * scale.
+      BaseFloat scale = Exp(max + alpha_t[h]);
+      if (scale == 0.0)
+        continue;
+      for (int32 a = begin; a < end; a++)
+        deriv_t[pdf_ids[a]] += variable_factors[a] * scale;
     }
   }
 }
 
 
 void GenericNumeratorComputation::AddSpecificPdfsIndirect(
-                                 Matrix<BaseFloat> *logprobs,
+                                 Matrix<BaseFloat> *derivs,
                                  const std::vector<MatrixIndexT> &indices,
                                  CuMatrixBase<BaseFloat> *output) {
   NVTX_RANGE(__func__);
@@ -405,8 +487,7 @@ void GenericNumeratorComputation::AddSpecificPdfsIndirect(
   KALDI_ASSERT(frames_per_sequence * num_sequences == output->NumRows());
 
   CuMatrix<BaseFloat> specific_pdfs;
-  specific_pdfs.Swap(logprobs);
-  specific_pdfs.ApplyExp();
+  specific_pdfs.Swap(derivs);
   specific_pdfs.Scale(supervision_.weight);
 
   std::vector<MatrixIndexT> indices_expanded(view_stride, -1);
@@ -443,7 +524,7 @@ bool GenericNumeratorComputation::CheckValues(int seq,
       int32 pdf2seq = index_to_pdf_[n] / pdf_stride;
       if (pdf2seq != seq)  // this pdf is not in the space of this sequence
         continue;
-      deriv_sum += Exp(derivs(t, n));
+      deriv_sum += derivs(t, n);
     }
 
     if (!ApproxEqual(deriv_sum, 1.0)) {
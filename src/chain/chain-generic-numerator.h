@@ -26,6 +26,7 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <functional>
 #include <thread>
 
 #include "base/kaldi-common.h"
@@ -101,6 +102,15 @@ namespace chain {
    when copying the activation values from the GPU memory or copying
    the computed derivatives to GPU memory, we use the bookkeeping info to
    map the values correctly.
+
+   The sequences are independent of each other, so they are divided among
+   'num_threads' threads.  Within a sequence, the arcs of each graph are
+   stored grouped by state in flat arrays (see ArcList), so that on each frame
+   the scores of all the arcs can be computed in a single loop over contiguous
+   memory; the log-sums over the arcs into (or out of) each state are then done
+   with one exponential per arc, instead of the two that LogAdd() needs.  The
+   derivatives are accumulated as probabilities rather than log-probabilities,
+   as they are bounded by one.
  */
 
 
@@ -150,31 +160,51 @@ class GenericNumeratorComputation {
                              const std::vector<MatrixIndexT> &indices,
                              Matrix<BaseFloat> *output);
 
-  // For the remapped FSTs, copy the computed values back to gpu,
+  // For the remapped FSTs, copy the computed derivatives back to gpu,
   // expand to the original shape and add to the output matrix.
   // For explanation of what remapped FST is, see the large comment in the
   // beginning of the file.
   void AddSpecificPdfsIndirect(
-                             Matrix<BaseFloat> *logprobs,
+                             Matrix<BaseFloat> *derivs,
                              const std::vector<MatrixIndexT> &indices,
                              CuMatrixBase<BaseFloat> *output);
 
+  // The arcs of one numerator graph, grouped by state: the arcs of state h are
+  // those with offsets[h] <= a < offsets[h+1].  For the incoming arcs of a
+  // state, states[a] is the state the arc comes from; for the outgoing arcs,
+  // the state it goes to.
+  struct ArcList {
+    std::vector<int32> offsets;
+    std::vector<int32> states;
+    std::vector<int32> pdf_ids;  // the remapped pdf-ids.
+    std::vector<BaseFloat> log_probs;
+
+    // Sets up this object from a list of the arcs of each state.
+    void Init(const std::vector<std::vector<DenominatorGraphTransition> >
+              &transitions);
+    int32 NumArcs() const { return log_probs.size(); }
+  };
+
   // sets up the alpha for frame t = 0.
   void AlphaFirstFrame(int seq, Matrix<BaseFloat> *alpha);
 
   // the alpha computation for 0 < t <= supervision_.frames_per_sequence
-  // for some 0 <= seq < supervision_.num_sequences.
+  // for some 0 <= seq < supervision_.num_sequences.  'scratch' is
+  // temporary space for the arc scores.
   BaseFloat AlphaRemainingFrames(int seq,
                               const Matrix<BaseFloat> &probs,
-                              Matrix<BaseFloat> *alpha);
+                              Matrix<BaseFloat> *alpha,
+                              std::vector<BaseFloat> *scratch);
 
   // the beta computation for 0 <= t < supervision_.frames_per_sequence
-  // for some 0 <= seq < supervision_.num_sequences.
+  // for some 0 <= seq < supervision_.num_sequences.  The derivatives (the
+  // occupation probabilities of the pdfs) are added to 'derivs'.
   void BetaRemainingFrames(int32 seq,
                         const Matrix<BaseFloat> &probs,
                         const Matrix<BaseFloat> &alpha,
                         Matrix<BaseFloat> *beta,
-                        Matrix<BaseFloat> *derivs);
+                        Matrix<BaseFloat> *derivs,
+                        std::vector<BaseFloat> *scratch);
 
   // the beta computation for t = supervision_.frames_per_sequence
   void BetaLastFrame(int seq,
@@ -194,6 +224,16 @@ class GenericNumeratorComputation {
                    const Matrix<BaseFloat> &beta,
                    const Matrix<BaseFloat> &derivs) const;
 
+  // Returns the number of threads to use, worked out from opts_.num_threads
+  // and the number of sequences.
+  int32 NumThreads() const;
+
+  // Calls func(thread, seq) for each sequence, in threads numbered
+  // 0 <= thread < num_threads; each thread takes the next sequence, in the
+  // order given by sequence_order_, when it has finished the last one.
+  void RunSequences(int32 num_threads,
+                    const std::function<void(int32, int32)> &func) const;
+
 
   const Supervision &supervision_;
 
@@ -202,13 +242,16 @@ class GenericNumeratorComputation {
   int32 nnet_output_stride_;   // we keep the original stride extra
                                // as the matrix can change before ForwardBackward
 
-  // in_transitions_ lists all the incoming transitions for
+  // in_arcs_ lists all the incoming transitions for
   // each state of each numerator graph
-  // out_transitions_ does the same but for the outgoing transitions
-  typedef std::vector<std::vector<DenominatorGraphTransition> > TransitionMap;
-  std::vector<TransitionMap> in_transitions_, out_transitions_;
+  // out_arcs_ does the same but for the outgoing transitions
+  std::vector<ArcList> in_arcs_, out_arcs_;
   std::vector<MatrixIndexT> index_to_pdf_;
 
+  // The sequences in the order in which the threads take them: the ones with
+  // the most arcs first, which evens out the threads' work.
+  std::vector<int32> sequence_order_;
+
   // final probs for each state of each numerator graph
   Matrix<BaseFloat> final_probs_;  // indexed by seq, state
 
@@ -19,6 +19,7 @@
 
 #include "chain/chain-supervision.h"
 #include "chain/chain-numerator.h"
+#include "chain/chain-generic-numerator.h"
 #include "fstext/fstext-lib.h"
 #include "cudamatrix/cu-device.h"
 #include "cudamatrix/cu-vector.h"
@@ -180,6 +181,68 @@ void TestSupervisionAppend(const TransitionModel &trans_model,
   output.Check(trans_model);
 }
 
+// Checks that GenericNumeratorComputation, run on 'e2e_fsts' that are copies of
+// the (time-constrained) FST of 'supervision', gives the same objective and
+// derivatives as NumeratorComputation does on the equivalent merged
+// supervision.  It is run with several numbers of threads, and the results
+// should not depend on which thread did which sequence.
+void TestSupervisionGenericNumerator(const Supervision &supervision) {
+  KALDI_ASSERT(supervision.num_sequences == 1);
+  int32 num_sequences = RandInt(1, 8);
+  std::vector<const Supervision*> input(num_sequences, &supervision);
+  Supervision merged;
+  MergeSupervision(input, &merged);
+
+  Supervision e2e_supervision;
+  e2e_supervision.weight = merged.weight;
+  e2e_supervision.num_sequences = num_sequences;
+  e2e_supervision.frames_per_sequence = merged.frames_per_sequence;
+  e2e_supervision.label_dim = merged.label_dim;
+  e2e_supervision.e2e_fsts.resize(num_sequences, supervision.fst);
+
+  CuMatrix<BaseFloat> nnet_output(num_sequences * merged.frames_per_sequence,
+                                  merged.label_dim);
+  nnet_output.SetRandn();
+
+  NumeratorComputation num(merged, nnet_output);
+  BaseFloat num_logprob = num.Forward();
+  CuMatrix<BaseFloat> num_deriv(nnet_output.NumRows(), nnet_output.NumCols());
+  num.Backward(&num_deriv);
+
+  BaseFloat first_logprob = 0.0;
+  Matrix<BaseFloat> first_deriv;
+  for (int32 i = 0; i < 6; i++) {
+    GenericNumeratorComputationOptions opts;
+    opts.num_threads = 1 << (i % 3);  // 1, 2 or 4 threads.
+    GenericNumeratorComputation generic_num(opts, e2e_supervision,
+                                            nnet_output);
+    BaseFloat generic_logprob;
+    CuMatrix<BaseFloat> generic_deriv(nnet_output.NumRows(),
+                                      nnet_output.NumCols());
+    bool ok = generic_num.ForwardBackward(&generic_logprob, &generic_deriv);
+    KALDI_ASSERT(ok);
+    KALDI_LOG << "Generic numerator logprob with " << opts.num_threads
+              << " threads is " << generic_logprob << " vs. "
+              << num_logprob << " from the regular numerator.";
+    KALDI_ASSERT(ApproxEqual(generic_logprob, num_logprob, 1.0e-03));
+    KALDI_ASSERT(generic_deriv.ApproxEqual(num_deriv, 1.0e-03));
+    // ComputeObjf() should give the same objective as ForwardBackward().
+    GenericNumeratorComputation generic_num2(opts, e2e_supervision,
+                                             nnet_output);
+    KALDI_ASSERT(generic_num2.ComputeObjf() == generic_logprob);
+
+    Matrix<BaseFloat> deriv(generic_deriv);
+    if (i == 0) {
+      first_logprob = generic_logprob;
+      first_deriv = deriv;
+    } else {
+      KALDI_ASSERT(generic_logprob == first_logprob &&
+                   deriv.Equal(first_deriv));
+    }
+  }
+}
+
+
 void TestSupervisionReattached(const TransitionModel &trans_model,
                                const Supervision &supervision,
                                const Supervision &reattached_supervision) {
@@ -453,6 +516,46 @@ void ChainDenominatorTest(const DenominatorGraph &den_graph) {
 }
 
 
+// Checks that the multi-threaded CPU version of the denominator computation
+// (--denominator-graph-threads) gives exactly the same results as the
+// single-threaded one: the threads only divide up HMM-states or sequences, so
+// the arithmetic done for each element is the same.
+void ChainDenominatorThreadsTest(const DenominatorGraph &den_graph) {
+  int32 num_sequences = RandInt(1, 8),
+      frames_per_sequence = RandInt(10, 30);
+  CuMatrix<BaseFloat> nnet_output(num_sequences * frames_per_sequence,
+                                  den_graph.NumPdfs());
+  nnet_output.SetRandn();
+
+  ChainTrainingOptions opts;
+  BaseFloat forward_prob_single;
+  CuMatrix<BaseFloat> nnet_output_deriv_single(nnet_output.NumRows(),
+                                               nnet_output.NumCols());
+  {
+    KALDI_ASSERT(opts.denominator_threads == 1);
+    DenominatorComputation denominator_computation(opts, den_graph,
+                                                   num_sequences, nnet_output);
+    forward_prob_single = denominator_computation.Forward();
+    denominator_computation.Backward(1.0, &nnet_output_deriv_single);
+  }
+  for (int32 num_threads = 2; num_threads <= 4; num_threads++) {
+    opts.denominator_threads = num_threads;
+    DenominatorComputation denominator_computation(opts, den_graph,
+                                                   num_sequences, nnet_output);
+    BaseFloat forward_prob = denominator_computation.Forward();
+    CuMatrix<BaseFloat> nnet_output_deriv(nnet_output.NumRows(),
+                                          nnet_output.NumCols());
+    denominator_computation.Backward(1.0, &nnet_output_deriv);
+    KALDI_LOG << "Forward prob with " << num_threads << " threads is "
+              << forward_prob << " vs. " << forward_prob_single
+              << " with one thread.";
+    KALDI_ASSERT(forward_prob == forward_prob_single);
+    Matrix<BaseFloat> deriv(nnet_output_deriv),
+        deriv_single(nnet_output_deriv_single);
+    KALDI_ASSERT(deriv.Equal(deriv_single));
+  }
+}
+
 
 void ChainSupervisionTest() {
   ContextDependency *ctx_dep;
@@ -504,12 +607,14 @@ void ChainSupervisionTest() {
   TestSupervisionIo(supervision);
   TestSupervisionSplitting(*ctx_dep, *trans_model, supervision);
   TestSupervisionAppend(*trans_model, supervision);
+  TestSupervisionGenericNumerator(supervision);
 
   {
     fst::StdVectorFst den_fst;
     ComputeExampleDenFst(*ctx_dep, *trans_model, &den_fst);
     DenominatorGraph den_graph(den_fst, trans_model->NumPdfs());
     ChainDenominatorTest(den_graph);
+    ChainDenominatorThreadsTest(den_graph);
     if (RandInt(0, 1) == 0)
       supervision.weight = 0.5;
     fst::StdVectorFst normalization_fst;
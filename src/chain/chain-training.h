@@ -71,9 +71,13 @@ struct ChainTrainingOptions {
   // should have a softmax as its final nonlinearity.
   BaseFloat xent_regularize;
 
+  // Number of threads used in the denominator forward-backward computation
+  // when it is done on CPU (i.e. not using a GPU).
+  int32 denominator_threads;
+
   ChainTrainingOptions(): l2_regularize(0.0), out_of_range_regularize(0.01),
                           leaky_hmm_coefficient(1.0e-05),
-                          xent_regularize(0.0) { }
+                          xent_regularize(0.0), denominator_threads(1) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("l2-regularize", &l2_regularize, "l2 regularization "
@@ -94,6 +98,10 @@ struct ChainTrainingOptions {
                    "nonzero, the network is expected to have an output "
                    "named 'output-xent', which should have a softmax as "
                    "its final nonlinearity.");
+    opts->Register("denominator-graph-threads", &denominator_threads,
+                   "Number of threads to use to parallelize the chain "
+                   "denominator graph computation, if it is done on CPU.  "
+                   "The results do not depend on this.");
 
     numerator_opts.Register(opts);
   }
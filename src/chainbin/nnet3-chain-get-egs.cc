@@ -21,6 +21,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 #include "nnet3/nnet-example.h"
@@ -32,8 +33,171 @@ namespace nnet3 {
 
 
 /**
-   This function does all the processing for one utterance, and outputs the
-   supervision objects to 'example_writer'.
+   This class creates the examples for one utterance, once it has been split
+   into chunks, and writes them to 'example_writer' in its destructor.  It is
+   used with class TaskSequencer, so that with --num-threads > 1 the
+   supervision splitting and composition with the normalization FST (which
+   dominate the time taken) are done for several utterances in parallel, while
+   the examples are still written in the order of the input.  The object keeps
+   its own copies of the per-utterance inputs, since the readers will have
+   moved on by the time it runs.
+*/
+class ChainExampleTask {
+ public:
+  /// 'ivectors' has one row per chunk, containing the iVector to attach to that
+  /// chunk; it is empty if we are not using iVectors.  'deriv_weights' may be
+  /// NULL.  The other arguments are as for ProcessFile().
+  ChainExampleTask(const TransitionModel *trans_mdl,
+                   const fst::StdVectorFst &normalization_fst,
+                   const GeneralMatrix &feats,
+                   const Matrix<BaseFloat> &ivectors,
+                   const chain::Supervision &supervision,
+                   const VectorBase<BaseFloat> *deriv_weights,
+                   const std::vector<ChunkTimeInfo> &chunks,
+                   int32 frame_subsampling_factor,
+                   const std::string &utt_id,
+                   bool compress, bool long_key,
+                   NnetChainExampleWriter *example_writer):
+      trans_mdl_(trans_mdl), normalization_fst_(normalization_fst),
+      feats_(feats), ivectors_(ivectors), supervision_(supervision),
+      have_deriv_weights_(deriv_weights != NULL), chunks_(chunks),
+      frame_subsampling_factor_(frame_subsampling_factor), utt_id_(utt_id),
+      compress_(compress), long_key_(long_key),
+      example_writer_(example_writer) {
+    if (deriv_weights != NULL)
+      deriv_weights_ = *deriv_weights;
+  }
+
+  void operator () () {
+    chain::SupervisionSplitter sup_splitter(supervision_);
+    keys_.resize(chunks_.size());
+    egs_.resize(chunks_.size());
+
+    for (size_t c = 0; c < chunks_.size(); c++) {
+      ChunkTimeInfo &chunk = chunks_[c];
+
+      int32 start_frame_subsampled = chunk.first_frame / frame_subsampling_factor_,
+          num_frames_subsampled = chunk.num_frames / frame_subsampling_factor_;
+
+      chain::Supervision supervision_part;
+      sup_splitter.GetFrameRange(start_frame_subsampled,
+                                 num_frames_subsampled,
+                                 &supervision_part);
+
+      if (trans_mdl_ != NULL)
+        ConvertSupervisionToUnconstrained(*trans_mdl_, &supervision_part);
+
+      if (normalization_fst_.NumStates() > 0 &&
+          !AddWeightToSupervisionFst(normalization_fst_,
+                                     &supervision_part)) {
+        KALDI_WARN << "For utterance " << utt_id_ << ", feature frames "
+                   << chunk.first_frame << " to "
+                   << (chunk.first_frame + chunk.num_frames)
+                   << ", FST was empty after composing with normalization FST. "
+                   << "This should be extremely rare (a few per corpus, at most)";
+      }
+
+      int32 first_frame = 0;  // we shift the time-indexes of all these parts so
+                              // that the supervised part starts from frame 0.
+
+      NnetChainExample &nnet_chain_eg = egs_[c];
+      nnet_chain_eg.outputs.resize(1);
+
+      SubVector<BaseFloat> output_weights(
+          &(chunk.output_weights[0]),
+          static_cast<int32>(chunk.output_weights.size()));
+
+      if (!have_deriv_weights_) {
+        NnetChainSupervision nnet_supervision("output", supervision_part,
+                                              output_weights,
+                                              first_frame,
+                                              frame_subsampling_factor_);
+        nnet_chain_eg.outputs[0].Swap(&nnet_supervision);
+      } else {
+        Vector<BaseFloat> this_deriv_weights(num_frames_subsampled);
+        for (int32 i = 0; i < num_frames_subsampled; i++) {
+          int32 t = i + start_frame_subsampled;
+          if (t < deriv_weights_.Dim())
+            this_deriv_weights(i) = deriv_weights_(t);
+        }
+        KALDI_ASSERT(output_weights.Dim() == num_frames_subsampled);
+        this_deriv_weights.MulElements(output_weights);
+        NnetChainSupervision nnet_supervision("output", supervision_part,
+                                              this_deriv_weights,
+                                              first_frame,
+                                              frame_subsampling_factor_);
+        nnet_chain_eg.outputs[0].Swap(&nnet_supervision);
+      }
+
+      nnet_chain_eg.inputs.resize(ivectors_.NumRows() != 0 ? 2 : 1);
+
+      int32 tot_input_frames = chunk.left_context + chunk.num_frames +
+          chunk.right_context,
+          start_frame = chunk.first_frame - chunk.left_context;
+
+      GeneralMatrix input_frames;
+      ExtractRowRangeWithPadding(feats_, start_frame, tot_input_frames,
+                                 &input_frames);
+
+      NnetIo input_io("input", -chunk.left_context, input_frames);
+      nnet_chain_eg.inputs[0].Swap(&input_io);
+
+      if (ivectors_.NumRows() != 0) {
+        // if applicable, add the iVector feature (chosen by the caller).
+        Matrix<BaseFloat> ivector(ivectors_.RowRange(c, 1));
+        NnetIo ivector_io("ivector", 0, ivector);
+        nnet_chain_eg.inputs[1].Swap(&ivector_io);
+      }
+
+      if (compress_)
+        nnet_chain_eg.Compress();
+
+      std::ostringstream os;
+      if (long_key_)
+        os << utt_id_
+           << "-" << chunk.first_frame << "-" << chunk.left_context
+           << "-" << chunk.num_frames << "-" << chunk.right_context << "-v1";
+      else  // key is <utt_id>-<frame_id>
+        os << utt_id_ << "-" << chunk.first_frame;
+
+      keys_[c] = os.str();
+    }
+  }
+
+  ~ChainExampleTask() {
+    for (size_t c = 0; c < egs_.size(); c++)
+      example_writer_->Write(keys_[c], egs_[c]);
+  }
+
+ private:
+  const TransitionModel *trans_mdl_;
+  const fst::StdVectorFst &normalization_fst_;
+  GeneralMatrix feats_;
+  Matrix<BaseFloat> ivectors_;
+  chain::Supervision supervision_;
+  bool have_deriv_weights_;
+  Vector<BaseFloat> deriv_weights_;
+  std::vector<ChunkTimeInfo> chunks_;
+  int32 frame_subsampling_factor_;
+  std::string utt_id_;
+  bool compress_;
+  bool long_key_;
+  NnetChainExampleWriter *example_writer_;
+
+  // The output of operator (): the keys and examples for each chunk.
+  std::vector<std::string> keys_;
+  std::vector<NnetChainExample> egs_;
+};
+
+
+/**
+   This function does all the processing for one utterance that has to be done
+   in order (checking the lengths, splitting the utterance into chunks and
+   choosing the iVectors, all of which may consume random numbers or update
+   stats), and then hands the rest of the work to 'sequencer' as a
+   ChainExampleTask, which will output the supervision objects to
+   'example_writer'.  Because all the random choices are made here, in the
+   main thread, the output does not depend on --num-threads.
 
      @param [in]  trans_mdl           The transition-model for the tree for which we
                                       are dumping egs.  This is expected to be
@@ -79,10 +243,14 @@ namespace nnet3 {
                                       and input frames.
      @param [in]  utt_id              Utterance-id
      @param [in]  compress            If true, compresses the feature matrices.
+     @param [in]  long_key            If true, the keys of the examples encode
+                                      the context info as well as the frame.
      @param [out]  utt_splitter       Pointer to UtteranceSplitter object,
                                       which helps to split an utterance into
                                       chunks. This also stores some stats.
      @param [out]  example_writer     Pointer to egs writer.
+     @param [out]  sequencer          The object that runs the ChainExampleTask,
+                                      possibly in a separate thread.
 
 **/
 
@@ -97,7 +265,8 @@ static bool ProcessFile(const TransitionModel *trans_mdl,
                         const std::string &utt_id,
                         bool compress, bool long_key,
                         UtteranceSplitter *utt_splitter,
-                        NnetChainExampleWriter *example_writer) {
+                        NnetChainExampleWriter *example_writer,
+                        TaskSequencer<ChainExampleTask> *sequencer) {
   KALDI_ASSERT(supervision.num_sequences == 1);
   int32 num_input_frames = feats.NumRows(),
       num_output_frames = supervision.frames_per_sequence;
@@ -137,108 +306,28 @@ static bool ProcessFile(const TransitionModel *trans_mdl,
     return false;
   }
 
-  chain::SupervisionSplitter sup_splitter(supervision);
-
-  for (size_t c = 0; c < chunks.size(); c++) {
-    ChunkTimeInfo &chunk = chunks[c];
-
-    int32 start_frame_subsampled = chunk.first_frame / frame_subsampling_factor,
-        num_frames_subsampled = chunk.num_frames / frame_subsampling_factor;
-
-    chain::Supervision supervision_part;
-    sup_splitter.GetFrameRange(start_frame_subsampled,
-                               num_frames_subsampled,
-                               &supervision_part);
-
-    if (trans_mdl != NULL)
-      ConvertSupervisionToUnconstrained(*trans_mdl, &supervision_part);
-
-    if (normalization_fst.NumStates() > 0 &&
-        !AddWeightToSupervisionFst(normalization_fst,
-                                   &supervision_part)) {
-      KALDI_WARN << "For utterance " << utt_id << ", feature frames "
-                 << chunk.first_frame << " to "
-                 << (chunk.first_frame + chunk.num_frames)
-                 << ", FST was empty after composing with normalization FST. "
-                 << "This should be extremely rare (a few per corpus, at most)";
-    }
-
-    int32 first_frame = 0;  // we shift the time-indexes of all these parts so
-                            // that the supervised part starts from frame 0.
-
-    NnetChainExample nnet_chain_eg;
-    nnet_chain_eg.outputs.resize(1);
-
-    SubVector<BaseFloat> output_weights(
-        &(chunk.output_weights[0]),
-        static_cast<int32>(chunk.output_weights.size()));
-
-    if (!deriv_weights) {
-      NnetChainSupervision nnet_supervision("output", supervision_part,
-                                            output_weights,
-                                            first_frame,
-                                            frame_subsampling_factor);
-      nnet_chain_eg.outputs[0].Swap(&nnet_supervision);
-    } else {
-      Vector<BaseFloat> this_deriv_weights(num_frames_subsampled);
-      for (int32 i = 0; i < num_frames_subsampled; i++) {
-        int32 t = i + start_frame_subsampled;
-        if (t < deriv_weights->Dim())
-          this_deriv_weights(i) = (*deriv_weights)(t);
-      }
-      KALDI_ASSERT(output_weights.Dim() == num_frames_subsampled);
-      this_deriv_weights.MulElements(output_weights);
-      NnetChainSupervision nnet_supervision("output", supervision_part,
-                                            this_deriv_weights,
-                                            first_frame,
-                                            frame_subsampling_factor);
-      nnet_chain_eg.outputs[0].Swap(&nnet_supervision);
-    }
-
-    nnet_chain_eg.inputs.resize(ivector_feats != NULL ? 2 : 1);
-
-    int32 tot_input_frames = chunk.left_context + chunk.num_frames +
-        chunk.right_context,
-        start_frame = chunk.first_frame - chunk.left_context;
-
-    GeneralMatrix input_frames;
-    ExtractRowRangeWithPadding(feats, start_frame, tot_input_frames,
-                               &input_frames);
-
-    NnetIo input_io("input", -chunk.left_context, input_frames);
-    nnet_chain_eg.inputs[0].Swap(&input_io);
-
-    if (ivector_feats != NULL) {
-      // if applicable, add the iVector feature.
+  Matrix<BaseFloat> ivectors;
+  if (ivector_feats != NULL) {
+    ivectors.Resize(chunks.size(), ivector_feats->NumCols(), kUndefined);
+    for (size_t c = 0; c < chunks.size(); c++) {
       // choose iVector from a random frame in the chunk
-      int32 ivector_frame = RandInt(start_frame,
-                                    start_frame + num_input_frames - 1),
+      int32 start_frame = chunks[c].first_frame - chunks[c].left_context,
+          ivector_frame = RandInt(start_frame,
+                                  start_frame + num_input_frames - 1),
           ivector_frame_subsampled = ivector_frame / ivector_period;
       if (ivector_frame_subsampled < 0)
         ivector_frame_subsampled = 0;
       if (ivector_frame_subsampled >= ivector_feats->NumRows())
         ivector_frame_subsampled = ivector_feats->NumRows() - 1;
-      Matrix<BaseFloat> ivector(1, ivector_feats->NumCols());
-      ivector.Row(0).CopyFromVec(ivector_feats->Row(ivector_frame_subsampled));
-      NnetIo ivector_io("ivector", 0, ivector);
-      nnet_chain_eg.inputs[1].Swap(&ivector_io);
+      ivectors.Row(c).CopyFromVec(ivector_feats->Row(ivector_frame_subsampled));
     }
-
-    if (compress)
-      nnet_chain_eg.Compress();
-
-    std::ostringstream os;
-    if (long_key)
-      os << utt_id
-         << "-" << chunk.first_frame << "-" << chunk.left_context
-         << "-" << chunk.num_frames << "-" << chunk.right_context << "-v1";
-    else  // key is <utt_id>-<frame_id>
-      os << utt_id << "-" << chunk.first_frame;
-
-    std::string key = os.str(); 
-
-    example_writer->Write(key, nnet_chain_eg);
   }
+
+  sequencer->Run(new ChainExampleTask(trans_mdl, normalization_fst, feats,
+                                      ivectors, supervision, deriv_weights,
+                                      chunks, frame_subsampling_factor,
+                                      utt_id, compress, long_key,
+                                      example_writer));
   return true;
 }
 
@@ -268,7 +357,8 @@ int main(int argc, char *argv[]) {
         "  nnet3-chain-get-egs --left-context=25 --right-context=9 --num-frames=150,100,90 dir/normalization.fst \\\n"
         "  \"$feats\" ark,s,cs:- ark:cegs.1.ark\n"
         "Note: the --frame-subsampling-factor option must be the same as given to\n"
-        "chain-get-supervision.\n";
+        "chain-get-supervision.\n"
+        "The output does not depend on --num-threads.\n";
 
     bool compress = true, long_key = false;
     int32 length_tolerance = 100, online_ivector_period = 1,
@@ -276,6 +366,7 @@ int main(int argc, char *argv[]) {
 
     ExampleGenerationConfig eg_config;  // controls num-frames,
                                         // left/right-context, etc.
+    TaskSequencerConfig sequencer_config;  // has --num-threads option.
 
     BaseFloat normalization_fst_scale = 1.0;
     int32 srand_seed = 0;
@@ -320,6 +411,7 @@ int main(int argc, char *argv[]) {
                 "for the key, which encodes context info, etc.");
 
     eg_config.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -371,6 +463,10 @@ int main(int argc, char *argv[]) {
 
       if (normalization_fst_scale != 1.0)
         ApplyProbabilityScale(normalization_fst_scale, &normalization_fst);
+      // Compute and cache the properties now, so that the composition in the
+      // ChainExampleTask objects, which may run in parallel, only ever reads
+      // the FST.
+      normalization_fst.Properties(fst::kFstProperties, true);
     }
 
     // Read as GeneralMatrix so we don't need to un-compress and re-compress
@@ -379,6 +475,9 @@ int main(int argc, char *argv[]) {
     chain::RandomAccessSupervisionReader supervision_reader(
         supervision_rspecifier);
     NnetChainExampleWriter example_writer(examples_wspecifier);
+    // 'sequencer' must be destroyed (which writes any remaining egs) before
+    // 'example_writer'.
+    TaskSequencer<ChainExampleTask> sequencer(sequencer_config);
     RandomAccessBaseFloatMatrixReader online_ivector_reader(
         online_ivector_rspecifier);
     RandomAccessBaseFloatVectorReader deriv_weights_reader(
@@ -434,10 +533,11 @@ int main(int argc, char *argv[]) {
                          online_ivector_feats, online_ivector_period,
                          supervision, deriv_weights, supervision_length_tolerance,
                          key, compress, long_key,
-                         &utt_splitter, &example_writer))
+                         &utt_splitter, &example_writer, &sequencer))
           num_err++;
       }
     }
+    sequencer.Wait();
     if (num_err > 0)
       KALDI_WARN << num_err << " utterances had errors and could "
           "not be processed.";
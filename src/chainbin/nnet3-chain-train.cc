@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-chain-training.h"
+#include "nnet3/nnet-example-prefetcher.h"
 #include "cudamatrix/cu-allocator.h"
 
 int main(int argc, char *argv[]) {
@@ -38,12 +39,15 @@ int main(int argc, char *argv[]) {
         "\n"
         "Usage:  nnet3-chain-train [options] <raw-nnet-in> <denominator-fst-in> <chain-training-examples-in> <raw-nnet-out>\n"
         "\n"
-        "nnet3-chain-train 1.raw den.fst 'ark:nnet3-merge-egs 1.cegs ark:-|' 2.raw\n";
+        "nnet3-chain-train 1.raw den.fst 'ark:nnet3-merge-egs 1.cegs ark:-|' 2.raw\n"
+        "or, with egs merged and written by nnet3-chain-copy-egs-to-indexed:\n"
+        "nnet3-chain-train --indexed-egs=true 1.raw den.fst 1.cegs.idx 2.raw\n";
 
     int32 srand_seed = 0;
     bool binary_write = true;
     std::string use_gpu = "yes";
     NnetChainTrainingOptions opts;
+    ExamplePrefetcherOptions prefetch_config;
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -52,6 +56,7 @@ int main(int argc, char *argv[]) {
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     opts.Register(&po);
+    prefetch_config.Register(&po);
 #if HAVE_CUDA==1
     CuDevice::RegisterDeviceOptions(&po);
 #endif
@@ -67,6 +72,10 @@ int main(int argc, char *argv[]) {
     }
 
 #if HAVE_CUDA==1
+    // With --prefetch-minibatches, the computations are compiled (which
+    // allocates GPU memory) in a background thread.
+    if (prefetch_config.prefetch_minibatches > 0)
+      CuDevice::Instantiate().AllowMultithreading();
     CuDevice::Instantiate().SelectGpuId(use_gpu);
 #endif
 
@@ -86,10 +95,14 @@ int main(int argc, char *argv[]) {
 
       NnetChainTrainer trainer(opts, den_fst, &nnet);
 
-      SequentialNnetChainExampleReader example_reader(examples_rspecifier);
-
-      for (; !example_reader.Done(); example_reader.Next())
-        trainer.Train(example_reader.Value());
+      {
+        ExamplePrefetcher<NnetChainExample, NnetChainTrainer> prefetcher(
+            prefetch_config, examples_rspecifier, &trainer);
+        NnetChainExample eg;
+        std::shared_ptr<const NnetComputation> computation;
+        while (prefetcher.Next(&eg, &computation))
+          trainer.Train(eg, *computation);
+      }
 
       ok = trainer.PrintTotalStats();
     }
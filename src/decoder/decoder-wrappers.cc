@@ -377,6 +377,9 @@ bool DecodeUtteranceLatticeFaster(
             << num_frames << " frames.";
   KALDI_VLOG(2) << "Cost for utterance " << utt << " is "
                 << weight.Value1() << " + " << weight.Value2();
+  KALDI_VLOG(2) << "Peak memory for tokens and links for utterance " << utt
+                << " was " << decoder.PeakArenaBytes() << " bytes ("
+                << decoder.ArenaBytesReserved() << " bytes reserved).";
   *like_ptr = likelihood;
   return true;
 }
@@ -19,6 +19,7 @@
 
 #include "decoder/grammar-fst.h"
 #include "fstext/grammar-context-fst.h"
+#include "util/kaldi-io.h"
 
 namespace fst {
 
@@ -382,7 +383,8 @@ std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::
 }
 
 template <typename FST>
-void GrammarFstTpl<FST>::Write(std::ostream &os, bool binary) const {
+void GrammarFstTpl<FST>::Write(std::ostream &os, bool binary,
+                               bool align) const {
   using namespace kaldi;
   if (!binary)
     KALDI_ERR << "GrammarFstTpl<FST>::Write only supports binary mode.";
@@ -395,23 +397,34 @@ void GrammarFstTpl<FST>::Write(std::ostream &os, bool binary) const {
 
   std::string stream_name("unknown");
   FstWriteOptions wopts(stream_name);
-  top_fst_->Write(os, wopts);
+  wopts.align = align;
+  if (!top_fst_->Write(os, wopts))
+    KALDI_ERR << "Error writing top-level FST of GrammarFst"
+              << (align ? " (note: --align requires a seekable stream)" : "");
 
   for (int32 i = 0; i < num_ifsts; i++) {
     int32 nonterminal = ifsts_[i].first;
     WriteBasicType(os, binary, nonterminal);
-    ifsts_[i].second->Write(os, wopts);
+    if (!ifsts_[i].second->Write(os, wopts))
+      KALDI_ERR << "Error writing FST for nonterminal " << nonterminal;
   }
   WriteToken(os, binary, "</GrammarFst>");
 }
 
+// If 'source' is nonempty it is the name of the file that 'is' was opened
+// from, and the FST will be memory-mapped if it was written aligned.
 template <typename FST>
-static FST *ReadConstFstFromStream(std::istream &is) {
+static FST *ReadConstFstFromStream(std::istream &is,
+                                   const std::string &source) {
   fst::FstHeader hdr;
   std::string stream_name("unknown");
   if (!hdr.Read(is, stream_name))
     KALDI_ERR << "Reading FST: error reading FST header";
   FstReadOptions ropts("<unspecified>", &hdr);
+  if (!source.empty() && (hdr.GetFlags() & FstHeader::IS_ALIGNED)) {
+    ropts.source = source;
+    ropts.mode = FstReadOptions::MAP;
+  }
   FST *ans = FST::Read(is, ropts);
   if (!ans)
     KALDI_ERR << "Could not read ConstFst from stream.";
@@ -424,6 +437,25 @@ void GrammarFstTpl<FST>::Read(std::istream &is, bool binary) {
   using namespace kaldi;
   if (!binary)
     KALDI_ERR << "GrammarFstTpl<FST>::Read only supports binary mode.";
+  ReadInternal(is, "");
+}
+
+template <typename FST>
+void GrammarFstTpl<FST>::ReadMapped(const std::string &rxfilename) {
+  using namespace kaldi;
+  bool binary;
+  Input ki(rxfilename, &binary);
+  if (!binary)
+    KALDI_ERR << "GrammarFstTpl<FST>::ReadMapped only supports binary mode.";
+  ReadInternal(ki.Stream(),
+               ClassifyRxfilename(rxfilename) == kFileInput ? rxfilename : "");
+}
+
+template <typename FST>
+void GrammarFstTpl<FST>::ReadInternal(std::istream &is,
+                                      const std::string &source) {
+  using namespace kaldi;
+  bool binary = true;
   if (top_fst_ != NULL)
     Destroy();
   int32 format = 1, num_ifsts;
@@ -434,12 +466,12 @@ void GrammarFstTpl<FST>::Read(std::istream &is, bool binary) {
         "update your code.";
   ReadBasicType(is, binary, &num_ifsts);
   ReadBasicType(is, binary, &nonterm_phones_offset_);
-  top_fst_ = std::shared_ptr<FST >(ReadConstFstFromStream<FST>(is));
+  top_fst_ = std::shared_ptr<FST >(ReadConstFstFromStream<FST>(is, source));
   for (int32 i = 0; i < num_ifsts; i++) {
     int32 nonterminal;
     ReadBasicType(is, binary, &nonterminal);
     std::shared_ptr<FST >
-        this_fst(ReadConstFstFromStream<FST>(is));
+        this_fst(ReadConstFstFromStream<FST>(is, source));
     ifsts_.push_back(std::pair<int32, std::shared_ptr<FST > >(
         nonterminal, this_fst));
   }
@@ -162,11 +162,24 @@ class GrammarFstTpl {
   // object.  It only supports binary mode, but the option is allowed for
   // compatibility with other Kaldi read/write functions (it will crash if
   // binary == false).
-  void Write(std::ostream &os, bool binary) const;
+  void Write(std::ostream &os, bool binary) const { Write(os, binary, false); }
+
+  // This version of Write() can also write the constituent FSTs with
+  // alignment, which (if FST is a ConstFst) allows ReadMapped() to
+  // memory-map them.  Aligned writing requires a seekable stream, i.e. an
+  // ordinary file, not a pipe.
+  void Write(std::ostream &os, bool binary, bool align) const;
 
   // Reads the format that Write() outputs.  Will crash if binary == false.
   void Read(std::istream &os, bool binary);
 
+  // Reads the format that Write() outputs from 'rxfilename'.  If it is an
+  // ordinary file and the FSTs in it were written with align == true, and FST
+  // is ConstFst, their arrays are memory-mapped read-only instead of being
+  // read onto the heap, so processes using the same grammar share one copy
+  // of it.  Otherwise this is equivalent to ReadKaldiObject().
+  void ReadMapped(const std::string &rxfilename);
+
   StateId Start() const {
     // the top 32 bits of the 64-bit state-id will be zero, because the
     // top FST instance has instance-id = 0.
@@ -352,6 +365,10 @@ class GrammarFstTpl {
   // clears everything.
   void Destroy();
 
+  // Implementation of Read() and ReadMapped(); 'source' is the filename to
+  // memory-map the FSTs from, or empty if they should not be mapped.
+  void ReadInternal(std::istream &is, const std::string &source);
+
   /*
     This utility function sets up a map from "left-context phone", meaning
     either a phone index or the index of the symbol #nonterm_bos, to
@@ -65,7 +65,7 @@ void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
   StateId start_state = fst_->Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = token_pool_.New(0.0, 0.0, nullptr, nullptr, nullptr);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -263,7 +263,8 @@ LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = token_pool_.New(tot_cost, extra_cost, nullptr, toks,
+                                     backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -340,7 +341,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -428,7 +429,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -489,7 +490,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_o
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -764,6 +765,10 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
 
+  if (config_.sort_emitting_tokens)
+    return ProcessEmittingSorted(decodable, frame, final_toks, cur_cutoff,
+                                 cost_offset, adaptive_beam, next_cutoff);
+
   // the tokens are now owned here, in final_toks, and the hash is empty.
   // 'owned' is a complex thing here; the point is we need to call DeleteElem
   // on each elem 'e' to let toks_ know we're done with them.
@@ -792,8 +797,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLinkT(e_next->val, arc.ilabel, arc.olabel,
-                                        graph_cost, ac_cost, tok->links);
+          tok->links = link_pool_.New(e_next->val, arc.ilabel, arc.olabel,
+                                      graph_cost, ac_cost, tok->links);
         }
       } // for all arcs
     }
@@ -803,13 +808,97 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   return next_cutoff;
 }
 
-// static inline
+// Prefetches the arcs leaving state 's' of 'graph', for the FST types where we
+// can locate them cheaply; for other types it does nothing.
+template <typename FST>
+static inline void PrefetchArcs(const FST &graph,
+                                typename FST::Arc::StateId s) { }
+
+template <typename Arc>
+static inline void PrefetchArcs(const fst::ConstFst<Arc> &graph,
+                                typename Arc::StateId s) {
+#ifdef __GNUC__
+  fst::ArcIteratorData<Arc> data;
+  graph.InitArcIterator(s, &data);
+  __builtin_prefetch(data.arcs);
+#endif
+}
+
+template <typename Arc>
+static inline void PrefetchArcs(const fst::VectorFst<Arc> &graph,
+                                typename Arc::StateId s) {
+#ifdef __GNUC__
+  fst::ArcIteratorData<Arc> data;
+  graph.InitArcIterator(s, &data);
+  __builtin_prefetch(data.arcs);
+#endif
+}
+
+template <typename FST, typename Token>
+BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmittingSorted(
+    DecodableInterface *decodable, int32 frame, Elem *final_toks,
+    BaseFloat cur_cutoff, BaseFloat cost_offset, BaseFloat adaptive_beam,
+    BaseFloat next_cutoff) {
+  // Collect the tokens within the cutoff, and give the Elems back to toks_.
+  emitting_unsorted_.clear();
+  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
+    if (e->val->tot_cost <= cur_cutoff)
+      emitting_unsorted_.push_back(std::make_pair(e->key, e->val));
+    e_tail = e->tail;
+    toks_.Delete(e);
+  }
+  // Sorting on the state gives better locality of access to the FST, whose
+  // states tend to be stored in numerical order.  (Each state occurs only
+  // once, so only the state is compared.)
+  std::sort(emitting_unsorted_.begin(), emitting_unsorted_.end(),
+            [](const std::pair<StateId, Token*> &a,
+               const std::pair<StateId, Token*> &b) {
+              return a.first < b.first; });
+  size_t num_toks = emitting_unsorted_.size();
+  emitting_states_.resize(num_toks);
+  emitting_costs_.resize(num_toks);
+  emitting_toks_.resize(num_toks);
+  for (size_t i = 0; i < num_toks; i++) {
+    emitting_states_[i] = emitting_unsorted_[i].first;
+    emitting_costs_[i] = emitting_unsorted_[i].second->tot_cost;
+    emitting_toks_[i] = emitting_unsorted_[i].second;
+  }
+
+  for (size_t i = 0; i < num_toks; i++) {
+    if (i + 1 < num_toks)
+      PrefetchArcs(*fst_, emitting_states_[i + 1]);
+    StateId state = emitting_states_[i];
+    BaseFloat cur_cost = emitting_costs_[i];
+    Token *tok = emitting_toks_[i];
+    for (fst::ArcIterator<FST> aiter(*fst_, state);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {  // propagate..
+        BaseFloat ac_cost = cost_offset -
+            decodable->LogLikelihood(frame, arc.ilabel),
+            graph_cost = arc.weight.Value(),
+            tot_cost = cur_cost + ac_cost + graph_cost;
+        if (tot_cost >= next_cutoff) continue;
+        else if (tot_cost + adaptive_beam < next_cutoff)
+          next_cutoff = tot_cost + adaptive_beam;  // prune by best current token
+        Elem *e_next = FindOrAddToken(arc.nextstate,
+                                      frame + 1, tot_cost, tok, NULL);
+        tok->links = link_pool_.New(e_next->val, arc.ilabel, arc.olabel,
+                                    graph_cost, ac_cost, tok->links);
+      }
+    }
+  }
+  return next_cutoff;
+}
+
+// inline
 template <typename FST, typename Token>
 void LatticeFasterDecoderTpl<FST, Token>::DeleteForwardLinks(Token *tok) {
   ForwardLinkT *l = tok->links, *m;
   while (l != NULL) {
     m = l->next;
-    delete l;
+    link_pool_.Delete(l);
     l = m;
   }
   tok->links = NULL;
@@ -873,8 +962,8 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
           Elem *e_new = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLinkT(e_new->val, 0, arc.olabel,
-                                        graph_cost, 0, tok->links);
+          tok->links = link_pool_.New(e_new->val, 0, arc.olabel,
+                                      graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -897,19 +986,12 @@ void LatticeFasterDecoderTpl<FST, Token>::DeleteElems(Elem *list) {
 
 template <typename FST, typename Token>
 void LatticeFasterDecoderTpl<FST, Token>::ClearActiveTokens() { // a cleanup routine, at utt end/begin
-  for (size_t i = 0; i < active_toks_.size(); i++) {
-    // Delete all tokens alive on this frame, and any forward
-    // links they may have.
-    for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      DeleteForwardLinks(tok);
-      Token *next_tok = tok->next;
-      delete tok;
-      num_toks_--;
-      tok = next_tok;
-    }
-  }
+  // All tokens and forward links come from token_pool_ and link_pool_, so
+  // there is no need to go through the lists deleting them one by one.
   active_toks_.clear();
-  KALDI_ASSERT(num_toks_ == 0);
+  token_pool_.Reset();
+  link_pool_.Reset();
+  num_toks_ = 0;
 }
 
 // static
@@ -23,6 +23,10 @@
 #ifndef KALDI_DECODER_LATTICE_FASTER_DECODER_H_
 #define KALDI_DECODER_LATTICE_FASTER_DECODER_H_
 
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
@@ -49,6 +53,10 @@ struct LatticeFasterDecoderConfig {
   // a very important parameter.  It affects the algorithm that prunes the
   // tokens as we go.
   BaseFloat prune_scale;
+  // If true, ProcessEmitting() copies the tokens that survive the cutoff into
+  // contiguous arrays sorted by FST state before expanding them, and
+  // prefetches the arcs of upcoming states; see ProcessEmittingSorted().
+  bool sort_emitting_tokens;
 
   // Most of the options inside det_opts are not actually queried by the
   // LatticeFasterDecoder class itself, but by the code that calls it, for
@@ -63,7 +71,8 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
-                                prune_scale(0.1) { }
+                                prune_scale(0.1),
+                                sort_emitting_tokens(false) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
     opts->Register("beam", &beam, "Decoding beam.  Larger->slower, more accurate.");
@@ -82,6 +91,11 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("sort-emitting-tokens", &sort_emitting_tokens, "If true, "
+                   "expand the active tokens in order of FST state on each "
+                   "frame, which gives better memory locality with large "
+                   "graphs.  Results may differ very slightly because the "
+                   "beam pruning depends on the order of expansion.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
@@ -99,6 +113,96 @@ namespace decoder {
 // those that do not (LatticeFasterDecoder).
 
 
+// SlabAllocator hands out objects of type T (which must be trivially
+// destructible, like Token and ForwardLink) from large blocks, and keeps a
+// free-list of the ones that have been given back; it's like the Elem
+// allocation in HashList.  The decoder allocates and frees a great many small
+// objects, and going through new and delete for each of them was a
+// significant part of the decoding time.  The memory is only released when
+// the allocator is destroyed, so it is recycled across utterances.
+template <typename T>
+class SlabAllocator {
+ public:
+  SlabAllocator(): free_head_(NULL), num_blocks_used_(0),
+                   block_pos_(kBlockSize), num_in_use_(0),
+                   peak_num_in_use_(0) { }
+
+  ~SlabAllocator() {
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+  }
+
+  // Constructs a T from the given arguments in memory from the pool.
+  template <typename... Args>
+  inline T *New(Args&&... args) {
+    Slot *slot;
+    if (free_head_ != NULL) {
+      slot = free_head_;
+      free_head_ = slot->next_free;
+    } else {
+      if (block_pos_ == kBlockSize) {
+        if (num_blocks_used_ == blocks_.size())
+          blocks_.push_back(new Slot[kBlockSize]);
+        num_blocks_used_++;
+        block_pos_ = 0;
+      }
+      slot = blocks_[num_blocks_used_ - 1] + block_pos_++;
+    }
+    if (++num_in_use_ > peak_num_in_use_)
+      peak_num_in_use_ = num_in_use_;
+    return new (slot) T(std::forward<Args>(args)...);
+  }
+
+  // Returns 't', which must have been obtained from New(), to the pool.
+  inline void Delete(T *t) {
+    Slot *slot = reinterpret_cast<Slot*>(t);
+    slot->next_free = free_head_;
+    free_head_ = slot;
+    num_in_use_--;
+  }
+
+  // Frees all objects at once (without needing to call Delete() on each),
+  // keeping the memory for reuse; also resets PeakNumInUse().
+  void Reset() {
+    free_head_ = NULL;
+    num_blocks_used_ = 0;
+    block_pos_ = kBlockSize;
+    num_in_use_ = 0;
+    peak_num_in_use_ = 0;
+  }
+
+  // The most objects that were allocated at any one time since the last
+  // Reset().
+  size_t PeakNumInUse() const { return peak_num_in_use_; }
+
+  // The memory held by the allocator, in bytes.  This is determined by the
+  // largest PeakNumInUse() seen so far.
+  size_t NumBytesReserved() const {
+    return blocks_.size() * kBlockSize * sizeof(Slot);
+  }
+
+  static size_t ObjectSize() { return sizeof(Slot); }
+
+ private:
+  union Slot {
+    Slot *next_free;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+  // Number of objects to allocate in one block.
+  static const size_t kBlockSize = 1024;
+
+  std::vector<Slot*> blocks_;
+  Slot *free_head_;  // Head of the list of objects given back by Delete().
+  size_t num_blocks_used_;  // blocks_[0 .. num_blocks_used_ - 1] are in use;
+                            // the rest are retained from before Reset().
+  size_t block_pos_;  // Next unused position in blocks_[num_blocks_used_ - 1].
+  size_t num_in_use_;
+  size_t peak_num_in_use_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+
 // ForwardLinks are the links from a token to a token on the next frame.
 // or sometimes on the current frame (for input-epsilon links).
 template <typename Token>
@@ -339,13 +443,29 @@ class LatticeFasterDecoderTpl {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// Returns the peak memory, in bytes, used for tokens and forward links
+  /// since the last InitDecoding() (the sum of the peaks for each; they need
+  /// not occur at the same time).  This is a function of the beams and can be
+  /// used to choose them when memory is limited.
+  size_t PeakArenaBytes() const {
+    return token_pool_.PeakNumInUse() * token_pool_.ObjectSize() +
+        link_pool_.PeakNumInUse() * link_pool_.ObjectSize();
+  }
+
+  /// Returns the memory, in bytes, that is held for tokens and forward links;
+  /// it is not freed between utterances, so it reflects the largest
+  /// utterances decoded with this object so far.
+  size_t ArenaBytesReserved() const {
+    return token_pool_.NumBytesReserved() + link_pool_.NumBytesReserved();
+  }
+
  protected:
   // we make things protected instead of private, as code in
   // LatticeFasterOnlineDecoderTpl, which inherits from this, also uses the
   // internals.
 
   // Deletes the elements of the singly linked list tok->links.
-  inline static void DeleteForwardLinks(Token *tok);
+  inline void DeleteForwardLinks(Token *tok);
 
   // head of per-frame list of Tokens (list is in topological order),
   // and something saying whether we ever pruned it using PruneForwardLinks.
@@ -444,6 +564,18 @@ class LatticeFasterDecoderTpl {
   /// use.
   BaseFloat ProcessEmitting(DecodableInterface *decodable);
 
+  /// Does the main loop of ProcessEmitting() when
+  /// config_.sort_emitting_tokens is true.  The tokens in 'final_toks' whose
+  /// cost is within 'cur_cutoff' are copied into the arrays emitting_states_,
+  /// emitting_costs_ and emitting_toks_, sorted by state, and expanded in
+  /// that order (this frees the Elems in 'final_toks').  The other arguments
+  /// are as computed by ProcessEmitting(); returns the updated next_cutoff.
+  BaseFloat ProcessEmittingSorted(DecodableInterface *decodable,
+                                  int32 frame, Elem *final_toks,
+                                  BaseFloat cur_cutoff, BaseFloat cost_offset,
+                                  BaseFloat adaptive_beam,
+                                  BaseFloat next_cutoff);
+
   /// Processes nonemitting (epsilon) arcs for one frame.  Called after
   /// ProcessEmitting() on each frame.  The cost cutoff is computed by the
   /// preceding ProcessEmitting().
@@ -463,6 +595,12 @@ class LatticeFasterDecoderTpl {
   // must_prune_tokens).
   std::vector<const Elem* > queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
+  // The following are used in ProcessEmittingSorted(): the active tokens
+  // of the frame being expanded, in structure-of-arrays form.
+  std::vector<std::pair<StateId, Token*> > emitting_unsorted_;
+  std::vector<StateId> emitting_states_;
+  std::vector<BaseFloat> emitting_costs_;
+  std::vector<Token*> emitting_toks_;
 
   // fst_ is a pointer to the FST we are decoding from.
   const FST *fst_;
@@ -476,6 +614,11 @@ class LatticeFasterDecoderTpl {
   // zero, to reduce roundoff errors.
   LatticeFasterDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
+
+  // All Tokens and ForwardLinks are allocated from these; they are emptied in
+  // ClearActiveTokens(), i.e. at the start of each utterance.
+  decoder::SlabAllocator<Token> token_pool_;
+  decoder::SlabAllocator<ForwardLinkT> link_pool_;
   bool warned_;
 
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
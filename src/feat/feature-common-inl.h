@@ -69,16 +69,33 @@ void OfflineFeatureTpl<F>::Compute(
     return;
   }
   output->Resize(rows_out, cols_out);
+  const FrameExtractionOptions &frame_opts = computer_.GetFrameOptions();
+  // We process the frames in batches of this many, which is enough for the
+  // matrix multiplications in ComputeBatch() to be efficient without using
+  // much memory for the windows of long recordings.
+  const int32 max_batch_size = 256;
+  int32 batch_size = std::min(rows_out, max_batch_size);
+  Matrix<BaseFloat> windows(batch_size, frame_opts.PaddedWindowSize(),
+                            kUndefined);
+  Vector<BaseFloat> raw_log_energies(batch_size);
   Vector<BaseFloat> window;  // windowed waveform.
   bool use_raw_log_energy = computer_.NeedRawLogEnergy();
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index.
-    BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(0, wave, r, computer_.GetFrameOptions(),
-                  feature_window_function_, &window,
-                  (use_raw_log_energy ? &raw_log_energy : NULL));
-
-    SubVector<BaseFloat> output_row(*output, r);
-    computer_.Compute(raw_log_energy, vtln_warp, &window, &output_row);
+  for (int32 start = 0; start < rows_out; start += batch_size) {
+    int32 this_batch_size = std::min(batch_size, rows_out - start);
+    SubMatrix<BaseFloat> this_windows(windows, 0, this_batch_size,
+                                      0, windows.NumCols());
+    SubVector<BaseFloat> this_raw_log_energies(raw_log_energies, 0,
+                                               this_batch_size);
+    for (int32 i = 0; i < this_batch_size; i++) {
+      int32 r = start + i;  // r is frame index.
+      ExtractWindow(0, wave, r, frame_opts, feature_window_function_, &window,
+                    (use_raw_log_energy ? &(this_raw_log_energies(i)) : NULL));
+      this_windows.Row(i).CopyFromVec(window);
+    }
+    SubMatrix<BaseFloat> this_output(*output, start, this_batch_size,
+                                     0, cols_out);
+    computer_.ComputeBatch(this_raw_log_energies, vtln_warp, &this_windows,
+                           &this_output);
   }
 }
 
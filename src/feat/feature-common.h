@@ -94,6 +94,24 @@ class ExampleFeatureComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /**
+     This is as Compute(), but for many frames at once; it is what
+     OfflineFeatureTpl uses.  The results are the same as calling Compute() on
+     each row, up to roundoff.
+
+     @param [in] signal_raw_log_energies  The raw log-energy of each frame
+         (see Compute()); ignored if NeedRawLogEnergy() returns false.
+     @param [in] vtln_warp  The VTLN warping factor; see Compute().
+     @param [in] signal_frames  The frames of the signal, one per row, as
+         extracted by ExtractWindow(); used as a workspace.
+     @param [out] features  The features, one row per frame; must have
+         Dim() columns.
+  */
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
  private:
   // disallow assignment.
   ExampleFeatureComputer &operator = (const ExampleFeatureComputer &in);
@@ -443,7 +443,46 @@ static void UnitTestHTKCompare4() {
 
 
 
+// Checks that the batched computation in Fbank::Compute() gives the same
+// results as computing the frames one by one.
+static void UnitTestBatch() {
+  std::cout << "=== UnitTestBatch() ===\n";
+
+  Vector<BaseFloat> v(RandInt(1000, 100000));
+  v.SetRandn();
+  v.Scale(1000.0);
+
+  FbankOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.round_to_power_of_two = (RandInt(0, 1) == 0);
+  op.use_energy = (RandInt(0, 1) == 0);
+  op.raw_energy = (RandInt(0, 1) == 0);
+  op.htk_compat = (RandInt(0, 1) == 0);
+  op.use_power = (RandInt(0, 1) == 0);
+  op.use_log_fbank = (RandInt(0, 1) == 0);
+
+  Fbank fbank(op);
+  Matrix<BaseFloat> batch_feats;
+  fbank.Compute(v, 1.0, &batch_feats);
+
+  FbankComputer computer(op);
+  FeatureWindowFunction window_function(op.frame_opts);
+  int32 num_frames = NumFrames(v.Dim(), op.frame_opts);
+  Matrix<BaseFloat> frame_feats(num_frames, computer.Dim());
+  Vector<BaseFloat> window;
+  for (int32 r = 0; r < num_frames; r++) {
+    BaseFloat raw_log_energy = 0.0;
+    ExtractWindow(0, v, r, op.frame_opts, window_function, &window,
+                  &raw_log_energy);
+    SubVector<BaseFloat> feat(frame_feats, r);
+    computer.Compute(raw_log_energy, 1.0, &window, &feat);
+  }
+  AssertEqual(batch_feats, frame_feats, 1.0e-03);
+  std::cout << "Test passed :)\n\n";
+}
+
 static void UnitTestFeat() {
+  UnitTestBatch();
   UnitTestReadWave();
   UnitTestSimple();
   UnitTestHTKCompare1();
@@ -24,13 +24,12 @@
 namespace kaldi {
 
 FbankComputer::FbankComputer(const FbankOptions &opts):
-    opts_(opts), srfft_(NULL) {
+    opts_(opts), fft_(NULL) {
   if (opts.energy_floor > 0.0)
     log_energy_floor_ = Log(opts.energy_floor);
 
   int32 padded_window_size = opts.frame_opts.PaddedWindowSize();
-  if ((padded_window_size & (padded_window_size-1)) == 0)  // Is a power of two...
-    srfft_ = new SplitRadixRealFft<BaseFloat>(padded_window_size);
+  fft_ = new MixedRadixRealFft<BaseFloat>(padded_window_size);
 
   // We'll definitely need the filterbanks info for VTLN warping factor 1.0.
   // [note: this call caches it.]
@@ -39,20 +38,20 @@ FbankComputer::FbankComputer(const FbankOptions &opts):
 
 FbankComputer::FbankComputer(const FbankComputer &other):
     opts_(other.opts_), log_energy_floor_(other.log_energy_floor_),
-    mel_banks_(other.mel_banks_), srfft_(NULL) {
+    mel_banks_(other.mel_banks_), fft_(NULL) {
   for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
       iter != mel_banks_.end();
       ++iter)
     iter->second = new MelBanks(*(iter->second));
-  if (other.srfft_)
-    srfft_ = new SplitRadixRealFft<BaseFloat>(*(other.srfft_));
+  if (other.fft_)
+    fft_ = new MixedRadixRealFft<BaseFloat>(*(other.fft_));
 }
 
 FbankComputer::~FbankComputer() {
   for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
       iter != mel_banks_.end(); ++iter)
     delete iter->second;
-  delete srfft_;
+  delete fft_;
 }
 
 const MelBanks* FbankComputer::GetMelBanks(BaseFloat vtln_warp) {
@@ -85,10 +84,7 @@ void FbankComputer::Compute(BaseFloat signal_raw_log_energy,
     signal_raw_log_energy = Log(std::max<BaseFloat>(VecVec(*signal_frame, *signal_frame),
                                      std::numeric_limits<float>::epsilon()));
 
-  if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-    srfft_->Compute(signal_frame->Data(), true);
-  else  // An alternative algorithm that works for non-powers-of-two.
-    RealFft(signal_frame, true);
+  fft_->Compute(signal_frame->Data(), true);
 
   // Convert the FFT into a power spectrum.
   ComputePowerSpectrum(signal_frame);
@@ -122,4 +118,63 @@ void FbankComputer::Compute(BaseFloat signal_raw_log_energy,
   }
 }
 
+void FbankComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows(),
+      padded_window_size = signal_frames->NumCols();
+  KALDI_ASSERT(padded_window_size == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> log_energies(signal_raw_log_energies);
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    // Compute energy after window function (not the raw one).
+    if (opts_.use_energy && !opts_.raw_energy)
+      log_energies(r) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::epsilon()));
+
+    fft_->Compute(signal_frame.Data(), true);
+
+    // Convert the FFT into a power spectrum.
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, padded_window_size / 2 + 1);
+
+  // Use magnitude instead of power if requested.
+  if (!opts_.use_power)
+    power_spectra.ApplyPow(0.5);
+
+  int32 mel_offset = ((opts_.use_energy && !opts_.htk_compat) ? 1 : 0);
+  SubMatrix<BaseFloat> mel_energies(*features, 0, num_frames,
+                                    mel_offset, opts_.mel_opts.num_bins);
+
+  // Sum with mel fiterbanks over the power spectra
+  mel_banks.ComputeBatch(power_spectra, &mel_energies);
+  if (opts_.use_log_fbank) {
+    // Avoid log of zero (which should be prevented anyway by dithering).
+    mel_energies.ApplyFloor(std::numeric_limits<float>::epsilon());
+    mel_energies.ApplyLog();  // take the log.
+  }
+
+  // Copy energy as first value (or the last, if htk_compat == true).
+  if (opts_.use_energy) {
+    int32 energy_index = opts_.htk_compat ? opts_.mel_opts.num_bins : 0;
+    for (int32 r = 0; r < num_frames; r++) {
+      BaseFloat log_energy = log_energies(r);
+      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
+        log_energy = log_energy_floor_;
+      (*features)(r, energy_index) = log_energy;
+    }
+  }
+}
+
 }  // namespace kaldi
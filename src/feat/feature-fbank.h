@@ -126,6 +126,13 @@ class FbankComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// This is as Compute(), but for many frames at once, one per row of
+  /// 'signal_frames' and 'features'; see ExampleFeatureComputer::ComputeBatch().
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
   ~FbankComputer();
 
  private:
@@ -135,7 +142,7 @@ class FbankComputer {
   FbankOptions opts_;
   BaseFloat log_energy_floor_;
   std::map<BaseFloat, MelBanks*> mel_banks_;  // BaseFloat is VTLN coefficient.
-  SplitRadixRealFft<BaseFloat> *srfft_;
+  MixedRadixRealFft<BaseFloat> *fft_;
   // Disallow assignment.
   FbankComputer &operator =(const FbankComputer &other);
 };
@@ -38,10 +38,7 @@ void MfccComputer::Compute(BaseFloat signal_raw_log_energy,
     signal_raw_log_energy = Log(std::max<BaseFloat>(VecVec(*signal_frame, *signal_frame),
                                      std::numeric_limits<float>::epsilon()));
 
-  if (srfft_ != NULL)  // Compute FFT using the split-radix algorithm.
-    srfft_->Compute(signal_frame->Data(), true);
-  else  // An alternative algorithm that works for non-powers-of-two.
-    RealFft(signal_frame, true);
+  fft_->Compute(signal_frame->Data(), true);
 
   // Convert the FFT into a power spectrum.
   ComputePowerSpectrum(signal_frame);
@@ -79,8 +76,73 @@ void MfccComputer::Compute(BaseFloat signal_raw_log_energy,
   }
 }
 
+void MfccComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows(),
+      padded_window_size = signal_frames->NumCols();
+  KALDI_ASSERT(padded_window_size == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> log_energies(signal_raw_log_energies);
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    if (opts_.use_energy && !opts_.raw_energy)
+      log_energies(r) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::epsilon()));
+
+    fft_->Compute(signal_frame.Data(), true);
+
+    // Convert the FFT into a power spectrum.
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, padded_window_size / 2 + 1);
+
+  Matrix<BaseFloat> mel_energies(num_frames, mel_banks.NumBins(),
+                                 kUndefined);
+  mel_banks.ComputeBatch(power_spectra, &mel_energies);
+
+  // avoid log of zero (which should be prevented anyway by dithering).
+  mel_energies.ApplyFloor(std::numeric_limits<float>::epsilon());
+  mel_energies.ApplyLog();  // take the log.
+
+  features->SetZero();  // in case there were NaNs.
+  // features = mel_energies [which now have log] * dct_matrix_^T
+  features->AddMatMat(1.0, mel_energies, kNoTrans, dct_matrix_, kTrans, 0.0);
+
+  if (opts_.cepstral_lifter != 0.0)
+    features->MulColsVec(lifter_coeffs_);
+
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> feature(*features, r);
+    if (opts_.use_energy) {
+      BaseFloat log_energy = log_energies(r);
+      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
+        log_energy = log_energy_floor_;
+      feature(0) = log_energy;
+    }
+
+    if (opts_.htk_compat) {
+      BaseFloat energy = feature(0);
+      for (int32 i = 0; i < opts_.num_ceps - 1; i++)
+        feature(i) = feature(i+1);
+      if (!opts_.use_energy)
+        energy *= M_SQRT2;  // scale on C0; see Compute().
+      feature(opts_.num_ceps - 1)  = energy;
+    }
+  }
+}
+
 MfccComputer::MfccComputer(const MfccOptions &opts):
-    opts_(opts), srfft_(NULL),
+    opts_(opts), fft_(NULL),
     mel_energies_(opts.mel_opts.num_bins) {
 
   int32 num_bins = opts.mel_opts.num_bins;
@@ -106,8 +168,7 @@ MfccComputer::MfccComputer(const MfccOptions &opts):
     log_energy_floor_ = Log(opts.energy_floor);
 
   int32 padded_window_size = opts.frame_opts.PaddedWindowSize();
-  if ((padded_window_size & (padded_window_size-1)) == 0)  // Is a power of two...
-    srfft_ = new SplitRadixRealFft<BaseFloat>(padded_window_size);
+  fft_ = new MixedRadixRealFft<BaseFloat>(padded_window_size);
 
   // We'll definitely need the filterbanks info for VTLN warping factor 1.0.
   // [note: this call caches it.]
@@ -119,13 +180,13 @@ MfccComputer::MfccComputer(const MfccComputer &other):
     dct_matrix_(other.dct_matrix_),
     log_energy_floor_(other.log_energy_floor_),
     mel_banks_(other.mel_banks_),
-    srfft_(NULL),
+    fft_(NULL),
     mel_energies_(other.mel_energies_.Dim(), kUndefined) {
   for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
        iter != mel_banks_.end(); ++iter)
     iter->second = new MelBanks(*(iter->second));
-  if (other.srfft_ != NULL)
-    srfft_ = new SplitRadixRealFft<BaseFloat>(*(other.srfft_));
+  if (other.fft_ != NULL)
+    fft_ = new MixedRadixRealFft<BaseFloat>(*(other.fft_));
 }
 
 
@@ -135,7 +196,7 @@ MfccComputer::~MfccComputer() {
       iter != mel_banks_.end();
       ++iter)
     delete iter->second;
-  delete srfft_;
+  delete fft_;
 }
 
 const MelBanks *MfccComputer::GetMelBanks(BaseFloat vtln_warp) {
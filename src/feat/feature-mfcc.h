@@ -124,6 +124,13 @@ class MfccComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// This is as Compute(), but for many frames at once, one per row of
+  /// 'signal_frames' and 'features'; see ExampleFeatureComputer::ComputeBatch().
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
   ~MfccComputer();
  private:
   // disallow assignment.
@@ -137,7 +144,7 @@ class MfccComputer {
   Matrix<BaseFloat> dct_matrix_;  // matrix we left-multiply by to perform DCT.
   BaseFloat log_energy_floor_;
   std::map<BaseFloat, MelBanks*> mel_banks_;  // BaseFloat is VTLN coefficient.
-  SplitRadixRealFft<BaseFloat> *srfft_;
+  MixedRadixRealFft<BaseFloat> *fft_;
 
   // note: mel_energies_ is specific to the frame we're processing, it's
   // just a temporary workspace.
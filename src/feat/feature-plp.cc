@@ -24,7 +24,7 @@
 namespace kaldi {
 
 PlpComputer::PlpComputer(const PlpOptions &opts):
-    opts_(opts), srfft_(NULL),
+    opts_(opts), fft_(NULL),
     mel_energies_duplicated_(opts_.mel_opts.num_bins + 2, kUndefined),
     autocorr_coeffs_(opts_.lpc_order + 1, kUndefined),
     lpc_coeffs_(opts_.lpc_order, kUndefined),
@@ -41,8 +41,7 @@ PlpComputer::PlpComputer(const PlpOptions &opts):
     log_energy_floor_ = Log(opts.energy_floor);
 
   int32 padded_window_size = opts.frame_opts.PaddedWindowSize();
-  if ((padded_window_size & (padded_window_size-1)) == 0)  // Is a power of two...
-    srfft_ = new SplitRadixRealFft<BaseFloat>(padded_window_size);
+  fft_ = new MixedRadixRealFft<BaseFloat>(padded_window_size);
 
   // We'll definitely need the filterbanks info for VTLN warping factor 1.0.
   // [note: this call caches it.]
@@ -53,7 +52,7 @@ PlpComputer::PlpComputer(const PlpComputer &other):
     opts_(other.opts_), lifter_coeffs_(other.lifter_coeffs_),
     idft_bases_(other.idft_bases_), log_energy_floor_(other.log_energy_floor_),
     mel_banks_(other.mel_banks_), equal_loudness_(other.equal_loudness_),
-    srfft_(NULL),
+    fft_(NULL),
     mel_energies_duplicated_(opts_.mel_opts.num_bins + 2, kUndefined),
     autocorr_coeffs_(opts_.lpc_order + 1, kUndefined),
     lpc_coeffs_(opts_.lpc_order, kUndefined),
@@ -65,8 +64,8 @@ PlpComputer::PlpComputer(const PlpComputer &other):
            iter = equal_loudness_.begin();
        iter != equal_loudness_.end(); ++iter)
     iter->second = new Vector<BaseFloat>(*(iter->second));
-  if (other.srfft_ != NULL)
-    srfft_ = new SplitRadixRealFft<BaseFloat>(*(other.srfft_));
+  if (other.fft_ != NULL)
+    fft_ = new MixedRadixRealFft<BaseFloat>(*(other.fft_));
 }
 
 PlpComputer::~PlpComputer() {
@@ -77,7 +76,7 @@ PlpComputer::~PlpComputer() {
            iter = equal_loudness_.begin();
        iter != equal_loudness_.end(); ++iter)
     delete iter->second;
-  delete srfft_;
+  delete fft_;
 }
 
 const MelBanks *PlpComputer::GetMelBanks(BaseFloat vtln_warp) {
@@ -127,10 +126,7 @@ void PlpComputer::Compute(BaseFloat signal_raw_log_energy,
     signal_raw_log_energy = Log(std::max<BaseFloat>(VecVec(*signal_frame, *signal_frame),
                                      std::numeric_limits<float>::min()));
 
-  if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-    srfft_->Compute(signal_frame->Data(), true);
-  else  // An alternative algorithm that works for non-powers-of-two.
-    RealFft(signal_frame, true);
+  fft_->Compute(signal_frame->Data(), true);
 
   // Convert the FFT into a power spectrum.
   ComputePowerSpectrum(signal_frame);  // elements 0 ... signal_frame->Dim()/2
@@ -187,5 +183,22 @@ void PlpComputer::Compute(BaseFloat signal_raw_log_energy,
   }
 }
 
+void PlpComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  // The LPC analysis is done separately for each frame anyway, so we just
+  // process the frames one by one.
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames);
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r),
+        feature(*features, r);
+    Compute(signal_raw_log_energies(r), vtln_warp, &signal_frame, &feature);
+  }
+}
+
 
 }  // namespace kaldi
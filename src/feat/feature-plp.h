@@ -138,6 +138,13 @@ class PlpComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// This is as Compute(), but for many frames at once, one per row of
+  /// 'signal_frames' and 'features'; see ExampleFeatureComputer::ComputeBatch().
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
   ~PlpComputer();
  private:
 
@@ -151,7 +158,7 @@ class PlpComputer {
   BaseFloat log_energy_floor_;
   std::map<BaseFloat, MelBanks*> mel_banks_;  // BaseFloat is VTLN coefficient.
   std::map<BaseFloat, Vector<BaseFloat>* > equal_loudness_;
-  SplitRadixRealFft<BaseFloat> *srfft_;
+  MixedRadixRealFft<BaseFloat> *fft_;
 
   // temporary vector used inside Compute; size is opts_.mel_opts.num_bins + 2
   Vector<BaseFloat> mel_energies_duplicated_;
@@ -25,23 +25,22 @@
 namespace kaldi {
 
 SpectrogramComputer::SpectrogramComputer(const SpectrogramOptions &opts)
-    : opts_(opts), srfft_(NULL) {
+    : opts_(opts), fft_(NULL) {
   if (opts.energy_floor > 0.0)
     log_energy_floor_ = Log(opts.energy_floor);
 
   int32 padded_window_size = opts.frame_opts.PaddedWindowSize();
-  if ((padded_window_size & (padded_window_size-1)) == 0)  // Is a power of two
-    srfft_ = new SplitRadixRealFft<BaseFloat>(padded_window_size);
+  fft_ = new MixedRadixRealFft<BaseFloat>(padded_window_size);
 }
 
 SpectrogramComputer::SpectrogramComputer(const SpectrogramComputer &other):
-    opts_(other.opts_), log_energy_floor_(other.log_energy_floor_), srfft_(NULL) {
-  if (other.srfft_ != NULL)
-    srfft_ = new SplitRadixRealFft<BaseFloat>(*other.srfft_);
+    opts_(other.opts_), log_energy_floor_(other.log_energy_floor_), fft_(NULL) {
+  if (other.fft_ != NULL)
+    fft_ = new MixedRadixRealFft<BaseFloat>(*other.fft_);
 }
 
 SpectrogramComputer::~SpectrogramComputer() {
-  delete srfft_;
+  delete fft_;
 }
 
 void SpectrogramComputer::Compute(BaseFloat signal_raw_log_energy,
@@ -57,10 +56,7 @@ void SpectrogramComputer::Compute(BaseFloat signal_raw_log_energy,
     signal_raw_log_energy = Log(std::max<BaseFloat>(VecVec(*signal_frame, *signal_frame),
                                      std::numeric_limits<float>::epsilon()));
 
-  if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-    srfft_->Compute(signal_frame->Data(), true);
-  else  // An alternative algorithm that works for non-powers-of-two
-    RealFft(signal_frame, true);
+  fft_->Compute(signal_frame->Data(), true);
 
   if (opts_.return_raw_fft) {
     feature->CopyFromVec(*signal_frame);
@@ -84,4 +80,52 @@ void SpectrogramComputer::Compute(BaseFloat signal_raw_log_energy,
   (*feature)(0) = signal_raw_log_energy;
 }
 
+void SpectrogramComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows(),
+      padded_window_size = signal_frames->NumCols();
+  KALDI_ASSERT(padded_window_size == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  Vector<BaseFloat> log_energies(signal_raw_log_energies);
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    // Compute energy after window function (not the raw one)
+    if (!opts_.raw_energy)
+      log_energies(r) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::epsilon()));
+
+    fft_->Compute(signal_frame.Data(), true);
+
+    if (!opts_.return_raw_fft)  // Convert the FFT into a power spectrum.
+      ComputePowerSpectrum(&signal_frame);
+  }
+
+  if (opts_.return_raw_fft) {
+    features->CopyFromMat(*signal_frames);
+    return;
+  }
+
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, padded_window_size / 2 + 1);
+  power_spectra.ApplyFloor(std::numeric_limits<float>::epsilon());
+  power_spectra.ApplyLog();
+  features->CopyFromMat(power_spectra);
+
+  for (int32 r = 0; r < num_frames; r++) {
+    BaseFloat log_energy = log_energies(r);
+    if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
+      log_energy = log_energy_floor_;
+    // The zeroth spectrogram component is always set to the signal energy,
+    // instead of the square of the constant component of the signal.
+    (*features)(r, 0) = log_energy;
+  }
+}
+
 }  // namespace kaldi
@@ -108,12 +108,19 @@ class SpectrogramComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// This is as Compute(), but for many frames at once, one per row of
+  /// 'signal_frames' and 'features'; see ExampleFeatureComputer::ComputeBatch().
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
   ~SpectrogramComputer();
 
  private:
   SpectrogramOptions opts_;
   BaseFloat log_energy_floor_;
-  SplitRadixRealFft<BaseFloat> *srfft_;
+  MixedRadixRealFft<BaseFloat> *fft_;
 
   // Disallow assignment.
   SpectrogramComputer &operator=(const SpectrogramComputer &other);
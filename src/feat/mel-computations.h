@@ -111,6 +111,13 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                VectorBase<BaseFloat> *mel_energies_out) const;
 
+  /// This is as Compute(), but for many frames at once, with one frame per
+  /// row; it does the computation as a single matrix multiplication.
+  /// "fft_energies" may have more columns than are needed (e.g. it may be the
+  /// whole FFT output); the extra ones are ignored.
+  void ComputeBatch(const MatrixBase<BaseFloat> &fft_energies,
+                    MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
@@ -134,6 +141,10 @@ class MelBanks {
   // (the first nonzero fft-bin), (the vector of weights).
   std::vector<std::pair<int32, Vector<BaseFloat> > > bins_;
 
+  // The same weights as in bins_, as a matrix of dimension num-bins by
+  // num-fft-bins, for ComputeBatch().
+  Matrix<BaseFloat> bin_matrix_;
+
   bool debug_;
   bool htk_mode_;
 };
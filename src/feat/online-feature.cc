@@ -19,6 +19,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstring>
 #include "feat/online-feature.h"
 #include "transform/cmvn.h"
 
@@ -71,7 +73,8 @@ OnlineGenericBaseFeature<C>::OnlineGenericBaseFeature(
     const typename C::Options &opts):
     computer_(opts), window_function_(computer_.GetFrameOptions()),
     features_(opts.frame_opts.max_feature_vectors),
-    input_finished_(false), waveform_offset_(0) {
+    input_finished_(false), waveform_offset_(0),
+    waveform_remainder_dim_(0) {
   // RE the following assert: search for ONLINE_IVECTOR_LIMIT in
   // online-ivector-feature.cc.
   // Casting to uint32, an unsigned type, means that -1 would be treated
@@ -108,20 +111,10 @@ void OnlineGenericBaseFeature<C>::InputFinished() {
   if (resampler_ != nullptr) {
     // There may be a few samples left once we flush the resampler_ object, telling it
     // that the file has finished.  This should rarely make any difference.
-    Vector<BaseFloat> appended_wave;
-    Vector<BaseFloat> resampled_wave;
-    resampler_->Resample(appended_wave, true, &resampled_wave);
-
-    if (resampled_wave.Dim() != 0) {
-      appended_wave.Resize(waveform_remainder_.Dim() +
-                           resampled_wave.Dim());
-      if (waveform_remainder_.Dim() != 0)
-        appended_wave.Range(0, waveform_remainder_.Dim())
-            .CopyFromVec(waveform_remainder_);
-      appended_wave.Range(waveform_remainder_.Dim(), resampled_wave.Dim())
-          .CopyFromVec(resampled_wave);
-      waveform_remainder_.Swap(&appended_wave);
-    }
+    Vector<BaseFloat> empty_wave;
+    SubVector<BaseFloat> resampled_wave = ExtendWaveformRemainder(
+        resampler_->NumOutputSamples(0, true));
+    resampler_->Resample(empty_wave, true, &resampled_wave);
   }
   input_finished_ = true;
   ComputeFeatures();
@@ -135,33 +128,38 @@ void OnlineGenericBaseFeature<C>::AcceptWaveform(
   if (input_finished_)
     KALDI_ERR << "AcceptWaveform called after InputFinished() was called.";
 
-  Vector<BaseFloat> appended_wave;
-  Vector<BaseFloat> resampled_wave;
-
-  const VectorBase<BaseFloat> *waveform;
-
   MaybeCreateResampler(sampling_rate);
-  if (resampler_ == nullptr) {
-    waveform = &original_waveform;
-  } else {
-    resampler_->Resample(original_waveform, false, &resampled_wave);
-    waveform = &resampled_wave;
-  }
-
-  appended_wave.Resize(waveform_remainder_.Dim() + waveform->Dim());
-  if (waveform_remainder_.Dim() != 0)
-    appended_wave.Range(0, waveform_remainder_.Dim())
-        .CopyFromVec(waveform_remainder_);
-  appended_wave.Range(waveform_remainder_.Dim(), waveform->Dim())
-      .CopyFromVec(*waveform);
-  waveform_remainder_.Swap(&appended_wave);
+  int32 num_new_samples = (resampler_ == nullptr ? original_waveform.Dim() :
+                           resampler_->NumOutputSamples(
+                               original_waveform.Dim(), false));
+
+  SubVector<BaseFloat> new_wave = ExtendWaveformRemainder(num_new_samples);
+  if (resampler_ == nullptr)
+    new_wave.CopyFromVec(original_waveform);
+  else  // resample straight into place, without a temporary.
+    resampler_->Resample(original_waveform, false, &new_wave);
   ComputeFeatures();
 }
 
+template <class C>
+SubVector<BaseFloat> OnlineGenericBaseFeature<C>::ExtendWaveformRemainder(
+    int32 num_samples) {
+  int32 new_dim = waveform_remainder_dim_ + num_samples;
+  if (new_dim > waveform_buffer_.Dim())  // Grow geometrically.
+    waveform_buffer_.Resize(std::max(new_dim, 2 * waveform_buffer_.Dim()),
+                            kCopyData);
+  SubVector<BaseFloat> ans(waveform_buffer_, waveform_remainder_dim_,
+                           num_samples);
+  waveform_remainder_dim_ = new_dim;
+  return ans;
+}
+
 template <class C>
 void OnlineGenericBaseFeature<C>::ComputeFeatures() {
   const FrameExtractionOptions &frame_opts = computer_.GetFrameOptions();
-  int64 num_samples_total = waveform_offset_ + waveform_remainder_.Dim();
+  SubVector<BaseFloat> waveform_remainder(waveform_buffer_, 0,
+                                          waveform_remainder_dim_);
+  int64 num_samples_total = waveform_offset_ + waveform_remainder_dim_;
   int32 num_frames_old = features_.Size(),
       num_frames_new = NumFrames(num_samples_total, frame_opts,
                                  input_finished_);
@@ -171,7 +169,7 @@ void OnlineGenericBaseFeature<C>::ComputeFeatures() {
   bool need_raw_log_energy = computer_.NeedRawLogEnergy();
   for (int32 frame = num_frames_old; frame < num_frames_new; frame++) {
     BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(waveform_offset_, waveform_remainder_, frame,
+    ExtractWindow(waveform_offset_, waveform_remainder, frame,
                   frame_opts, window_function_, &window,
                   need_raw_log_energy ? &raw_log_energy : NULL);
     Vector<BaseFloat> *this_feature = new Vector<BaseFloat>(computer_.Dim(),
@@ -188,17 +186,18 @@ void OnlineGenericBaseFeature<C>::ComputeFeatures() {
   int32 samples_to_discard = first_sample_of_next_frame - waveform_offset_;
   if (samples_to_discard > 0) {
     // discard the leftmost part of the waveform that we no longer need.
-    int32 new_num_samples = waveform_remainder_.Dim() - samples_to_discard;
+    int32 new_num_samples = waveform_remainder_dim_ - samples_to_discard;
     if (new_num_samples <= 0) {
       // odd, but we'll try to handle it.
-      waveform_offset_ += waveform_remainder_.Dim();
-      waveform_remainder_.Resize(0);
+      waveform_offset_ += waveform_remainder_dim_;
+      waveform_remainder_dim_ = 0;
     } else {
-      Vector<BaseFloat> new_remainder(new_num_samples);
-      new_remainder.CopyFromVec(waveform_remainder_.Range(samples_to_discard,
-                                                          new_num_samples));
+      // Shift the rest to the start of the buffer; the ranges may overlap.
+      BaseFloat *data = waveform_buffer_.Data();
+      std::memmove(data, data + samples_to_discard,
+                   sizeof(BaseFloat) * new_num_samples);
       waveform_offset_ += samples_to_discard;
-      waveform_remainder_.Swap(&new_remainder);
+      waveform_remainder_dim_ = new_num_samples;
     }
   }
 }
@@ -117,11 +117,11 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
 
  private:
   // This function computes any additional feature frames that it is possible to
-  // compute from 'waveform_remainder_', which at this point may contain more
+  // compute from the waveform remainder, which at this point may contain more
   // than just a remainder-sized quantity (because AcceptWaveform() appends to
-  // waveform_remainder_ before calling this function).  It adds these feature
-  // frames to features_, and shifts off any now-unneeded samples of input from
-  // waveform_remainder_ while incrementing waveform_offset_ by the same amount.
+  // it before calling this function).  It adds these feature frames to
+  // features_, and shifts off any now-unneeded samples of input from the
+  // remainder while incrementing waveform_offset_ by the same amount.
   void ComputeFeatures();
 
   void MaybeCreateResampler(BaseFloat sampling_rate);
@@ -146,13 +146,22 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   BaseFloat sampling_frequency_;
 
   // waveform_offset_ is the number of samples of waveform that we have
-  // already discarded, i.e. that were prior to 'waveform_remainder_'.
+  // already discarded, i.e. that were prior to the waveform remainder.
   int64 waveform_offset_;
 
-  // waveform_remainder_ is a short piece of waveform that we may need to keep
+  // The first waveform_remainder_dim_ samples of waveform_buffer_ are the
+  // waveform remainder, a short piece of waveform that we may need to keep
   // after extracting all the whole frames we can (whatever length of feature
-  // will be required for the next phase of computation).
-  Vector<BaseFloat> waveform_remainder_;
+  // will be required for the next phase of computation).  The rest of
+  // waveform_buffer_ is spare capacity, so that AcceptWaveform() does not
+  // normally need to allocate memory.
+  Vector<BaseFloat> waveform_buffer_;
+  int32 waveform_remainder_dim_;
+
+  // Extends the waveform remainder by 'num_samples' samples, enlarging
+  // waveform_buffer_ if needed, and returns the new part for the caller to
+  // fill in.
+  SubVector<BaseFloat> ExtendWaveformRemainder(int32 num_samples);
 };
 
 typedef OnlineGenericBaseFeature<MfccComputer> OnlineMfcc;
@@ -284,15 +284,18 @@ static void UnitTestDelay() {
 
 extern bool pitch_use_naive_search; // was declared in pitch-functions.cc
 
-// Make sure that doing a calculation on the whole waveform gives
-// the same results as doing on the waveform broken into pieces.
+// Make sure that the fast search over the previous frame's states gives
+// the same results as the naive search.
 static void UnitTestSearch() {
   KALDI_LOG << "=== UnitTestSearch() ===\n";
-  for (int32 n = 0; n < 3; n++) {
+  for (int32 n = 0; n < 5; n++) {
     // the parametrization object
     PitchExtractionOptions op;
     op.nccf_ballast_online = true;  // this is necessary for the computation
     // to be identical regardless how many pieces we break the signal into.
+    // Exercise the zero-penalty special case and a very large penalty too.
+    if (n == 3) op.penalty_factor = 0.0;
+    if (n == 4) op.penalty_factor = 100.0;
 
     int32 size = 1000 + rand() % 1000;
 
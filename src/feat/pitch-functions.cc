@@ -109,14 +109,31 @@ void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
   SubVector<BaseFloat> wave_part(wave, 0, nccf_window_size);
   // subtract mean-frame from wave
   zero_mean_wave.Add(-wave_part.Sum() / nccf_window_size);
-  BaseFloat e1, e2, sum;
   SubVector<BaseFloat> sub_vec1(zero_mean_wave, 0, nccf_window_size);
-  e1 = VecVec(sub_vec1, sub_vec1);
+  BaseFloat e1 = VecVec(sub_vec1, sub_vec1);
+  int32 num_lags = last_lag + 1 - first_lag;
+  const BaseFloat *data = zero_mean_wave.Data();
+
+  // Rather than doing a dot product per lag, we accumulate the inner products
+  // for all the lags at once, one sample of the un-shifted window at a time;
+  // these are vector operations of dimension num_lags.
+  inner_prod->SetZero();
+  for (int32 n = 0; n < nccf_window_size; n++) {
+    SubVector<BaseFloat> shifted(zero_mean_wave, first_lag + n, num_lags);
+    inner_prod->AddVec(data[n], shifted);
+  }
+
+  // The energy e2 of the shifted window is updated incrementally as the lag
+  // increases; it's done in double precision so the roundoff doesn't build up.
+  SubVector<BaseFloat> sub_vec2(zero_mean_wave, first_lag, nccf_window_size);
+  double e2 = VecVec(sub_vec2, sub_vec2);
   for (int32 lag = first_lag; lag <= last_lag; lag++) {
-    SubVector<BaseFloat> sub_vec2(zero_mean_wave, lag, nccf_window_size);
-    e2 = VecVec(sub_vec2, sub_vec2);
-    sum = VecVec(sub_vec1, sub_vec2);
-    (*inner_prod)(lag - first_lag) = sum;
+    if (lag > first_lag) {
+      double leaving = data[lag - 1],
+          entering = data[lag + nccf_window_size - 1];
+      e2 += entering * entering - leaving * leaving;
+      if (e2 < 0.0) e2 = 0.0;
+    }
     (*norm_prod)(lag - first_lag) = e1 * e2;
   }
 }
@@ -136,7 +153,7 @@ void ComputeNccf(const VectorBase<BaseFloat> &inner_prod,
                inner_prod.Dim() == nccf_vec->Dim());
   for (int32 lag = 0; lag < inner_prod.Dim(); lag++) {
     BaseFloat numerator = inner_prod(lag),
-        denominator = pow(norm_prod(lag) + nccf_ballast, 0.5),
+        denominator = std::sqrt(norm_prod(lag) + nccf_ballast),
         nccf;
     if (denominator != 0.0) {
       nccf = numerator / denominator;
@@ -192,6 +209,17 @@ void ComputeLocalCost(const VectorBase<BaseFloat> &nccf_pitch,
 
 
 
+// Temporary storage used by PitchFrameInfo::ComputeBacktraces(); the caller
+// keeps it so it doesn't have to be reallocated on every frame.  The members
+// describe the lower envelope of a set of parabolas; see the code.
+struct PitchEnvelopeWorkspace {
+  std::vector<int32> center;
+  std::vector<double> offset;
+  std::vector<double> start_num;
+  std::vector<double> start_den;
+};
+
+
 // class PitchFrameInfo is used inside class OnlinePitchFeatureImpl.
 // It stores the information we need to keep around for a single frame
 // of the pitch computation.
@@ -247,14 +275,14 @@ class PitchFrameInfo {
   ///                       nccf_pov are sampled.
   ///  @param  prev_frame_forward_cost   The forward-cost vector for the
   ///                       previous frame.
-  ///  @param  index_info   A pointer to a temporary vector used by this function
+  ///  @param  workspace    Temporary storage used by this function
   ///  @param  this_forward_cost   The forward-cost vector for this frame
   ///                       (to be computed).
   void ComputeBacktraces(const PitchExtractionOptions &opts,
                          const VectorBase<BaseFloat> &nccf_pitch,
                          const VectorBase<BaseFloat> &lags,
                          const VectorBase<BaseFloat> &prev_forward_cost,
-                         std::vector<std::pair<int32, int32> > *index_info,
+                         PitchEnvelopeWorkspace *workspace,
                          VectorBase<BaseFloat> *this_forward_cost);
  private:
   // struct StateInfo is the information we keep for a single one of the
@@ -308,7 +336,7 @@ void PitchFrameInfo::ComputeBacktraces(
     const VectorBase<BaseFloat> &nccf_pitch,
     const VectorBase<BaseFloat> &lags,
     const VectorBase<BaseFloat> &prev_forward_cost_vec,
-    std::vector<std::pair<int32, int32> > *index_info,
+    PitchEnvelopeWorkspace *workspace,
     VectorBase<BaseFloat> *this_forward_cost_vec) {
   int32 num_states = nccf_pitch.Dim();
 
@@ -324,17 +352,6 @@ void PitchFrameInfo::ComputeBacktraces(
   const BaseFloat *prev_forward_cost = prev_forward_cost_vec.Data();
   BaseFloat *this_forward_cost = this_forward_cost_vec->Data();
 
-  if (index_info->empty())
-    index_info->resize(num_states);
-
-  // make it a reference for more concise indexing.
-  std::vector<std::pair<int32, int32> > &bounds = *index_info;
-
-  /* bounds[i].first will be a lower bound on the backpointer for state i,
-     bounds[i].second will be an upper bound on it.  We progressively tighten
-     these bounds till we know the backpointers exactly.
-  */
-
   if (pitch_use_naive_search) {
     // This branch is only taken in unit-testing code.
     for (int32 i = 0; i < num_states; i++) {
@@ -351,130 +368,74 @@ void PitchFrameInfo::ComputeBacktraces(
       this_forward_cost[i] = best_cost;
       state_info_[i].backpointer = best_j;
     }
-  } else {
-    int32 last_backpointer = 0;
+  } else if (inter_frame_factor == 0.0) {
+    // With no penalty for changing the lag, every state's best predecessor is
+    // the best state of the previous frame.
+    int32 best_j = 0;
+    for (int32 j = 1; j < num_states; j++)
+      if (prev_forward_cost[j] < prev_forward_cost[best_j])
+        best_j = j;
     for (int32 i = 0; i < num_states; i++) {
-      int32 start_j = last_backpointer;
-      BaseFloat best_cost = (start_j - i) * (start_j - i) * inter_frame_factor
-          + prev_forward_cost[start_j];
-      int32 best_j = start_j;
-
-      for (int32 j = start_j + 1; j < num_states; j++) {
-        BaseFloat this_cost = (j - i) * (j - i) * inter_frame_factor
-            + prev_forward_cost[j];
-        if (this_cost < best_cost) {
-          best_cost = this_cost;
-          best_j = j;
-        } else {  // as soon as the costs stop improving, we stop searching.
-          break;  // this is a loose lower bound we're getting.
-        }
-      }
+      this_forward_cost[i] = prev_forward_cost[best_j];
       state_info_[i].backpointer = best_j;
-      this_forward_cost[i] = best_cost;
-      bounds[i].first = best_j;  // this is now a lower bound on the
-                                 // backpointer.
-      bounds[i].second = num_states - 1;  // we have no meaningful upper bound
-                                          // yet.
-      last_backpointer = best_j;
     }
-
-    // We iterate, progressively refining the upper and lower bounds until they
-    // meet and we know that the resulting backtraces are optimal.  Each
-    // iteration takes time linear in num_states.  We won't normally iterate as
-    // far as num_states; normally we only do two iterations; when printing out
-    // the number of iterations, it's rarely more than that (once I saw seven
-    // iterations).  Anyway, this part of the computation does not dominate.
-    for (int32 iter = 0; iter < num_states; iter++) {
-      bool changed = false;
-      if (iter % 2 == 0) {  // go backwards through the states
-        last_backpointer = num_states - 1;
-        for (int32 i = num_states - 1; i >= 0; i--) {
-          int32 lower_bound = bounds[i].first,
-              upper_bound = std::min(last_backpointer, bounds[i].second);
-          if (upper_bound == lower_bound) {
-            last_backpointer = lower_bound;
-            continue;
-          }
-          BaseFloat best_cost = this_forward_cost[i];
-          int32 best_j = state_info_[i].backpointer, initial_best_j = best_j;
-
-          if (best_j == upper_bound) {
-            // if best_j already equals upper bound, don't bother tightening the
-            // upper bound, we'll tighten the lower bound when the time comes.
-            last_backpointer = best_j;
-            continue;
-          }
-          // Below, we have j > lower_bound + 1 because we know we've already
-          // evaluated lower_bound and lower_bound + 1 [via knowledge of
-          // this algorithm.]
-          for (int32 j = upper_bound; j > lower_bound + 1; j--) {
-            BaseFloat this_cost = (j - i) * (j - i) * inter_frame_factor
-                + prev_forward_cost[j];
-            if (this_cost < best_cost) {
-              best_cost = this_cost;
-              best_j = j;
-            } else {  // as soon as the costs stop improving, we stop searching,
-              // unless the best j is still lower than j, in which case
-              // we obviously need to keep moving.
-              if (best_j > j)
-                break;  // this is a loose lower bound we're getting.
-            }
-          }
-          // our "best_j" is now an upper bound on the backpointer.
-          bounds[i].second = best_j;
-          if (best_j != initial_best_j) {
-            this_forward_cost[i] = best_cost;
-            state_info_[i].backpointer = best_j;
-            changed = true;
-          }
-          last_backpointer = best_j;
-        }
-      } else {  // go forwards through the states.
-        last_backpointer = 0;
-        for (int32 i = 0; i < num_states; i++) {
-          int32 lower_bound = std::max(last_backpointer, bounds[i].first),
-              upper_bound = bounds[i].second;
-          if (upper_bound == lower_bound) {
-            last_backpointer = lower_bound;
-            continue;
-          }
-          BaseFloat best_cost = this_forward_cost[i];
-          int32 best_j = state_info_[i].backpointer, initial_best_j = best_j;
-
-          if (best_j == lower_bound) {
-            // if best_j already equals lower bound, we don't bother tightening
-            // the lower bound, we'll tighten the upper bound when the time
-            // comes.
-            last_backpointer = best_j;
-            continue;
-          }
-          // Below, we have j < upper_bound because we know we've already
-          // evaluated that point.
-          for (int32 j = lower_bound; j < upper_bound - 1; j++) {
-            BaseFloat this_cost = (j - i) * (j - i) * inter_frame_factor
-                + prev_forward_cost[j];
-            if (this_cost < best_cost) {
-              best_cost = this_cost;
-              best_j = j;
-            } else {  // as soon as the costs stop improving, we stop searching,
-              // unless the best j is still higher than j, in which case
-              // we obviously need to keep moving.
-              if (best_j < j)
-                break;  // this is a loose lower bound we're getting.
-            }
-          }
-          // our "best_j" is now a lower bound on the backpointer.
-          bounds[i].first = best_j;
-          if (best_j != initial_best_j) {
-            this_forward_cost[i] = best_cost;
-            state_info_[i].backpointer = best_j;
-            changed = true;
-          }
-          last_backpointer = best_j;
-        }
+  } else {
+    /* The minimization over j of (j - i)^2 * inter_frame_factor +
+       prev_forward_cost[j] is a one-dimensional distance transform, which we
+       compute exactly in time linear in num_states as in Felzenszwalb and
+       Huttenlocher, "Distance transforms of sampled functions": we find the
+       lower envelope of the parabolas (j - i)^2 * inter_frame_factor +
+       prev_forward_cost[j], as functions of i, and then read off the lowest
+       one for each i.  Where parabolas tie we keep the lower j, as the naive
+       search does.
+
+       workspace->center[k] is the j of the k'th parabola in the envelope, and
+       workspace->offset[k] is prev_forward_cost[j] + inter_frame_factor j^2.
+       The parabola is the lowest one from the point
+       start_num[k] / start_den[k] onward; we keep the fraction, with
+       start_den[k] > 0, rather than dividing, because divisions would be the
+       slowest part of this loop.
+    */
+    workspace->center.resize(num_states);
+    workspace->offset.resize(num_states);
+    workspace->start_num.resize(num_states);
+    workspace->start_den.resize(num_states);
+    int32 *center = &(workspace->center[0]);
+    double *offset = &(workspace->offset[0]),
+        *start_num = &(workspace->start_num[0]),
+        *start_den = &(workspace->start_den[0]);
+    const double c = inter_frame_factor;
+    int32 k = 0;
+    center[0] = 0;
+    offset[0] = prev_forward_cost[0];
+    for (int32 j = 1; j < num_states; j++) {
+      // The parabolas for center[k] and j intersect at
+      // (offset_j - offset[k]) / (2 c (j - center[k])).
+      double offset_j = prev_forward_cost[j] + c * j * j, num, den;
+      while (true) {
+        num = offset_j - offset[k];
+        den = 2.0 * c * (j - center[k]);
+        // The following is the test num / den > start_num[k] / start_den[k].
+        if (k == 0 || num * start_den[k] > start_num[k] * den)
+          break;
+        k--;
       }
-      if (!changed)
-        break;
+      k++;
+      center[k] = j;
+      offset[k] = offset_j;
+      start_num[k] = num;
+      start_den[k] = den;
+    }
+    int32 num_parabolas = k + 1;
+    k = 0;
+    for (int32 i = 0; i < num_states; i++) {
+      // Move on while the next parabola starts before i.
+      while (k + 1 < num_parabolas && start_num[k + 1] < i * start_den[k + 1])
+        k++;
+      int32 j = center[k];
+      this_forward_cost[i] = (j - i) * (j - i) * inter_frame_factor
+          + prev_forward_cost[j];
+      state_info_[i].backpointer = j;
     }
   }
   // The next statement is needed due to RecomputeBacktraces: we have to
@@ -981,7 +942,7 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
   double forward_cost_remainder = 0.0;
   Vector<BaseFloat> forward_cost(num_states),  // start off at zero.
       next_forward_cost(forward_cost);
-  std::vector<std::pair<int32, int32 > > index_info;
+  PitchEnvelopeWorkspace workspace;
 
   for (int32 frame = 0; frame < num_frames; frame++) {
     NccfInfo &nccf_info = *nccf_info_[frame];
@@ -1006,7 +967,7 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
 
     frame_info_[frame + 1]->ComputeBacktraces(
         opts_, nccf_info.nccf_pitch_resampled, lags_,
-        forward_cost, &index_info, &next_forward_cost);
+        forward_cost, &workspace, &next_forward_cost);
 
     forward_cost.Swap(&next_forward_cost);
     BaseFloat remainder = forward_cost.Min();
@@ -1164,7 +1125,7 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   // below, which is why we don't do it at the very end.
   UpdateRemainder(downsampled_wave);
 
-  std::vector<std::pair<int32, int32 > > index_info;
+  PitchEnvelopeWorkspace workspace;
 
   for (int32 frame = start_frame; frame < end_frame; frame++) {
     int32 frame_idx = frame - start_frame;
@@ -1172,7 +1133,7 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
         *cur_info = new PitchFrameInfo(prev_info);
     cur_info->SetNccfPov(nccf_pov_resampled.Row(frame_idx));
     cur_info->ComputeBacktraces(opts_, nccf_pitch_resampled.Row(frame_idx),
-                                lags_, forward_cost_, &index_info,
+                                lags_, forward_cost_, &workspace,
                                 &cur_forward_cost);
     forward_cost_.Swap(&cur_forward_cost);
     // Renormalize forward_cost so smallest element is zero.
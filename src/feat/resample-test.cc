@@ -275,10 +275,45 @@ void UnitTestLinearResample2() {
   AssertEqual(self1, cross, 0.001);
 }
 
+void UnitTestLinearResampleStreaming() {
+  // this test makes sure that the version of LinearResample::Resample() that
+  // writes into a preallocated output gives the same results as processing the
+  // whole signal at once, for typical sampling rates.
+  int32 rates[][2] = { { 44100, 16000 }, { 8000, 16000 }, { 48000, 16000 },
+                       { 16000, 8000 } };
+  int32 r = rand() % 4, samp_freq = rates[r][0], resamp_freq = rates[r][1];
+  int32 num_samp = 1000 + rand() % 4000;
+  Vector<BaseFloat> test_signal(num_samp);
+  test_signal.SetRandn();
+
+  LinearResample linear_resampler(samp_freq, resamp_freq,
+                                  std::min(samp_freq, resamp_freq) / 2.0, 6);
+  Vector<BaseFloat> resampled_vec;
+  linear_resampler.Resample(test_signal, true, &resampled_vec);
+
+  Vector<BaseFloat> resampled_vec2(resampled_vec.Dim());
+  int32 input_dim_seen = 0, output_dim_seen = 0;
+  while (input_dim_seen < test_signal.Dim()) {
+    int32 dim_remaining = test_signal.Dim() - input_dim_seen;
+    int32 piece_size = rand() % std::min(dim_remaining + 1, 1000);
+    SubVector<BaseFloat> in_piece(test_signal, input_dim_seen, piece_size);
+    bool flush = (piece_size == dim_remaining);
+    int32 num_out = linear_resampler.NumOutputSamples(piece_size, flush);
+    SubVector<BaseFloat> out_piece(resampled_vec2, output_dim_seen, num_out);
+    linear_resampler.Resample(in_piece, flush, &out_piece);
+    input_dim_seen += piece_size;
+    output_dim_seen += num_out;
+  }
+  KALDI_ASSERT(output_dim_seen == resampled_vec.Dim());
+  AssertEqual(resampled_vec, resampled_vec2, 1.0e-04);
+}
+
 int main() {
   try {
     for (int32 x = 0; x < 50; x++)
       UnitTestLinearResample();
+    for (int32 x = 0; x < 50; x++)
+      UnitTestLinearResampleStreaming();
     for (int32 x = 0; x < 50; x++)
       UnitTestLinearResample2();    
     for (int32 x = 0; x < 50; x++)
@@ -22,13 +22,118 @@
 
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include "feat/feature-functions.h"
 #include "matrix/matrix-functions.h"
 #include "feat/resample.h"
 
+// As in gmm/diag-gmm-kernels.cc, the x86 kernel is compiled with a
+// per-function target attribute and selected at run time.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ >= 7) && (KALDI_DOUBLEPRECISION == 0)
+#define KALDI_RESAMPLE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
 namespace kaldi {
 
+namespace {
+
+// The following functions do the inner loop of LinearResample::Resample().
+// They compute output samples, starting from 'output', for as long as the
+// filter for the next sample lies wholly inside 'input' and fewer than
+// 'num_output' samples have been computed, and return the number of samples
+// computed.  'weights' is LinearResample::weights_, with 'num_taps' (a
+// multiple of 8) columns and row stride 'stride'; 'first_index' is
+// LinearResample::first_index_.  '*phase' is the index of the row of weights
+// for the next output sample, and '*unit_start' is the index into 'input'
+// of the start of its repeating unit, so that its first input sample is
+// *unit_start + first_index[*phase]; both are updated.
+template<typename Real>
+int32 ResampleInteriorGeneric(const Real *weights, MatrixIndexT stride,
+                              int32 num_taps, const int32 *first_index,
+                              int32 num_phases, int32 input_samples_in_unit,
+                              const Real *input, int32 input_dim,
+                              int32 num_output, int32 *phase,
+                              int64 *unit_start, Real *output) {
+  int32 p = *phase;
+  int64 u = *unit_start;
+  int32 i = 0;
+  for (; i < num_output; i++) {
+    int64 first_input_index = u + first_index[p];
+    if (first_input_index < 0 || first_input_index + num_taps > input_dim)
+      break;
+    const Real *w = weights + p * stride, *x = input + first_input_index;
+    Real sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    for (int32 j = 0; j < num_taps; j += 4) {
+      sum0 += w[j] * x[j];
+      sum1 += w[j + 1] * x[j + 1];
+      sum2 += w[j + 2] * x[j + 2];
+      sum3 += w[j + 3] * x[j + 3];
+    }
+    output[i] = (sum0 + sum1) + (sum2 + sum3);
+    if (++p == num_phases) {
+      p = 0;
+      u += input_samples_in_unit;
+    }
+  }
+  *phase = p;
+  *unit_start = u;
+  return i;
+}
+
+#ifdef KALDI_RESAMPLE_X86_KERNELS
+
+bool HaveAvx2() {
+  // Worked out once; initialization of function-local statics is
+  // thread-safe.
+  static const bool ans = (__builtin_cpu_init(),
+                           __builtin_cpu_supports("avx2") &&
+                           __builtin_cpu_supports("fma"));
+  return ans;
+}
+
+__attribute__((target("avx2,fma")))
+int32 ResampleInteriorAvx2(const float *weights, MatrixIndexT stride,
+                           int32 num_taps, const int32 *first_index,
+                           int32 num_phases, int32 input_samples_in_unit,
+                           const float *input, int32 input_dim,
+                           int32 num_output, int32 *phase,
+                           int64 *unit_start, float *output) {
+  int32 p = *phase;
+  int64 u = *unit_start;
+  int32 i = 0;
+  for (; i < num_output; i++) {
+    int64 first_input_index = u + first_index[p];
+    if (first_input_index < 0 || first_input_index + num_taps > input_dim)
+      break;
+    const float *w = weights + p * stride, *x = input + first_input_index;
+    __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(w), _mm256_loadu_ps(x));
+    for (int32 j = 8; j < num_taps; j += 8)
+      sum = _mm256_fmadd_ps(_mm256_loadu_ps(w + j), _mm256_loadu_ps(x + j),
+                            sum);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum),
+                             _mm256_extractf128_ps(sum, 1));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_movehdup_ps(sum4));
+    output[i] = _mm_cvtss_f32(sum4);
+    if (++p == num_phases) {
+      p = 0;
+      u += input_samples_in_unit;
+    }
+  }
+  // See ComponentLogLikelihoodsAvx2() in gmm/diag-gmm-kernels.cc.
+  _mm256_zeroupper();
+  *phase = p;
+  *unit_start = u;
+  return i;
+}
+
+#endif  // KALDI_RESAMPLE_X86_KERNELS
+
+}  // namespace
+
 
 LinearResample::LinearResample(int32 samp_rate_in_hz,
                                int32 samp_rate_out_hz,
@@ -103,10 +208,11 @@ int64 LinearResample::GetNumOutputSamples(int64 input_num_samp,
 
 void LinearResample::SetIndexesAndWeights() {
   first_index_.resize(output_samples_in_unit_);
-  weights_.resize(output_samples_in_unit_);
 
   double window_width = num_zeros_ / (2.0 * filter_cutoff_);
 
+  std::vector<int32> num_indices(output_samples_in_unit_);
+  int32 max_num_indices = 0;
   for (int32 i = 0; i < output_samples_in_unit_; i++) {
     double output_t = i / static_cast<double>(samp_rate_out_);
     double min_t = output_t - window_width, max_t = output_t + window_width;
@@ -118,17 +224,26 @@ void LinearResample::SetIndexesAndWeights() {
     // that we unnecessarily include something with a zero coefficient,
     // but this is only a slight efficiency issue.
     int32 min_input_index = ceil(min_t * samp_rate_in_),
-        max_input_index = floor(max_t * samp_rate_in_),
-        num_indices = max_input_index - min_input_index + 1;
+        max_input_index = floor(max_t * samp_rate_in_);
     first_index_[i] = min_input_index;
-    weights_[i].Resize(num_indices);
-    for (int32 j = 0; j < num_indices; j++) {
-      int32 input_index = min_input_index + j;
+    num_indices[i] = max_input_index - min_input_index + 1;
+    max_num_indices = std::max(max_num_indices, num_indices[i]);
+  }
+  // Pad all the rows of weights at the start to the same length, a multiple
+  // of 8, so the inner loop of Resample() is the same for all of them.
+  int32 num_taps = (max_num_indices + 7) / 8 * 8;
+  weights_.Resize(output_samples_in_unit_, num_taps);
+  for (int32 i = 0; i < output_samples_in_unit_; i++) {
+    double output_t = i / static_cast<double>(samp_rate_out_);
+    int32 pad = num_taps - num_indices[i];
+    for (int32 j = 0; j < num_indices[i]; j++) {
+      int32 input_index = first_index_[i] + j;
       double input_t = input_index / static_cast<double>(samp_rate_in_),
           delta_t = input_t - output_t;
       // sign of delta_t doesn't matter.
-      weights_[i](j) = FilterFunc(delta_t) / samp_rate_in_;
+      weights_(i, pad + j) = FilterFunc(delta_t) / samp_rate_in_;
     }
+    first_index_[i] -= pad;
   }
 }
 
@@ -148,56 +263,107 @@ void LinearResample::GetIndexes(int64 samp_out,
       unit_index * input_samples_in_unit_;
 }
 
+int32 LinearResample::NumOutputSamples(int32 input_dim, bool flush) const {
+  return static_cast<int32>(
+      GetNumOutputSamples(input_sample_offset_ + input_dim, flush) -
+      output_sample_offset_);
+}
 
 void LinearResample::Resample(const VectorBase<BaseFloat> &input,
                               bool flush,
                               Vector<BaseFloat> *output) {
+  output->Resize(NumOutputSamples(input.Dim(), flush), kUndefined);
+  VectorBase<BaseFloat> *output_base = output;
+  Resample(input, flush, output_base);
+}
+
+void LinearResample::Resample(const VectorBase<BaseFloat> &input,
+                              bool flush,
+                              VectorBase<BaseFloat> *output) {
   int32 input_dim = input.Dim();
   int64 tot_input_samp = input_sample_offset_ + input_dim,
       tot_output_samp = GetNumOutputSamples(tot_input_samp, flush);
 
-  KALDI_ASSERT(tot_output_samp >= output_sample_offset_);
-
-  output->Resize(tot_output_samp - output_sample_offset_);
-
-  // samp_out is the index into the total output signal, not just the part
-  // of it we are producing here.
-  for (int64 samp_out = output_sample_offset_;
-       samp_out < tot_output_samp;
-       samp_out++) {
-    int64 first_samp_in;
-    int32 samp_out_wrapped;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
+  KALDI_ASSERT(tot_output_samp >= output_sample_offset_ &&
+               output->Dim() == tot_output_samp - output_sample_offset_);
+
+  int32 num_output = output->Dim(), num_taps = weights_.NumCols();
+  // 'phase' is the row of weights_ for the next output sample, and
+  // 'unit_start' is the index into 'input' of the start of its unit (see
+  // GetIndexes()).
+  int64 first_samp_in;
+  int32 phase;
+  GetIndexes(output_sample_offset_, &first_samp_in, &phase);
+  int64 unit_start = first_samp_in - first_index_[phase] -
+      input_sample_offset_;
+
+  // The output samples whose filter starts before 'input' are done using
+  // head_buffer_, which contains input_remainder_ followed by the start of
+  // 'input'.
+  int32 remainder_dim = input_remainder_.Dim(),
+      head_input_dim = std::min(input_dim, num_taps);
+  head_buffer_.Resize(remainder_dim + num_taps, kUndefined);
+  SubVector<BaseFloat> head(head_buffer_, 0, remainder_dim + head_input_dim);
+  head.Range(0, remainder_dim).CopyFromVec(input_remainder_);
+  head.Range(remainder_dim, head_input_dim).CopyFromVec(
+      input.Range(0, head_input_dim));
+
+  int32 output_index = 0;
+  while (output_index < num_output) {
+    // Do as many samples as we can with the fast code...
+    bool use_head = (unit_start + first_index_[phase] < 0);
+    const BaseFloat *data = (use_head ? head.Data() : input.Data());
+    int32 data_dim = (use_head ? head.Dim() : input_dim),
+        data_offset = (use_head ? remainder_dim : 0);
+    int64 data_unit_start = unit_start + data_offset;
+    int32 n;
+#ifdef KALDI_RESAMPLE_X86_KERNELS
+    if (HaveAvx2())
+      n = ResampleInteriorAvx2(
+          weights_.Data(), weights_.Stride(), num_taps, &(first_index_[0]),
+          output_samples_in_unit_, input_samples_in_unit_, data, data_dim,
+          num_output - output_index, &phase, &data_unit_start,
+          output->Data() + output_index);
+    else
+#endif
+      n = ResampleInteriorGeneric(
+          weights_.Data(), weights_.Stride(), num_taps, &(first_index_[0]),
+          output_samples_in_unit_, input_samples_in_unit_, data, data_dim,
+          num_output - output_index, &phase, &data_unit_start,
+          output->Data() + output_index);
+    unit_start = data_unit_start - data_offset;
+    output_index += n;
+    if (output_index == num_output || n != 0)
+      continue;
+    // ... and if we could not do any, one sample with the slow code; this
+    // happens near the end of the signal when flushing, and in odd cases
+    // where the remainder is shorter than the padded filter.
+    const BaseFloat *weights = weights_.RowData(phase);
     // first_input_index is the first index into "input" that we have a weight
     // for.
-    int32 first_input_index = static_cast<int32>(first_samp_in -
-                                                 input_sample_offset_);
-    BaseFloat this_output;
-    if (first_input_index >= 0 &&
-        first_input_index + weights.Dim() <= input_dim) {
-      SubVector<BaseFloat> input_part(input, first_input_index, weights.Dim());
-      this_output = VecVec(input_part, weights);
-    } else {  // Handle edge cases.
-      this_output = 0.0;
-      for (int32 i = 0; i < weights.Dim(); i++) {
-        BaseFloat weight = weights(i);
-        int32 input_index = first_input_index + i;
-        if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
-          this_output += weight *
-              input_remainder_(input_remainder_.Dim() + input_index);
-        } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input(input_index);
-        } else if (input_index >= input_dim) {
-          // We're past the end of the input and are adding zero; should only
-          // happen if the user specified flush == true, or else we would not
-          // be trying to output this sample.
-          KALDI_ASSERT(flush);
-        }
+    int32 first_input_index = static_cast<int32>(unit_start +
+                                                 first_index_[phase]);
+    BaseFloat this_output = 0.0;
+    for (int32 i = 0; i < num_taps; i++) {
+      BaseFloat weight = weights[i];
+      int32 input_index = first_input_index + i;
+      if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
+        this_output += weight *
+            input_remainder_(input_remainder_.Dim() + input_index);
+      } else if (input_index >= 0 && input_index < input_dim) {
+        this_output += weight * input(input_index);
+      } else if (input_index >= input_dim) {
+        // We're past the end of the input and are adding zero; should only
+        // happen if the user specified flush == true, or else we would not
+        // be trying to output this sample.
+        KALDI_ASSERT(flush);
       }
     }
-    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
-    (*output)(output_index) = this_output;
+    (*output)(output_index++) = this_output;
+    if (++phase == output_samples_in_unit_) {
+      phase = 0;
+      unit_start += input_samples_in_unit_;
+    }
   }
 
   if (flush) {
@@ -210,32 +376,34 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
 }
 
 void LinearResample::SetRemainder(const VectorBase<BaseFloat> &input) {
-  Vector<BaseFloat> old_remainder(input_remainder_);
-  // max_remainder_needed is the width of the filter from side to side,
-  // measured in input samples.  you might think it should be half that,
-  // but you have to consider that you might be wanting to output samples
-  // that are "in the past" relative to the beginning of the latest
-  // input... anyway, storing more remainder than needed is not harmful.
-  int32 max_remainder_needed = ceil(samp_rate_in_ * num_zeros_ /
-                                    filter_cutoff_);
-  input_remainder_.Resize(max_remainder_needed);
-  for (int32 index = - input_remainder_.Dim(); index < 0; index++) {
-    // we interpret "index" as an offset from the end of "input" and
-    // from the end of input_remainder_.
-    int32 input_index = index + input.Dim();
-    if (input_index >= 0)
-      input_remainder_(index + input_remainder_.Dim()) = input(input_index);
-    else if (input_index + old_remainder.Dim() >= 0)
-      input_remainder_(index + input_remainder_.Dim()) =
-          old_remainder(input_index + old_remainder.Dim());
-    // else leave it at zero.
+  // input_remainder_ has a fixed dimension (see Reset()); we shift the new
+  // input into it from the right.
+  int32 remainder_dim = input_remainder_.Dim(), input_dim = input.Dim();
+  if (input_dim >= remainder_dim) {
+    input_remainder_.CopyFromVec(input.Range(input_dim - remainder_dim,
+                                             remainder_dim));
+  } else {
+    BaseFloat *data = input_remainder_.Data();
+    std::memmove(data, data + input_dim,
+                 sizeof(BaseFloat) * (remainder_dim - input_dim));
+    std::memcpy(data + remainder_dim - input_dim, input.Data(),
+                sizeof(BaseFloat) * input_dim);
   }
 }
 
 void LinearResample::Reset() {
   input_sample_offset_ = 0;
   output_sample_offset_ = 0;
-  input_remainder_.Resize(0);
+  // The dimension of the remainder is the width of the filter from side to
+  // side, measured in input samples.  you might think it should be half that,
+  // but you have to consider that you might be wanting to output samples
+  // that are "in the past" relative to the beginning of the latest
+  // input... anyway, storing more remainder than needed is not harmful.
+  // Zeros in it stand for the time before the signal started.  Resize() does
+  // not reallocate if the dimension is unchanged.
+  int32 max_remainder_needed = ceil(samp_rate_in_ * num_zeros_ /
+                                    filter_cutoff_);
+  input_remainder_.Resize(max_remainder_needed);
 }
 
 /** Here, t is a time in seconds representing an offset from
@@ -274,6 +442,7 @@ ArbitraryResample::ArbitraryResample(
   // set up weights_ and indices_.  Please try to keep all functions short and
   SetIndexes(sample_points);
   SetWeights(sample_points);
+  SetBlocks();
 }
 
 
@@ -286,15 +455,15 @@ void ArbitraryResample::Resample(const MatrixBase<BaseFloat> &input,
                input.NumCols() == num_samples_in_ &&
                output->NumCols() == weights_.size());
 
-  Vector<BaseFloat> output_col(output->NumRows());
-  for (int32 i = 0; i < NumSamplesOut(); i++) {
+  for (size_t b = 0; b < blocks_.size(); b++) {
+    const WeightBlock &block = blocks_[b];
     SubMatrix<BaseFloat> input_part(input, 0, input.NumRows(),
-                                    first_index_[i],
-                                    weights_[i].Dim());
-    const Vector<BaseFloat> &weight_vec(weights_[i]);
-    output_col.AddMatVec(1.0, input_part,
-                         kNoTrans, weight_vec, 0.0);
-    output->CopyColFromVec(output_col, i);
+                                    block.first_input,
+                                    block.weights.NumRows()),
+        output_part(*output, 0, output->NumRows(),
+                    block.first_output, block.weights.NumCols());
+    output_part.AddMatMat(1.0, input_part, kNoTrans,
+                          block.weights, kNoTrans, 0.0);
   }
 }
 
@@ -345,6 +514,36 @@ void ArbitraryResample::SetWeights(const Vector<BaseFloat> &sample_points) {
   }
 }
 
+void ArbitraryResample::SetBlocks() {
+  // The blocks cover this many output samples.  With the sample points used
+  // in the pitch code, which are sorted, this gives blocks with a reasonable
+  // proportion of nonzero weights.
+  const int32 block_size = 32;
+  int32 num_samples_out = NumSamplesOut();
+  blocks_.clear();
+  for (int32 start = 0; start < num_samples_out; start += block_size) {
+    int32 end = std::min(start + block_size, num_samples_out),
+        input_begin = num_samples_in_, input_end = 0;
+    for (int32 i = start; i < end; i++) {
+      input_begin = std::min(input_begin, first_index_[i]);
+      input_end = std::max(input_end, first_index_[i] + weights_[i].Dim());
+    }
+    if (input_end <= input_begin) {  // No nonzero weights; only
+      input_begin = 0;               // possible in odd cases.
+      input_end = 1;
+    }
+    blocks_.resize(blocks_.size() + 1);
+    WeightBlock &block = blocks_.back();
+    block.first_output = start;
+    block.first_input = input_begin;
+    block.weights.Resize(input_end - input_begin, end - start);
+    for (int32 i = start; i < end; i++)
+      for (int32 j = 0; j < weights_[i].Dim(); j++)
+        block.weights(first_index_[i] + j - input_begin, i - start) =
+            weights_[i](j);
+  }
+}
+
 /** Here, t is a time in seconds representing an offset from
     the center of the windowed filter function, and FilterFunction(t)
     returns the windowed filter function, described
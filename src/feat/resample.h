@@ -123,6 +123,9 @@ class ArbitraryResample {
 
   BaseFloat FilterFunc(BaseFloat t) const;
 
+  // Sets up blocks_ from first_index_ and weights_.
+  void SetBlocks();
+
   int32 num_samples_in_;
   BaseFloat samp_rate_in_;
   BaseFloat filter_cutoff_;
@@ -131,6 +134,19 @@ class ArbitraryResample {
   std::vector<int32> first_index_;  // The first input-sample index that we sum
                                     // over, for this output-sample index.
   std::vector<Vector<BaseFloat> > weights_;
+
+  // The matrix version of Resample() treats the resampling as multiplication
+  // by a sparse (banded, if the sample points are sorted) matrix of weights.
+  // We store it as a sequence of dense blocks, each covering a range of
+  // consecutive output samples and the range of input samples that they
+  // depend on, so that the product can be done as one matrix multiplication
+  // per block.
+  struct WeightBlock {
+    int32 first_output;
+    int32 first_input;
+    Matrix<BaseFloat> weights;  // Dimension is (num-inputs, num-outputs).
+  };
+  std::vector<WeightBlock> blocks_;
 };
 
 
@@ -142,6 +158,17 @@ class ArbitraryResample {
 
    We require that the input and output sampling rate be specified as
    integers, as this is an easy way to specify that their ratio be rational.
+
+   The implementation is polyphase: if the sampling rates are in the ratio
+   p:q in lowest terms (e.g. 441:160 for 44.1kHz to 16kHz), the output
+   samples fall into q phases, and we precompute one row of filter weights
+   for each phase.  Output samples are computed as dot products with those
+   rows, with an AVX2 kernel where the machine supports it.  The samples
+   whose filter straddles the remainder of the previous piece and the start
+   of the current one go through the same kernel, using a small buffer that
+   holds the remainder followed by the start of the input; slower scalar
+   code is only needed when flushing at the end of the signal, and in odd
+   cases where the remainder is too short.
 */
 
 class LinearResample {
@@ -178,6 +205,18 @@ class LinearResample {
                 bool flush,
                 Vector<BaseFloat> *output);
 
+  /// This version of Resample() is for streaming use, where you want to avoid
+  /// allocating memory on each call: 'output' must already have the right
+  /// dimension, i.e. NumOutputSamples(input.Dim(), flush), and may be part
+  /// of a larger vector.  Otherwise it behaves the same as the version above.
+  void Resample(const VectorBase<BaseFloat> &input,
+                bool flush,
+                VectorBase<BaseFloat> *output);
+
+  /// Returns the number of samples that Resample() will output if you call it
+  /// now with 'input_dim' samples of input and this value of 'flush'.
+  int32 NumOutputSamples(int32 input_dim, bool flush) const;
+
   /// Calling the function Reset() resets the state of the object prior to
   /// processing a new signal; it is only necessary if you have called
   /// Resample(x, y, false) for some signal, leading to a remainder of the
@@ -237,8 +276,11 @@ class LinearResample {
   /// extrapolate the correct input-sample index for arbitrary output samples.
   std::vector<int32> first_index_;
 
-  /// Weights on the input samples, for this output-sample index.
-  std::vector<Vector<BaseFloat> > weights_;
+  /// Weights on the input samples: row i is for output-sample index i.  All
+  /// rows have the same length, a multiple of 8; the rows for which the filter
+  /// needs fewer input samples are padded with zeros at the start (and their
+  /// first_index_ is reduced accordingly).
+  Matrix<BaseFloat> weights_;
 
   // the following variables keep track of where we are in a particular signal,
   // if it is being provided over multiple calls to Resample().
@@ -249,7 +291,15 @@ class LinearResample {
   int64 output_sample_offset_;  ///< The number of samples we have already
                                 ///< output for this signal.
   Vector<BaseFloat> input_remainder_;  ///< A small trailing part of the
-                                       ///< previously seen input signal.
+                                       ///< previously seen input signal; its
+                                       ///< dimension is fixed, and it is
+                                       ///< zero-padded at the start of a
+                                       ///< signal.
+  Vector<BaseFloat> head_buffer_;  ///< Temporary storage used in Resample():
+                                   ///< input_remainder_ followed by the
+                                   ///< start of the input, so the output
+                                   ///< samples that straddle the two can be
+                                   ///< done by the fast code.
 };
 
 /**
@@ -22,6 +22,59 @@
 #include "util/common-utils.h"
 #include "feat/pitch-functions.h"
 #include "feat/wave-reader.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class is used with TaskSequencer to compute the pitch of several
+// utterances in parallel; the computation happens in the operator (), and the
+// output in the destructor, in the order in which the utterances were read.
+class PitchTask {
+ public:
+  PitchTask(const PitchExtractionOptions &pitch_opts,
+            const ProcessPitchOptions &process_opts,
+            const std::string &utt, const VectorBase<BaseFloat> &waveform,
+            BaseFloatMatrixWriter *feat_writer,
+            int32 *num_done, int32 *num_err):
+      pitch_opts_(pitch_opts), process_opts_(process_opts), utt_(utt),
+      waveform_(waveform), feat_writer_(feat_writer), num_done_(num_done),
+      num_err_(num_err), failed_(false) { }
+
+  void operator () () {
+    try {
+      ComputeAndProcessKaldiPitch(pitch_opts_, process_opts_,
+                                  waveform_, &features_);
+    } catch (...) {
+      failed_ = true;
+    }
+  }
+
+  ~PitchTask() {
+    if (failed_) {
+      KALDI_WARN << "Failed to compute pitch for utterance "
+                 << utt_;
+      (*num_err_)++;
+      return;
+    }
+    feat_writer_->Write(utt_, features_);
+    if (*num_done_ % 50 == 0 && *num_done_ != 0)
+      KALDI_VLOG(2) << "Processed " << *num_done_ << " utterances";
+    (*num_done_)++;
+  }
+
+ private:
+  const PitchExtractionOptions &pitch_opts_;
+  const ProcessPitchOptions &process_opts_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+  BaseFloatMatrixWriter *feat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool failed_;
+  Matrix<BaseFloat> features_;
+};
+
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -37,11 +90,15 @@ int main(int argc, char *argv[]) {
         "e.g.\n"
         "compute-and-process-kaldi-pitch-feats --simulate-first-pass-online=true \\\n"
         "  --frames-per-chunk=10 --sample-frequency=8000 scp:wav.scp ark:- \n"
+        "With --num-threads > 1, several utterances are processed in parallel\n"
+        "and written out in the original order; use e.g. 'scp,bg:wav.scp' so\n"
+        "that the wav data is also read (and any pipes run) in its own thread.\n"
         "See also: compute-kaldi-pitch-feats, process-kaldi-pitch-feats\n";
 
     ParseOptions po(usage);
     PitchExtractionOptions pitch_opts;
     ProcessPitchOptions process_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     int32 channel = -1; // Note: this isn't configurable because it's not a very
                         // good idea to control it this way: better to extract the
@@ -50,6 +107,7 @@ int main(int argc, char *argv[]) {
 
     pitch_opts.Register(&po);
     process_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -65,6 +123,7 @@ int main(int argc, char *argv[]) {
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
 
     int32 num_done = 0, num_err = 0;
+    TaskSequencer<PitchTask> sequencer(sequencer_config);
     for (; !wav_reader.Done(); wav_reader.Next()) {
       std::string utt = wav_reader.Key();
       const WaveData &wave_data = wav_reader.Value();
@@ -95,22 +154,10 @@ int main(int argc, char *argv[]) {
 
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        ComputeAndProcessKaldiPitch(pitch_opts, process_opts,
-                                    waveform, &features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute pitch for utterance "
-                   << utt;
-        num_err++;
-        continue;
-      }
-
-      feat_writer.Write(utt, features);
-      if (num_done % 50 == 0 && num_done != 0)
-        KALDI_VLOG(2) << "Processed " << num_done << " utterances";
-      num_done++;
+      sequencer.Run(new PitchTask(pitch_opts, process_opts, utt, waveform,
+                                  &feat_writer, &num_done, &num_err));
     }
+    sequencer.Wait();
     KALDI_LOG << "Done " << num_done << " utterances, " << num_err
               << " with errors.";
     return (num_done != 0 ? 0 : 1);
@@ -22,6 +22,93 @@
 #include "feat/feature-mfcc.h"
 #include "feat/wave-reader.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class is used with TaskSequencer to compute the features of several
+// utterances in parallel.  The features are computed in the operator (), in a
+// worker thread, with the task's own copy of the feature computer; the output
+// happens in the destructor, which TaskSequencer calls in the order in which
+// the utterances were read.
+class MfccTask {
+ public:
+  MfccTask(const Mfcc &mfcc, const std::string &utt,
+            const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq,
+            BaseFloat vtln_warp, BaseFloat duration, bool subtract_mean,
+            bool use_energy,
+            BaseFloatMatrixWriter *kaldi_writer,
+            TableWriter<HtkMatrixHolder> *htk_writer,
+            DoubleWriter *utt2dur_writer, int32 *num_success):
+      mfcc_(mfcc), utt_(utt), waveform_(waveform), samp_freq_(samp_freq),
+      vtln_warp_(vtln_warp), duration_(duration),
+      subtract_mean_(subtract_mean), use_energy_(use_energy),
+      kaldi_writer_(kaldi_writer),
+      htk_writer_(htk_writer), utt2dur_writer_(utt2dur_writer),
+      num_success_(num_success), failed_(false) { }
+
+  void operator () () {
+    try {
+      mfcc_.ComputeFeatures(waveform_, samp_freq_, vtln_warp_, &features_);
+    } catch (...) {
+      failed_ = true;
+      return;
+    }
+    if (subtract_mean_) {
+      Vector<BaseFloat> mean(features_.NumCols());
+      mean.AddRowSumMat(1.0, features_);
+      mean.Scale(1.0 / features_.NumRows());
+      for (int32 i = 0; i < features_.NumRows(); i++)
+        features_.Row(i).AddVec(-1.0, mean);
+    }
+  }
+
+  ~MfccTask() {
+    if (failed_) {
+      KALDI_WARN << "Failed to compute features for utterance " << utt_;
+      return;
+    }
+    if (kaldi_writer_->IsOpen()) {
+      kaldi_writer_->Write(utt_, features_);
+    } else {
+      std::pair<Matrix<BaseFloat>, HtkHeader> p;
+      p.first.Resize(features_.NumRows(), features_.NumCols());
+      p.first.CopyFromMat(features_);
+      HtkHeader header = {
+        features_.NumRows(),
+        100000,  // 10ms shift
+        static_cast<int16>(sizeof(float)*(features_.NumCols())),
+        static_cast<uint16>(006 | // MFCC
+        (use_energy_ ? 0100 : 020000)) // energy; otherwise c0
+      };
+      p.second = header;
+      htk_writer_->Write(utt_, p);
+    }
+    if (utt2dur_writer_->IsOpen()) {
+      utt2dur_writer_->Write(utt_, duration_);
+    }
+    KALDI_VLOG(2) << "Processed features for key " << utt_;
+    (*num_success_)++;
+  }
+
+ private:
+  Mfcc mfcc_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+  BaseFloat samp_freq_;
+  BaseFloat vtln_warp_;
+  BaseFloat duration_;
+  bool subtract_mean_;
+  bool use_energy_;  // Only needed for the HTK header.
+  BaseFloatMatrixWriter *kaldi_writer_;
+  TableWriter<HtkMatrixHolder> *htk_writer_;
+  DoubleWriter *utt2dur_writer_;
+  int32 *num_success_;
+  bool failed_;
+  Matrix<BaseFloat> features_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -29,7 +116,10 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Create MFCC feature files.\n"
         "Usage:  compute-mfcc-feats [options...] <wav-rspecifier> "
-        "<feats-wspecifier>\n";
+        "<feats-wspecifier>\n"
+        "With --num-threads > 1, several utterances are processed in parallel\n"
+        "and written out in the original order; use e.g. 'scp,bg:wav.scp' so\n"
+        "that the wav data is also read (and any pipes run) in its own thread.\n";
 
     // Construct all the global objects.
     ParseOptions po(usage);
@@ -43,6 +133,7 @@ int main(int argc, char *argv[]) {
     BaseFloat min_duration = 0.0;
     std::string output_format = "kaldi";
     std::string utt2dur_wspecifier;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     // Register the MFCC option struct.
     mfcc_opts.Register(&po);
@@ -64,6 +155,7 @@ int main(int argc, char *argv[]) {
                 "to process (in seconds).");
     po.Register("write-utt2dur", &utt2dur_wspecifier, "Wspecifier to write "
                 "duration of each utterance in seconds, e.g. 'ark,t:utt2dur'.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -103,6 +195,7 @@ int main(int argc, char *argv[]) {
     DoubleWriter utt2dur_writer(utt2dur_wspecifier);
 
     int32 num_utts = 0, num_success = 0;
+    TaskSequencer<MfccTask> sequencer(sequencer_config);
     for (; !reader.Done(); reader.Next()) {
       num_utts++;
       std::string utt = reader.Key();
@@ -143,45 +236,15 @@ int main(int argc, char *argv[]) {
       }
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        mfcc.ComputeFeatures(waveform, wave_data.SampFreq(),
-                             vtln_warp_local, &features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute features for utterance " << utt;
-        continue;
-      }
-      if (subtract_mean) {
-        Vector<BaseFloat> mean(features.NumCols());
-        mean.AddRowSumMat(1.0, features);
-        mean.Scale(1.0 / features.NumRows());
-        for (int32 i = 0; i < features.NumRows(); i++)
-          features.Row(i).AddVec(-1.0, mean);
-      }
-      if (output_format == "kaldi") {
-        kaldi_writer.Write(utt, features);
-      } else {
-        std::pair<Matrix<BaseFloat>, HtkHeader> p;
-        p.first.Resize(features.NumRows(), features.NumCols());
-        p.first.CopyFromMat(features);
-        HtkHeader header = {
-          features.NumRows(),
-          100000,  // 10ms shift
-          static_cast<int16>(sizeof(float)*(features.NumCols())),
-          static_cast<uint16>( 006 | // MFCC
-          (mfcc_opts.use_energy ? 0100 : 020000)) // energy; otherwise c0
-        };
-        p.second = header;
-        htk_writer.Write(utt, p);
-      }
-      if (utt2dur_writer.IsOpen()) {
-        utt2dur_writer.Write(utt, wave_data.Duration());
-      }
+      sequencer.Run(new MfccTask(mfcc, utt, waveform, wave_data.SampFreq(),
+                                 vtln_warp_local, wave_data.Duration(),
+                                 subtract_mean, mfcc_opts.use_energy,
+                                 &kaldi_writer, &htk_writer, &utt2dur_writer,
+                                 &num_success));
       if (num_utts % 10 == 0)
         KALDI_LOG << "Processed " << num_utts << " utterances";
-      KALDI_VLOG(2) << "Processed features for key " << utt;
-      num_success++;
     }
+    sequencer.Wait();
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
     return (num_success != 0 ? 0 : 1);
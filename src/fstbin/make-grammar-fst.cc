@@ -28,7 +28,8 @@
 template<typename FST>
 void MakeGrammarFst(kaldi::ParseOptions po,
                     int32 nonterm_phones_offset,
-                    bool write_as_grammar){
+                    bool write_as_grammar,
+                    bool align){
   using namespace kaldi;
   using namespace fst;
   using kaldi::int32;
@@ -64,7 +65,9 @@ void MakeGrammarFst(kaldi::ParseOptions po,
 
   if (write_as_grammar) {
     bool binary = true;  // GrammarFst does not support non-binary write.
-    WriteKaldiObject(*grammar_fst, fst_out_str, binary);
+    Output ko(fst_out_str, binary);
+    grammar_fst->Write(ko.Stream(), binary, align);
+    ko.Close();
   } else {
     VectorFst<StdArc> vfst;
     CopyToVectorFst<FST>(grammar_fst, &vfst);
@@ -74,7 +77,9 @@ void MakeGrammarFst(kaldi::ParseOptions po,
     bool binary = true, write_binary_header = false;  // suppress the ^@B
     Output ko(fst_out_str, binary, write_binary_header);
     FstWriteOptions wopts(kaldi::PrintableWxfilename(fst_out_str));
-    cfst.Write(ko.Stream(), wopts);
+    wopts.align = align;
+    if (!cfst.Write(ko.Stream(), wopts))
+      KALDI_ERR << "Error writing FST to " << fst_out_str;
   }
 
   KALDI_LOG << "Created grammar FST and wrote it to "
@@ -121,6 +126,7 @@ int main(int argc, char *argv[]) {
     int32 nonterm_phones_offset = -1;
     bool write_as_grammar = true;
     bool make_mutable = false;
+    bool align = false;
 
     po.Register("nonterm-phones-offset", &nonterm_phones_offset,
                 "Integer id of #nonterm_bos in phones.txt");
@@ -132,6 +138,10 @@ int main(int argc, char *argv[]) {
                 "Make a GrammarFst using StdVectorFst as the "
                 "underlying FST instance type."
                 "Use const ConstFst<StdArc> otherwise.");
+    po.Register("align", &align, "If true, write the FSTs with alignment, "
+                "so that decoders can memory-map them instead of reading "
+                "them into memory.  Requires <fst-out> to be an ordinary "
+                "file.");
 
     po.Read(argc, argv);
 
@@ -156,9 +166,11 @@ int main(int argc, char *argv[]) {
     }
 
     if (make_mutable) {
-      MakeGrammarFst<StdVectorFst>(po, nonterm_phones_offset, write_as_grammar);
+      MakeGrammarFst<StdVectorFst>(po, nonterm_phones_offset, write_as_grammar,
+                                   align);
     } else {
-      MakeGrammarFst<const ConstFst<StdArc> >(po, nonterm_phones_offset, write_as_grammar);
+      MakeGrammarFst<const ConstFst<StdArc> >(po, nonterm_phones_offset,
+                                              write_as_grammar, align);
     }
   } catch(const std::exception &e) {
     std::cerr << e.what();
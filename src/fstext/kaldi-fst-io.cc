@@ -77,6 +77,14 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   }
   // Read the FST
   FstReadOptions ropts("<unspecified>", &hdr);
+  if ((hdr.GetFlags() & FstHeader::IS_ALIGNED) &&
+      kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput) {
+    // OpenFst memory-maps the arrays of aligned ConstFsts if it is told the
+    // name of the file the stream was opened from.  Other FST types ignore
+    // this.
+    ropts.source = rxfilename;
+    ropts.mode = FstReadOptions::MAP;
+  }
   Fst<StdArc> *fst = Fst<StdArc>::Read(ki.Stream(), ropts);
   if (!fst) {
     if(throw_on_err) {
@@ -48,6 +48,13 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
 // (const-fst can give better performance for decoding). Other
 // types could be also loaded if registered inside OpenFst.
+// If 'rxfilename' is an ordinary file and it contains a ConstFst that was
+// written with alignment (e.g. by "fstconvert --fst_type=const --fst_align",
+// see utils/mkgraph.sh), the arrays of the FST are memory-mapped read-only
+// instead of being read onto the heap; this makes loading fast, and lets all
+// processes on a machine that decode with the same graph share one copy of it
+// in the page cache.  Don't overwrite such a file in place while it is in use
+// (write a new file and rename it instead).
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
                                  bool throw_on_err = true);
 
@@ -22,6 +22,7 @@
 using std::vector;
 
 #include "gmm/decodable-am-diag-gmm.h"
+#include "gmm/diag-gmm-kernels.h"
 
 namespace kaldi {
 
@@ -55,11 +56,15 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
         "before computing likelihood.";
   }
 
-  Vector<BaseFloat> loglikes(pdf.gconsts());  // need to recreate for each pdf
-  // loglikes +=  means * inv(vars) * data.
-  loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
-  // loglikes += -0.5 * inv(vars) * data_sq.
-  loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
+  // loglikes_ is only ever grown, so this does not allocate in the common case.
+  int32 num_gauss = pdf.NumGauss();
+  if (loglikes_.Dim() < num_gauss)
+    loglikes_.Resize(num_gauss, kUndefined);
+  SubVector<BaseFloat> loglikes(loglikes_, 0, num_gauss);
+  // loglikes = gconsts + means * inv(vars) * data - 0.5 * inv(vars) * data_sq.
+  DiagGmmComponentLogLikelihoods(pdf.gconsts(), pdf.means_invvars(),
+                                 pdf.inv_vars(), data, data_squared_,
+                                 &loglikes);
 
   BaseFloat log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
   if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
@@ -89,6 +89,7 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
   std::vector<LikelihoodCacheRecord> log_like_cache_;
  private:
   Vector<BaseFloat> data_squared_;  ///< Cache for fast likelihood calculation
+  Vector<BaseFloat> loglikes_;  ///< Per-Gaussian loglikes; may be oversized.
 
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmUnmapped);
@@ -0,0 +1,145 @@
+// gmm/diag-gmm-kernels-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include "base/timer.h"
+#include "gmm/diag-gmm.h"
+#include "gmm/diag-gmm-kernels.h"
+#include "gmm/model-test-common.h"
+
+namespace kaldi {
+
+// The computation the kernels replace, as done previously through BLAS.
+static void ReferenceLogLikelihoods(const DiagGmm &gmm,
+                                    const VectorBase<BaseFloat> &data,
+                                    const VectorBase<BaseFloat> &data_sq,
+                                    Vector<BaseFloat> *loglikes) {
+  loglikes->Resize(gmm.NumGauss(), kUndefined);
+  loglikes->CopyFromVec(gmm.gconsts());
+  loglikes->AddMatVec(1.0, gmm.means_invvars(), kNoTrans, data, 1.0);
+  loglikes->AddMatVec(-0.5, gmm.inv_vars(), kNoTrans, data_sq, 1.0);
+}
+
+static std::vector<DiagGmmKernelType> SupportedKernels() {
+  std::vector<DiagGmmKernelType> ans;
+  DiagGmmKernelType all[] = { kDiagGmmKernelGeneric, kDiagGmmKernelAvx2,
+                              kDiagGmmKernelAvx512 };
+  for (int32 i = 0; i < 3; i++)
+    if (DiagGmmKernelIsSupported(all[i]))
+      ans.push_back(all[i]);
+  return ans;
+}
+
+void UnitTestDiagGmmKernels() {
+  std::vector<DiagGmmKernelType> kernels = SupportedKernels();
+  KALDI_ASSERT(DiagGmmKernelIsSupported(DiagGmmBestKernel()));
+  for (int32 n = 0; n < 50; n++) {
+    // Cover dimensions that are, and are not, multiples of the SIMD width.
+    int32 dim = 1 + Rand() % 70, num_gauss = 1 + Rand() % 30;
+    DiagGmm gmm;
+    unittest::InitRandDiagGmm(dim, num_gauss, &gmm);
+    Vector<BaseFloat> data(dim), data_sq(dim);
+    data.SetRandn();
+    data_sq.CopyFromVec(data);
+    data_sq.ApplyPow(2.0);
+
+    Vector<BaseFloat> ref;
+    ReferenceLogLikelihoods(gmm, data, data_sq, &ref);
+    for (size_t k = 0; k < kernels.size(); k++) {
+      Vector<BaseFloat> loglikes(num_gauss);
+      DiagGmmComponentLogLikelihoods(kernels[k], gmm.gconsts(),
+                                     gmm.means_invvars(), gmm.inv_vars(),
+                                     data, data_sq, &loglikes);
+      AssertEqual(ref, loglikes, 1.0e-04);
+    }
+
+    // Sub-ranges of the parameter matrices have a stride that differs from
+    // their number of columns; LogLikelihoodsPreselect() uses those.
+    std::vector<int32> indices;
+    int32 start = Rand() % num_gauss, end = start + Rand() % (num_gauss - start);
+    for (int32 i = start; i <= end; i++)
+      indices.push_back(i);
+    Vector<BaseFloat> preselect_loglikes, all_loglikes;
+    gmm.LogLikelihoodsPreselect(data, indices, &preselect_loglikes);
+    gmm.LogLikelihoods(data, &all_loglikes);
+    AssertEqual(ref, all_loglikes, 1.0e-04);
+    SubVector<BaseFloat> ref_part(ref, start, end + 1 - start);
+    AssertEqual(ref_part, preselect_loglikes, 1.0e-04);
+  }
+}
+
+// Compares the speed of the kernels with that of the BLAS-based computation,
+// on a model of about the size of a typical triphone system, evaluating
+// every pdf on each frame as DecodableAmDiagGmm would with all pdfs active.
+void UnitTestDiagGmmKernelsSpeed() {
+  int32 num_pdfs = 500, num_gauss = 20, dim = 39, num_frames = 50;
+  std::vector<DiagGmm> gmms(num_pdfs);
+  for (int32 p = 0; p < num_pdfs; p++)
+    unittest::InitRandDiagGmm(dim, num_gauss, &gmms[p]);
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+
+  BaseFloat ref_tot = 0.0;
+  double ref_time;
+  {
+    Timer timer;
+    Vector<BaseFloat> data_sq(dim), loglikes;
+    for (int32 t = 0; t < num_frames; t++) {
+      data_sq.CopyFromVec(feats.Row(t));
+      data_sq.ApplyPow(2.0);
+      for (int32 p = 0; p < num_pdfs; p++) {
+        ReferenceLogLikelihoods(gmms[p], feats.Row(t), data_sq, &loglikes);
+        ref_tot += loglikes.LogSumExp();
+      }
+    }
+    ref_time = timer.Elapsed();
+  }
+  KALDI_LOG << "For BLAS-based computation, time taken is " << ref_time;
+
+  std::vector<DiagGmmKernelType> kernels = SupportedKernels();
+  for (size_t k = 0; k < kernels.size(); k++) {
+    BaseFloat tot = 0.0;
+    Timer timer;
+    Vector<BaseFloat> data_sq(dim), loglikes(num_gauss);
+    for (int32 t = 0; t < num_frames; t++) {
+      data_sq.CopyFromVec(feats.Row(t));
+      data_sq.ApplyPow(2.0);
+      for (int32 p = 0; p < num_pdfs; p++) {
+        DiagGmmComponentLogLikelihoods(kernels[k], gmms[p].gconsts(),
+                                       gmms[p].means_invvars(),
+                                       gmms[p].inv_vars(), feats.Row(t),
+                                       data_sq, &loglikes);
+        tot += loglikes.LogSumExp();
+      }
+    }
+    double time = timer.Elapsed();
+    KALDI_LOG << "For kernel " << DiagGmmKernelName(kernels[k])
+              << ", time taken is " << time << ", speedup vs. BLAS is "
+              << (ref_time / time);
+    KALDI_ASSERT(ApproxEqual(tot, ref_tot, 1.0e-04));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::UnitTestDiagGmmKernels();
+  kaldi::UnitTestDiagGmmKernelsSpeed();
+  KALDI_LOG << "Test OK.";
+  return 0;
+}
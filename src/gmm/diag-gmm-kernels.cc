@@ -0,0 +1,238 @@
+// gmm/diag-gmm-kernels.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/diag-gmm-kernels.h"
+
+// The x86 kernels are compiled with per-function target attributes, so the
+// rest of the build does not need -mavx2 etc. and the same binary runs on
+// older machines.  They only exist for single precision.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ >= 7) && (KALDI_DOUBLEPRECISION == 0)
+#define KALDI_DIAG_GMM_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The arguments of all kernels: 'gconsts', 'means_invvars' and 'inv_vars'
+// point to DiagGmm's parameters (the two matrices with row strides
+// 'mi_stride' and 'iv_stride'); 'data' and 'data_sq' are the feature vector
+// and its square; 'loglikes' is the output.
+template<typename Real>
+void ComponentLogLikelihoodsGeneric(
+    int32 num_gauss, int32 dim, const Real *gconsts,
+    const Real *means_invvars, MatrixIndexT mi_stride,
+    const Real *inv_vars, MatrixIndexT iv_stride,
+    const Real *data, const Real *data_sq, Real *loglikes) {
+  for (int32 i = 0; i < num_gauss; i++) {
+    const Real *mi = means_invvars + i * mi_stride,
+        *iv = inv_vars + i * iv_stride;
+    Real linear = 0.0, quadratic = 0.0;
+    for (int32 d = 0; d < dim; d++) {
+      linear += mi[d] * data[d];
+      quadratic += iv[d] * data_sq[d];
+    }
+    loglikes[i] = gconsts[i] + linear - 0.5 * quadratic;
+  }
+}
+
+#ifdef KALDI_DIAG_GMM_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+void ComponentLogLikelihoodsAvx2(
+    int32 num_gauss, int32 dim, const float *gconsts,
+    const float *means_invvars, MatrixIndexT mi_stride,
+    const float *inv_vars, MatrixIndexT iv_stride,
+    const float *data, const float *data_sq, float *loglikes) {
+  // Mask for the last (dim % 8) elements, which are loaded with maskload so
+  // that we never read past the end of a row.
+  static const int32 kMaskTable[16] = { -1, -1, -1, -1, -1, -1, -1, -1,
+                                        0, 0, 0, 0, 0, 0, 0, 0 };
+  const int32 dim_round = dim & ~7, tail = dim - dim_round;
+  const __m256i tail_mask = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(kMaskTable + 8 - tail));
+  const __m256 minus_half = _mm256_set1_ps(-0.5f);
+  for (int32 i = 0; i < num_gauss; i++) {
+    const float *mi = means_invvars + i * mi_stride,
+        *iv = inv_vars + i * iv_stride;
+    __m256 linear = _mm256_setzero_ps(), quadratic = _mm256_setzero_ps();
+    for (int32 d = 0; d < dim_round; d += 8) {
+      linear = _mm256_fmadd_ps(_mm256_loadu_ps(mi + d),
+                               _mm256_loadu_ps(data + d), linear);
+      quadratic = _mm256_fmadd_ps(_mm256_loadu_ps(iv + d),
+                                  _mm256_loadu_ps(data_sq + d), quadratic);
+    }
+    if (tail != 0) {
+      linear = _mm256_fmadd_ps(
+          _mm256_maskload_ps(mi + dim_round, tail_mask),
+          _mm256_maskload_ps(data + dim_round, tail_mask), linear);
+      quadratic = _mm256_fmadd_ps(
+          _mm256_maskload_ps(iv + dim_round, tail_mask),
+          _mm256_maskload_ps(data_sq + dim_round, tail_mask), quadratic);
+    }
+    __m256 sum8 = _mm256_fmadd_ps(minus_half, quadratic, linear);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8),
+                             _mm256_extractf128_ps(sum8, 1));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_movehdup_ps(sum4));
+    loglikes[i] = gconsts[i] + _mm_cvtss_f32(sum4);
+  }
+  // The rest of Kaldi is compiled for SSE; leaving the upper halves of the
+  // vector registers dirty makes subsequent SSE code (e.g. the expf() in
+  // LogSumExp()) many times slower on some CPUs.
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx512f")))
+void ComponentLogLikelihoodsAvx512(
+    int32 num_gauss, int32 dim, const float *gconsts,
+    const float *means_invvars, MatrixIndexT mi_stride,
+    const float *inv_vars, MatrixIndexT iv_stride,
+    const float *data, const float *data_sq, float *loglikes) {
+  const int32 dim_round = dim & ~15, tail = dim - dim_round;
+  const __mmask16 tail_mask = static_cast<__mmask16>((1u << tail) - 1);
+  const __m512 minus_half = _mm512_set1_ps(-0.5f);
+  for (int32 i = 0; i < num_gauss; i++) {
+    const float *mi = means_invvars + i * mi_stride,
+        *iv = inv_vars + i * iv_stride;
+    __m512 linear = _mm512_setzero_ps(), quadratic = _mm512_setzero_ps();
+    for (int32 d = 0; d < dim_round; d += 16) {
+      linear = _mm512_fmadd_ps(_mm512_loadu_ps(mi + d),
+                               _mm512_loadu_ps(data + d), linear);
+      quadratic = _mm512_fmadd_ps(_mm512_loadu_ps(iv + d),
+                                  _mm512_loadu_ps(data_sq + d), quadratic);
+    }
+    if (tail != 0) {
+      linear = _mm512_fmadd_ps(
+          _mm512_maskz_loadu_ps(tail_mask, mi + dim_round),
+          _mm512_maskz_loadu_ps(tail_mask, data + dim_round), linear);
+      quadratic = _mm512_fmadd_ps(
+          _mm512_maskz_loadu_ps(tail_mask, iv + dim_round),
+          _mm512_maskz_loadu_ps(tail_mask, data_sq + dim_round), quadratic);
+    }
+    __m512 sum16 = _mm512_fmadd_ps(minus_half, quadratic, linear);
+    // We do the horizontal sum by hand: with GCC 12, _mm512_reduce_add_ps()
+    // and the intrinsics that take the halves of a 512-bit register give
+    // spurious -Wmaybe-uninitialized warnings, so we go through memory.
+    alignas(64) float sum16_array[16];
+    _mm512_store_ps(sum16_array, sum16);
+    __m128 sum4 = _mm_add_ps(
+        _mm_add_ps(_mm_load_ps(sum16_array), _mm_load_ps(sum16_array + 4)),
+        _mm_add_ps(_mm_load_ps(sum16_array + 8),
+                   _mm_load_ps(sum16_array + 12)));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_movehdup_ps(sum4));
+    loglikes[i] = gconsts[i] + _mm_cvtss_f32(sum4);
+  }
+  _mm256_zeroupper();  // See ComponentLogLikelihoodsAvx2().
+}
+
+#endif  // KALDI_DIAG_GMM_X86_KERNELS
+
+}  // namespace
+
+
+bool DiagGmmKernelIsSupported(DiagGmmKernelType kernel) {
+  switch (kernel) {
+    case kDiagGmmKernelGeneric:
+      return true;
+#ifdef KALDI_DIAG_GMM_X86_KERNELS
+    case kDiagGmmKernelAvx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case kDiagGmmKernelAvx512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+DiagGmmKernelType DiagGmmBestKernel() {
+  // Worked out once; initialization of function-local statics is
+  // thread-safe.
+  static const DiagGmmKernelType best =
+      DiagGmmKernelIsSupported(kDiagGmmKernelAvx512) ? kDiagGmmKernelAvx512 :
+      (DiagGmmKernelIsSupported(kDiagGmmKernelAvx2) ? kDiagGmmKernelAvx2 :
+       kDiagGmmKernelGeneric);
+  return best;
+}
+
+const char *DiagGmmKernelName(DiagGmmKernelType kernel) {
+  switch (kernel) {
+    case kDiagGmmKernelGeneric: return "generic";
+    case kDiagGmmKernelAvx2: return "avx2";
+    case kDiagGmmKernelAvx512: return "avx512";
+    default: return "unknown";
+  }
+}
+
+void DiagGmmComponentLogLikelihoods(const VectorBase<BaseFloat> &gconsts,
+                                    const MatrixBase<BaseFloat> &means_invvars,
+                                    const MatrixBase<BaseFloat> &inv_vars,
+                                    const VectorBase<BaseFloat> &data,
+                                    const VectorBase<BaseFloat> &data_squared,
+                                    VectorBase<BaseFloat> *loglikes) {
+  DiagGmmComponentLogLikelihoods(DiagGmmBestKernel(), gconsts, means_invvars,
+                                 inv_vars, data, data_squared, loglikes);
+}
+
+void DiagGmmComponentLogLikelihoods(DiagGmmKernelType kernel,
+                                    const VectorBase<BaseFloat> &gconsts,
+                                    const MatrixBase<BaseFloat> &means_invvars,
+                                    const MatrixBase<BaseFloat> &inv_vars,
+                                    const VectorBase<BaseFloat> &data,
+                                    const VectorBase<BaseFloat> &data_squared,
+                                    VectorBase<BaseFloat> *loglikes) {
+  int32 num_gauss = gconsts.Dim(), dim = data.Dim();
+  KALDI_ASSERT(means_invvars.NumRows() == num_gauss &&
+               inv_vars.NumRows() == num_gauss &&
+               means_invvars.NumCols() == dim && inv_vars.NumCols() == dim &&
+               data_squared.Dim() == dim && loglikes->Dim() == num_gauss);
+  if (kernel != DiagGmmBestKernel() && !DiagGmmKernelIsSupported(kernel))
+    KALDI_ERR << "Diagonal-GMM kernel " << DiagGmmKernelName(kernel)
+              << " is not supported on this machine.";
+  switch (kernel) {
+#ifdef KALDI_DIAG_GMM_X86_KERNELS
+    case kDiagGmmKernelAvx2:
+      ComponentLogLikelihoodsAvx2(
+          num_gauss, dim, gconsts.Data(), means_invvars.Data(),
+          means_invvars.Stride(), inv_vars.Data(), inv_vars.Stride(),
+          data.Data(), data_squared.Data(), loglikes->Data());
+      return;
+    case kDiagGmmKernelAvx512:
+      ComponentLogLikelihoodsAvx512(
+          num_gauss, dim, gconsts.Data(), means_invvars.Data(),
+          means_invvars.Stride(), inv_vars.Data(), inv_vars.Stride(),
+          data.Data(), data_squared.Data(), loglikes->Data());
+      return;
+#endif
+    case kDiagGmmKernelGeneric:
+      ComponentLogLikelihoodsGeneric(
+          num_gauss, dim, gconsts.Data(), means_invvars.Data(),
+          means_invvars.Stride(), inv_vars.Data(), inv_vars.Stride(),
+          data.Data(), data_squared.Data(), loglikes->Data());
+      return;
+    default:
+      KALDI_ERR << "Invalid diagonal-GMM kernel " << static_cast<int>(kernel);
+  }
+}
+
+}  // End namespace kaldi
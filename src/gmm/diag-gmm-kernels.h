@@ -0,0 +1,80 @@
+// gmm/diag-gmm-kernels.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GMM_DIAG_GMM_KERNELS_H_
+#define KALDI_GMM_DIAG_GMM_KERNELS_H_
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+namespace kaldi {
+
+/// This file contains the inner loop of diagonal-GMM likelihood evaluation,
+/// which dominates the time taken by GMM-based decoding and alignment.  The
+/// two matrix-vector products that DiagGmm::LogLikelihoods() does through
+/// BLAS are fused into one pass over the parameters; this matters because
+/// the matrices involved (#Gaussians by feature-dim, typically something
+/// like 20 by 40) are too small for BLAS to be efficient on.  On x86 there
+/// are AVX2 and AVX-512 versions, chosen at run time according to what the
+/// CPU supports, so the binaries do not need to be compiled for a
+/// particular machine.
+
+/// Identifies an implementation of DiagGmmComponentLogLikelihoods().
+enum DiagGmmKernelType {
+  kDiagGmmKernelGeneric = 0,  ///< Portable C++; always available.
+  kDiagGmmKernelAvx2 = 1,     ///< x86 AVX2 + FMA, single precision only.
+  kDiagGmmKernelAvx512 = 2    ///< x86 AVX-512F, single precision only.
+};
+
+/// Returns true if 'kernel' can be used in this build on this machine.
+bool DiagGmmKernelIsSupported(DiagGmmKernelType kernel);
+
+/// Returns the fastest kernel that DiagGmmKernelIsSupported(); this is what
+/// the version of DiagGmmComponentLogLikelihoods() without a 'kernel'
+/// argument uses.
+DiagGmmKernelType DiagGmmBestKernel();
+
+/// Returns a printable name for 'kernel', e.g. "avx2".
+const char *DiagGmmKernelName(DiagGmmKernelType kernel);
+
+/// Computes the per-Gaussian log-likelihoods of a diagonal GMM stored in the
+/// form DiagGmm uses, i.e. for each Gaussian i,
+///   (*loglikes)(i) = gconsts(i) + means_invvars.Row(i) * data
+///                     - 0.5 * inv_vars.Row(i) * data_squared,
+/// where data_squared must contain the elementwise square of 'data' (callers
+/// that evaluate many GMMs on the same frame compute it once).
+/// 'loglikes' must already have the right dimension.
+void DiagGmmComponentLogLikelihoods(const VectorBase<BaseFloat> &gconsts,
+                                    const MatrixBase<BaseFloat> &means_invvars,
+                                    const MatrixBase<BaseFloat> &inv_vars,
+                                    const VectorBase<BaseFloat> &data,
+                                    const VectorBase<BaseFloat> &data_squared,
+                                    VectorBase<BaseFloat> *loglikes);
+
+/// As above, but using a specific kernel, which must be supported; this is
+/// intended for testing and benchmarking.
+void DiagGmmComponentLogLikelihoods(DiagGmmKernelType kernel,
+                                    const VectorBase<BaseFloat> &gconsts,
+                                    const MatrixBase<BaseFloat> &means_invvars,
+                                    const MatrixBase<BaseFloat> &inv_vars,
+                                    const VectorBase<BaseFloat> &data,
+                                    const VectorBase<BaseFloat> &data_squared,
+                                    VectorBase<BaseFloat> *loglikes);
+
+}  // End namespace kaldi
+
+#endif  // KALDI_GMM_DIAG_GMM_KERNELS_H_
@@ -28,6 +28,7 @@
 #include <vector>
 
 #include "gmm/diag-gmm.h"
+#include "gmm/diag-gmm-kernels.h"
 #include "gmm/diag-gmm-normal.h"
 #include "gmm/full-gmm.h"
 #include "gmm/full-gmm-normal.h"
@@ -528,7 +529,6 @@ BaseFloat DiagGmm::LogLikelihood(const VectorBase<BaseFloat> &data) const {
 void DiagGmm::LogLikelihoods(const VectorBase<BaseFloat> &data,
                              Vector<BaseFloat> *loglikes) const {
   loglikes->Resize(gconsts_.Dim(), kUndefined);
-  loglikes->CopyFromVec(gconsts_);
   if (data.Dim() != Dim()) {
     KALDI_ERR << "DiagGmm::LogLikelihoods, dimension "
               << "mismatch " << data.Dim() << " vs. "<< Dim();
@@ -536,10 +536,9 @@ void DiagGmm::LogLikelihoods(const VectorBase<BaseFloat> &data,
   Vector<BaseFloat> data_sq(data);
   data_sq.ApplyPow(2.0);
 
-  // loglikes +=  means * inv(vars) * data.
-  loglikes->AddMatVec(1.0, means_invvars_, kNoTrans, data, 1.0);
-  // loglikes += -0.5 * inv(vars) * data_sq.
-  loglikes->AddMatVec(-0.5, inv_vars_, kNoTrans, data_sq, 1.0);
+  // loglikes = gconsts + means * inv(vars) * data - 0.5 * inv(vars) * data_sq.
+  DiagGmmComponentLogLikelihoods(gconsts_, means_invvars_, inv_vars_,
+                                 data, data_sq, loglikes);
 }
 
 
@@ -575,15 +574,13 @@ void DiagGmm::LogLikelihoodsPreselect(const VectorBase<BaseFloat> &data,
   if (indices.back() + 1 - indices.front() == num_indices) {
     // A special (but common) case when the indices form a contiguous range.
     int32 start_idx = indices.front();
-    loglikes->CopyFromVec(SubVector<BaseFloat>(gconsts_, start_idx, num_indices));
-    // loglikes +=  means * inv(vars) * data.
     SubMatrix<BaseFloat> means_invvars_sub(means_invvars_, start_idx, num_indices,
                                            0, Dim());
-    loglikes->AddMatVec(1.0, means_invvars_sub, kNoTrans, data, 1.0);
     SubMatrix<BaseFloat> inv_vars_sub(inv_vars_, start_idx, num_indices,
                                       0, Dim());
-    // loglikes += -0.5 * inv(vars) * data_sq.
-    loglikes->AddMatVec(-0.5, inv_vars_sub, kNoTrans, data_sq, 1.0);
+    DiagGmmComponentLogLikelihoods(
+        SubVector<BaseFloat>(gconsts_, start_idx, num_indices),
+        means_invvars_sub, inv_vars_sub, data, data_sq, loglikes);
   } else {
     for (int32 i = 0; i < num_indices; i++) {
       int32 idx = indices[i];  // The Gaussian index.
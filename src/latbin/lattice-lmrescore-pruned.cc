@@ -26,6 +26,110 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; the work is done in operator (), possibly in a
+// separate thread, and the output is written in the destructor (see
+// TaskSequencer).  The LMs are shared read-only between tasks, but each task
+// owns its DeterministicOnDemandFst wrappers, since those cache states.
+class PrunedRescoreTask {
+ public:
+  // Takes ownership of "clat".  Exactly one of "lm_to_add_fst" and
+  // "const_arpa" is expected to be non-NULL.
+  PrunedRescoreTask(const ComposeLatticePrunedOptions &compose_opts,
+                    BaseFloat lm_scale,
+                    BaseFloat acoustic_scale,
+                    const fst::VectorFst<fst::StdArc> &lm_to_subtract_fst,
+                    const fst::VectorFst<fst::StdArc> *lm_to_add_fst,
+                    const ConstArpaLm *const_arpa,
+                    const std::string &key,
+                    CompactLattice *clat,
+                    CompactLatticeWriter *clat_writer,
+                    int32 *num_done,
+                    int32 *num_err):
+      compose_opts_(compose_opts), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale),
+      lm_to_subtract_fst_(lm_to_subtract_fst), lm_to_add_fst_(lm_to_add_fst),
+      const_arpa_(const_arpa), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    using fst::StdArc;
+    fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
+        lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
+        -lm_scale_, &lm_to_subtract_det_backoff);
+
+    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
+        *lm_to_add = NULL;
+    if (const_arpa_ != NULL) {
+      lm_to_add = new ConstArpaLmDeterministicFst(*const_arpa_);
+    } else {
+      lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *lm_to_add_fst_);
+    }
+    if (lm_scale_ != 1.0) {
+      lm_to_add_orig = lm_to_add;
+      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale_,
+                                                         lm_to_add_orig);
+    }
+
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    // It shouldn't make a difference in which order we provide the
+    // arguments to the composition; either way should work.  They are both
+    // acceptors so the result is the same either way.
+    fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
+        &lm_to_subtract_det_scale, lm_to_add);
+
+    ComposeCompactLatticePruned(compose_opts_,
+                                *clat_,
+                                &combined_lms,
+                                &composed_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    delete lm_to_add_orig;
+    delete lm_to_add;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~PrunedRescoreTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+    delete clat_;
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  const fst::VectorFst<fst::StdArc> &lm_to_subtract_fst_;
+  const fst::VectorFst<fst::StdArc> *lm_to_add_fst_;
+  const ConstArpaLm *const_arpa_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  CompactLattice composed_clat_;  // The output of our process.  Will be
+                                  // written to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -44,7 +148,9 @@ int main(int argc, char *argv[]) {
         "language model is expected to be an FST, e.g. G.fst; the second one can\n"
         "either be in FST or const-arpa format.  Any FST-format language models will\n"
         "be projected on their output by this program, making it unnecessary for the\n"
-        "caller to remove disambiguation symbols.\n"
+        "caller to remove disambiguation symbols.  With --num-threads > 1,\n"
+        "lattices are rescored in parallel and written out in their original\n"
+        "order.\n"
         "\n"
         "Usage: lattice-lmrescore-pruned [options] <lm-to-subtract> <lm-to-add> <lattice-rspecifier> <lattice-wspecifier>\n"
         " e.g.: lattice-lmrescore-pruned --acoustic-scale=0.1 \\\n"
@@ -60,6 +166,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,6 +176,7 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected "
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
+    sequencer_config.Register(&po);
 
 
     po.Read(argc, argv);
@@ -89,32 +197,15 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_add_fst = NULL;
     ConstArpaLm const_arpa;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      const_arpa.ReadMapped(lm_to_add_rxfilename);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
-    fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
-        *lm_to_subtract_fst);
-    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
-        -lm_scale, &lm_to_subtract_det_backoff);
-
-
-    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
-        *lm_to_add = NULL;
-    if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
-    } else {
-      lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
-          *lm_to_add_fst);
-    }
-    if (lm_scale != 1.0) {
-      lm_to_add_orig = lm_to_add;
-      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
-                                                         lm_to_add_orig);
-    }
-
     KALDI_LOG << "Done.";
 
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
     // We read and write as CompactLattice.
     SequentialCompactLatticeReader clat_reader(lats_rspecifier);
 
@@ -123,47 +214,24 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice &clat = clat_reader.Value();
-
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      // To avoid memory gradually increasing with time, we reconstruct the
-      // composed-LM FST for each lattice we process.
-      //   It shouldn't make a difference in which order we provide the
-      // arguments to the composition; either way should work.  They are both
-      // acceptors so the result is the same either way.
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          &lm_to_subtract_det_scale, lm_to_add);
-
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts,
-                                  clat,
-                                  &combined_lms,
-                                  &composed_clat);
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    {
+      // The lattices are rescored in parallel (if --num-threads > 1), but
+      // written in the same order as they were read.
+      TaskSequencer<PrunedRescoreTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        // Will give ownership to "task" below.
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new PrunedRescoreTask(
+            compose_opts, lm_scale, acoustic_scale, *lm_to_subtract_fst,
+            lm_to_add_fst, (add_const_arpa ? &const_arpa : NULL), key, clat,
+            &compact_lattice_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
-    delete lm_to_add_orig;
-    delete lm_to_add;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -0,0 +1,124 @@
+// lm/const-arpa-lm-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//  http://www.apache.org/licenses/LICENSE-2.0
+
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "lm/const-arpa-lm.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+// Same as test_data/input.arpa, with words mapped to integers:
+// <s> = 1, </s> = 2, a = 3, b = 4.
+static const char *kIntegerArpa =
+    "\\data\\\n"
+    "ngram 1=4\n"
+    "ngram 2=2\n"
+    "ngram 3=2\n"
+    "\n"
+    "\\1-grams:\n"
+    "-5.234679\t3 -3.3\n"
+    "-3.456783\t4\n"
+    "0.0000000\t1 -2.5\n"
+    "-4.333333\t2\n"
+    "\n"
+    "\\2-grams:\n"
+    "-1.45678\t3 4 -3.23\n"
+    "-1.30490\t1 3 -4.2\n"
+    "\n"
+    "\\3-grams:\n"
+    "-0.34958\t1 3 4\n"
+    "-0.23940\t3 4 2\n"
+    "\n"
+    "\\end\\\n";
+
+// Checks that 'lm1' and 'lm2' give the same probabilities for all n-grams
+// over the vocabulary.
+static void AssertSameLm(const ConstArpaLm &lm1, const ConstArpaLm &lm2) {
+  KALDI_ASSERT(lm1.NgramOrder() == lm2.NgramOrder());
+  for (int32 w1 = 1; w1 <= 4; w1++) {
+    for (int32 w2 = 1; w2 <= 4; w2++) {
+      for (int32 w3 = 1; w3 <= 4; w3++) {
+        std::vector<int32> hist;
+        hist.push_back(w1);
+        hist.push_back(w2);
+        KALDI_ASSERT(lm1.GetNgramLogprob(w3, hist) ==
+                     lm2.GetNgramLogprob(w3, hist));
+        KALDI_ASSERT(lm1.HistoryStateExists(hist) ==
+                     lm2.HistoryStateExists(hist));
+      }
+    }
+  }
+}
+
+void UnitTestConstArpaLmReadMapped() {
+  std::string arpa_filename = "tmp.const-arpa-lm-test.arpa",
+      lm_filename = "tmp.const-arpa-lm-test.carpa",
+      lm_filename2 = "tmp.const-arpa-lm-test.carpa2";
+  {
+    std::ofstream os(arpa_filename.c_str());
+    os << kIntegerArpa;
+  }
+  ArpaParseOptions options;
+  options.bos_symbol = 1;
+  options.eos_symbol = 2;
+  BuildConstArpaLm(options, arpa_filename, lm_filename);
+
+  ConstArpaLm lm_read, lm_mapped, lm_stream;
+  ReadKaldiObject(lm_filename, &lm_read);
+  lm_mapped.ReadMapped(lm_filename);
+  AssertSameLm(lm_read, lm_mapped);
+
+  // Writing to a stream that is not at the start of a file exercises the
+  // padding; the result must still be readable, by Read() and ReadMapped().
+  {
+    std::ostringstream os;
+    os << "xyz";
+    lm_read.Write(os, true);
+    std::istringstream is(os.str());
+    is.ignore(3);
+    lm_stream.Read(is, true);
+    AssertSameLm(lm_read, lm_stream);
+  }
+  // A memory-mapped LM can be written out again (to another file; the mapped
+  // file must not be overwritten).
+  {
+    Output ko(lm_filename2, true);
+    lm_mapped.Write(ko.Stream(), true);
+    ko.Close();
+  }
+  ConstArpaLm lm_remapped;
+  lm_remapped.ReadMapped(lm_filename2);
+  AssertSameLm(lm_read, lm_remapped);
+
+  std::remove(arpa_filename.c_str());
+  std::remove(lm_filename.c_str());
+  std::remove(lm_filename2.c_str());
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::UnitTestConstArpaLmReadMapped();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
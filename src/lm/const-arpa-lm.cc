@@ -18,10 +18,18 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <utility>
 
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "base/kaldi-math.h"
 #include "lm/arpa-file-parser.h"
 #include "lm/const-arpa-lm.h"
@@ -510,7 +518,23 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, ngram_order_);
   WriteToken(os, binary, "</LmInfo>");
 
-  // LmStates section.
+  // LmStates section. If we know the position in the file, we insert spaces
+  // before the <LmStates> token (they are skipped when reading the token) so
+  // that the array itself starts at an aligned offset; see ReadMapped().
+  int64 pos = os.tellp();
+  if (pos >= 0) {
+    // Bytes from the start of the <LmStates> token to the start of the array:
+    // the token and its trailing space, then <lm_states_size_> as written by
+    // WriteBasicType(), which is a size byte followed by the int64.
+    int64 header_size = std::strlen("<LmStates> ") + 1 + sizeof(int64);
+    int64 num_pad = (kLmStatesAlignment -
+                     (pos + header_size) % kLmStatesAlignment) %
+        kLmStatesAlignment;
+    for (int64 i = 0; i < num_pad; i++)
+      os.put(' ');
+  } else {
+    os.clear();  // tellp() may set the fail bit on non-seekable streams.
+  }
   WriteToken(os, binary, "<LmStates>");
   WriteBasicType(os, binary, lm_states_size_);
   os.write(reinterpret_cast<char *>(lm_states_),
@@ -584,7 +608,66 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   }
 }
 
-void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
+void ConstArpaLm::ReadMapped(const std::string &rxfilename) {
+  KALDI_ASSERT(!initialized_);
+  bool binary;
+  Input ki(rxfilename, &binary);
+  if (!binary) {
+    KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
+  }
+  if (ki.Stream().peek() == 4) {  // Old on-disk format; never aligned.
+    ReadInternalOldFormat(ki.Stream(), binary);
+  } else {
+    ReadInternal(ki.Stream(), binary,
+                 ClassifyRxfilename(rxfilename) == kFileInput ? rxfilename
+                 : "");
+  }
+}
+
+bool ConstArpaLm::MapLmStates(const std::string &source, int64 offset) {
+#ifndef _MSC_VER
+  if (offset % kLmStatesAlignment != 0) return false;
+  int fd = open(source.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+  // mmap() requires the offset to be a multiple of the page size, so we map
+  // from the start of the page that contains <offset>.
+  int64 page_size = sysconf(_SC_PAGESIZE),
+      page_offset = offset % page_size;
+  size_t size = page_offset + sizeof(int32) * lm_states_size_;
+  void *region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd,
+                      offset - page_offset);
+  close(fd);
+  if (region == MAP_FAILED) {
+    KALDI_WARN << "Failed to memory-map LM states from " << source
+               << ", reading them instead: " << strerror(errno);
+    return false;
+  }
+  mapped_region_ = region;
+  mapped_region_size_ = size;
+  lm_states_ = reinterpret_cast<int32*>(static_cast<char*>(region) +
+                                        page_offset);
+  return true;
+#else
+  return false;
+#endif
+}
+
+ConstArpaLm::~ConstArpaLm() {
+  if (memory_assigned_) {
+    if (mapped_region_ != NULL) {
+#ifndef _MSC_VER
+      munmap(mapped_region_, mapped_region_size_);
+#endif
+    } else {
+      delete[] lm_states_;
+    }
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+  }
+}
+
+void ConstArpaLm::ReadInternal(std::istream &is, bool binary,
+                               const std::string &source) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
@@ -603,9 +686,14 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   // LmStates section.
   ExpectToken(is, binary, "<LmStates>");
   ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
-  is.read(reinterpret_cast<char *>(lm_states_),
-          sizeof(int32) * lm_states_size_);
+  int64 pos = source.empty() ? -1 : static_cast<int64>(is.tellg());
+  if (pos >= 0 && MapLmStates(source, pos)) {
+    is.seekg(pos + sizeof(int32) * lm_states_size_, std::ios::beg);
+  } else {
+    lm_states_ = new int32[lm_states_size_];
+    is.read(reinterpret_cast<char *>(lm_states_),
+            sizeof(int32) * lm_states_size_);
+  }
   if (!is.good()) {
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
   }
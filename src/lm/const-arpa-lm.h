@@ -220,6 +220,8 @@ class ConstArpaLm {
     memory_assigned_ = false;
     initialized_ = false;
     ngram_order_ = 0;
+    mapped_region_ = NULL;
+    mapped_region_size_ = 0;
   }
 
   // Special constructor, will be used when you initialize ConstArpaLm from
@@ -245,23 +247,35 @@ class ConstArpaLm {
     lm_states_end_ = lm_states_ + lm_states_size_ - 1;
     memory_assigned_ = false;
     initialized_ = true;
+    mapped_region_ = NULL;
+    mapped_region_size_ = 0;
   }
 
-  ~ConstArpaLm() {
-    if (memory_assigned_) {
-      delete[] lm_states_;
-      delete[] unigram_states_;
-      delete[] overflow_buffer_;
-    }
-  }
+  ~ConstArpaLm();
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
   // ReadInternalOldFormat() to do the actual reading.
   void Read(std::istream &is, bool binary);
 
-  // Writes the language model in ConstArpaLm format.
+  // Reads the ConstArpaLm format language model from <rxfilename>. This is
+  // like ReadKaldiObject(rxfilename, this), except that if <rxfilename> is an
+  // ordinary file and its <LmStates> section is aligned (see Write()), the LM
+  // states are memory-mapped read-only instead of being read onto the heap.
+  // This makes loading a large LM almost instant, and all processes on a
+  // machine that use the same LM share one copy of it in the page cache. The
+  // file must not be modified in place while it is mapped.
+  void ReadMapped(const std::string &rxfilename);
+
+  // Writes the language model in ConstArpaLm format. If the stream is seekable
+  // (e.g. an ordinary file), the <LmStates> array is aligned to a multiple of
+  // kLmStatesAlignment bytes from the start of the file, by padding with
+  // whitespace that older versions of Read() skip; this allows ReadMapped()
+  // to memory-map it.
   void Write(std::ostream &os, bool binary) const;
 
+  // Alignment, in bytes, of the <LmStates> array in files written by Write().
+  static const int32 kLmStatesAlignment = 64;
+
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
   void WriteArpa(std::ostream &os) const;
@@ -281,8 +295,15 @@ class ConstArpaLm {
   bool Initialized() const { return initialized_; }
 
  private:
-  // Function that loads data from stream to the class.
-  void ReadInternal(std::istream &is, bool binary);
+  // Function that loads data from stream to the class. If <source> is
+  // nonempty, it is the name of the file that <is> was opened from, and
+  // the LM states will be memory-mapped from it if they are aligned.
+  void ReadInternal(std::istream &is, bool binary,
+                    const std::string &source = "");
+
+  // Memory-maps the <lm_states_> array, which starts at byte <offset> of the
+  // file <source>. Returns false (and does nothing) if this is not possible.
+  bool MapLmStates(const std::string &source, int64 offset);
 
   // Function that loads data from stream to the class. This is a deprecated one
   // that handles the old on-disk format. We keep this for back-compatibility
@@ -327,6 +348,12 @@ class ConstArpaLm {
   // the destructor.
   bool memory_assigned_;
 
+  // If the LM states were memory-mapped by ReadMapped(), this is the mapped
+  // region (which starts at or before <lm_states_>) and its size; we unmap it
+  // in the destructor. Otherwise NULL.
+  void *mapped_region_;
+  size_t mapped_region_size_;
+
   // Makes sure that the language model has been loaded before using it.
   bool initialized_;
 
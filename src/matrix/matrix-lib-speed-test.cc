@@ -60,6 +60,49 @@ template<typename Real> static void UnitTestSplitRadixRealFftSpeed() {
   CsvResult<Real>(__func__, 512, t.Elapsed(), "seconds");
 }
 
+// Compares the FFT implementations on the sizes used for typical frame
+// lengths: the power-of-two sizes that the feature code rounds up to, and
+// the 200 and 400 samples of 25ms windows at 8kHz and 16kHz.
+template<typename Real> static void UnitTestFftSpeedBySize() {
+  std::vector<MatrixIndexT> sizes;
+  sizes.push_back(200);
+  sizes.push_back(256);
+  sizes.push_back(400);
+  sizes.push_back(512);
+  sizes.push_back(1024);
+  sizes.push_back(2048);
+  for (size_t s = 0; s < sizes.size(); s++) {
+    MatrixIndexT sz = sizes[s];
+    int32 iter = 2000000 / sz;
+    Vector<Real> v(sz);
+    v.SetRandn();
+    Vector<Real> w(v);
+    {
+      Timer t;
+      for (int32 i = 0; i < iter; i++)
+        RealFft(&w, true);
+      CsvResult<Real>("RealFft", sz, t.Elapsed() * 1.0e+06 / iter,
+                      "microseconds");
+    }
+    if ((sz & (sz - 1)) == 0) {
+      SplitRadixRealFft<Real> srfft(sz);
+      Timer t;
+      for (int32 i = 0; i < iter; i++)
+        srfft.Compute(w.Data(), true);
+      CsvResult<Real>("SplitRadixRealFft", sz, t.Elapsed() * 1.0e+06 / iter,
+                      "microseconds");
+    }
+    {
+      MixedRadixRealFft<Real> fft(sz);
+      Timer t;
+      for (int32 i = 0; i < iter; i++)
+        fft.Compute(w.Data(), true);
+      CsvResult<Real>("MixedRadixRealFft", sz, t.Elapsed() * 1.0e+06 / iter,
+                      "microseconds");
+    }
+  }
+}
+
 template<typename Real>
 static void UnitTestSvdSpeed() {
   Timer t;
@@ -257,6 +300,7 @@ static void UnitTestAddVecToColsSpeed() {
 template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestRealFftSpeed<Real>();
   UnitTestSplitRadixRealFftSpeed<Real>();
+  UnitTestFftSpeedBySize<Real>();
   UnitTestSvdSpeed<Real>();
   UnitTestAddMatMatSpeed<Real>();
   UnitTestAddRowSumMatSpeed<Real>();
@@ -3672,6 +3672,58 @@ template<typename Real> static void UnitTestSplitRadixRealFft() {
 }
 
 
+template<typename Real> static void UnitTestMixedRadixComplexFft() {
+  for (MatrixIndexT p = 0; p < 30; p++) {
+    MatrixIndexT N;
+    if (p < 20) N = 1 + Rand() % 70;
+    else N = 1 + Rand() % 1100;  // includes a few sizes with large factors.
+
+    MatrixIndexT twoN = 2*N;
+    MixedRadixComplexFft<Real> fft(N), fft2(fft);
+    std::vector<Real> temp_buffer;
+    Vector<Real> v(twoN), w_base(twoN), w_alg(twoN), x_alg(twoN);
+    v.SetRandn();
+    w_base.CopyFromVec(v);
+    ComplexFft(&w_base, true);
+    w_alg.CopyFromVec(v);
+    if (Rand() % 2 == 0)
+      fft.Compute(w_alg.Data(), true);
+    else
+      fft2.Compute(w_alg.Data(), true, &temp_buffer);
+    AssertEqual(w_base, w_alg, 0.01*N);
+
+    x_alg.CopyFromVec(w_alg);
+    fft.Compute(x_alg.Data(), false);
+    x_alg.Scale(1.0/N);
+    AssertEqual(v, x_alg, 0.001*N);
+  }
+}
+
+template<typename Real> static void UnitTestMixedRadixRealFft() {
+  for (MatrixIndexT p = 0; p < 30; p++) {
+    MatrixIndexT N;
+    if (p < 5) N = 1 << (1 + Rand() % 10);
+    else N = 2 * (1 + Rand() % 600);
+
+    MixedRadixRealFft<Real> fft(N), fft2(fft);
+    std::vector<Real> temp_buffer;
+    Vector<Real> v(N), w(N), y(N);
+    v.SetRandn();
+    w.CopyFromVec(v);
+    RealFft(&w, true);
+    y.CopyFromVec(v);
+    if (Rand() % 2 == 0)
+      fft.Compute(y.Data(), true);
+    else
+      fft2.Compute(y.Data(), true, &temp_buffer);
+    AssertEqual(w, y, 0.01*N);
+    fft.Compute(y.Data(), false);
+    y.Scale(1.0/N);
+    AssertEqual(v, y, 0.001*N);
+  }
+}
+
+
 
 template<typename Real> static void UnitTestRealFftSpeed() {
 
@@ -4620,10 +4672,12 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestComplexFft<Real>();
   UnitTestSplitRadixComplexFft<Real>();
   UnitTestSplitRadixComplexFft2<Real>();
+  UnitTestMixedRadixComplexFft<Real>();
   UnitTestDct<Real>();
   UnitTestRealFft<Real>();
   KALDI_LOG << " Point C";
   UnitTestSplitRadixRealFft<Real>();
+  UnitTestMixedRadixRealFft<Real>();
   UnitTestSvd<Real>();
   UnitTestSvdNodestroy<Real>();
   UnitTestSvdJustvec<Real>();
@@ -0,0 +1,550 @@
+// matrix/mixed-radix-fft.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include "matrix/mixed-radix-fft.h"
+#include "matrix/matrix-functions.h"
+
+// As in gmm/diag-gmm-kernels.cc, the AVX2 code is compiled with per-function
+// target attributes and chosen at run time.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ >= 7)
+#define KALDI_MIXED_RADIX_FFT_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The passes below all do the forward transform; the inverse one is done by
+// conjugating the input and output.  In each pass, with n = radix * m, the
+// input element (q, p + k m) of each of the 's' interleaved sequences, at
+// index q + s (p + k m), contributes to the outputs at q + s (radix p + j),
+// for 0 <= q < s, 0 <= p < m and 0 <= j, k < radix.  The twiddle factor
+// for output j and index p is at tw_re[(j - 1) m + p].
+
+template<typename Real>
+void Radix2Pass(MatrixIndexT m, MatrixIndexT s, MatrixIndexT q_begin,
+                const Real *tw_re, const Real *tw_im,
+                const Real *x_re, const Real *x_im,
+                Real *y_re, Real *y_im) {
+  for (MatrixIndexT p = 0; p < m; p++) {
+    Real wr = tw_re[p], wi = tw_im[p];
+    const Real *x0r = x_re + s * p, *x0i = x_im + s * p,
+        *x1r = x0r + s * m, *x1i = x0i + s * m;
+    Real *y0r = y_re + s * 2 * p, *y0i = y_im + s * 2 * p,
+        *y1r = y0r + s, *y1i = y0i + s;
+    for (MatrixIndexT q = q_begin; q < s; q++) {
+      Real ar = x0r[q], ai = x0i[q], br = x1r[q], bi = x1i[q];
+      y0r[q] = ar + br;
+      y0i[q] = ai + bi;
+      Real dr = ar - br, di = ai - bi;
+      y1r[q] = dr * wr - di * wi;
+      y1i[q] = dr * wi + di * wr;
+    }
+  }
+}
+
+template<typename Real>
+void Radix3Pass(MatrixIndexT m, MatrixIndexT s,
+                const Real *tw_re, const Real *tw_im,
+                const Real *x_re, const Real *x_im,
+                Real *y_re, Real *y_im) {
+  const Real c = 0.86602540378443864676;  // sin(2 pi / 3).
+  for (MatrixIndexT p = 0; p < m; p++) {
+    Real w1r = tw_re[p], w1i = tw_im[p],
+        w2r = tw_re[m + p], w2i = tw_im[m + p];
+    const Real *x0r = x_re + s * p, *x0i = x_im + s * p,
+        *x1r = x0r + s * m, *x1i = x0i + s * m,
+        *x2r = x1r + s * m, *x2i = x1i + s * m;
+    Real *y0r = y_re + s * 3 * p, *y0i = y_im + s * 3 * p,
+        *y1r = y0r + s, *y1i = y0i + s,
+        *y2r = y1r + s, *y2i = y1i + s;
+    for (MatrixIndexT q = 0; q < s; q++) {
+      Real a0r = x0r[q], a0i = x0i[q],
+          t1r = x1r[q] + x2r[q], t1i = x1i[q] + x2i[q],
+          t2r = x1r[q] - x2r[q], t2i = x1i[q] - x2i[q];
+      y0r[q] = a0r + t1r;
+      y0i[q] = a0i + t1i;
+      Real mr = a0r - 0.5 * t1r, mi = a0i - 0.5 * t1i;
+      // b1 = m - i c t2, b2 = m + i c t2.
+      Real b1r = mr + c * t2i, b1i = mi - c * t2r,
+          b2r = mr - c * t2i, b2i = mi + c * t2r;
+      y1r[q] = b1r * w1r - b1i * w1i;
+      y1i[q] = b1r * w1i + b1i * w1r;
+      y2r[q] = b2r * w2r - b2i * w2i;
+      y2i[q] = b2r * w2i + b2i * w2r;
+    }
+  }
+}
+
+template<typename Real>
+void Radix4Pass(MatrixIndexT m, MatrixIndexT s, MatrixIndexT q_begin,
+                const Real *tw_re, const Real *tw_im,
+                const Real *x_re, const Real *x_im,
+                Real *y_re, Real *y_im) {
+  for (MatrixIndexT p = 0; p < m; p++) {
+    Real w1r = tw_re[p], w1i = tw_im[p],
+        w2r = tw_re[m + p], w2i = tw_im[m + p],
+        w3r = tw_re[2 * m + p], w3i = tw_im[2 * m + p];
+    const Real *x0r = x_re + s * p, *x0i = x_im + s * p,
+        *x1r = x0r + s * m, *x1i = x0i + s * m,
+        *x2r = x1r + s * m, *x2i = x1i + s * m,
+        *x3r = x2r + s * m, *x3i = x2i + s * m;
+    Real *y0r = y_re + s * 4 * p, *y0i = y_im + s * 4 * p,
+        *y1r = y0r + s, *y1i = y0i + s,
+        *y2r = y1r + s, *y2i = y1i + s,
+        *y3r = y2r + s, *y3i = y2i + s;
+    for (MatrixIndexT q = q_begin; q < s; q++) {
+      Real t0r = x0r[q] + x2r[q], t0i = x0i[q] + x2i[q],
+          t1r = x0r[q] - x2r[q], t1i = x0i[q] - x2i[q],
+          t2r = x1r[q] + x3r[q], t2i = x1i[q] + x3i[q],
+          t3r = x1r[q] - x3r[q], t3i = x1i[q] - x3i[q];
+      y0r[q] = t0r + t2r;
+      y0i[q] = t0i + t2i;
+      // b1 = t1 - i t3, b2 = t0 - t2, b3 = t1 + i t3.
+      Real b1r = t1r + t3i, b1i = t1i - t3r,
+          b2r = t0r - t2r, b2i = t0i - t2i,
+          b3r = t1r - t3i, b3i = t1i + t3r;
+      y1r[q] = b1r * w1r - b1i * w1i;
+      y1i[q] = b1r * w1i + b1i * w1r;
+      y2r[q] = b2r * w2r - b2i * w2i;
+      y2i[q] = b2r * w2i + b2i * w2r;
+      y3r[q] = b3r * w3r - b3i * w3i;
+      y3i[q] = b3r * w3i + b3i * w3r;
+    }
+  }
+}
+
+template<typename Real>
+void Radix5Pass(MatrixIndexT m, MatrixIndexT s,
+                const Real *tw_re, const Real *tw_im,
+                const Real *x_re, const Real *x_im,
+                Real *y_re, Real *y_im) {
+  // cos and sin of 2 pi / 5 and 4 pi / 5.
+  const Real c1 = 0.30901699437494742410, c2 = -0.80901699437494742410,
+      s1 = 0.95105651629515357212, s2 = 0.58778525229247312917;
+  for (MatrixIndexT p = 0; p < m; p++) {
+    Real w1r = tw_re[p], w1i = tw_im[p],
+        w2r = tw_re[m + p], w2i = tw_im[m + p],
+        w3r = tw_re[2 * m + p], w3i = tw_im[2 * m + p],
+        w4r = tw_re[3 * m + p], w4i = tw_im[3 * m + p];
+    const Real *x0r = x_re + s * p, *x0i = x_im + s * p,
+        *x1r = x0r + s * m, *x1i = x0i + s * m,
+        *x2r = x1r + s * m, *x2i = x1i + s * m,
+        *x3r = x2r + s * m, *x3i = x2i + s * m,
+        *x4r = x3r + s * m, *x4i = x3i + s * m;
+    Real *y0r = y_re + s * 5 * p, *y0i = y_im + s * 5 * p,
+        *y1r = y0r + s, *y1i = y0i + s,
+        *y2r = y1r + s, *y2i = y1i + s,
+        *y3r = y2r + s, *y3i = y2i + s,
+        *y4r = y3r + s, *y4i = y3i + s;
+    for (MatrixIndexT q = 0; q < s; q++) {
+      Real a0r = x0r[q], a0i = x0i[q],
+          t1r = x1r[q] + x4r[q], t1i = x1i[q] + x4i[q],
+          t2r = x2r[q] + x3r[q], t2i = x2i[q] + x3i[q],
+          t3r = x1r[q] - x4r[q], t3i = x1i[q] - x4i[q],
+          t4r = x2r[q] - x3r[q], t4i = x2i[q] - x3i[q];
+      y0r[q] = a0r + t1r + t2r;
+      y0i[q] = a0i + t1i + t2i;
+      Real m1r = a0r + c1 * t1r + c2 * t2r, m1i = a0i + c1 * t1i + c2 * t2i,
+          m2r = a0r + c2 * t1r + c1 * t2r, m2i = a0i + c2 * t1i + c1 * t2i,
+          u1r = s1 * t3r + s2 * t4r, u1i = s1 * t3i + s2 * t4i,
+          u2r = s2 * t3r - s1 * t4r, u2i = s2 * t3i - s1 * t4i;
+      // b1 = m1 - i u1, b4 = m1 + i u1, b2 = m2 - i u2, b3 = m2 + i u2.
+      Real b1r = m1r + u1i, b1i = m1i - u1r,
+          b4r = m1r - u1i, b4i = m1i + u1r,
+          b2r = m2r + u2i, b2i = m2i - u2r,
+          b3r = m2r - u2i, b3i = m2i + u2r;
+      y1r[q] = b1r * w1r - b1i * w1i;
+      y1i[q] = b1r * w1i + b1i * w1r;
+      y2r[q] = b2r * w2r - b2i * w2i;
+      y2i[q] = b2r * w2i + b2i * w2r;
+      y3r[q] = b3r * w3r - b3i * w3i;
+      y3i[q] = b3r * w3i + b3i * w3r;
+      y4r[q] = b4r * w4r - b4i * w4i;
+      y4i[q] = b4r * w4i + b4i * w4r;
+    }
+  }
+}
+
+// Any other radix, done as a plain DFT of size 'radix'; 'roots_re' and
+// 'roots_im' are the radix'th roots of unity and 'scratch' has space for
+// 2 * radix elements.
+template<typename Real>
+void GenericPass(int32 radix, MatrixIndexT m, MatrixIndexT s,
+                 const Real *tw_re, const Real *tw_im,
+                 const Real *roots_re, const Real *roots_im,
+                 const Real *x_re, const Real *x_im,
+                 Real *y_re, Real *y_im, Real *scratch) {
+  Real *a_re = scratch, *a_im = scratch + radix;
+  for (MatrixIndexT p = 0; p < m; p++) {
+    for (MatrixIndexT q = 0; q < s; q++) {
+      for (int32 k = 0; k < radix; k++) {
+        a_re[k] = x_re[q + s * (p + k * m)];
+        a_im[k] = x_im[q + s * (p + k * m)];
+      }
+      for (int32 j = 0; j < radix; j++) {
+        Real sum_re = 0.0, sum_im = 0.0;
+        int32 t = 0;  // t = j * k mod radix.
+        for (int32 k = 0; k < radix; k++) {
+          sum_re += a_re[k] * roots_re[t] - a_im[k] * roots_im[t];
+          sum_im += a_re[k] * roots_im[t] + a_im[k] * roots_re[t];
+          t += j;
+          if (t >= radix) t -= radix;
+        }
+        MatrixIndexT out = q + s * (radix * p + j);
+        if (j == 0) {
+          y_re[out] = sum_re;
+          y_im[out] = sum_im;
+        } else {
+          Real wr = tw_re[(j - 1) * m + p], wi = tw_im[(j - 1) * m + p];
+          y_re[out] = sum_re * wr - sum_im * wi;
+          y_im[out] = sum_re * wi + sum_im * wr;
+        }
+      }
+    }
+  }
+}
+
+
+#ifdef KALDI_MIXED_RADIX_FFT_X86_KERNELS
+
+bool HaveAvx2() {
+  // Worked out once; initialization of function-local statics is
+  // thread-safe.
+  static const bool ans = (__builtin_cpu_init(),
+                           __builtin_cpu_supports("avx2") &&
+                           __builtin_cpu_supports("fma"));
+  return ans;
+}
+
+// Sets (*yr, *yi) to (br, bi) times the complex number (wr, wi).
+__attribute__((target("avx2,fma")))
+inline void ComplexMulAvx2(__m256 br, __m256 bi, __m256 wr, __m256 wi,
+                           float *yr, float *yi) {
+  _mm256_storeu_ps(yr, _mm256_fmsub_ps(br, wr, _mm256_mul_ps(bi, wi)));
+  _mm256_storeu_ps(yi, _mm256_fmadd_ps(br, wi, _mm256_mul_ps(bi, wr)));
+}
+
+// These do the same as Radix2Pass() and Radix4Pass() for 0 <= q < s rounded
+// down to a multiple of 8, and return that number; the caller does the rest.
+__attribute__((target("avx2,fma")))
+MatrixIndexT Radix2PassAvx2(MatrixIndexT m, MatrixIndexT s,
+                            const float *tw_re, const float *tw_im,
+                            const float *x_re, const float *x_im,
+                            float *y_re, float *y_im) {
+  MatrixIndexT s_round = s & ~7;
+  for (MatrixIndexT p = 0; p < m; p++) {
+    __m256 wr = _mm256_set1_ps(tw_re[p]), wi = _mm256_set1_ps(tw_im[p]);
+    const float *x0r = x_re + s * p, *x0i = x_im + s * p,
+        *x1r = x0r + s * m, *x1i = x0i + s * m;
+    float *y0r = y_re + s * 2 * p, *y0i = y_im + s * 2 * p,
+        *y1r = y0r + s, *y1i = y0i + s;
+    for (MatrixIndexT q = 0; q < s_round; q += 8) {
+      __m256 ar = _mm256_loadu_ps(x0r + q), ai = _mm256_loadu_ps(x0i + q),
+          br = _mm256_loadu_ps(x1r + q), bi = _mm256_loadu_ps(x1i + q);
+      _mm256_storeu_ps(y0r + q, _mm256_add_ps(ar, br));
+      _mm256_storeu_ps(y0i + q, _mm256_add_ps(ai, bi));
+      ComplexMulAvx2(_mm256_sub_ps(ar, br), _mm256_sub_ps(ai, bi), wr, wi,
+                     y1r + q, y1i + q);
+    }
+  }
+  return s_round;
+}
+
+__attribute__((target("avx2,fma")))
+MatrixIndexT Radix4PassAvx2(MatrixIndexT m, MatrixIndexT s,
+                            const float *tw_re, const float *tw_im,
+                            const float *x_re, const float *x_im,
+                            float *y_re, float *y_im) {
+  MatrixIndexT s_round = s & ~7;
+  for (MatrixIndexT p = 0; p < m; p++) {
+    __m256 w1r = _mm256_set1_ps(tw_re[p]), w1i = _mm256_set1_ps(tw_im[p]),
+        w2r = _mm256_set1_ps(tw_re[m + p]), w2i = _mm256_set1_ps(tw_im[m + p]),
+        w3r = _mm256_set1_ps(tw_re[2 * m + p]),
+        w3i = _mm256_set1_ps(tw_im[2 * m + p]);
+    const float *x0r = x_re + s * p, *x0i = x_im + s * p,
+        *x1r = x0r + s * m, *x1i = x0i + s * m,
+        *x2r = x1r + s * m, *x2i = x1i + s * m,
+        *x3r = x2r + s * m, *x3i = x2i + s * m;
+    float *y0r = y_re + s * 4 * p, *y0i = y_im + s * 4 * p,
+        *y1r = y0r + s, *y1i = y0i + s,
+        *y2r = y1r + s, *y2i = y1i + s,
+        *y3r = y2r + s, *y3i = y2i + s;
+    for (MatrixIndexT q = 0; q < s_round; q += 8) {
+      __m256 a0r = _mm256_loadu_ps(x0r + q), a0i = _mm256_loadu_ps(x0i + q),
+          a1r = _mm256_loadu_ps(x1r + q), a1i = _mm256_loadu_ps(x1i + q),
+          a2r = _mm256_loadu_ps(x2r + q), a2i = _mm256_loadu_ps(x2i + q),
+          a3r = _mm256_loadu_ps(x3r + q), a3i = _mm256_loadu_ps(x3i + q);
+      __m256 t0r = _mm256_add_ps(a0r, a2r), t0i = _mm256_add_ps(a0i, a2i),
+          t1r = _mm256_sub_ps(a0r, a2r), t1i = _mm256_sub_ps(a0i, a2i),
+          t2r = _mm256_add_ps(a1r, a3r), t2i = _mm256_add_ps(a1i, a3i),
+          t3r = _mm256_sub_ps(a1r, a3r), t3i = _mm256_sub_ps(a1i, a3i);
+      _mm256_storeu_ps(y0r + q, _mm256_add_ps(t0r, t2r));
+      _mm256_storeu_ps(y0i + q, _mm256_add_ps(t0i, t2i));
+      ComplexMulAvx2(_mm256_add_ps(t1r, t3i), _mm256_sub_ps(t1i, t3r),
+                     w1r, w1i, y1r + q, y1i + q);
+      ComplexMulAvx2(_mm256_sub_ps(t0r, t2r), _mm256_sub_ps(t0i, t2i),
+                     w2r, w2i, y2r + q, y2i + q);
+      ComplexMulAvx2(_mm256_sub_ps(t1r, t3i), _mm256_add_ps(t1i, t3r),
+                     w3r, w3i, y3r + q, y3i + q);
+    }
+  }
+  return s_round;
+}
+
+#endif  // KALDI_MIXED_RADIX_FFT_X86_KERNELS
+
+// The following do as much of a radix-2 or radix-4 pass as they can with
+// vectorized code, and return the q index from which the generic code should
+// continue.
+MatrixIndexT Radix2PassSimd(MatrixIndexT m, MatrixIndexT s,
+                            const float *tw_re, const float *tw_im,
+                            const float *x_re, const float *x_im,
+                            float *y_re, float *y_im) {
+#ifdef KALDI_MIXED_RADIX_FFT_X86_KERNELS
+  if (s >= 8 && HaveAvx2())
+    return Radix2PassAvx2(m, s, tw_re, tw_im, x_re, x_im, y_re, y_im);
+#endif
+  return 0;
+}
+
+MatrixIndexT Radix2PassSimd(MatrixIndexT m, MatrixIndexT s,
+                            const double *tw_re, const double *tw_im,
+                            const double *x_re, const double *x_im,
+                            double *y_re, double *y_im) {
+  return 0;
+}
+
+MatrixIndexT Radix4PassSimd(MatrixIndexT m, MatrixIndexT s,
+                            const float *tw_re, const float *tw_im,
+                            const float *x_re, const float *x_im,
+                            float *y_re, float *y_im) {
+#ifdef KALDI_MIXED_RADIX_FFT_X86_KERNELS
+  if (s >= 8 && HaveAvx2())
+    return Radix4PassAvx2(m, s, tw_re, tw_im, x_re, x_im, y_re, y_im);
+#endif
+  return 0;
+}
+
+MatrixIndexT Radix4PassSimd(MatrixIndexT m, MatrixIndexT s,
+                            const double *tw_re, const double *tw_im,
+                            const double *x_re, const double *x_im,
+                            double *y_re, double *y_im) {
+  return 0;
+}
+
+}  // namespace
+
+
+template<typename Real>
+MixedRadixComplexFft<Real>::MixedRadixComplexFft(MatrixIndexT N):
+    N_(N), max_radix_(0) {
+  KALDI_ASSERT(N >= 1);
+  std::vector<MatrixIndexT> factors;
+  Factorize(N, &factors);
+  // Work out the radices.  The radix-4 and radix-2 passes go last, because
+  // the stride (the length of the innermost loops) grows with each pass, and
+  // those are the ones that have vectorized versions.
+  int32 num_twos = std::count(factors.begin(), factors.end(), 2);
+  std::vector<int32> radices;
+  for (size_t i = 0; i < factors.size(); i++)
+    if (factors[i] != 2)
+      radices.push_back(factors[i]);
+  if (num_twos % 2 == 1)
+    radices.push_back(2);
+  for (int32 i = 0; i < num_twos / 2; i++)
+    radices.push_back(4);
+
+  MatrixIndexT n = N, stride = 1;
+  for (size_t i = 0; i < radices.size(); i++) {
+    Pass pass;
+    pass.radix = radices[i];
+    pass.m = n / pass.radix;
+    pass.stride = stride;
+    pass.twiddle_offset = twiddle_re_.size();
+    for (int32 j = 1; j < pass.radix; j++) {
+      for (MatrixIndexT p = 0; p < pass.m; p++) {
+        double angle = -M_2PI * ((j * p) % n) / static_cast<double>(n);
+        twiddle_re_.push_back(std::cos(angle));
+        twiddle_im_.push_back(std::sin(angle));
+      }
+    }
+    pass.roots_offset = roots_re_.size();
+    if (pass.radix > 5) {
+      for (int32 t = 0; t < pass.radix; t++) {
+        double angle = -M_2PI * t / static_cast<double>(pass.radix);
+        roots_re_.push_back(std::cos(angle));
+        roots_im_.push_back(std::sin(angle));
+      }
+    }
+    max_radix_ = std::max(max_radix_, pass.radix);
+    passes_.push_back(pass);
+    n = pass.m;
+    stride *= pass.radix;
+  }
+  KALDI_ASSERT(n == 1 && stride == N);
+}
+
+template<typename Real>
+std::vector<int32> MixedRadixComplexFft<Real>::Radices() const {
+  std::vector<int32> ans;
+  for (size_t i = 0; i < passes_.size(); i++)
+    ans.push_back(passes_[i].radix);
+  return ans;
+}
+
+template<typename Real>
+void MixedRadixComplexFft<Real>::Compute(Real *data, bool forward,
+                                         std::vector<Real> *temp_buffer) const {
+  MatrixIndexT N = N_;
+  if (N == 1)
+    return;
+  size_t buffer_size = 4 * N + 2 * max_radix_;
+  if (temp_buffer->size() < buffer_size)
+    temp_buffer->resize(buffer_size);
+  Real *x_re = &((*temp_buffer)[0]), *x_im = x_re + N,
+      *y_re = x_im + N, *y_im = y_re + N, *scratch = y_im + N;
+
+  // We do the inverse transform as conj(FFT(conj(data))).
+  Real im_scale = (forward ? 1.0 : -1.0);
+  for (MatrixIndexT n = 0; n < N; n++) {
+    x_re[n] = data[2 * n];
+    x_im[n] = im_scale * data[2 * n + 1];
+  }
+  for (size_t i = 0; i < passes_.size(); i++) {
+    const Pass &pass = passes_[i];
+    const Real *tw_re = &(twiddle_re_[0]) + pass.twiddle_offset,
+        *tw_im = &(twiddle_im_[0]) + pass.twiddle_offset;
+    MatrixIndexT q_begin;
+    switch (pass.radix) {
+      case 2:
+        q_begin = Radix2PassSimd(pass.m, pass.stride, tw_re, tw_im,
+                                 x_re, x_im, y_re, y_im);
+        Radix2Pass(pass.m, pass.stride, q_begin, tw_re, tw_im,
+                   x_re, x_im, y_re, y_im);
+        break;
+      case 3:
+        Radix3Pass(pass.m, pass.stride, tw_re, tw_im, x_re, x_im,
+                   y_re, y_im);
+        break;
+      case 4:
+        q_begin = Radix4PassSimd(pass.m, pass.stride, tw_re, tw_im,
+                                 x_re, x_im, y_re, y_im);
+        Radix4Pass(pass.m, pass.stride, q_begin, tw_re, tw_im,
+                   x_re, x_im, y_re, y_im);
+        break;
+      case 5:
+        Radix5Pass(pass.m, pass.stride, tw_re, tw_im, x_re, x_im,
+                   y_re, y_im);
+        break;
+      default:
+        GenericPass(pass.radix, pass.m, pass.stride, tw_re, tw_im,
+                    &(roots_re_[0]) + pass.roots_offset,
+                    &(roots_im_[0]) + pass.roots_offset,
+                    x_re, x_im, y_re, y_im, scratch);
+    }
+    std::swap(x_re, y_re);
+    std::swap(x_im, y_im);
+  }
+  for (MatrixIndexT n = 0; n < N; n++) {
+    data[2 * n] = x_re[n];
+    data[2 * n + 1] = im_scale * x_im[n];
+  }
+}
+
+
+template<typename Real>
+MixedRadixRealFft<Real>::MixedRadixRealFft(MatrixIndexT N):
+    N_(N), complex_fft_(std::max<MatrixIndexT>(N / 2, 1)) {
+  KALDI_ASSERT(N >= 2 && N % 2 == 0);
+  for (MatrixIndexT k = 0; 4 * k <= N; k++) {
+    double angle = M_2PI * k / static_cast<double>(N);
+    cos_.push_back(std::cos(angle));
+    sin_.push_back(std::sin(angle));
+  }
+}
+
+// This is the same computation as in RealFft() in matrix-functions.cc; see
+// the notes there for the math.
+template<typename Real>
+void MixedRadixRealFft<Real>::Compute(Real *data, bool forward,
+                                      std::vector<Real> *temp_buffer) const {
+  MatrixIndexT N = N_, N2 = N / 2;
+  if (forward)
+    complex_fft_.Compute(data, true, temp_buffer);
+
+  for (MatrixIndexT k = 1; 2 * k <= N2; k++) {
+    // kN is exp(-2pik/N) for the forward transform and -exp(2pik/N) for
+    // the backward one.
+    Real kN_re = (forward ? cos_[k] : -cos_[k]), kN_im = -sin_[k];
+
+    Real Ck_re, Ck_im, Dk_re, Dk_im;
+    // C_k = 1/2 (B_k + B_{N/2 - k}^*) :
+    Ck_re = 0.5 * (data[2*k] + data[N - 2*k]);
+    Ck_im = 0.5 * (data[2*k + 1] - data[N - 2*k + 1]);
+    // re(D_k)= 1/2 (im(B_k) + im(B_{N/2-k})):
+    Dk_re = 0.5 * (data[2*k + 1] + data[N - 2*k + 1]);
+    // im(D_k) = -1/2 (re(B_k) - re(B_{N/2-k}))
+    Dk_im =-0.5 * (data[2*k] - data[N - 2*k]);
+    // A_k = C_k + 1^(k/N) D_k:
+    data[2*k] = Ck_re;  // A_k <-- C_k
+    data[2*k+1] = Ck_im;
+    // now A_k += D_k 1^(k/N)
+    ComplexAddProduct(Dk_re, Dk_im, kN_re, kN_im, &(data[2*k]),
+                      &(data[2*k+1]));
+
+    MatrixIndexT kdash = N2 - k;
+    if (kdash != k) {
+      // The quantities C_{k'} and D_{k'} are the conjugates of C_k and D_k,
+      // and 1^(k'/N) is -1 * (1^(k/N))^*.
+      data[2*kdash] = Ck_re;  // A_k' <-- C_k'
+      data[2*kdash+1] = -Ck_im;
+      ComplexAddProduct(Dk_re, -Dk_im, -kN_re, kN_im, &(data[2*kdash]),
+                        &(data[2*kdash+1]));
+    }
+  }
+
+  {  // Now handle k = 0.
+    Real zeroth = data[0] + data[1],
+        n2th = data[0] - data[1];
+    data[0] = zeroth;
+    data[1] = n2th;
+    if (!forward) {
+      data[0] /= 2;
+      data[1] /= 2;
+    }
+  }
+  if (!forward) {
+    complex_fft_.Compute(data, false, temp_buffer);
+    for (MatrixIndexT i = 0; i < N; i++)
+      data[i] *= 2.0;
+    // This is so we get a factor of N increase, rather than N/2 which we would
+    // otherwise get from [ComplexFft, forward] + [ComplexFft, backward] in
+    // dimension N/2.
+  }
+}
+
+template class MixedRadixComplexFft<float>;
+template class MixedRadixComplexFft<double>;
+template class MixedRadixRealFft<float>;
+template class MixedRadixRealFft<double>;
+
+}  // end namespace kaldi
@@ -0,0 +1,140 @@
+// matrix/mixed-radix-fft.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_MIXED_RADIX_FFT_H_
+#define KALDI_MATRIX_MIXED_RADIX_FFT_H_
+
+#include <vector>
+#include "matrix/kaldi-vector.h"
+
+namespace kaldi {
+
+/// @addtogroup matrix_funcs_misc
+/// @{
+
+/**
+   MixedRadixComplexFft computes complex FFTs of any size N, with the same
+   conventions as ComplexFft() (declared in matrix-functions.h) and
+   SplitRadixComplexFft (srfft.h).  It is intended for sizes that are not
+   powers of two, such as the 400-sample windows of 25ms frames at 16kHz,
+   where until now we had to use ComplexFft(), which factorizes N and
+   computes its twiddle factors by repeated multiplication on every call.
+
+   The constructor works out a plan for size N: a factorization of N into
+   radices (4, 2, 3 and 5 have special code; any other prime factors are done
+   as plain DFTs, so sizes with large prime factors are slow), and tables of
+   all the twiddle factors, computed in double precision.  The transform is
+   done as a sequence of Stockham "autosort" passes, one per radix, which
+   need no bit-reversal permutation and whose innermost loops run over
+   contiguous memory.  The data is kept in separate real and imaginary arrays
+   while the passes run, and on x86 machines that support AVX2 the radix-4 and
+   radix-2 passes have vectorized versions for single precision, selected at
+   run time.
+
+   Once constructed, the object may be used from several threads at once via
+   the Compute() function that takes a temporary buffer.
+*/
+template<typename Real>
+class MixedRadixComplexFft {
+ public:
+  /// N is the number of complex points; it must be at least 1.
+  explicit MixedRadixComplexFft(MatrixIndexT N);
+
+  MatrixIndexT N() const { return N_; }
+
+  /// Does the FFT of the array 'data' of size N*2, containing
+  /// [ r0 im0 r1 im1 ... ].  If "forward", does the forward FFT (with
+  /// exp(-2 pi i n k / N)); otherwise the inverse FFT, without the 1/N
+  /// factor.  'temp_buffer' is used as temporary storage and will be resized
+  /// if needed.
+  void Compute(Real *data, bool forward, std::vector<Real> *temp_buffer) const;
+
+  /// As above, but using a class-member buffer, so it is not const.
+  void Compute(Real *data, bool forward) {
+    Compute(data, forward, &temp_buffer_);
+  }
+
+  /// Returns the radices of the passes, for diagnostics.
+  std::vector<int32> Radices() const;
+
+ private:
+  // One Stockham pass.  At the start of the pass the data consists of
+  // 'stride' interleaved sequences, each of length radix * m; the pass does
+  // the first stage of the decimation-in-frequency FFT of each of them.
+  struct Pass {
+    int32 radix;
+    MatrixIndexT m;
+    MatrixIndexT stride;
+    // The twiddle factors for this pass, exp(-2 pi i j p / (radix * m)),
+    // are at twiddle_re_[twiddle_offset + (j - 1) * m + p] (and the same
+    // for twiddle_im_), for 1 <= j < radix and 0 <= p < m.
+    MatrixIndexT twiddle_offset;
+    // For the radices with no special code, the roots of unity
+    // exp(-2 pi i t / radix), 0 <= t < radix, are at
+    // roots_re_[roots_offset + t] (and the same for roots_im_).
+    MatrixIndexT roots_offset;
+  };
+
+  MatrixIndexT N_;
+  int32 max_radix_;
+  std::vector<Pass> passes_;
+  std::vector<Real> twiddle_re_, twiddle_im_;
+  std::vector<Real> roots_re_, roots_im_;
+  std::vector<Real> temp_buffer_;
+};
+
+
+/**
+   MixedRadixRealFft does the FFT of N real points, for any even N, with the
+   same input and output format as RealFft() (matrix-functions.h) and
+   SplitRadixRealFft (srfft.h): the output is N/2 complex numbers,
+   [real0, real_{N/2}, real1, im1, real2, im2, ...].  It does a complex FFT of
+   size N/2 with MixedRadixComplexFft and then the usual post-processing,
+   with precomputed coefficients.
+*/
+template<typename Real>
+class MixedRadixRealFft {
+ public:
+  /// N must be even and at least 2.
+  explicit MixedRadixRealFft(MatrixIndexT N);
+
+  MatrixIndexT N() const { return N_; }
+
+  /// If forward == true, transforms the N real points in 'data' to their
+  /// complex Fourier transform, in the format described above; otherwise goes
+  /// in the reverse direction.  If you call it in the forward and then reverse
+  /// direction and multiply by 1.0/N, you will get back the original data.
+  void Compute(Real *data, bool forward, std::vector<Real> *temp_buffer) const;
+
+  /// As above, but using a class-member buffer, so it is not const.
+  void Compute(Real *data, bool forward) {
+    Compute(data, forward, &temp_buffer_);
+  }
+
+ private:
+  MatrixIndexT N_;
+  MixedRadixComplexFft<Real> complex_fft_;
+  // cos(2 pi k / N) and sin(2 pi k / N), for 0 <= k <= N/4.
+  std::vector<Real> cos_, sin_;
+  std::vector<Real> temp_buffer_;
+};
+
+/// @} end of "addtogroup matrix_funcs_misc"
+
+}  // end namespace kaldi
+
+#endif  // KALDI_MATRIX_MIXED_RADIX_FFT_H_
@@ -34,7 +34,9 @@ DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
     input_features_(input_features),
     ivector_features_(ivector_features),
     computer_(info_.opts.compute_config, info_.computation,
-              info_.nnet, NULL) {   // NULL is 'nnet_to_update'
+              info_.nnet, NULL),   // NULL is 'nnet_to_update'
+    num_chunks_submitted_(0),
+    lookahead_stop_(false) {
   // Check that feature dimensions match.
   KALDI_ASSERT(input_features_ != NULL);
   int32 nnet_input_dim = info_.nnet.InputDim("input"),
@@ -53,6 +55,22 @@ DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
 }
 
 
+DecodableNnetLoopedOnlineBase::~DecodableNnetLoopedOnlineBase() {
+  if (lookahead_thread_.joinable()) {
+    {
+      std::unique_lock<std::mutex> lock(lookahead_mutex_);
+      lookahead_stop_ = true;
+      lookahead_cond_.notify_all();
+    }
+    lookahead_thread_.join();
+  }
+  for (size_t i = 0; i < pending_chunks_.size(); i++)
+    delete pending_chunks_[i];
+  for (size_t i = 0; i < computed_chunks_.size(); i++)
+    delete computed_chunks_[i];
+}
+
+
 int32 DecodableNnetLoopedOnlineBase::NumFramesReady() const {
   // note: the ivector_features_ may have 2 or 3 fewer frames ready than
   // input_features_, but we don't wait for them; we just use the most recent
@@ -115,22 +133,45 @@ void DecodableNnetLoopedOnlineBase::SetFrameOffset(int32 frame_offset) {
   frame_offset_ = frame_offset;
 }
 
-void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
-  // Prepare the input data for the next chunk of features.
-  // note: 'end' means one past the last.
-  int32 begin_input_frame, end_input_frame;
-  if (num_chunks_computed_ == 0) {
-    begin_input_frame = -info_.frames_left_context;
-    // note: end is last plus one.
-    end_input_frame = info_.frames_per_chunk + info_.frames_right_context;
+// Sets 'begin' and 'end' to the range of input frames needed for chunk
+// 'chunk_index' (note: 'end' means one past the last).
+static void GetChunkInputRange(const DecodableNnetSimpleLoopedInfo &info,
+                               int32 chunk_index, int32 *begin, int32 *end) {
+  if (chunk_index == 0) {
+    *begin = -info.frames_left_context;
+    *end = info.frames_per_chunk + info.frames_right_context;
   } else {
-    // note: begin_input_frame will be the same as the previous end_input_frame.
-    // you can verify this directly if num_chunks_computed_ == 0, and then by
+    // note: begin will be the same as the previous chunk's end.
+    // you can verify this directly if chunk_index == 1, and then by
     // induction.
-    begin_input_frame = num_chunks_computed_ * info_.frames_per_chunk +
-        info_.frames_right_context;
-    end_input_frame = begin_input_frame + info_.frames_per_chunk;
+    *begin = chunk_index * info.frames_per_chunk +
+        info.frames_right_context;
+    *end = *begin + info.frames_per_chunk;
   }
+}
+
+bool DecodableNnetLoopedOnlineBase::ChunkInputIsReady(
+    int32 chunk_index) const {
+  int32 begin_input_frame, end_input_frame;
+  GetChunkInputRange(info_, chunk_index, &begin_input_frame, &end_input_frame);
+  int32 num_feature_frames_ready = input_features_->NumFramesReady();
+  if (end_input_frame <= num_feature_frames_ready)
+    return true;
+  if (num_feature_frames_ready == 0 ||
+      !input_features_->IsLastFrame(num_feature_frames_ready - 1))
+    return false;
+  // The input has finished, so the features will be padded as needed; but
+  // the chunk must contain some real output frames (c.f. NumFramesReady()).
+  int32 sf = info_.opts.frame_subsampling_factor,
+      num_subsampled_frames = (num_feature_frames_ready + sf - 1) / sf;
+  return chunk_index * (info_.frames_per_chunk / sf) < num_subsampled_frames;
+}
+
+void DecodableNnetLoopedOnlineBase::GetChunkInput(
+    int32 chunk_index, CuMatrix<BaseFloat> *feats,
+    CuMatrix<BaseFloat> *ivectors) {
+  int32 begin_input_frame, end_input_frame;
+  GetChunkInputRange(info_, chunk_index, &begin_input_frame, &end_input_frame);
 
   int32 num_feature_frames_ready = input_features_->NumFramesReady();
   bool is_finished = input_features_->IsLastFrame(num_feature_frames_ready - 1);
@@ -150,8 +191,7 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
   }
 
 
-  CuMatrix<BaseFloat> feats_chunk;
-  { // this block sets 'feats_chunk'.
+  { // this block sets 'feats'.
     Matrix<BaseFloat> this_feats(end_input_frame - begin_input_frame,
                                  input_features_->Dim());
     for (int32 i = begin_input_frame; i < end_input_frame; i++) {
@@ -162,16 +202,15 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
         input_frame = num_feature_frames_ready - 1;
       input_features_->GetFrame(input_frame, &this_row);
     }
-    feats_chunk.Swap(&this_feats);
+    feats->Swap(&this_feats);
   }
-  computer_.AcceptInput("input", &feats_chunk);
 
   if (info_.has_ivectors) {
     KALDI_ASSERT(ivector_features_ != NULL);
     KALDI_ASSERT(info_.request1.inputs.size() == 2);
     // all but the 1st chunk should have 1 iVector, but there is no need to
     // assume this.
-    int32 num_ivectors = (num_chunks_computed_ == 0 ?
+    int32 num_ivectors = (chunk_index == 0 ?
 			  info_.request1.inputs[1].indexes.size() :
 			  info_.request2.inputs[1].indexes.size());
     KALDI_ASSERT(num_ivectors > 0);
@@ -197,13 +236,19 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     // only at file begin.
 
     // note: we expect num_ivectors to be 1 in practice.
-    Matrix<BaseFloat> ivectors(num_ivectors,
-			       ivector.Dim());
-    ivectors.CopyRowsFromVec(ivector);
-    CuMatrix<BaseFloat> cu_ivectors;
-    cu_ivectors.Swap(&ivectors);
-    computer_.AcceptInput("ivector", &cu_ivectors);
+    Matrix<BaseFloat> this_ivectors(num_ivectors,
+			            ivector.Dim());
+    this_ivectors.CopyRowsFromVec(ivector);
+    ivectors->Swap(&this_ivectors);
   }
+}
+
+void DecodableNnetLoopedOnlineBase::ComputeChunk(
+    CuMatrix<BaseFloat> *feats, CuMatrix<BaseFloat> *ivectors,
+    Matrix<BaseFloat> *log_post) {
+  computer_.AcceptInput("input", feats);
+  if (info_.has_ivectors)
+    computer_.AcceptInput("ivector", ivectors);
   computer_.Run();
 
   {
@@ -221,12 +266,67 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     }
     // apply the acoustic scale
     output.Scale(info_.opts.acoustic_scale);
-    current_log_post_.Resize(0, 0);
-    current_log_post_.Swap(&output);
+    log_post->Resize(0, 0);
+    log_post->Swap(&output);
   }
-  KALDI_ASSERT(current_log_post_.NumRows() == info_.frames_per_chunk /
+  KALDI_ASSERT(log_post->NumRows() == info_.frames_per_chunk /
                info_.opts.frame_subsampling_factor &&
-               current_log_post_.NumCols() == info_.output_dim);
+               log_post->NumCols() == info_.output_dim);
+}
+
+void DecodableNnetLoopedOnlineBase::SubmitChunk() {
+  Chunk *chunk = new Chunk();
+  GetChunkInput(num_chunks_submitted_, &(chunk->feats), &(chunk->ivectors));
+  num_chunks_submitted_++;
+  if (!lookahead_thread_.joinable())
+    lookahead_thread_ = std::thread(
+        &DecodableNnetLoopedOnlineBase::LookaheadThread, this);
+  std::unique_lock<std::mutex> lock(lookahead_mutex_);
+  pending_chunks_.push_back(chunk);
+  lookahead_cond_.notify_all();
+}
+
+void DecodableNnetLoopedOnlineBase::LookaheadThread() {
+  std::unique_lock<std::mutex> lock(lookahead_mutex_);
+  while (true) {
+    lookahead_cond_.wait(lock, [this] {
+        return lookahead_stop_ || !pending_chunks_.empty(); });
+    if (lookahead_stop_)
+      return;
+    Chunk *chunk = pending_chunks_.front();
+    lock.unlock();
+    ComputeChunk(&(chunk->feats), &(chunk->ivectors), &(chunk->log_post));
+    lock.lock();
+    pending_chunks_.pop_front();
+    computed_chunks_.push_back(chunk);
+    lookahead_cond_.notify_all();
+  }
+}
+
+void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
+  int32 lookahead = info_.opts.lookahead_chunks;
+  if (lookahead == 0) {
+    CuMatrix<BaseFloat> feats_chunk, ivectors_chunk;
+    GetChunkInput(num_chunks_computed_, &feats_chunk, &ivectors_chunk);
+    ComputeChunk(&feats_chunk, &ivectors_chunk, &current_log_post_);
+  } else {
+    if (num_chunks_submitted_ == num_chunks_computed_)
+      SubmitChunk();
+    // Queue up the following chunks as far as we can, so they will be
+    // computed while the decoder is busy with this one.
+    while (num_chunks_submitted_ <= num_chunks_computed_ + lookahead &&
+           ChunkInputIsReady(num_chunks_submitted_))
+      SubmitChunk();
+    Chunk *chunk;
+    {
+      std::unique_lock<std::mutex> lock(lookahead_mutex_);
+      lookahead_cond_.wait(lock, [this] { return !computed_chunks_.empty(); });
+      chunk = computed_chunks_.front();
+      computed_chunks_.pop_front();
+    }
+    current_log_post_.Swap(&(chunk->log_post));
+    delete chunk;
+  }
 
   num_chunks_computed_++;
 
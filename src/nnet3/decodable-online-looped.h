@@ -22,6 +22,11 @@
 #ifndef KALDI_NNET3_DECODABLE_ONLINE_LOOPED_H_
 #define KALDI_NNET3_DECODABLE_ONLINE_LOOPED_H_
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include "itf/online-feature-itf.h"
 #include "itf/decodable-itf.h"
 #include "nnet3/am-nnet-simple.h"
@@ -62,6 +67,9 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
                                  OnlineFeatureInterface *input_features,
                                  OnlineFeatureInterface *ivector_features);
 
+  // Waits for the lookahead thread, if there is one, to finish.
+  virtual ~DecodableNnetLoopedOnlineBase();
+
   // note: the LogLikelihood function is not overridden; the child
   // class needs to do this.
   //virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 index);
@@ -129,16 +137,61 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
 
  private:
 
-  // This function does the computation for the next chunk.  It will change
-  // current_log_post_ and current_log_post_subsampled_offset_, and
-  // increment num_chunks_computed_.
+  // This function does the computation for the next chunk (or, if
+  // info_.opts.lookahead_chunks > 0, gets it from the lookahead thread).  It
+  // will change current_log_post_ and current_log_post_subsampled_offset_,
+  // and increment num_chunks_computed_.
   void AdvanceChunk();
 
+  // Returns true if enough features are ready to compute chunk 'chunk_index'.
+  bool ChunkInputIsReady(int32 chunk_index) const;
+
+  // Gets the input features, and if applicable the iVectors, for chunk
+  // 'chunk_index'.  Reads input_features_ and ivector_features_, so it must
+  // only be called from the thread that owns them.
+  void GetChunkInput(int32 chunk_index, CuMatrix<BaseFloat> *feats,
+                     CuMatrix<BaseFloat> *ivectors);
+
+  // Runs the neural net on the input of the next chunk (the inputs are
+  // consumed) and outputs the scaled log-likelihoods to 'log_post'.  This is
+  // the only function that uses computer_.
+  void ComputeChunk(CuMatrix<BaseFloat> *feats, CuMatrix<BaseFloat> *ivectors,
+                    Matrix<BaseFloat> *log_post);
+
   OnlineFeatureInterface *input_features_;
   OnlineFeatureInterface *ivector_features_;
 
   NnetComputer computer_;
 
+  // The rest of the members are only used if info_.opts.lookahead_chunks > 0.
+  // In that case the neural net is run in lookahead_thread_, which computes
+  // the chunks (in order) from the inputs in pending_chunks_ and moves them to
+  // computed_chunks_.  The features are always read in the calling thread,
+  // and only inside AdvanceChunk(), so the user may give the feature pipeline
+  // more data while the lookahead thread is running.
+  struct Chunk {
+    CuMatrix<BaseFloat> feats;
+    CuMatrix<BaseFloat> ivectors;
+    Matrix<BaseFloat> log_post;
+  };
+
+  // Gives the input for chunk num_chunks_submitted_ to the lookahead thread,
+  // starting the thread if needed.
+  void SubmitChunk();
+
+  // The main function of lookahead_thread_.
+  void LookaheadThread();
+
+  // The number of chunks whose input has been given to the lookahead thread
+  // (including those that have since been computed).
+  int32 num_chunks_submitted_;
+  std::thread lookahead_thread_;
+  std::mutex lookahead_mutex_;  // Guards the following three members.
+  std::condition_variable lookahead_cond_;
+  std::deque<Chunk*> pending_chunks_;
+  std::deque<Chunk*> computed_chunks_;
+  bool lookahead_stop_;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetLoopedOnlineBase);
 };
 
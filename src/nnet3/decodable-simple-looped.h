@@ -49,6 +49,7 @@ struct NnetSimpleLoopedComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  int32 lookahead_chunks;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   NnetSimpleLoopedComputationOptions():
@@ -56,12 +57,13 @@ struct NnetSimpleLoopedComputationOptions {
       frame_subsampling_factor(1),
       frames_per_chunk(24),
       acoustic_scale(0.1),
-      debug_computation(false) { }
+      debug_computation(false),
+      lookahead_chunks(0) { }
 
   void Check() const {
     KALDI_ASSERT(extra_left_context_initial >= 0 &&
                  frame_subsampling_factor > 0 && frames_per_chunk > 0 &&
-                 acoustic_scale > 0.0);
+                 acoustic_scale > 0.0 && lookahead_chunks >= 0);
   }
 
   void Register(OptionsItf *opts) {
@@ -83,6 +85,12 @@ struct NnetSimpleLoopedComputationOptions {
                    "if needed.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("lookahead-chunks", &lookahead_chunks, "Only relevant for "
+                   "online decoding.  If >0, the neural net is evaluated in a "
+                   "separate thread, up to this many chunks ahead of the chunk "
+                   "the decoder is searching, so the two overlap in time.  "
+                   "iVectors may then be taken from slightly earlier frames, "
+                   "which can change the output very slightly.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -102,6 +102,8 @@ struct NnetSimpleComputationOptions {
     // register the compute options with the prefix "computation".
     ParseOptions compute_opts("computation", opts);
     compute_config.Register(&compute_opts);
+
+    compiler_config.Register(opts);
   }
 
   void CheckAndFixConfigs(int32 nnet_modulus) {
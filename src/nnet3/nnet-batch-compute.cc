@@ -34,7 +34,7 @@ NnetBatchComputer::NnetBatchComputer(
     const VectorBase<BaseFloat> &priors):
     opts_(opts),
     nnet_(nnet),
-    compiler_(nnet_, opts.optimize_config),
+    compiler_(nnet_, opts.optimize_config, opts.compiler_config),
     log_priors_(priors),
     num_full_minibatches_(0) {
   log_priors_.ApplyLog();
@@ -1402,6 +1402,9 @@ void NnetBatchDecoder::Decode() {
                      << "--allow-partial=false.\n";
           std::unique_lock<std::mutex> lock(stats_mutex_);
           num_fail_++;
+          // Mark it as finished (with an empty lattice) so that GetOutput()
+          // skips it rather than waiting for it forever.
+          output_utterance->finished = true;
           continue;
         }
       }
@@ -1425,8 +1428,11 @@ void NnetBatchDecoder::ProcessOutputUtterance(UtteranceOutput *output) {
   if (output->lat.NumStates() == 0) {
     KALDI_WARN << "Unexpected problem getting lattice for utterance "
                << output->utterance_id;
-    std::unique_lock<std::mutex> lock(stats_mutex_);
-    num_fail_++;
+    {
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_fail_++;
+    }
+    output->finished = true;
     return;
   }
 
@@ -717,6 +717,15 @@ class NnetBatchDecoder {
                  Lattice *lat,
                  std::string *sentence);
 
+  /// Returns the number of utterances that have been provided via
+  /// AcceptInput() but not yet consumed by GetOutput().  Since utterances
+  /// whose decoding failed are silently skipped by GetOutput(), callers that
+  /// need to know which utterances failed (e.g. a server that has to reply to
+  /// every request) can compare this with their own list of submitted
+  /// utterances.  Like the rest of the interface, only call this from the
+  /// main thread.
+  size_t NumPendingUtterances() const { return pending_utts_.size(); }
+
   ~NnetBatchDecoder();
 
  private:
@@ -58,7 +58,13 @@ NnetChainTrainer::NnetChainTrainer(const NnetChainTrainingOptions &opts,
 
 
 void NnetChainTrainer::Train(const NnetChainExample &chain_eg) {
-  NVTX_RANGE(__func__);
+  std::shared_ptr<const NnetComputation> computation =
+      GetComputation(chain_eg);
+  Train(chain_eg, *computation);
+}
+
+std::shared_ptr<const NnetComputation> NnetChainTrainer::GetComputation(
+    const NnetChainExample &chain_eg) {
   bool need_model_derivative = true;
   const NnetTrainerOptions &nnet_config = opts_.nnet_config;
   bool use_xent_regularization = (opts_.chain_config.xent_regularize != 0.0);
@@ -67,8 +73,13 @@ void NnetChainTrainer::Train(const NnetChainExample &chain_eg) {
                              nnet_config.store_component_stats,
                              use_xent_regularization, need_model_derivative,
                              &request);
-  std::shared_ptr<const NnetComputation> computation = compiler_.Compile(request);
+  return compiler_.Compile(request);
+}
 
+void NnetChainTrainer::Train(const NnetChainExample &chain_eg,
+                             const NnetComputation &computation) {
+  NVTX_RANGE(__func__);
+  const NnetTrainerOptions &nnet_config = opts_.nnet_config;
   if (nnet_config.backstitch_training_scale > 0.0 && num_minibatches_processed_
       % nnet_config.backstitch_training_interval ==
       srand_seed_ % nnet_config.backstitch_training_interval) {
@@ -78,14 +89,14 @@ void NnetChainTrainer::Train(const NnetChainExample &chain_eg) {
     bool is_backstitch_step1 = true;
     srand(srand_seed_ + num_minibatches_processed_);
     ResetGenerators(nnet_);
-    TrainInternalBackstitch(chain_eg, *computation, is_backstitch_step1);
+    TrainInternalBackstitch(chain_eg, computation, is_backstitch_step1);
     FreezeNaturalGradient(false, delta_nnet_); // un-freeze natural gradient
     is_backstitch_step1 = false;
     srand(srand_seed_ + num_minibatches_processed_);
     ResetGenerators(nnet_);
-    TrainInternalBackstitch(chain_eg, *computation, is_backstitch_step1);
+    TrainInternalBackstitch(chain_eg, computation, is_backstitch_step1);
   } else { // conventional training
-    TrainInternal(chain_eg, *computation);
+    TrainInternal(chain_eg, computation);
   }
   if (num_minibatches_processed_ == 0) {
     ConsolidateMemory(nnet_);
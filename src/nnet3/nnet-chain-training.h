@@ -61,6 +61,15 @@ class NnetChainTrainer {
   // train on one minibatch.
   void Train(const NnetChainExample &eg);
 
+  // Returns the compiled computation for training on 'eg'.  This may be
+  // called from a different thread than Train(), to compile ahead.
+  std::shared_ptr<const NnetComputation> GetComputation(
+      const NnetChainExample &eg);
+
+  // train on one minibatch, using the computation returned by
+  // GetComputation(eg).
+  void Train(const NnetChainExample &eg, const NnetComputation &computation);
+
   // Prints out the final stats, and return true if there was a nonzero count.
   bool PrintTotalStats() const;
 
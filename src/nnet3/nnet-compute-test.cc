@@ -276,6 +276,129 @@ void UnitTestNnetCompute() {
   }
 }
 
+// Checks that running a computation with several threads gives the same
+// results as running it with one.
+void UnitTestNnetComputeMultiThreaded() {
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+    NnetComputation computation;
+    Compiler compiler(request, nnet);
+    CompilerOptions opts;
+    compiler.CreateComputation(opts, &computation);
+    if (RandInt(0, 1) == 0) {
+      NnetOptimizeOptions opt_config;
+      Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+               &computation);
+    }
+    computation.ComputeCudaIndexes();
+
+    CuMatrix<BaseFloat> output_deriv;
+    std::vector<CuMatrix<BaseFloat> > outputs(2), input_derivs(2);
+    std::vector<Nnet> nnets(2, nnet);
+    for (int32 i = 0; i < 2; i++) {
+      NnetComputeOptions compute_opts;
+      compute_opts.num_threads = (i == 0 ? 1 : RandInt(2, 4));
+      ResetGenerators(&(nnets[i]));
+      NnetComputer computer(compute_opts, computation, nnets[i], &(nnets[i]));
+      for (size_t j = 0; j < request.inputs.size(); j++) {
+        CuMatrix<BaseFloat> temp(inputs[j]);
+        computer.AcceptInput(request.inputs[j].name, &temp);
+      }
+      computer.Run();
+      outputs[i] = computer.GetOutput("output");
+      if (request.outputs[0].has_deriv) {
+        if (i == 0) {
+          output_deriv.Resize(outputs[i].NumRows(), outputs[i].NumCols());
+          output_deriv.SetRandn();
+        }
+        CuMatrix<BaseFloat> temp(output_deriv);
+        computer.AcceptInput("output", &temp);
+        computer.Run();
+        if (request.inputs[0].has_deriv)
+          input_derivs[i] = computer.GetOutput(request.inputs[0].name);
+      }
+    }
+    AssertEqual(outputs[0], outputs[1]);
+    AssertEqual(input_derivs[0], input_derivs[1]);
+    AddNnet(nnets[1], -1.0, &(nnets[0]));
+    KALDI_ASSERT(DotProduct(nnets[0], nnets[0]) <=
+                 1.0e-06 * (1.0 + DotProduct(nnets[1], nnets[1])));
+  }
+}
+
+// Checks that fusing nonlinearities (see NnetComputeOptions) does not change
+// the output, on a network with chains of nonlinearities and enough frames
+// that they are processed in several blocks of rows.
+void UnitTestNnetComputeFused() {
+  std::string config =
+      "input-node name=input dim=40\n"
+      "component name=affine1 type=AffineComponent input-dim=40 "
+      "output-dim=200\n"
+      "component-node name=affine1 component=affine1 input=input\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=200\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component name=norm1 type=NormalizeComponent dim=200\n"
+      "component-node name=norm1 component=norm1 input=relu1\n"
+      "component name=affine2 type=AffineComponent input-dim=600 "
+      "output-dim=150\n"
+      "component-node name=affine2 component=affine2 "
+      "input=Append(Offset(norm1, -1), norm1, Offset(norm1, 1))\n"
+      "component name=sigmoid2 type=SigmoidComponent dim=150\n"
+      "component-node name=sigmoid2 component=sigmoid2 input=affine2\n"
+      "component name=tanh2 type=TanhComponent dim=150\n"
+      "component-node name=tanh2 component=tanh2 input=sigmoid2\n"
+      "component name=norm2 type=NormalizeComponent dim=150\n"
+      "component-node name=norm2 component=norm2 input=tanh2\n"
+      "output-node name=output input=norm2\n";
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+
+  int32 num_frames = RandInt(100, 1000);
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", -1, num_frames + 1));
+  request.outputs.push_back(IoSpecification("output", 0, num_frames));
+  CachingOptimizingCompiler compiler(nnet);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler.Compile(request);
+  CuMatrix<BaseFloat> input(num_frames + 2, 40);
+  input.SetRandn();
+
+  std::vector<CuMatrix<BaseFloat> > outputs(2);
+  for (int32 i = 0; i < 2; i++) {
+    NnetComputeOptions compute_opts;
+    compute_opts.fuse_nonlinearities = (i == 1);
+    NnetComputer computer(compute_opts, *computation, nnet, NULL);
+    bool use_gpu = false;
+#if HAVE_CUDA == 1
+    use_gpu = CuDevice::Instantiate().Enabled();
+#endif
+    // The optimizer makes norm1 work in place on relu1's output (and the same
+    // for sigmoid2, tanh2 and norm2), so there is something to fuse; fusion
+    // is not done on GPU.
+    if (compute_opts.fuse_nonlinearities && !use_gpu)
+      KALDI_ASSERT(computer.NumFusedPropagateGroups() > 0);
+    else
+      KALDI_ASSERT(computer.NumFusedPropagateGroups() == 0);
+    CuMatrix<BaseFloat> temp(input);
+    computer.AcceptInput("input", &temp);
+    computer.Run();
+    computer.GetOutputDestructive("output", &(outputs[i]));
+  }
+  AssertEqual(outputs[0], outputs[1]);
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -296,6 +419,8 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetCompute();
+    UnitTestNnetComputeMultiThreaded();
+    UnitTestNnetComputeFused();
   }
 
   KALDI_LOG << "Nnet tests succeeded.";
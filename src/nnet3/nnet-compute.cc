@@ -17,21 +17,146 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <mutex>
+#include <queue>
 #include <sstream>
+#include <thread>
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-normalize-component.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
 
 
+/**
+   This class executes a block of commands of an NnetComputer (see
+   NnetComputer::ExecuteCommandsInParallel()) using a pool of threads that
+   lasts as long as the NnetComputer.  The thread that calls Run() executes
+   commands too, so there are num_threads - 1 threads in the pool.  Commands
+   become ready when all of their predecessors have finished; ready commands
+   are taken lowest-index-first, so the execution order stays close to the
+   serial one.
+ */
+class NnetComputer::ParallelExecutor {
+ public:
+  ParallelExecutor(NnetComputer *computer, int32 num_threads):
+      computer_(computer), num_remaining_(0), shutdown_(false) {
+    for (int32 i = 1; i < num_threads; i++)
+      threads_.push_back(std::thread(&ParallelExecutor::ThreadFunction, this));
+  }
+
+  // Executes the commands begin ... end - 1 and returns when they have all
+  // finished.  If any of them threw, the first exception is rethrown here
+  // (once the commands that were running have finished).
+  void Run(int32 begin, int32 end) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_pending_.resize(computer_->num_command_predecessors_.size());
+    for (int32 command = begin; command < end; command++) {
+      num_pending_[command] = computer_->num_command_predecessors_[command];
+      if (num_pending_[command] == 0)
+        ready_.push(command);
+    }
+    num_remaining_ = end - begin;
+    error_ = std::exception_ptr();
+    cond_.notify_all();
+    while (num_remaining_ > 0) {
+      if (!ready_.empty())
+        ExecuteReadyCommand(&lock);
+      else
+        cond_.wait(lock);
+    }
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = std::exception_ptr();
+      lock.unlock();
+      std::rethrow_exception(error);
+    }
+  }
+
+  ~ParallelExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    cond_.notify_all();
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+  }
+
+ private:
+  void ThreadFunction() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (!ready_.empty())
+        ExecuteReadyCommand(&lock);
+      else if (shutdown_)
+        return;
+      else
+        cond_.wait(lock);
+    }
+  }
+
+  // Takes the first ready command, executes it without holding the lock and
+  // then releases its successors.  Expects 'lock' to be locked, and leaves it
+  // locked.  After an error, the remaining commands of the block are not
+  // executed but are still counted off so that Run() can return.
+  void ExecuteReadyCommand(std::unique_lock<std::mutex> *lock) {
+    int32 command = ready_.top();
+    ready_.pop();
+    if (!error_) {
+      lock->unlock();
+      std::exception_ptr error;
+      try {
+        computer_->ExecuteCommand(command);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock->lock();
+      if (error && !error_)
+        error_ = error;
+    }
+    const std::vector<int32> &successors =
+        computer_->command_successors_[command];
+    for (size_t i = 0; i < successors.size(); i++)
+      if (--num_pending_[successors[i]] == 0)
+        ready_.push(successors[i]);
+    num_remaining_--;
+    if (!successors.empty() || num_remaining_ == 0)
+      cond_.notify_all();
+  }
+
+  NnetComputer *computer_;
+  std::vector<std::thread> threads_;
+  // mutex_ guards all of the variables below.
+  std::mutex mutex_;
+  // Signaled when commands become ready, when a block is finished and on
+  // shutdown.
+  std::condition_variable cond_;
+  std::priority_queue<int32, std::vector<int32>,
+                      std::greater<int32> > ready_;
+  // The number of unfinished predecessors of each command of the current
+  // block.
+  std::vector<int32> num_pending_;
+  // The number of commands of the current block that have not finished.
+  int32 num_remaining_;
+  std::exception_ptr error_;
+  bool shutdown_;
+};
+
+
 NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
                            const Nnet &nnet,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(nnet),
     program_counter_(0), nnet_to_store_stats_(nnet_to_update),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), parallel_executor_(NULL) {
   Init();
 }
 
@@ -41,7 +166,7 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(*nnet),
     program_counter_(0), nnet_to_store_stats_(nnet),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), parallel_executor_(NULL) {
   Init();
 }
 
@@ -62,6 +187,240 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  bool use_threads = (options_.num_threads > 1 && !debug_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    use_threads = false;
+#endif
+  if (use_threads)
+    ComputeCommandDependencies();
+  bool fuse = (options_.fuse_nonlinearities && !debug_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    fuse = false;
+#endif
+  if (fuse)
+    ComputeFusedPropagates();
+}
+
+// static
+bool NnetComputer::IsBarrierCommand(CommandType command_type) {
+  switch (command_type) {
+    case kAcceptInput: case kProvideOutput: case kNoOperationMarker:
+    case kNoOperationLabel: case kGotoLabel:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void NnetComputer::ComputeCommandDependencies() {
+  ComputationVariables variables;
+  variables.Init(computation_);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet_, computation_, variables, &attributes);
+
+  const std::vector<NnetComputation::Command> &c = computation_.commands;
+  int32 num_commands = c.size(), num_variables = variables.NumVariables(),
+      num_components = nnet_.NumComponents();
+  command_successors_.clear();
+  command_successors_.resize(num_commands);
+  num_command_predecessors_.clear();
+  num_command_predecessors_.resize(num_commands, 0);
+
+  // For each variable, the last command that wrote to it and the commands
+  // that have read it since then; for each component, the last command that
+  // used it.  -1 means none (within the current block).
+  std::vector<int32> last_writer(num_variables, -1),
+      last_component_user(num_components, -1);
+  std::vector<std::vector<int32> > readers(num_variables);
+  // The variables and components touched in the current block, so they can
+  // be reset at the next barrier.
+  std::vector<int32> touched_variables, touched_components;
+
+  std::vector<int32> variables_read, variables_written, predecessors;
+  for (int32 command = 0; command < num_commands; command++) {
+    CommandType command_type = c[command].command_type;
+    if (IsBarrierCommand(command_type)) {
+      for (size_t i = 0; i < touched_variables.size(); i++) {
+        last_writer[touched_variables[i]] = -1;
+        readers[touched_variables[i]].clear();
+      }
+      for (size_t i = 0; i < touched_components.size(); i++)
+        last_component_user[touched_components[i]] = -1;
+      touched_variables.clear();
+      touched_components.clear();
+      continue;
+    }
+    variables_read = attributes[command].variables_read;
+    variables_written = attributes[command].variables_written;
+    if (command_type == kAllocMatrix || command_type == kDeallocMatrix ||
+        command_type == kSwapMatrix) {
+      // These change the matrix object itself, so they act as writes to all
+      // of its variables.
+      variables.AppendVariablesForMatrix(
+          computation_.submatrices[c[command].arg1].matrix_index,
+          &variables_written);
+      if (command_type == kSwapMatrix)
+        variables.AppendVariablesForMatrix(
+            computation_.submatrices[c[command].arg2].matrix_index,
+            &variables_written);
+    }
+    predecessors.clear();
+    for (size_t i = 0; i < variables_read.size(); i++) {
+      int32 v = variables_read[i];
+      if (last_writer[v] != -1)
+        predecessors.push_back(last_writer[v]);
+    }
+    for (size_t i = 0; i < variables_written.size(); i++) {
+      int32 v = variables_written[i];
+      if (last_writer[v] != -1)
+        predecessors.push_back(last_writer[v]);
+      predecessors.insert(predecessors.end(), readers[v].begin(),
+                          readers[v].end());
+    }
+    if (command_type == kPropagate || command_type == kBackprop ||
+        command_type == kBackpropNoModelUpdate) {
+      // Commands that use the same component are kept in order: they may
+      // store stats in it or update it, and a backprop may need the memo from
+      // the propagate.
+      int32 component = c[command].arg1;
+      if (last_component_user[component] != -1)
+        predecessors.push_back(last_component_user[component]);
+      else
+        touched_components.push_back(component);
+      last_component_user[component] = command;
+    }
+    SortAndUniq(&predecessors);
+    for (size_t i = 0; i < predecessors.size(); i++)
+      command_successors_[predecessors[i]].push_back(command);
+    num_command_predecessors_[command] = predecessors.size();
+
+    for (size_t i = 0; i < variables_read.size(); i++) {
+      int32 v = variables_read[i];
+      readers[v].push_back(command);
+      touched_variables.push_back(v);
+    }
+    for (size_t i = 0; i < variables_written.size(); i++) {
+      int32 v = variables_written[i];
+      last_writer[v] = command;
+      // A command that reads and writes a variable is its writer, not one of
+      // its readers.
+      readers[v].clear();
+      touched_variables.push_back(v);
+    }
+  }
+}
+
+// Returns true if the Propagate() function of component 'c' works row by row
+// (so it can be applied to blocks of rows separately, and in place) and is
+// cheap enough that its cost is dominated by memory access.
+static bool IsRowWiseNonlinearity(const Component &c) {
+  if (dynamic_cast<const RectifiedLinearComponent*>(&c) != NULL ||
+      dynamic_cast<const SigmoidComponent*>(&c) != NULL ||
+      dynamic_cast<const TanhComponent*>(&c) != NULL ||
+      dynamic_cast<const NormalizeComponent*>(&c) != NULL)
+    return true;
+  // Batch-norm only works row by row in test mode, where it is a fixed
+  // per-dimension affine transform.
+  const BatchNormComponent *bc = dynamic_cast<const BatchNormComponent*>(&c);
+  return (bc != NULL && bc->Offset().Dim() != 0);
+}
+
+bool NnetComputer::CanFusePropagate(int32 command) const {
+  const NnetComputation::Command &c = computation_.commands[command];
+  return (c.command_type == kPropagate && c.arg2 == 0 && c.arg5 == 0 &&
+          c.arg6 == 0 && IsRowWiseNonlinearity(*nnet_.GetComponent(c.arg1)));
+}
+
+void NnetComputer::ComputeFusedPropagates() {
+  const std::vector<NnetComputation::Command> &c = computation_.commands;
+  int32 num_commands = c.size();
+  fused_propagate_end_.clear();
+  fused_propagate_end_.resize(num_commands, 0);
+  bool any_fused = false;
+  int32 begin = 0;
+  while (begin < num_commands) {
+    if (!CanFusePropagate(begin)) {
+      begin++;
+      continue;
+    }
+    int32 input_submatrix = c[begin].arg3, output_submatrix = c[begin].arg4;
+    // If the first command is not in place, its input and output must not
+    // overlap, or processing by blocks of rows could change the result.
+    if (input_submatrix != output_submatrix &&
+        computation_.submatrices[input_submatrix].matrix_index ==
+        computation_.submatrices[output_submatrix].matrix_index) {
+      begin++;
+      continue;
+    }
+    int32 end = begin + 1;
+    while (end < num_commands && CanFusePropagate(end) &&
+           c[end].arg3 == output_submatrix && c[end].arg4 == output_submatrix)
+      end++;
+    if (end - begin > 1) {
+      fused_propagate_end_[begin] = end;
+      for (int32 command = begin + 1; command < end; command++)
+        fused_propagate_end_[command] = -1;
+      any_fused = true;
+    }
+    begin = end;
+  }
+  if (!any_fused)
+    fused_propagate_end_.clear();
+}
+
+int32 NnetComputer::NumFusedPropagateGroups() const {
+  int32 ans = 0;
+  for (size_t i = 0; i < fused_propagate_end_.size(); i++)
+    if (fused_propagate_end_[i] > 0)
+      ans++;
+  return ans;
+}
+
+void NnetComputer::ExecuteFusedPropagates(int32 begin, int32 end) {
+  NVTX_RANGE("NnetComputer::ExecuteFusedPropagates");
+  // The number of elements in each block of rows; 16k floats is 64KB, which
+  // fits comfortably in the L2 cache.
+  const int32 block_elements = 16384;
+  const std::vector<NnetComputation::Command> &c = computation_.commands;
+  const CuSubMatrix<BaseFloat> input(GetSubMatrix(c[begin].arg3));
+  CuSubMatrix<BaseFloat> output(GetSubMatrix(c[begin].arg4));
+  int32 num_rows = output.NumRows(),
+      block_size = std::max<int32>(1, block_elements / output.NumCols());
+  for (int32 row = 0; row < num_rows; row += block_size) {
+    int32 this_block_size = std::min(block_size, num_rows - row);
+    const CuSubMatrix<BaseFloat> input_block(
+        input.RowRange(row, this_block_size));
+    CuSubMatrix<BaseFloat> output_block(output.RowRange(row, this_block_size));
+    for (int32 command = begin; command < end; command++) {
+      const Component *component = nnet_.GetComponent(c[command].arg1);
+      void *memo = component->Propagate(
+          NULL, (command == begin ? input_block : output_block),
+          &output_block);
+      if (memo != NULL)  // No memo is needed; see CanFusePropagate().
+        component->DeleteMemo(memo);
+    }
+  }
+}
+
+void NnetComputer::ExecuteCommandsInParallel(int32 begin, int32 end) {
+  if (parallel_executor_ == NULL) {
+    parallel_executor_ = new ParallelExecutor(this, options_.num_threads);
+    // SaveMemo() would otherwise resize memos_ while other threads use it.
+    int32 max_memo_index = 0;
+    const std::vector<NnetComputation::Command> &c = computation_.commands;
+    for (size_t i = 0; i < c.size(); i++) {
+      if (c[i].command_type == kPropagate)
+        max_memo_index = std::max(max_memo_index, c[i].arg5);
+      else if (c[i].command_type == kBackprop ||
+               c[i].command_type == kBackpropNoModelUpdate)
+        max_memo_index = std::max(max_memo_index, c[i].arg7);
+    }
+    if (memos_.size() <= static_cast<size_t>(max_memo_index))
+      memos_.resize(max_memo_index + 1, NULL);
+  }
+  parallel_executor_->Run(begin, end);
 }
 
 //static
@@ -199,7 +558,11 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
+    memos_(other.memos_),
+    command_successors_(other.command_successors_),
+    num_command_predecessors_(other.num_command_predecessors_),
+    parallel_executor_(NULL),
+    fused_propagate_end_(other.fused_propagate_end_) {
   // Note: this is the same as the default copy constructor, except for the check below.
   if (!memos_.empty()) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
@@ -207,8 +570,8 @@ NnetComputer::NnetComputer(const NnetComputer &other):
   }
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command) {
+  const NnetComputation::Command &c = computation_.commands[command];
   int32 m1, m2;
   try {
     switch (c.command_type) {
@@ -236,6 +599,14 @@ void NnetComputer::ExecuteCommand() {
       }
       case kPropagate: {
         NVTX_RANGE("NnetComputer::ExecuteCommand::kPropagate");
+        if (!fused_propagate_end_.empty() &&
+            fused_propagate_end_[command] != 0) {
+          // The command is part of a fused group.  If it's not the first
+          // command of the group, it was done when the first one was.
+          if (fused_propagate_end_[command] > 0)
+            ExecuteFusedPropagates(command, fused_propagate_end_[command]);
+          break;
+        }
         const Component *component = nnet_.GetComponent(c.arg1);
         ComponentPrecomputedIndexes *indexes =
             computation_.component_precomputed_indexes[c.arg2].data;
@@ -426,23 +797,27 @@ void NnetComputer::ExecuteCommand() {
         break;
       case kGotoLabel:
         KALDI_ASSERT(computation_.commands[c.arg1].command_type == kNoOperationLabel);
+        KALDI_ASSERT(command == program_counter_);
         program_counter_ = c.arg1;
         break;
       default:
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
+    // We use local copies of the command strings as this may be called from
+    // several threads at once (see ParallelExecutor).
+    std::string preamble;
+    std::vector<std::string> command_strings;
+    computation_.GetCommandStrings(nnet_, &preamble, &command_strings);
     if (!debug_) {
-      std::string preamble;
-      computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
-        KALDI_LOG << command_strings_[prev_c];
+      for (int32 prev_c = 0; prev_c < command; prev_c++)
+        KALDI_LOG << command_strings[prev_c];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command " << command_strings[command];
   }
 }
 
@@ -532,9 +907,21 @@ void NnetComputer::Run() {
       // interaction, e.g. the end of the forward or backward phase.
       break;
     }
+    if (!command_successors_.empty() &&
+        !IsBarrierCommand(c[program_counter_].command_type)) {
+      // Execute the block of commands up to the next barrier in parallel.
+      int32 end = program_counter_ + 1;
+      while (end < num_commands && !IsBarrierCommand(c[end].command_type))
+        end++;
+      if (end - program_counter_ > 1) {
+        ExecuteCommandsInParallel(program_counter_, end);
+        program_counter_ = end - 1;
+        continue;
+      }
+    }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    ExecuteCommand(program_counter_);
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -684,6 +1071,7 @@ NnetComputer::~NnetComputer() {
   // the forward propagation but not the backprop.
   for (size_t i = 0; i < compressed_matrices_.size(); i++)
     delete compressed_matrices_[i];
+  delete parallel_executor_;
 }
 
 } // namespace nnet3
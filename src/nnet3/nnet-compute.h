@@ -38,11 +38,26 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  bool fuse_nonlinearities;
+  NnetComputeOptions(): debug(false), num_threads(1),
+                        fuse_nonlinearities(true) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "execute the commands of the computation; commands that "
+                   "do not depend on each other (e.g. separate branches of "
+                   "the network) are run in parallel.  Only affects CPU "
+                   "computation; you will normally want your BLAS library to "
+                   "use a single thread if you set this.");
+    opts->Register("fuse-nonlinearities", &fuse_nonlinearities, "If true, "
+                   "successive nonlinearities and normalizations that are "
+                   "applied to the same matrix (e.g. ReLU then batch-norm) "
+                   "are run together on blocks of rows small enough to stay "
+                   "in cache, instead of each passing over the whole matrix. "
+                   "Only affects CPU computation.");
   }
 
 };
@@ -124,11 +139,20 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
+  /// Returns the number of groups of kPropagate commands that are executed
+  /// together because of the --fuse-nonlinearities option (zero if there
+  /// was nothing to fuse, or the option is not in effect).  Used in testing.
+  int32 NumFusedPropagateGroups() const;
+
 
   ~NnetComputer();
  private:
   void Init(); // called from constructors.
 
+  // Runs the commands of the computation in several threads; defined in the
+  // .cc file.
+  class ParallelExecutor;
+
   const NnetComputeOptions &options_;
   const NnetComputation &computation_;
   const Nnet &nnet_;
@@ -172,9 +196,62 @@ class NnetComputer {
   // happens.
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
-
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // The following three variables are only set up if options_.num_threads >
+  // 1 (and we are not using a GPU or debugging).  They describe the order in
+  // which commands must be executed: command_successors_[c] lists the commands
+  // that may not start until command c has finished, and
+  // num_command_predecessors_[c] is the number of commands that c waits for.
+  // Dependencies only exist within "blocks" of commands that contain no
+  // barrier commands (see IsBarrierCommand()); a block is executed in
+  // parallel, and the barriers one at a time.
+  std::vector<std::vector<int32> > command_successors_;
+  std::vector<int32> num_command_predecessors_;
+  ParallelExecutor *parallel_executor_;
+
+  // fused_propagate_end_ is only set up if options_.fuse_nonlinearities is
+  // true (and we are not using a GPU or debugging), and is empty if there was
+  // nothing to fuse.  It describes groups of successive kPropagate commands
+  // that are executed together by ExecuteFusedPropagates(): for the first
+  // command of a group, it is the index one past its last command; for the
+  // other commands of the group it is -1 (they have nothing left to do when
+  // they are reached); and for other commands it is 0.
+  std::vector<int32> fused_propagate_end_;
+
+  // Returns true for commands that must be executed on their own, in order:
+  // input, output, and the markers and labels that control the flow of the
+  // computation.
+  static bool IsBarrierCommand(CommandType command_type);
+
+  // Sets up command_successors_ and num_command_predecessors_ from the
+  // variables (parts of matrices) that each command reads and writes.  Also,
+  // commands that use the same component are kept in order.
+  void ComputeCommandDependencies();
+
+  // Executes the commands begin ... end - 1, which must be a block containing
+  // no barrier commands, using parallel_executor_.
+  void ExecuteCommandsInParallel(int32 begin, int32 end);
+
+  // Returns true if 'command' is a kPropagate command that may be part of a
+  // group in fused_propagate_end_: its component must work row by row (see
+  // IsRowWiseNonlinearity() in the .cc file), and it must not save a memo or
+  // store stats.
+  bool CanFusePropagate(int32 command) const;
+
+  // Sets up fused_propagate_end_.  A group consists of a kPropagate command
+  // followed by at least one kPropagate command that works in place on its
+  // output, all satisfying CanFusePropagate().  The optimizer produces such
+  // sequences when in-place propagation is possible, i.e. when the
+  // intermediate values are not needed for backprop.
+  void ComputeFusedPropagates();
+
+  // Executes the group of kPropagate commands begin ... end - 1 (see
+  // fused_propagate_end_) on one block of rows at a time, so that each block
+  // stays in cache for all of the commands.
+  void ExecuteFusedPropagates(int32 begin, int32 end);
+
+  // executes the command in computation_.commands[command]; 'command' must
+  // equal program_counter_ for kGotoLabel, which changes program_counter_.
+  void ExecuteCommand(int32 command);
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -559,8 +559,26 @@ class TdnnComponent: public UpdatableComponent {
 
   BaseFloat OrthonormalConstraint() const { return orthonormal_constraint_; }
 
+  const std::vector<int32> &TimeOffsets() const { return time_offsets_; }
+
   void ConsolidateMemory();
- private:
+
+  // The following static functions do the work of GetInputIndexes(),
+  // IsComputable(), ReorderIndexes() and PrecomputeIndexes(), given the time
+  // offsets.  They are public so that QuantizedTdnnComponent can share them.
+  static void GetTdnnInputIndexes(const std::vector<int32> &time_offsets,
+                                  const Index &output_index,
+                                  std::vector<Index> *desired_indexes);
+  static bool TdnnIsComputable(const std::vector<int32> &time_offsets,
+                               const Index &output_index,
+                               const IndexSet &input_index_set,
+                               std::vector<Index> *used_inputs);
+  static void ReorderTdnnIndexes(std::vector<Index> *input_indexes,
+                                 std::vector<Index> *output_indexes);
+  static PrecomputedIndexes *PrecomputeTdnnIndexes(
+      const std::vector<int32> &time_offsets,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes);
 
   // This static function is a utility function that extracts a CuSubMatrix
   // representing a subset of rows of 'input_matrix'.
@@ -571,6 +589,7 @@ class TdnnComponent: public UpdatableComponent {
       int32 num_output_rows,
       int32 row_stride,
       int32 row_offset);
+ private:
 
   // see the definition for more explanation.
   static void ModifyComputationIo(time_height_convolution::ConvolutionComputationIo *io);
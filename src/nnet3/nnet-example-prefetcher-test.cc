@@ -0,0 +1,128 @@
+// nnet3/nnet-example-prefetcher-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include "nnet3/nnet-example-prefetcher.h"
+#include "matrix/kaldi-matrix.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Stands in for NnetTrainer.  Its "computation" for an example records the
+// number of rows of the example, so we can check that each example gets the
+// right computation.
+class TestTrainer {
+ public:
+  std::shared_ptr<const NnetComputation> GetComputation(
+      const Matrix<BaseFloat> &eg) {
+    NnetComputation *computation = new NnetComputation();
+    computation->matrices.resize(eg.NumRows());
+    return std::shared_ptr<const NnetComputation>(computation);
+  }
+};
+
+void UnitTestExamplePrefetcher() {
+  std::vector<Matrix<BaseFloat> > egs(RandInt(0, 30));
+  {
+    TableWriter<KaldiObjectHolder<Matrix<BaseFloat> > > writer(
+        "ark:tmpf.prefetch_egs");
+    IndexedEgsWriter<Matrix<BaseFloat> > indexed_writer(
+        "tmpf.prefetch_egs.idx");
+    for (size_t i = 0; i < egs.size(); i++) {
+      egs[i].Resize(RandInt(1, 20), RandInt(1, 5));
+      egs[i].SetRandn();
+      egs[i](0, 0) = i;  // so we can tell which example it is.
+      std::ostringstream os;
+      os << "eg" << i;
+      writer.Write(os.str(), egs[i]);
+      indexed_writer.Write(os.str(), egs[i]);
+    }
+  }
+  for (int32 prefetch = 0; prefetch < 4; prefetch++) {
+    for (int32 indexed = 0; indexed < 2; indexed++) {
+      ExamplePrefetcherOptions opts;
+      opts.prefetch_minibatches = prefetch;
+      opts.indexed_egs = (indexed != 0);
+      opts.shuffle_indexed_egs = false;
+      TestTrainer trainer;
+      ExamplePrefetcher<Matrix<BaseFloat>, TestTrainer> prefetcher(
+          opts, (indexed ? "tmpf.prefetch_egs.idx" : "ark:tmpf.prefetch_egs"),
+          &trainer);
+      Matrix<BaseFloat> eg;
+      std::shared_ptr<const NnetComputation> computation;
+      size_t i = 0;
+      while (prefetcher.Next(&eg, &computation)) {
+        KALDI_ASSERT(i < egs.size());
+        AssertEqual(eg, egs[i]);
+        KALDI_ASSERT(static_cast<int32>(computation->matrices.size()) ==
+                     eg.NumRows());
+        if (RandInt(0, 3) == 0)
+          Sleep(0.001);  // let the background thread get ahead.
+        i++;
+      }
+      KALDI_ASSERT(i == egs.size());
+      KALDI_ASSERT(!prefetcher.Next(&eg, &computation));
+    }
+  }
+  for (int32 prefetch = 0; prefetch < 2; prefetch++) {
+    // With --shuffle-indexed-egs, we should see every example exactly once.
+    ExamplePrefetcherOptions opts;
+    opts.prefetch_minibatches = prefetch;
+    opts.indexed_egs = true;
+    TestTrainer trainer;
+    ExamplePrefetcher<Matrix<BaseFloat>, TestTrainer> prefetcher(
+        opts, "tmpf.prefetch_egs.idx", &trainer);
+    Matrix<BaseFloat> eg;
+    std::shared_ptr<const NnetComputation> computation;
+    std::vector<int32> counts(egs.size(), 0);
+    while (prefetcher.Next(&eg, &computation)) {
+      int32 i = static_cast<int32>(eg(0, 0));
+      KALDI_ASSERT(i >= 0 && i < static_cast<int32>(egs.size()));
+      AssertEqual(eg, egs[i]);
+      counts[i]++;
+    }
+    for (size_t i = 0; i < egs.size(); i++)
+      KALDI_ASSERT(counts[i] == 1);
+  }
+  {
+    // Stop before the end, to test the destructor.
+    ExamplePrefetcherOptions opts;
+    opts.prefetch_minibatches = 2;
+    TestTrainer trainer;
+    ExamplePrefetcher<Matrix<BaseFloat>, TestTrainer> prefetcher(
+        opts, "ark:tmpf.prefetch_egs", &trainer);
+    Matrix<BaseFloat> eg;
+    std::shared_ptr<const NnetComputation> computation;
+    prefetcher.Next(&eg, &computation);
+  }
+  std::remove("tmpf.prefetch_egs");
+  std::remove("tmpf.prefetch_egs.idx");
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  for (int32 i = 0; i < 5; i++)
+    UnitTestExamplePrefetcher();
+
+  KALDI_LOG << "Example-prefetcher tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,300 @@
+// nnet3/nnet-example-prefetcher.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_EXAMPLE_PREFETCHER_H_
+#define KALDI_NNET3_NNET_EXAMPLE_PREFETCHER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-computation.h"
+#include "nnet3/nnet-indexed-egs.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+struct ExamplePrefetcherOptions {
+  int32 prefetch_minibatches;
+  bool indexed_egs;
+  bool shuffle_indexed_egs;
+
+  ExamplePrefetcherOptions(): prefetch_minibatches(0), indexed_egs(false),
+                              shuffle_indexed_egs(true) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("prefetch-minibatches", &prefetch_minibatches, "If >0, "
+                   "read the minibatches and compile their computations in a "
+                   "background thread, up to this many minibatches ahead of "
+                   "the training, so that the reading and compilation overlap "
+                   "with the computation.");
+    opts->Register("indexed-egs", &indexed_egs, "If true, the examples are "
+                   "read from an indexed egs archive (see "
+                   "nnet3/nnet-indexed-egs.h), which is memory-mapped, instead "
+                   "of being read as a table.");
+    opts->Register("shuffle-indexed-egs", &shuffle_indexed_egs, "If true, "
+                   "read the examples of an indexed egs archive in a random "
+                   "order, which depends on --srand, instead of the order of "
+                   "the archive.  Only relevant if --indexed-egs=true.");
+  }
+};
+
+
+/**
+   This class supplies a training program with its minibatches, together with
+   the compiled computations for them.  Example is NnetExample or
+   NnetChainExample, and Trainer is the corresponding trainer class
+   (NnetTrainer or NnetChainTrainer), which must have a thread-safe function
+   GetComputation(const Example&).
+
+   If opts.prefetch_minibatches > 0, a background thread reads the examples and
+   compiles their computations into a queue of at most that many minibatches,
+   while the main thread trains on the minibatches it gets from Next().  This
+   keeps the GPU (or on CPU, the training thread) busy while the next
+   minibatch is being read and parsed.  Otherwise Next() reads and compiles
+   each minibatch itself, in the usual way.  Either way, the destructor prints
+   how the time was divided between the stages.
+
+   Example usage:
+\code
+    ExamplePrefetcher<NnetExample, NnetTrainer> prefetcher(
+        prefetch_opts, examples_rspecifier, &trainer);
+    NnetExample eg;
+    std::shared_ptr<const NnetComputation> computation;
+    while (prefetcher.Next(&eg, &computation))
+      trainer.Train(eg, *computation);
+\endcode
+*/
+template <class Example, class Trainer>
+class ExamplePrefetcher {
+ public:
+  /// 'examples_rspecifier' is the filename of the archive, if
+  /// opts.indexed_egs is true.  If opts.shuffle_indexed_egs is also true, the
+  /// order of the examples is seeded from Rand(), so call srand() first.
+  ExamplePrefetcher(const ExamplePrefetcherOptions &opts,
+                    const std::string &examples_rspecifier,
+                    Trainer *trainer);
+
+  /// Outputs the next minibatch and its computation and returns true, or
+  /// returns false if there are no more minibatches.  An error in reading
+  /// the examples is thrown from here.
+  bool Next(Example *eg, std::shared_ptr<const NnetComputation> *computation);
+
+  /// Waits for the background thread, if any, and prints the timing info.
+  ~ExamplePrefetcher();
+
+ private:
+  struct Minibatch {
+    Example eg;
+    std::shared_ptr<const NnetComputation> computation;
+  };
+
+  // Reads the next example from whichever reader we are using, and
+  // returns false if there are no more.
+  bool ReadExample(Example *eg);
+
+  // The function that runs in the background thread.
+  void ProducerThread();
+
+  ExamplePrefetcherOptions opts_;
+  Trainer *trainer_;
+  SequentialTableReader<KaldiObjectHolder<Example> > table_reader_;
+  std::unique_ptr<IndexedEgsReader<Example> > indexed_reader_;
+  // The order in which we read indexed_reader_, if opts_.shuffle_indexed_egs.
+  std::unique_ptr<IndexedEgsOrder> indexed_order_;
+  int32 indexed_position_;  // The number of examples read from it so far.
+  bool first_read_;  // true if we haven't read from table_reader_ yet.
+
+  // The following are used only if opts_.prefetch_minibatches > 0.  The
+  // variables from queue_ to error_ are protected by mutex_.
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable queue_changed_;
+  std::deque<Minibatch*> queue_;
+  int32 num_requested_;  // The number of times Next() has been called.
+  bool done_;  // Set by the producer when there are no more examples.
+  bool stop_;  // Set by the destructor to make the producer exit early.
+  std::string error_;  // The message of any exception in the producer.
+
+  // Timing info.  read_time_ and compile_time_ are only accessed by
+  // the thread that does the reading.
+  double read_time_;
+  double compile_time_;
+  double wait_time_;
+  double train_time_;
+  Timer train_timer_;  // Started at the end of each call to Next().
+  int64 num_minibatches_;
+};
+
+
+template <class Example, class Trainer>
+ExamplePrefetcher<Example, Trainer>::ExamplePrefetcher(
+    const ExamplePrefetcherOptions &opts,
+    const std::string &examples_rspecifier,
+    Trainer *trainer):
+    opts_(opts), trainer_(trainer), indexed_position_(0), first_read_(true),
+    num_requested_(0), done_(false), stop_(false), read_time_(0.0),
+    compile_time_(0.0), wait_time_(0.0), train_time_(0.0),
+    num_minibatches_(0) {
+  if (opts_.indexed_egs) {
+    indexed_reader_.reset(new IndexedEgsReader<Example>(examples_rspecifier));
+    if (opts_.shuffle_indexed_egs && indexed_reader_->NumExamples() > 0)
+      indexed_order_.reset(new IndexedEgsOrder(indexed_reader_->NumExamples(),
+                                               Rand()));
+  } else if (!table_reader_.Open(examples_rspecifier))
+    KALDI_ERR << "Error opening examples from " << examples_rspecifier;
+  if (opts_.prefetch_minibatches > 0)
+    thread_ = std::thread(&ExamplePrefetcher<Example, Trainer>::ProducerThread,
+                          this);
+}
+
+template <class Example, class Trainer>
+bool ExamplePrefetcher<Example, Trainer>::ReadExample(Example *eg) {
+  Timer timer;
+  bool ans;
+  if (indexed_reader_ != NULL) {
+    ans = (indexed_position_ < indexed_reader_->NumExamples());
+    if (ans) {
+      int32 i = (indexed_order_ != NULL ? indexed_order_->Next() :
+                 indexed_position_);
+      indexed_reader_->GetExample(i, eg);
+      indexed_position_++;
+    }
+  } else {
+    if (!first_read_ && !table_reader_.Done())
+      table_reader_.Next();
+    first_read_ = false;
+    ans = !table_reader_.Done();
+    if (ans)
+      *eg = table_reader_.Value();
+  }
+  read_time_ += timer.Elapsed();
+  return ans;
+}
+
+template <class Example, class Trainer>
+void ExamplePrefetcher<Example, Trainer>::ProducerThread() {
+  try {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // We don't compile anything for the second minibatch until the
+        // first has been trained on, because at the end of that the trainer
+        // consolidates the model's memory (see ConsolidateMemory()), which
+        // changes the parameter matrices whose dimensions the compilation
+        // looks at.
+        while (!stop_ && (static_cast<int32>(queue_.size()) >=
+                          opts_.prefetch_minibatches ||
+                          (num_minibatches_ == 1 && num_requested_ < 2)))
+          queue_changed_.wait(lock);
+        if (stop_)
+          return;
+      }
+      Minibatch *minibatch = new Minibatch();
+      if (!ReadExample(&(minibatch->eg))) {
+        delete minibatch;
+        break;
+      }
+      Timer timer;
+      minibatch->computation = trainer_->GetComputation(minibatch->eg);
+      compile_time_ += timer.Elapsed();
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_.push_back(minibatch);
+      num_minibatches_++;
+      queue_changed_.notify_all();
+    }
+  } catch (const std::exception &e) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    error_ = e.what();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_ = true;
+  queue_changed_.notify_all();
+}
+
+template <class Example, class Trainer>
+bool ExamplePrefetcher<Example, Trainer>::Next(
+    Example *eg, std::shared_ptr<const NnetComputation> *computation) {
+  if (num_requested_ > 0)
+    train_time_ += train_timer_.Elapsed();
+  Timer timer;
+  bool ans;
+  if (opts_.prefetch_minibatches <= 0) {
+    num_requested_++;
+    ans = ReadExample(eg);
+    if (ans) {
+      Timer compile_timer;
+      *computation = trainer_->GetComputation(*eg);
+      compile_time_ += compile_timer.Elapsed();
+      num_minibatches_++;
+    }
+  } else {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_requested_++;
+    queue_changed_.notify_all();
+    while (queue_.empty() && !done_)
+      queue_changed_.wait(lock);
+    if (!error_.empty())
+      KALDI_ERR << "Error reading examples: " << error_;
+    ans = !queue_.empty();
+    if (ans) {
+      Minibatch *minibatch = queue_.front();
+      queue_.pop_front();
+      queue_changed_.notify_all();
+      lock.unlock();
+      eg->Swap(&(minibatch->eg));
+      *computation = minibatch->computation;
+      delete minibatch;
+    }
+    wait_time_ += timer.Elapsed();
+  }
+  train_timer_.Reset();
+  return ans;
+}
+
+template <class Example, class Trainer>
+ExamplePrefetcher<Example, Trainer>::~ExamplePrefetcher() {
+  if (thread_.joinable()) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+      queue_changed_.notify_all();
+    }
+    thread_.join();
+    for (size_t i = 0; i < queue_.size(); i++)
+      delete queue_[i];
+    KALDI_LOG << "Over " << num_minibatches_ << " minibatches, the background "
+              << "thread spent " << read_time_ << " seconds reading and "
+              << compile_time_ << " seconds compiling; the training spent "
+              << train_time_ << " seconds training and " << wait_time_
+              << " seconds waiting for minibatches.";
+  } else {
+    KALDI_LOG << "Over " << num_minibatches_ << " minibatches, spent "
+              << read_time_ << " seconds reading, " << compile_time_
+              << " seconds compiling and " << train_time_
+              << " seconds training.";
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_EXAMPLE_PREFETCHER_H_
@@ -96,6 +96,47 @@ void UnitTestNnetMergeExamples() {
 }
 
 
+void UnitTestShuffleWithTempFiles() {
+  // The function is templated on the Holder type; we test it with integers,
+  // which makes it easy to check the output.
+  for (int32 n = 0; n < 10; n++) {
+    int32 num_items = RandInt(0, 100), run_size = RandInt(1, 30);
+    std::string in_filename = "shuffle-test-in.ark",
+        out_filename = "shuffle-test-out.ark";
+    {
+      Int32Writer writer("ark:" + in_filename);
+      for (int32 i = 0; i < num_items; i++)
+        writer.Write("key" + std::to_string(i), i);
+    }
+    int64 num_done;
+    {
+      SequentialInt32Reader reader("ark:" + in_filename);
+      Int32Writer writer("ark:" + out_filename);
+      num_done = ShuffleWithTempFiles(run_size, ".", n, &reader, &writer);
+    }
+    KALDI_ASSERT(num_done == num_items);
+    std::vector<int32> values;
+    bool in_run_order = true;
+    for (SequentialInt32Reader reader("ark:" + out_filename); !reader.Done();
+         reader.Next()) {
+      int32 value = reader.Value();
+      KALDI_ASSERT(reader.Key() == "key" + std::to_string(value));
+      if (!values.empty() && value / run_size < values.back() / run_size)
+        in_run_order = false;
+      values.push_back(value);
+    }
+    std::vector<int32> sorted_values(values);
+    std::sort(sorted_values.begin(), sorted_values.end());
+    for (int32 i = 0; i < num_items; i++)
+      KALDI_ASSERT(sorted_values[i] == i);
+    // If there were several runs, they should have been interleaved; the
+    // chance that they stayed in order is tiny.
+    if (num_items >= 2 * run_size + 20)
+      KALDI_ASSERT(!in_run_order);
+    std::remove(in_filename.c_str());
+    std::remove(out_filename.c_str());
+  }
+}
 
 } // namespace nnet3
 } // namespace kaldi
@@ -106,6 +147,7 @@ int main() {
 
   UnitTestNnetExample();
   UnitTestNnetMergeExamples();
+  UnitTestShuffleWithTempFiles();
 
   KALDI_LOG << "Nnet-example tests succeeded.";
 
@@ -25,6 +25,11 @@
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-compute.h"
 #include "util/kaldi-table.h"
+#include "util/stl-utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <sstream>
 
 namespace kaldi {
 namespace nnet3 {
@@ -524,6 +529,123 @@ class ExampleMerger {
    MapType eg_to_egs_;
 };
 
+
+/**
+   This function copies the objects from 'reader' to 'writer' in a random order,
+   like the full randomization of nnet3-shuffle-egs, but without keeping more
+   than 'run_size' of them in memory at once, so it can shuffle archives
+   much larger than the memory.  It is templated on the Holder type so it works
+   for all the types of example (NnetExampleHolder, NnetChainExampleHolder,
+   etc.)
+
+   It reads the input in runs of 'run_size' objects, shuffles each run in
+   memory and writes it to a temporary archive in 'temp_dir'.  Then it reads
+   all the temporary archives at once, each time taking the next object from
+   a randomly chosen archive, with probability proportional to the number of
+   objects that remain in it; this makes every order of the objects equally
+   likely, as with a full shuffle in memory.  All disk access is sequential.
+   The temporary archives are deleted before returning, even on error.
+   If the whole input fits in one run, nothing is written to disk.
+
+   The runs are shuffled with std::random_shuffle, which uses the C library
+   random number generator (see srand()).  The choice of archive when merging
+   uses a 64-bit generator seeded with 'srand_seed', so that it is unbiased
+   even for very large inputs.  Returns the number of objects written.
+ */
+template <class Holder>
+int64 ShuffleWithTempFiles(int32 run_size, const std::string &temp_dir,
+                           int32 srand_seed,
+                           SequentialTableReader<Holder> *reader,
+                           TableWriter<Holder> *writer) {
+  typedef typename Holder::T T;
+  KALDI_ASSERT(run_size > 0);
+  // Owns the objects of the current run, so they are freed on exception.
+  struct RunObjects {
+    std::vector<std::pair<std::string, T*> > objects;
+    void Clear() {
+      for (size_t i = 0; i < objects.size(); i++)
+        delete objects[i].second;
+      objects.clear();
+    }
+    ~RunObjects() { Clear(); }
+  } run_objects;
+  std::vector<std::pair<std::string, T*> > &run = run_objects.objects;
+  // Deletes the temporary files when we return or on exception.
+  struct TempFiles {
+    std::vector<std::string> filenames;
+    ~TempFiles() {
+      for (size_t i = 0; i < filenames.size(); i++)
+        std::remove(filenames[i].c_str());
+    }
+  } temp_files;
+  // The filenames must be unique across processes, so we don't use Rand(),
+  // whose sequence is the same in every process.
+  std::random_device random_device;
+  std::ostringstream prefix;
+  prefix << temp_dir << "/shuffle." << std::hex << random_device()
+         << random_device() << ".";
+
+  std::vector<int64> run_sizes;
+  int64 num_done = 0;
+  while (!reader->Done()) {
+    for (; !reader->Done() && run.size() < static_cast<size_t>(run_size);
+         reader->Next())
+      run.push_back(std::make_pair(reader->Key(), new T(reader->Value())));
+    std::random_shuffle(run.begin(), run.end());
+    if (run_sizes.empty() && reader->Done()) {
+      // Everything fitted in memory.
+      for (size_t i = 0; i < run.size(); i++)
+        writer->Write(run[i].first, *(run[i].second));
+      return run.size();
+    }
+    std::ostringstream filename;
+    filename << prefix.str() << run_sizes.size() << ".ark";
+    temp_files.filenames.push_back(filename.str());
+    {
+      TableWriter<Holder> run_writer("ark:" + filename.str());
+      for (size_t i = 0; i < run.size(); i++)
+        run_writer.Write(run[i].first, *(run[i].second));
+      if (!run_writer.Close())
+        KALDI_ERR << "Error writing temporary file " << filename.str()
+                  << " (does the directory " << temp_dir << " exist and "
+                  << "does it have enough space?)";
+    }
+    run_sizes.push_back(run.size());
+    run_objects.Clear();
+  }
+  KALDI_LOG << "Wrote " << run_sizes.size() << " shuffled runs to temporary "
+            << "files in " << temp_dir << "; merging them.";
+
+  int32 num_runs = run_sizes.size();
+  std::vector<SequentialTableReader<Holder>*> run_readers(num_runs);
+  int64 num_remaining = 0;
+  for (int32 r = 0; r < num_runs; r++) {
+    run_readers[r] = new SequentialTableReader<Holder>(
+        "ark:" + temp_files.filenames[r]);
+    num_remaining += run_sizes[r];
+  }
+  std::mt19937_64 generator(srand_seed);
+  try {
+    for (; num_remaining > 0; num_remaining--, num_done++) {
+      // i is uniform on [0, num_remaining).
+      int64 i = std::uniform_int_distribution<int64>(0, num_remaining - 1)(
+          generator);
+      int32 r = 0;
+      for (; r + 1 < num_runs && i >= run_sizes[r]; r++)
+        i -= run_sizes[r];
+      KALDI_ASSERT(run_sizes[r] > 0 && !run_readers[r]->Done());
+      writer->Write(run_readers[r]->Key(), run_readers[r]->Value());
+      run_readers[r]->Next();
+      run_sizes[r]--;
+    }
+  } catch (...) {
+    DeletePointers(&run_readers);
+    throw;
+  }
+  DeletePointers(&run_readers);
+  return num_done;
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -0,0 +1,110 @@
+// nnet3/nnet-indexed-egs-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include "nnet3/nnet-indexed-egs.h"
+#include "matrix/kaldi-matrix.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The archive code only needs the example type to have Read() and Write(), so
+// we test it with matrices, which are what most of an example consists of.
+void UnitTestIndexedEgs() {
+  const char *filename = "tmpf.indexed_egs";
+  for (int32 n = 0; n < 5; n++) {
+    int32 num_examples = RandInt(0, 20);
+    std::vector<Matrix<BaseFloat> > mats(num_examples);
+    std::vector<std::string> keys(num_examples);
+    {
+      IndexedEgsWriter<Matrix<BaseFloat> > writer(filename);
+      for (int32 i = 0; i < num_examples; i++) {
+        mats[i].Resize(RandInt(1, 10), RandInt(1, 10));
+        mats[i].SetRandn();
+        std::ostringstream os;
+        os << "utt" << i << "-" << RandInt(0, 100);
+        keys[i] = os.str();
+        writer.Write(keys[i], mats[i]);
+      }
+      if (n % 2 == 0)
+        KALDI_ASSERT(writer.Close());
+      // else the destructor closes it.
+    }
+    IndexedEgsReader<Matrix<BaseFloat> > reader(filename);
+    KALDI_ASSERT(reader.NumExamples() == num_examples);
+    // Read the examples in a random order.
+    for (int32 j = 0; j < 2 * num_examples; j++) {
+      int32 i = RandInt(0, num_examples - 1);
+      Matrix<BaseFloat> mat;
+      reader.GetExample(i, &mat);
+      KALDI_ASSERT(reader.Key(i) == keys[i]);
+      AssertEqual(mat, mats[i]);
+    }
+    if (num_examples > 0) {
+      int32 begin = RandInt(0, num_examples - 1),
+          end = RandInt(begin, num_examples);
+      std::vector<Matrix<BaseFloat> > range;
+      reader.GetExamples(begin, end, &range);
+      KALDI_ASSERT(static_cast<int32>(range.size()) == end - begin);
+      for (int32 i = begin; i < end; i++)
+        AssertEqual(range[i - begin], mats[i]);
+    }
+  }
+  std::remove(filename);
+}
+
+void UnitTestIndexedEgsOrder() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 num_examples = RandInt(0, 50), seed = RandInt(0, 1000);
+    IndexedEgsOrder order(num_examples, seed), order2(num_examples, seed),
+        order3(num_examples, seed + 1);
+    // We should get every record exactly once.
+    std::vector<int32> counts(num_examples, 0);
+    bool same_as_other_seed = true, in_archive_order = true;
+    for (int32 j = 0; j < num_examples; j++) {
+      KALDI_ASSERT(!order.Done());
+      int32 i = order.Next();
+      KALDI_ASSERT(i >= 0 && i < num_examples);
+      KALDI_ASSERT(order2.Next() == i);  // Same seed, same order.
+      if (order3.Next() != i)
+        same_as_other_seed = false;
+      if (i != j)
+        in_archive_order = false;
+      counts[i]++;
+    }
+    KALDI_ASSERT(order.Done());
+    for (int32 i = 0; i < num_examples; i++)
+      KALDI_ASSERT(counts[i] == 1);
+    // The chance of these happening by accident is negligible.
+    if (num_examples >= 20)
+      KALDI_ASSERT(!same_as_other_seed && !in_archive_order);
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  UnitTestIndexedEgs();
+  UnitTestIndexedEgsOrder();
+
+  KALDI_LOG << "Indexed-egs tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,225 @@
+// nnet3/nnet-indexed-egs.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "nnet3/nnet-indexed-egs.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The trailer at the end of the file is the offset of <Index> followed by
+// these 8 characters.
+static const char *kIndexedEgsTrailer = "EGSINDEX";
+static const size_t kIndexedEgsTrailerSize = sizeof(int64) + 8;
+
+IndexedEgsWriterBase::IndexedEgsWriterBase(const std::string &wxfilename):
+    wxfilename_(wxfilename), offset_(0), is_open_(true) {
+  // We write our own header, not the Kaldi binary-mode header "\0B".
+  if (!output_.Open(wxfilename, true, false))
+    KALDI_ERR << "Failed to open indexed egs archive for writing: "
+              << PrintableWxfilename(wxfilename);
+  std::ostringstream os;
+  WriteToken(os, true, "<IndexedEgs>");
+  WriteToken(os, true, "<Version>");
+  WriteBasicType(os, true, static_cast<int32>(1));
+  std::string header = os.str();
+  output_.Stream().write(header.data(), header.size());
+  offset_ += header.size();
+  WritePadding();
+}
+
+void IndexedEgsWriterBase::WritePadding() {
+  int64 num_zeros = (kIndexedEgsAlignment -
+                     offset_ % kIndexedEgsAlignment) % kIndexedEgsAlignment;
+  for (int64 i = 0; i < num_zeros; i++)
+    output_.Stream().put('\0');
+  offset_ += num_zeros;
+}
+
+void IndexedEgsWriterBase::WriteRecord(const std::string &key,
+                                       const std::string &data) {
+  KALDI_ASSERT(is_open_);
+  if (!IsToken(key))
+    KALDI_ERR << "Invalid key '" << key << "' for indexed egs archive.";
+  keys_.push_back(key);
+  offsets_.push_back(offset_);
+  sizes_.push_back(data.size());
+  output_.Stream().write(data.data(), data.size());
+  offset_ += data.size();
+  WritePadding();
+  if (!output_.Stream().good())
+    KALDI_ERR << "Error writing indexed egs archive "
+              << PrintableWxfilename(wxfilename_);
+}
+
+bool IndexedEgsWriterBase::Close() {
+  if (!is_open_)
+    return true;
+  is_open_ = false;
+  std::ostream &os = output_.Stream();
+  int64 index_offset = offset_;
+  WriteToken(os, true, "<Index>");
+  WriteBasicType(os, true, static_cast<int64>(keys_.size()));
+  for (size_t i = 0; i < keys_.size(); i++) {
+    WriteToken(os, true, keys_[i]);
+    WriteBasicType(os, true, offsets_[i]);
+    WriteBasicType(os, true, sizes_[i]);
+  }
+  WriteToken(os, true, "</Index>");
+  os.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
+  os.write(kIndexedEgsTrailer, 8);
+  return output_.Close();
+}
+
+IndexedEgsWriterBase::~IndexedEgsWriterBase() {
+  if (is_open_ && !Close())
+    KALDI_ERR << "Error closing indexed egs archive "
+              << PrintableWxfilename(wxfilename_);
+}
+
+
+std::streambuf::pos_type IndexedEgsReaderBase::MemoryBuffer::seekoff(
+    off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+  if (dir == std::ios_base::cur && off == 0 && (which & std::ios_base::in))
+    return pos_type(gptr() - eback());
+  return pos_type(off_type(-1));
+}
+
+IndexedEgsReaderBase::IndexedEgsReaderBase(const std::string &rxfilename):
+    rxfilename_(rxfilename), data_(NULL), size_(0), mapped_region_(NULL) {
+  if (ClassifyRxfilename(rxfilename) != kFileInput)
+    KALDI_ERR << "An indexed egs archive must be read from an ordinary file, "
+              << "not " << PrintableRxfilename(rxfilename);
+#ifndef _MSC_VER
+  int fd = open(rxfilename.c_str(), O_RDONLY);
+  struct stat stat_buf;
+  if (fd != -1 && fstat(fd, &stat_buf) == 0 && stat_buf.st_size > 0) {
+    size_t size = stat_buf.st_size;
+    void *region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (region != MAP_FAILED) {
+      mapped_region_ = region;
+      data_ = static_cast<const char*>(region);
+      size_ = size;
+    } else {
+      KALDI_WARN << "Failed to memory-map " << rxfilename
+                 << ", reading it instead: " << strerror(errno);
+    }
+  }
+  if (fd != -1)
+    close(fd);
+#endif
+  if (data_ == NULL) {
+    std::ifstream is(rxfilename.c_str(), std::ios::binary);
+    buffer_.assign(std::istreambuf_iterator<char>(is),
+                   std::istreambuf_iterator<char>());
+    if (is.bad())
+      KALDI_ERR << "Error reading indexed egs archive " << rxfilename;
+    data_ = (buffer_.empty() ? NULL : &(buffer_[0]));
+    size_ = buffer_.size();
+  }
+
+  int64 index_offset;
+  if (size_ < kIndexedEgsTrailerSize ||
+      strncmp(data_ + size_ - 8, kIndexedEgsTrailer, 8) != 0)
+    KALDI_ERR << rxfilename << " is not an indexed egs archive (or it was "
+              << "not completely written).";
+  memcpy(&index_offset, data_ + size_ - kIndexedEgsTrailerSize,
+         sizeof(index_offset));
+  if (index_offset < 0 ||
+      index_offset > static_cast<int64>(size_ - kIndexedEgsTrailerSize))
+    KALDI_ERR << "Invalid index offset in indexed egs archive " << rxfilename;
+
+  {
+    MemoryBuffer buffer(data_, size_);
+    std::istream is(&buffer);
+    ExpectToken(is, true, "<IndexedEgs>");
+    ExpectToken(is, true, "<Version>");
+    int32 version;
+    ReadBasicType(is, true, &version);
+    if (version != 1)
+      KALDI_ERR << "Indexed egs archive " << rxfilename << " has version "
+                << version << "; this code only supports version 1.";
+  }
+
+  MemoryBuffer buffer(data_ + index_offset,
+                      size_ - kIndexedEgsTrailerSize - index_offset);
+  std::istream is(&buffer);
+  ExpectToken(is, true, "<Index>");
+  int64 num_records;
+  ReadBasicType(is, true, &num_records);
+  if (num_records < 0 || num_records > std::numeric_limits<int32>::max())
+    KALDI_ERR << "Invalid number of records " << num_records
+              << " in indexed egs archive " << rxfilename;
+  keys_.resize(num_records);
+  offsets_.resize(num_records);
+  sizes_.resize(num_records);
+  for (int64 i = 0; i < num_records; i++) {
+    ReadToken(is, true, &(keys_[i]));
+    ReadBasicType(is, true, &(offsets_[i]));
+    ReadBasicType(is, true, &(sizes_[i]));
+    if (offsets_[i] < 0 || sizes_[i] < 0 ||
+        offsets_[i] + sizes_[i] > index_offset)
+      KALDI_ERR << "Invalid index entry for " << keys_[i]
+                << " in indexed egs archive " << rxfilename;
+  }
+  ExpectToken(is, true, "</Index>");
+}
+
+void IndexedEgsReaderBase::GetRecord(int32 i, const char **data,
+                                     size_t *size) const {
+  KALDI_ASSERT(static_cast<size_t>(i) < keys_.size());
+  *data = data_ + offsets_[i];
+  *size = sizes_[i];
+}
+
+IndexedEgsReaderBase::~IndexedEgsReaderBase() {
+#ifndef _MSC_VER
+  if (mapped_region_ != NULL)
+    munmap(mapped_region_, size_);
+#endif
+}
+
+IndexedEgsOrder::IndexedEgsOrder(int32 num_examples, int32 seed):
+    order_(num_examples), position_(0) {
+  KALDI_ASSERT(num_examples >= 0);
+  for (int32 i = 0; i < num_examples; i++)
+    order_[i] = i;
+  std::mt19937 generator(seed);
+  std::shuffle(order_.begin(), order_.end(), generator);
+}
+
+int32 IndexedEgsOrder::Next() {
+  KALDI_ASSERT(!Done());
+  return order_[position_++];
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
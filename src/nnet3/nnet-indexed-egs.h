@@ -0,0 +1,209 @@
+// nnet3/nnet-indexed-egs.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_INDEXED_EGS_H_
+#define KALDI_NNET3_NNET_INDEXED_EGS_H_
+
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   An indexed egs archive is an alternative to the usual Kaldi archive format
+   for storing training examples (NnetExample, NnetChainExample and so on),
+   designed for the training programs' access pattern of reading the same
+   examples many times.  It is a single file, laid out as follows:
+
+      <IndexedEgs> <Version> [int32]
+      [padding]
+      record 0 (the binary form of the example, as written by its Write())
+      [padding]
+      record 1
+      ...
+      <Index> [int64 num-records] { [key] [int64 offset] [int64 size] }* </Index>
+      [int64 offset of <Index>] "EGSINDEX"
+
+   where every record starts at an offset that is a multiple of
+   kIndexedEgsAlignment.  Because the index is at the end, the file can be
+   written to a pipe; but it can only be read from an ordinary file.
+
+   The reader memory-maps the file (where supported; otherwise it reads it
+   into memory) and reads the index, after which any example can be read
+   directly from memory, without the I/O and the key/header parsing of the
+   table code, in any order and from any number of threads.  The features are
+   stored as they were in the input examples; to avoid decompressing them each
+   time they are read, the egs can be uncompressed when the archive is
+   written (see nnet3-copy-egs-to-indexed).
+*/
+
+static const int32 kIndexedEgsAlignment = 64;
+
+/// This class writes an indexed egs archive; see the comment above for the
+/// format.  It serializes each example into memory before writing it, so it
+/// knows the offsets without needing to seek.
+class IndexedEgsWriterBase {
+ public:
+  explicit IndexedEgsWriterBase(const std::string &wxfilename);
+
+  /// Writes the index and closes the file; returns false on error.  Called
+  /// from the destructor if you don't call it, but then errors will be fatal.
+  bool Close();
+
+  ~IndexedEgsWriterBase();
+
+ protected:
+  /// Writes the record 'data' (the binary form of an example) with key 'key'.
+  void WriteRecord(const std::string &key, const std::string &data);
+
+ private:
+  // Writes zeros to bring the output to a multiple of kIndexedEgsAlignment.
+  void WritePadding();
+
+  std::string wxfilename_;
+  Output output_;
+  int64 offset_;  // The number of bytes written so far.
+  std::vector<std::string> keys_;
+  std::vector<int64> offsets_;
+  std::vector<int64> sizes_;
+  bool is_open_;
+};
+
+template <class Example>
+class IndexedEgsWriter: public IndexedEgsWriterBase {
+ public:
+  explicit IndexedEgsWriter(const std::string &wxfilename):
+      IndexedEgsWriterBase(wxfilename) { }
+
+  void Write(const std::string &key, const Example &eg) {
+    std::ostringstream os;
+    eg.Write(os, true);
+    WriteRecord(key, os.str());
+  }
+};
+
+
+/// This class gives read-only access to the records of an indexed egs archive,
+/// and is used by class IndexedEgsReader.
+class IndexedEgsReaderBase {
+ public:
+  /// 'rxfilename' must be an ordinary file (not a pipe or an archive offset).
+  explicit IndexedEgsReaderBase(const std::string &rxfilename);
+
+  int32 NumExamples() const { return keys_.size(); }
+
+  const std::string &Key(int32 i) const {
+    KALDI_ASSERT(static_cast<size_t>(i) < keys_.size());
+    return keys_[i];
+  }
+
+  ~IndexedEgsReaderBase();
+
+ protected:
+  /// Gives the location and size in memory of record i.
+  void GetRecord(int32 i, const char **data, size_t *size) const;
+
+  /// A read-only std::streambuf that reads from a region of memory, so that
+  /// examples can be read with their usual Read() functions without copying
+  /// the record.
+  class MemoryBuffer: public std::streambuf {
+   public:
+    MemoryBuffer(const char *data, size_t size) {
+      char *begin = const_cast<char*>(data);
+      setg(begin, begin, begin + size);
+    }
+   protected:
+    // This is only needed for tellg(), which is used in some error messages.
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which);
+  };
+
+ private:
+  std::string rxfilename_;
+  // The contents of the file.  If mapped_region_ != NULL this points into it;
+  // otherwise it points to the contents of buffer_.
+  const char *data_;
+  size_t size_;
+  void *mapped_region_;
+  std::vector<char> buffer_;
+
+  std::vector<std::string> keys_;
+  std::vector<int64> offsets_;
+  std::vector<int64> sizes_;
+};
+
+/// This class reads examples from an indexed egs archive.  GetExample() is
+/// const and may be called from multiple threads at once.
+template <class Example>
+class IndexedEgsReader: public IndexedEgsReaderBase {
+ public:
+  explicit IndexedEgsReader(const std::string &rxfilename):
+      IndexedEgsReaderBase(rxfilename) { }
+
+  /// Reads example i, for 0 <= i < NumExamples().
+  void GetExample(int32 i, Example *eg) const {
+    const char *data;
+    size_t size;
+    GetRecord(i, &data, &size);
+    MemoryBuffer buffer(data, size);
+    std::istream is(&buffer);
+    eg->Read(is, true);
+    if (is.fail())
+      KALDI_ERR << "Error reading example " << Key(i)
+                << " from indexed egs archive.";
+  }
+
+  /// Reads examples begin ... end-1 into 'egs', e.g. to form a minibatch.
+  void GetExamples(int32 begin, int32 end, std::vector<Example> *egs) const {
+    KALDI_ASSERT(begin >= 0 && begin <= end && end <= NumExamples());
+    egs->resize(end - begin);
+    for (int32 i = begin; i < end; i++)
+      GetExample(i, &((*egs)[i - begin]));
+  }
+};
+
+/// This class gives a random order in which to read the records of an indexed
+/// egs archive: a permutation of 0 ... num_examples - 1 that depends only on
+/// 'seed'.  Training programs read the archive once per invocation, so giving
+/// each invocation a different seed (e.g. via --srand) gives each epoch a
+/// different order.
+class IndexedEgsOrder {
+ public:
+  IndexedEgsOrder(int32 num_examples, int32 seed);
+
+  /// Returns true if all the records have been returned by Next().
+  bool Done() const { return position_ == order_.size(); }
+
+  /// Returns the index of the next record to read.  Must not be called if
+  /// Done().
+  int32 Next();
+
+ private:
+  std::vector<int32> order_;
+  size_t position_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_INDEXED_EGS_H_
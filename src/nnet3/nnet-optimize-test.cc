@@ -17,12 +17,16 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
+#include <fstream>
+
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -292,6 +296,59 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
 #undef KALDI_SUCCFAIL
 }
 
+// Tests that computations written to --computation-cache-dir are found again by
+// a compiler for a network of the same structure, and not by one with different
+// optimization options.
+static void UnitTestNnetOptimizeCacheDir() {
+  struct NnetGenerationOptions gen_config;
+  std::vector<std::string> configs;
+  GenerateConfigSequence(gen_config, &configs);
+  Nnet nnet;
+  for (size_t j = 0; j < configs.size(); j++) {
+    std::istringstream is(configs[j]);
+    nnet.ReadConfig(is);
+  }
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+  NnetOptimizeOptions opt_config;
+  CachingOptimizingCompilerOptions compiler_config;
+  compiler_config.cache_dir = ".";
+  CachingOptimizingCompiler compiler(nnet, opt_config, compiler_config);
+  std::string filename = compiler.CacheDirFilename(request);
+  std::remove(filename.c_str());
+  std::ostringstream os;
+  compiler.Compile(request)->Print(os, nnet);
+  KALDI_ASSERT(compiler.NumCacheDirReads() == 0);
+  {
+    std::ifstream is(filename.c_str());
+    KALDI_ASSERT(is.is_open() && "Computation was not written to cache dir.");
+  }
+
+  // Different parameters, same structure: the file is used.
+  Nnet nnet2(nnet);
+  PerturbParams(1.0, &nnet2);
+  CachingOptimizingCompiler compiler2(nnet2, opt_config, compiler_config);
+  KALDI_ASSERT(compiler2.CacheDirFilename(request) == filename);
+  std::ostringstream os2;
+  compiler2.Compile(request)->Print(os2, nnet2);
+  KALDI_ASSERT(compiler2.NumCacheDirReads() == 1 &&
+               "Computation was not read from cache dir.");
+  KALDI_ASSERT(os.str() == os2.str());
+
+  // Different optimization options: the file is not used.
+  opt_config.optimize = false;
+  CachingOptimizingCompiler compiler3(nnet, opt_config, compiler_config);
+  std::string filename3 = compiler3.CacheDirFilename(request);
+  KALDI_ASSERT(filename3 != filename);
+  compiler3.Compile(request);
+  KALDI_ASSERT(compiler3.NumCacheDirReads() == 0);
+
+  std::remove(filename.c_str());
+  std::remove(filename3.c_str());
+}
+
 static void UnitTestNnetOptimize() {
   for (int32 srand_seed = 0; srand_seed < 40; srand_seed++) {
     KALDI_LOG << "About to run UnitTestNnetOptimizeInternal with srand_seed = "
@@ -317,6 +374,7 @@ int main() {
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  UnitTestNnetOptimizeCacheDir();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -18,7 +18,10 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
+#include <random>
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-utils.h"
@@ -632,6 +635,31 @@ void Optimize(const NnetOptimizeOptions &config,
 }
 
 
+// Returns the 64-bit FNV-1a hash of 'str'.
+static uint64 HashString(const std::string &str) {
+  uint64 ans = 14695981039346656037ULL;
+  for (size_t i = 0; i < str.size(); i++) {
+    ans ^= static_cast<unsigned char>(str[i]);
+    ans *= 1099511628211ULL;
+  }
+  return ans;
+}
+
+// Returns a hash of everything about 'nnet' that the compiled computations
+// could depend on.  The parameters don't matter, so we hash a copy with the
+// parameters, stats and learning rates zeroed; this way the same computations
+// are found for different iterations of a model (what remains is the network
+// topology and the configuration of the components).
+static uint64 NnetStructureHash(const Nnet &nnet) {
+  Nnet nnet_copy(nnet);
+  ScaleNnet(0.0, &nnet_copy);
+  ZeroComponentStats(&nnet_copy);
+  SetLearningRate(0.0, &nnet_copy);
+  std::ostringstream os;
+  nnet_copy.Write(os, true);
+  return HashString(os.str());
+}
+
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
     const CachingOptimizingCompilerOptions config):
@@ -639,8 +667,13 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
-    seconds_taken_io_(0.0), cache_(config.cache_capacity),
-    nnet_left_context_(-1), nnet_right_context_(-1) { }
+    seconds_taken_io_(0.0), seconds_taken_cache_dir_(0.0),
+    num_cache_dir_reads_(0), cache_(config.cache_capacity),
+    nnet_structure_hash_(0), nnet_left_context_(-1),
+    nnet_right_context_(-1) {
+  if (!config_.cache_dir.empty())
+    nnet_structure_hash_ = NnetStructureHash(nnet_);
+}
 
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
@@ -650,8 +683,13 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
-    seconds_taken_io_(0.0), cache_(config.cache_capacity),
-    nnet_left_context_(-1), nnet_right_context_(-1) { }
+    seconds_taken_io_(0.0), seconds_taken_cache_dir_(0.0),
+    num_cache_dir_reads_(0), cache_(config.cache_capacity),
+    nnet_structure_hash_(0), nnet_left_context_(-1),
+    nnet_right_context_(-1) {
+  if (!config_.cache_dir.empty())
+    nnet_structure_hash_ = NnetStructureHash(nnet_);
+}
 
 void CachingOptimizingCompiler::GetSimpleNnetContext(
     int32 *nnet_left_context, int32 *nnet_right_context) {
@@ -697,7 +735,8 @@ CachingOptimizingCompiler::~CachingOptimizingCompiler() {
     std::ostringstream os;
     double seconds_taken_misc = seconds_taken_total_ - seconds_taken_compile_
         - seconds_taken_optimize_ - seconds_taken_expand_
-        - seconds_taken_check_ - seconds_taken_indexes_;
+        - seconds_taken_check_ - seconds_taken_indexes_
+        - seconds_taken_cache_dir_;
     os << std::setprecision(3) << seconds_taken_total_
        << " seconds taken in nnet3 compilation total (breakdown: "
        << seconds_taken_compile_ << " compilation, "
@@ -707,6 +746,9 @@ CachingOptimizingCompiler::~CachingOptimizingCompiler() {
        << seconds_taken_indexes_ << " computing indexes, "
        << seconds_taken_misc << " misc.) + "
        << seconds_taken_io_ << " I/O.";
+    if (!config_.cache_dir.empty())
+      os << "  Time spent reading and writing --computation-cache-dir (included "
+         << "in the total) was " << seconds_taken_cache_dir_ << " seconds.";
     KALDI_LOG << os.str();
     // note: the leftover amount is misc things like hashing and == comparisons on
     // computation-requests, and calling RequestIsDecomposable().
@@ -728,16 +770,126 @@ std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileInterna
     return ans;
   } else {
     const NnetComputation *computation = NULL;
-    if (config_.use_shortcut)
-      computation = CompileViaShortcut(request);
-    if (computation == NULL)
-      computation = CompileNoShortcut(request);
-    KALDI_ASSERT(computation != NULL);
+    if (!config_.cache_dir.empty())
+      computation = ReadFromCacheDir(request);
+    if (computation == NULL) {
+      if (config_.use_shortcut)
+        computation = CompileViaShortcut(request);
+      if (computation == NULL)
+        computation = CompileNoShortcut(request);
+      KALDI_ASSERT(computation != NULL);
+      if (!config_.cache_dir.empty())
+        WriteToCacheDir(request, *computation);
+    }
     return cache_.Insert(request, computation);
   }
 }
 
 
+std::string CachingOptimizingCompiler::CacheDirFilename(
+    const ComputationRequest &request) const {
+  KALDI_ASSERT(!config_.cache_dir.empty());
+  std::ostringstream os;
+  WriteBasicType(os, true, nnet_structure_hash_);
+  WriteBasicType(os, true, config_.use_shortcut);
+  opt_config_.Write(os, true);
+  request.Write(os, true);
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx",
+           static_cast<unsigned long long>(HashString(os.str())));
+  return config_.cache_dir + "/" + buf + ".computation";
+}
+
+// The format of the files in the --computation-cache-dir is: the token
+// <Nnet3CachedComputation>, the nnet-structure hash, use_shortcut, the
+// optimization options, the request and then the computation (all in binary
+// mode).  Everything before the computation is checked when reading.
+
+const NnetComputation *CachingOptimizingCompiler::ReadFromCacheDir(
+    const ComputationRequest &request) {
+  Timer timer;
+  std::string filename = CacheDirFilename(request);
+  std::ifstream is(filename.c_str(), std::ios_base::in |
+                   std::ios_base::binary);
+  if (!is.is_open())
+    return NULL;  // Not cached yet; this is the normal case.
+  NnetComputation *computation = new NnetComputation();
+  try {
+    uint64 nnet_structure_hash;
+    bool use_shortcut;
+    NnetOptimizeOptions opt_config;
+    ComputationRequest file_request;
+    ExpectToken(is, true, "<Nnet3CachedComputation>");
+    ReadBasicType(is, true, &nnet_structure_hash);
+    ReadBasicType(is, true, &use_shortcut);
+    opt_config.Read(is, true);
+    file_request.Read(is, true);
+    if (nnet_structure_hash != nnet_structure_hash_ ||
+        use_shortcut != config_.use_shortcut ||
+        !(opt_config == opt_config_) || !(file_request == request)) {
+      // A hash collision; very unlikely.  We'll overwrite the file.
+      KALDI_WARN << "Cached computation in " << filename
+                 << " is for a different computation; ignoring it.";
+      delete computation;
+      return NULL;
+    }
+    computation->Read(is, true);  // This calls ComputeCudaIndexes().
+  } catch (const std::exception &) {
+    // e.g. a file written by a version of Kaldi with a different format.
+    KALDI_WARN << "Error reading cached computation from " << filename
+               << ", will recompile it.";
+    delete computation;
+    return NULL;
+  }
+  if (GetVerboseLevel() >= 2) {
+    CheckComputationOptions check_config;
+    ComputationChecker checker(check_config, nnet_, *computation);
+    checker.Check();
+  }
+  seconds_taken_cache_dir_ += timer.Elapsed();
+  num_cache_dir_reads_++;
+  return computation;
+}
+
+void CachingOptimizingCompiler::WriteToCacheDir(
+    const ComputationRequest &request,
+    const NnetComputation &computation) {
+  Timer timer;
+  std::string filename = CacheDirFilename(request);
+  // The temporary filename must be unique across processes and threads, so we
+  // don't use Rand(), whose sequence is the same in every process.
+  std::random_device random_device;
+  std::ostringstream tmp_filename;
+  tmp_filename << filename << ".tmp." << std::hex << random_device()
+               << random_device();
+  {
+    std::ofstream os(tmp_filename.str().c_str(), std::ios_base::out |
+                     std::ios_base::binary);
+    if (os.is_open()) {
+      WriteToken(os, true, "<Nnet3CachedComputation>");
+      WriteBasicType(os, true, nnet_structure_hash_);
+      WriteBasicType(os, true, config_.use_shortcut);
+      opt_config_.Write(os, true);
+      request.Write(os, true);
+      computation.Write(os, true);
+      os.close();
+    }
+    if (os.fail()) {
+      KALDI_WARN << "Error writing cached computation to " << tmp_filename.str()
+                 << " (does the directory " << config_.cache_dir
+                 << " exist and is it writable?)";
+      std::remove(tmp_filename.str().c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_filename.str().c_str(), filename.c_str()) != 0) {
+    // e.g. on Windows, if another process wrote the file first.
+    std::remove(tmp_filename.str().c_str());
+  }
+  seconds_taken_cache_dir_ += timer.Elapsed();
+}
+
+
 const NnetComputation *CachingOptimizingCompiler::CompileNoShortcut(
     const ComputationRequest &request) {
 
@@ -192,6 +192,7 @@ void Optimize(const NnetOptimizeOptions &config,
 struct CachingOptimizingCompilerOptions {
   bool use_shortcut;
   int32 cache_capacity;
+  std::string cache_dir;
 
   CachingOptimizingCompilerOptions():
       use_shortcut(true),
@@ -208,6 +209,12 @@ struct CachingOptimizingCompilerOptions {
     opts->Register("cache-capacity", &cache_capacity,
                    "Determines how many computations the computation-cache will "
                    "store (most-recently-used).");
+    opts->Register("computation-cache-dir", &cache_dir,
+                   "If set, a directory (which must already exist) in which "
+                   "compiled computations are stored, so that other processes "
+                   "using a network of the same structure, with the same "
+                   "optimization options, can load them instead of compiling "
+                   "them again.  Safe to share between parallel jobs.");
   }
 };
 
@@ -242,6 +249,16 @@ class CachingOptimizingCompiler {
   void ReadCache(std::istream &is, bool binary);
   void WriteCache(std::ostream &os, bool binary);
 
+  /// Returns the name of the file in which the computation for 'request' is
+  /// stored in the --computation-cache-dir, which must be set.  The name is
+  /// derived from a hash of the structure of the nnet, the request and the
+  /// optimization options (the file itself contains the request and options,
+  /// so that hash collisions are detected).
+  std::string CacheDirFilename(const ComputationRequest &request) const;
+
+  /// Returns the number of computations that were read from the
+  /// --computation-cache-dir instead of being compiled (used in testing).
+  int32 NumCacheDirReads() const { return num_cache_dir_reads_; }
 
   // GetSimpleNnetContext() is equivalent to calling:
   // ComputeSimpleNnetContext(nnet_, &nnet_left_context,
@@ -285,6 +302,16 @@ class CachingOptimizingCompiler {
   // the computation cache).
   const NnetComputation *CompileNoShortcut(const ComputationRequest &request);
 
+  // These functions, called from CompileInternal() if config_.cache_dir is
+  // set, read and write the computation for 'request' in that directory.
+  // ReadFromCacheDir() returns a newly allocated computation, or NULL if there
+  // was none (or it could not be read).  WriteToCacheDir() writes to a
+  // temporary file which is then renamed, so other processes never see a
+  // partly written file.
+  const NnetComputation *ReadFromCacheDir(const ComputationRequest &request);
+  void WriteToCacheDir(const ComputationRequest &request,
+                       const NnetComputation &computation);
+
   const Nnet &nnet_;
   CachingOptimizingCompilerOptions config_;
   NnetOptimizeOptions opt_config_;
@@ -298,9 +325,16 @@ class CachingOptimizingCompiler {
   double seconds_taken_check_;
   double seconds_taken_indexes_;
   double seconds_taken_io_;
+  double seconds_taken_cache_dir_;
+  // The number of computations read from config_.cache_dir.
+  int32 num_cache_dir_reads_;
 
   ComputationCache cache_;
 
+  // A hash of the structure of nnet_ (i.e. of everything but the parameters);
+  // only computed if config_.cache_dir is set.
+  uint64 nnet_structure_hash_;
+
   // These following two variables are only used by the function GetSimpleNnetContext().
   int32 nnet_left_context_;
   int32 nnet_right_context_;
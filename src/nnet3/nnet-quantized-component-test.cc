@@ -0,0 +1,201 @@
+// nnet3/nnet-quantized-component-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "base/timer.h"
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns the Frobenius norm of (a - b) divided by that of b.
+static BaseFloat RelativeDifference(const MatrixBase<BaseFloat> &a,
+                                    const MatrixBase<BaseFloat> &b) {
+  Matrix<BaseFloat> diff(a);
+  diff.AddMat(-1.0, b);
+  return diff.FrobeniusNorm() / b.FrobeniusNorm();
+}
+
+void UnitTestQuantizedLinearParams() {
+  for (int32 n = 0; n < 20; n++) {
+    // Cover dimensions that are, and are not, multiples of the SIMD width.
+    int32 num_blocks = RandInt(1, 3), block_dim = RandInt(1, 100),
+        num_rows = RandInt(1, 150), row_stride = RandInt(1, 3),
+        num_out_rows = RandInt(1, 20);
+    Matrix<BaseFloat> params(num_rows, num_blocks * block_dim);
+    params.SetRandn();
+    QuantizedLinearParams qparams;
+    qparams.Init(params, num_blocks);
+    KALDI_ASSERT(qparams.NumRows() == num_rows &&
+                 qparams.NumCols() == num_blocks * block_dim);
+    Matrix<BaseFloat> dequantized;
+    qparams.GetParams(&dequantized);
+    KALDI_ASSERT(RelativeDifference(dequantized, params) < 0.02);
+
+    std::vector<int32> row_offsets(num_blocks);
+    for (int32 b = 0; b < num_blocks; b++)
+      row_offsets[b] = RandInt(0, 5);
+    int32 num_in_rows = 6 + row_stride * num_out_rows;
+    Matrix<BaseFloat> in(num_in_rows, block_dim);
+    in.SetRandn();
+    // Make some rows non-negative, like the output of a ReLU, and one all
+    // zero.
+    for (int32 i = 0; i < num_in_rows; i += 2)
+      in.Row(i).ApplyAbs();
+    in.Row(RandInt(0, num_in_rows - 1)).SetZero();
+
+    Matrix<BaseFloat> out(num_out_rows, num_rows), ref_out(num_out_rows,
+                                                         num_rows);
+    out.SetRandn();
+    ref_out.CopyFromMat(out);
+    qparams.AddToOutput(in, row_stride, row_offsets, &out);
+    for (int32 b = 0; b < num_blocks; b++) {
+      SubMatrix<BaseFloat> params_part(params, 0, num_rows,
+                                       b * block_dim, block_dim);
+      for (int32 r = 0; r < num_out_rows; r++)
+        ref_out.Row(r).AddMatVec(1.0, params_part, kNoTrans,
+                                 in.Row(row_offsets[b] + r * row_stride), 1.0);
+    }
+    KALDI_ASSERT(RelativeDifference(out, ref_out) < 0.05);
+
+    for (int32 i = 0; i < 2; i++) {
+      bool binary = (i == 0);
+      std::ostringstream os;
+      qparams.Write(os, binary);
+      QuantizedLinearParams qparams2;
+      std::istringstream is(os.str());
+      qparams2.Read(is, binary);
+      Matrix<BaseFloat> dequantized2;
+      qparams2.GetParams(&dequantized2);
+      AssertEqual(dequantized, dequantized2, 1.0e-05);
+    }
+  }
+}
+
+void UnitTestQuantizeNnet() {
+  // A TDNN-F-like network with all the types of component that QuantizeNnet()
+  // handles.
+  std::string config =
+      "input-node name=input dim=40\n"
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=40 output-dim=100\n"
+      "component-node name=affine1 component=affine1 input=input\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=100\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component name=tdnn2l type=TdnnComponent input-dim=100 output-dim=40 "
+      "time-offsets=-1,0 use-bias=false\n"
+      "component-node name=tdnn2l component=tdnn2l input=relu1\n"
+      "component name=tdnn2 type=TdnnComponent input-dim=40 output-dim=100 "
+      "time-offsets=0,1\n"
+      "component-node name=tdnn2 component=tdnn2 input=tdnn2l\n"
+      "component name=relu2 type=RectifiedLinearComponent dim=100\n"
+      "component-node name=relu2 component=relu2 input=tdnn2\n"
+      "component name=tdnn3 type=TdnnComponent input-dim=100 output-dim=70 "
+      "time-offsets=-3,0,3\n"
+      "component-node name=tdnn3 component=tdnn3 input=relu2\n"
+      "component name=linear4 type=LinearComponent input-dim=70 "
+      "output-dim=30\n"
+      "component-node name=linear4 component=linear4 input=tdnn3\n"
+      "component name=affine5 type=AffineComponent input-dim=30 "
+      "output-dim=50\n"
+      "component-node name=affine5 component=affine5 input=linear4\n"
+      "output-node name=output input=affine5\n";
+  Nnet nnet;
+  {
+    std::istringstream is(config);
+    nnet.ReadConfig(is);
+  }
+  Nnet quantized_nnet(nnet);
+  KALDI_ASSERT(QuantizeNnet("*", &quantized_nnet) == 6);
+  KALDI_LOG << "Quantized nnet is: " << quantized_nnet.Info();
+  Nnet partly_quantized_nnet(nnet);
+  KALDI_ASSERT(QuantizeNnet("tdnn*", &partly_quantized_nnet) == 3);
+
+  int32 num_frames = 30, left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+  Matrix<BaseFloat> input(num_frames + left_context + right_context, 40);
+  input.SetRandn();
+  Matrix<BaseFloat> output, quantized_output;
+  ComputeSimpleOutput(nnet, input, NULL, &output);
+  ComputeSimpleOutput(quantized_nnet, input, NULL, &quantized_output);
+  BaseFloat relative_difference =
+      RelativeDifference(quantized_output, output);
+  KALDI_LOG << "Relative difference in output from quantization is "
+            << relative_difference;
+  KALDI_ASSERT(relative_difference < 0.05);
+
+  // Writing and reading the quantized nnet gives the same output.
+  for (int32 i = 0; i < 2; i++) {
+    bool binary = (i == 0);
+    std::ostringstream os;
+    quantized_nnet.Write(os, binary);
+    Nnet quantized_nnet2;
+    std::istringstream is(os.str());
+    quantized_nnet2.Read(is, binary);
+    Matrix<BaseFloat> quantized_output2;
+    ComputeSimpleOutput(quantized_nnet2, input, NULL, &quantized_output2);
+    AssertEqual(quantized_output, quantized_output2, 1.0e-04);
+  }
+}
+
+// Compares the speed of QuantizedLinearParams::AddToOutput() with that of
+// BLAS, for a matrix of the size found in TDNN-F layers.
+void UnitTestQuantizedSpeed() {
+  int32 num_rows = 1536, num_blocks = 2, block_dim = 160, num_frames = 150,
+      num_repeats = 20;
+  Matrix<BaseFloat> params(num_rows, num_blocks * block_dim),
+      in(num_frames + 1, block_dim), out(num_frames, num_rows);
+  params.SetRandn();
+  in.SetRandn();
+  QuantizedLinearParams qparams;
+  qparams.Init(params, num_blocks);
+  std::vector<int32> row_offsets(num_blocks);
+  row_offsets[1] = 1;
+
+  Timer timer;
+  for (int32 n = 0; n < num_repeats; n++) {
+    for (int32 b = 0; b < num_blocks; b++)
+      out.AddMatMat(1.0, in.RowRange(row_offsets[b], num_frames), kNoTrans,
+                    params.ColRange(b * block_dim, block_dim), kTrans, 1.0);
+  }
+  double blas_time = timer.Elapsed();
+  timer.Reset();
+  for (int32 n = 0; n < num_repeats; n++)
+    qparams.AddToOutput(in, 1, row_offsets, &out);
+  double quantized_time = timer.Elapsed();
+  KALDI_LOG << "For " << num_rows << " x " << (num_blocks * block_dim)
+            << " parameters, BLAS time is " << blas_time
+            << ", quantized time is " << quantized_time << ", speedup is "
+            << (blas_time / quantized_time);
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  UnitTestQuantizedLinearParams();
+  UnitTestQuantizeNnet();
+  UnitTestQuantizedSpeed();
+  KALDI_LOG << "Quantized-component tests succeeded.";
+  return 0;
+}
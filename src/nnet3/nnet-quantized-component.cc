@@ -0,0 +1,646 @@
+// nnet3/nnet-quantized-component.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-parse.h"
+
+// As in gmm/diag-gmm-kernels.cc, the x86 kernels are compiled with
+// per-function target attributes so the rest of the build does not need
+// -mavx2.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ >= 7)
+#define KALDI_NNET3_QUANTIZED_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace kaldi {
+namespace nnet3 {
+
+namespace {
+
+// The number of bytes that the rows of the quantized input and the blocks of
+// the quantized parameters are padded to.
+const int32 kQuantizedAlign = 32;
+
+// The kernels compute out[j] = sum_d x[d] * w[j * w_stride + d] for
+// 0 <= j < num_w, where 0 <= x[d] <= 127, -127 <= w[..] <= 127, and 'dim' is
+// a multiple of kQuantizedAlign.  All kernels give exactly the same results.
+typedef void (*QuantizedDotProductsFunction)(
+    const uint8 *x, const int8 *w, int32 w_stride, int32 num_w, int32 dim,
+    int32 *out);
+
+void QuantizedDotProductsGeneric(const uint8 *x, const int8 *w,
+                                 int32 w_stride, int32 num_w, int32 dim,
+                                 int32 *out) {
+  for (int32 j = 0; j < num_w; j++) {
+    const int8 *wj = w + j * w_stride;
+    int32 sum = 0;
+    for (int32 d = 0; d < dim; d++)
+      sum += static_cast<int32>(x[d]) * static_cast<int32>(wj[d]);
+    out[j] = sum;
+  }
+}
+
+#ifdef KALDI_NNET3_QUANTIZED_X86_KERNELS
+
+__attribute__((target("avx2")))
+inline int32 HorizontalSumAvx2(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+// pmaddubsw multiplies unsigned by signed bytes and adds adjacent pairs into
+// 16-bit values with saturation; since x <= 127 and |w| <= 127 the sums are at
+// most 2 * 127 * 127 = 32258 in magnitude, so saturation cannot happen.
+// pmaddwd with ones then widens them to 32 bits.  Four rows of 'w' are done
+// at a time so each load of 'x' is used four times.
+__attribute__((target("avx2")))
+void QuantizedDotProductsAvx2(const uint8 *x, const int8 *w,
+                              int32 w_stride, int32 num_w, int32 dim,
+                              int32 *out) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  int32 j = 0;
+  for (; j + 4 <= num_w; j += 4) {
+    const int8 *w0 = w + j * w_stride, *w1 = w0 + w_stride,
+        *w2 = w1 + w_stride, *w3 = w2 + w_stride;
+    __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256(),
+        s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+    for (int32 d = 0; d < dim; d += 32) {
+      __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + d));
+      s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_maddubs_epi16(
+          xv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w0 + d))),
+                                                  ones));
+      s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(_mm256_maddubs_epi16(
+          xv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w1 + d))),
+                                                  ones));
+      s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(_mm256_maddubs_epi16(
+          xv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w2 + d))),
+                                                  ones));
+      s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(_mm256_maddubs_epi16(
+          xv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w3 + d))),
+                                                  ones));
+    }
+    out[j] = HorizontalSumAvx2(s0);
+    out[j + 1] = HorizontalSumAvx2(s1);
+    out[j + 2] = HorizontalSumAvx2(s2);
+    out[j + 3] = HorizontalSumAvx2(s3);
+  }
+  for (; j < num_w; j++) {
+    const int8 *wj = w + j * w_stride;
+    __m256i s = _mm256_setzero_si256();
+    for (int32 d = 0; d < dim; d += 32) {
+      __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + d));
+      s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_maddubs_epi16(
+          xv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(wj + d))),
+                                                ones));
+    }
+    out[j] = HorizontalSumAvx2(s);
+  }
+  // See ComponentLogLikelihoodsAvx2() in gmm/diag-gmm-kernels.cc.
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_NNET3_QUANTIZED_X86_KERNELS
+
+QuantizedDotProductsFunction GetQuantizedDotProductsFunction() {
+#ifdef KALDI_NNET3_QUANTIZED_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return QuantizedDotProductsAvx2;
+#endif
+  return QuantizedDotProductsGeneric;
+}
+
+// Quantizes the 'dim' values in 'in' to integers in [0, 127], written to
+// 'out', such that in[d] is approximately *scale * (out[d] - *zero_point).
+// The range always includes zero, so that zero is represented exactly.
+void QuantizeInputRow(const BaseFloat *in, int32 dim, uint8 *out,
+                      BaseFloat *scale, int32 *zero_point) {
+  BaseFloat min_value = 0.0, max_value = 0.0;
+  for (int32 d = 0; d < dim; d++) {
+    min_value = std::min(min_value, in[d]);
+    max_value = std::max(max_value, in[d]);
+  }
+  if (max_value == min_value) {  // All zeros.
+    std::fill(out, out + dim, 0);
+    *scale = 0.0;
+    *zero_point = 0;
+    return;
+  }
+  BaseFloat s = (max_value - min_value) / 127.0,
+      inv_s = 1.0 / s;
+  int32 zp = static_cast<int32>(-min_value * inv_s + 0.5);
+  zp = std::max(0, std::min(127, zp));
+  // Adding 0.5 and truncating rounds to the nearest integer, because
+  // in[d] * inv_s + zp >= -0.5 (up to roundoff).
+  BaseFloat offset = zp + 0.5;
+  for (int32 d = 0; d < dim; d++) {
+    int32 q = static_cast<int32>(in[d] * inv_s + offset);
+    out[d] = static_cast<uint8>(std::max(0, std::min(127, q)));
+  }
+  *scale = s;
+  *zero_point = zp;
+}
+
+// Does the work of the Propagate() functions of the quantized components, on
+// the CPU: sets 'out' to the bias (or zero, if it is empty) and then adds the
+// output of linear_params.AddToOutput().
+void QuantizedPropagateCpu(const QuantizedLinearParams &linear_params,
+                           const Vector<BaseFloat> &bias_params,
+                           const MatrixBase<BaseFloat> &in,
+                           int32 row_stride,
+                           const std::vector<int32> &row_offsets,
+                           MatrixBase<BaseFloat> *out) {
+  if (bias_params.Dim() != 0)
+    out->CopyRowsFromVec(bias_params);
+  else
+    out->SetZero();
+  linear_params.AddToOutput(in, row_stride, row_offsets, out);
+}
+
+// As QuantizedPropagateCpu(), but accepting CUDA matrices.  The integer
+// kernels only exist for the CPU, so if a GPU is in use we copy the data to
+// and from it.
+void QuantizedPropagate(const QuantizedLinearParams &linear_params,
+                        const Vector<BaseFloat> &bias_params,
+                        const CuMatrixBase<BaseFloat> &in,
+                        int32 row_stride,
+                        const std::vector<int32> &row_offsets,
+                        CuMatrixBase<BaseFloat> *out) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    Matrix<BaseFloat> in_cpu(in),
+        out_cpu(out->NumRows(), out->NumCols(), kUndefined);
+    QuantizedPropagateCpu(linear_params, bias_params, in_cpu, row_stride,
+                          row_offsets, &out_cpu);
+    out->CopyFromMat(out_cpu);
+    return;
+  }
+#endif
+  QuantizedPropagateCpu(linear_params, bias_params, in.Mat(), row_stride,
+                        row_offsets, &(out->Mat()));
+}
+
+// Reads the "matrix" and "use-bias" values from the config line for the
+// InitFromConfig() functions, and splits the matrix into linear and bias
+// parameters.
+void GetQuantizedParamsFromConfig(ConfigLine *cfl,
+                                  Matrix<BaseFloat> *linear_params,
+                                  Vector<BaseFloat> *bias_params) {
+  std::string filename;
+  bool use_bias = true;
+  cfl->GetValue("use-bias", &use_bias);
+  if (!cfl->GetValue("matrix", &filename) || cfl->HasUnusedValues())
+    KALDI_ERR << "Invalid initializer for quantized component: \""
+              << cfl->WholeLine() << "\"";
+  Matrix<BaseFloat> mat;
+  ReadKaldiObject(filename, &mat);
+  int32 num_linear_cols = mat.NumCols() - (use_bias ? 1 : 0);
+  if (mat.NumRows() == 0 || num_linear_cols <= 0)
+    KALDI_ERR << "Matrix in " << filename << " has unexpected dimension "
+              << mat.NumRows() << " by " << mat.NumCols();
+  *linear_params = mat.Range(0, mat.NumRows(), 0, num_linear_cols);
+  if (use_bias) {
+    bias_params->Resize(mat.NumRows());
+    bias_params->CopyColFromMat(mat, num_linear_cols);
+  } else {
+    bias_params->Resize(0);
+  }
+}
+
+}  // namespace
+
+
+void QuantizedLinearParams::Init(const MatrixBase<BaseFloat> &params,
+                                 int32 num_blocks) {
+  KALDI_ASSERT(num_blocks > 0 && params.NumCols() > 0 &&
+               params.NumCols() % num_blocks == 0);
+  num_rows_ = params.NumRows();
+  num_blocks_ = num_blocks;
+  block_dim_ = params.NumCols() / num_blocks;
+  int32 num_cols = params.NumCols();
+  row_scales_.Resize(num_rows_);
+  std::vector<int8> values(static_cast<size_t>(num_rows_) * num_cols, 0);
+  for (int32 i = 0; i < num_rows_; i++) {
+    const BaseFloat *row = params.RowData(i);
+    BaseFloat max_abs = 0.0;
+    for (int32 d = 0; d < num_cols; d++)
+      max_abs = std::max(max_abs, std::abs(row[d]));
+    if (max_abs == 0.0)
+      continue;
+    BaseFloat scale = max_abs / 127.0, inv_scale = 1.0 / scale;
+    row_scales_(i) = scale;
+    int8 *row_values = &(values[static_cast<size_t>(i) * num_cols]);
+    for (int32 d = 0; d < num_cols; d++) {
+      BaseFloat f = row[d] * inv_scale;
+      int32 q = static_cast<int32>(f >= 0 ? f + 0.5 : f - 0.5);
+      row_values[d] = static_cast<int8>(std::max(-127, std::min(127, q)));
+    }
+  }
+  SetData(values);
+}
+
+void QuantizedLinearParams::SetData(const std::vector<int8> &values) {
+  KALDI_ASSERT(values.size() ==
+               static_cast<size_t>(num_rows_) * num_blocks_ * block_dim_);
+  block_stride_ = ((block_dim_ + kQuantizedAlign - 1) / kQuantizedAlign) *
+      kQuantizedAlign;
+  data_.clear();
+  data_.resize(static_cast<size_t>(num_rows_) * num_blocks_ * block_stride_, 0);
+  block_sums_.clear();
+  block_sums_.resize(static_cast<size_t>(num_rows_) * num_blocks_, 0);
+  for (int32 i = 0; i < num_rows_; i++) {
+    for (int32 b = 0; b < num_blocks_; b++) {
+      size_t block_index = static_cast<size_t>(i) * num_blocks_ + b;
+      const int8 *src = &(values[block_index * block_dim_]);
+      int8 *dest = &(data_[block_index * block_stride_]);
+      int32 sum = 0;
+      for (int32 d = 0; d < block_dim_; d++) {
+        dest[d] = src[d];
+        sum += src[d];
+      }
+      block_sums_[block_index] = sum;
+    }
+  }
+}
+
+void QuantizedLinearParams::GetParams(Matrix<BaseFloat> *params) const {
+  params->Resize(num_rows_, NumCols());
+  for (int32 i = 0; i < num_rows_; i++) {
+    BaseFloat scale = row_scales_(i);
+    BaseFloat *row = params->RowData(i);
+    for (int32 b = 0; b < num_blocks_; b++) {
+      const int8 *src = &(data_[(static_cast<size_t>(i) * num_blocks_ + b) *
+                                block_stride_]);
+      for (int32 d = 0; d < block_dim_; d++)
+        row[b * block_dim_ + d] = scale * src[d];
+    }
+  }
+}
+
+void QuantizedLinearParams::AddToOutput(
+    const MatrixBase<BaseFloat> &in,
+    int32 row_stride,
+    const std::vector<int32> &row_offsets,
+    MatrixBase<BaseFloat> *out) const {
+  KALDI_ASSERT(in.NumCols() == block_dim_ && out->NumCols() == num_rows_ &&
+               static_cast<int32>(row_offsets.size()) == num_blocks_ &&
+               row_stride >= 1);
+  int32 num_in_rows = in.NumRows(), num_out_rows = out->NumRows();
+
+  // Quantize the rows of the input that we'll use (some may be padding,
+  // whose contents are undefined).
+  std::vector<bool> row_used(num_in_rows, false);
+  for (int32 b = 0; b < num_blocks_; b++) {
+    for (int32 r = 0; r < num_out_rows; r++) {
+      int32 i = row_offsets[b] + r * row_stride;
+      KALDI_ASSERT(i >= 0 && i < num_in_rows);
+      row_used[i] = true;
+    }
+  }
+  std::vector<uint8> in_data(static_cast<size_t>(num_in_rows) * block_stride_,
+                             0);
+  std::vector<BaseFloat> in_scales(num_in_rows, 0.0);
+  std::vector<int32> in_zero_points(num_in_rows, 0);
+  for (int32 i = 0; i < num_in_rows; i++)
+    if (row_used[i])
+      QuantizeInputRow(in.RowData(i), block_dim_,
+                       &(in_data[static_cast<size_t>(i) * block_stride_]),
+                       &(in_scales[i]), &(in_zero_points[i]));
+
+  static const QuantizedDotProductsFunction dot_products =
+      GetQuantizedDotProductsFunction();
+  // We go through the parameters in groups of rows small enough to stay in
+  // cache while we go through all rows of the input.
+  const int32 kRowGroupSize = 64;
+  int32 param_row_stride = num_blocks_ * block_stride_;
+  std::vector<int32> dots(kRowGroupSize);
+  for (int32 j0 = 0; j0 < num_rows_; j0 += kRowGroupSize) {
+    int32 num_j = std::min(kRowGroupSize, num_rows_ - j0);
+    const BaseFloat *row_scales = row_scales_.Data() + j0;
+    for (int32 r = 0; r < num_out_rows; r++) {
+      BaseFloat *out_row = out->RowData(r) + j0;
+      for (int32 b = 0; b < num_blocks_; b++) {
+        int32 i = row_offsets[b] + r * row_stride;
+        BaseFloat in_scale = in_scales[i];
+        if (in_scale == 0.0)
+          continue;
+        dot_products(&(in_data[static_cast<size_t>(i) * block_stride_]),
+                     &(data_[static_cast<size_t>(j0) * param_row_stride +
+                             b * block_stride_]),
+                     param_row_stride, num_j, block_stride_, &(dots[0]));
+        int32 zero_point = in_zero_points[i];
+        const int32 *block_sums = &(block_sums_[static_cast<size_t>(j0) *
+                                                num_blocks_ + b]);
+        for (int32 j = 0; j < num_j; j++)
+          out_row[j] += in_scale * row_scales[j] *
+              (dots[j] - zero_point * block_sums[j * num_blocks_]);
+      }
+    }
+  }
+}
+
+void QuantizedLinearParams::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<NumBlocks>");
+  WriteBasicType(os, binary, num_blocks_);
+  WriteToken(os, binary, "<BlockDim>");
+  WriteBasicType(os, binary, block_dim_);
+  WriteToken(os, binary, "<RowScales>");
+  row_scales_.Write(os, binary);
+  // The values are written without the padding.
+  std::vector<int8> values(static_cast<size_t>(num_rows_) * num_blocks_ *
+                           block_dim_);
+  for (size_t k = 0; k < static_cast<size_t>(num_rows_) * num_blocks_; k++)
+    std::copy(data_.begin() + k * block_stride_,
+              data_.begin() + k * block_stride_ + block_dim_,
+              values.begin() + k * block_dim_);
+  WriteToken(os, binary, "<Values>");
+  WriteIntegerVector(os, binary, values);
+}
+
+void QuantizedLinearParams::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<NumBlocks>");
+  ReadBasicType(is, binary, &num_blocks_);
+  ExpectToken(is, binary, "<BlockDim>");
+  ReadBasicType(is, binary, &block_dim_);
+  ExpectToken(is, binary, "<RowScales>");
+  row_scales_.Read(is, binary);
+  num_rows_ = row_scales_.Dim();
+  std::vector<int8> values;
+  ExpectToken(is, binary, "<Values>");
+  ReadIntegerVector(is, binary, &values);
+  if (num_blocks_ <= 0 || block_dim_ < 0 ||
+      values.size() != static_cast<size_t>(num_rows_) * num_blocks_ *
+      block_dim_)
+    KALDI_ERR << "Bad dimensions reading quantized parameters.";
+  SetData(values);
+}
+
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const QuantizedAffineComponent &other):
+    linear_params_(other.linear_params_),
+    bias_params_(other.bias_params_) { }
+
+void QuantizedAffineComponent::Init(const MatrixBase<BaseFloat> &linear_params,
+                                    const VectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(bias_params.Dim() == 0 ||
+               bias_params.Dim() == linear_params.NumRows());
+  linear_params_.Init(linear_params, 1);
+  bias_params_ = bias_params;
+}
+
+std::string QuantizedAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  Matrix<BaseFloat> linear_params;
+  linear_params_.GetParams(&linear_params);
+  PrintParameterStats(stream, "linear-params",
+                      CuMatrix<BaseFloat>(linear_params));
+  if (bias_params_.Dim() == 0)
+    stream << ", has-bias=false";
+  else
+    PrintParameterStats(stream, "bias", CuVector<BaseFloat>(bias_params_),
+                        true);
+  return stream.str();
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  Matrix<BaseFloat> linear_params;
+  Vector<BaseFloat> bias_params;
+  GetQuantizedParamsFromConfig(cfl, &linear_params, &bias_params);
+  Init(linear_params, bias_params);
+}
+
+void* QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  QuantizedPropagate(linear_params_, bias_params_, in, 1,
+                     std::vector<int32>(1, 0), out);
+  return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  NVTX_RANGE("QuantizedAffineComponent::Backprop");
+  if (in_deriv) {
+    Matrix<BaseFloat> linear_params;
+    linear_params_.GetParams(&linear_params);
+    in_deriv->AddMatMat(1.0, out_deriv, kNoTrans,
+                        CuMatrix<BaseFloat>(linear_params), kNoTrans, 1.0);
+  }
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  if (linear_params_.NumBlocks() != 1)
+    KALDI_ERR << "Bad parameters reading QuantizedAffineComponent";
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+}
+
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(
+    const QuantizedTdnnComponent &other):
+    time_offsets_(other.time_offsets_),
+    linear_params_(other.linear_params_),
+    bias_params_(other.bias_params_) { }
+
+void QuantizedTdnnComponent::Init(const std::vector<int32> &time_offsets,
+                                  const MatrixBase<BaseFloat> &linear_params,
+                                  const VectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(!time_offsets.empty() &&
+               std::set<int32>(time_offsets.begin(),
+                               time_offsets.end()).size() ==
+               time_offsets.size() &&
+               linear_params.NumCols() % time_offsets.size() == 0 &&
+               (bias_params.Dim() == 0 ||
+                bias_params.Dim() == linear_params.NumRows()));
+  time_offsets_ = time_offsets;
+  linear_params_.Init(linear_params, time_offsets.size());
+  bias_params_ = bias_params;
+}
+
+std::string QuantizedTdnnComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  stream << ", time-offsets=";
+  for (size_t i = 0; i < time_offsets_.size(); i++) {
+    if (i != 0) stream << ',';
+    stream << time_offsets_[i];
+  }
+  Matrix<BaseFloat> linear_params;
+  linear_params_.GetParams(&linear_params);
+  PrintParameterStats(stream, "linear-params",
+                      CuMatrix<BaseFloat>(linear_params));
+  if (bias_params_.Dim() == 0)
+    stream << ", has-bias=false";
+  else
+    PrintParameterStats(stream, "bias", CuVector<BaseFloat>(bias_params_),
+                        true);
+  return stream.str();
+}
+
+void QuantizedTdnnComponent::InitFromConfig(ConfigLine *cfl) {
+  std::string time_offsets_str;
+  std::vector<int32> time_offsets;
+  if (!cfl->GetValue("time-offsets", &time_offsets_str) ||
+      !SplitStringToIntegers(time_offsets_str, ",", false, &time_offsets) ||
+      time_offsets.empty())
+    KALDI_ERR << "Bad initializer: there is a problem with time-offsets "
+        "(not defined?): " << cfl->WholeLine();
+  Matrix<BaseFloat> linear_params;
+  Vector<BaseFloat> bias_params;
+  GetQuantizedParamsFromConfig(cfl, &linear_params, &bias_params);
+  if (linear_params.NumCols() % time_offsets.size() != 0)
+    KALDI_ERR << "Matrix dimension does not match time-offsets: "
+              << cfl->WholeLine();
+  Init(time_offsets, linear_params, bias_params);
+}
+
+void* QuantizedTdnnComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+  QuantizedPropagate(linear_params_, bias_params_, in, indexes->row_stride,
+                     indexes->row_offsets, out);
+  return NULL;
+}
+
+void QuantizedTdnnComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  NVTX_RANGE("QuantizedTdnnComponent::Backprop");
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+  if (in_deriv == NULL)
+    return;
+  Matrix<BaseFloat> linear_params_cpu;
+  linear_params_.GetParams(&linear_params_cpu);
+  CuMatrix<BaseFloat> linear_params(linear_params_cpu);
+  int32 num_offsets = time_offsets_.size(), input_dim = InputDim();
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_deriv_part =
+        TdnnComponent::GetInputPart(*in_deriv, out_deriv.NumRows(),
+                                    indexes->row_stride,
+                                    indexes->row_offsets[i]);
+    CuSubMatrix<BaseFloat> linear_params_part(linear_params,
+                                              0, linear_params.NumRows(),
+                                              i * input_dim, input_dim);
+    in_deriv_part.AddMatMat(1.0, out_deriv, kNoTrans,
+                            linear_params_part, kNoTrans, 1.0);
+  }
+}
+
+void QuantizedTdnnComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedTdnnComponent>");
+  WriteToken(os, binary, "<TimeOffsets>");
+  WriteIntegerVector(os, binary, time_offsets_);
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedTdnnComponent>");
+}
+
+void QuantizedTdnnComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedTdnnComponent>",
+                       "<TimeOffsets>");
+  ReadIntegerVector(is, binary, &time_offsets_);
+  ExpectToken(is, binary, "<LinearParams>");
+  linear_params_.Read(is, binary);
+  if (time_offsets_.empty() ||
+      linear_params_.NumBlocks() != static_cast<int32>(time_offsets_.size()))
+    KALDI_ERR << "Bad parameters reading QuantizedTdnnComponent";
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedTdnnComponent>");
+}
+
+void QuantizedTdnnComponent::ReorderIndexes(
+    std::vector<Index> *input_indexes,
+    std::vector<Index> *output_indexes) const {
+  TdnnComponent::ReorderTdnnIndexes(input_indexes, output_indexes);
+}
+
+void QuantizedTdnnComponent::GetInputIndexes(
+    const MiscComputationInfo &misc_info,
+    const Index &output_index,
+    std::vector<Index> *desired_indexes) const {
+  TdnnComponent::GetTdnnInputIndexes(time_offsets_, output_index,
+                                     desired_indexes);
+}
+
+bool QuantizedTdnnComponent::IsComputable(
+    const MiscComputationInfo &misc_info,
+    const Index &output_index,
+    const IndexSet &input_index_set,
+    std::vector<Index> *used_inputs) const {
+  return TdnnComponent::TdnnIsComputable(time_offsets_, output_index,
+                                         input_index_set, used_inputs);
+}
+
+ComponentPrecomputedIndexes* QuantizedTdnnComponent::PrecomputeIndexes(
+    const MiscComputationInfo &misc_info,
+    const std::vector<Index> &input_indexes,
+    const std::vector<Index> &output_indexes,
+    bool need_backprop) const {
+  return TdnnComponent::PrecomputeTdnnIndexes(time_offsets_, input_indexes,
+                                              output_indexes);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,264 @@
+// nnet3/nnet-quantized-component.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+#define KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-convolutional-component.h"
+#include <iostream>
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-quantized-component.h
+///
+/// This file contains components whose linear parameters are stored as 8-bit
+/// integers, which are intended for fast inference on CPU.  They are not
+/// normally created from config files but by converting a trained model with
+/// nnet3-quantize (see QuantizeNnet() in nnet-utils.h), which replaces
+/// AffineComponent, NaturalGradientAffineComponent and LinearComponent with
+/// QuantizedAffineComponent, and TdnnComponent with QuantizedTdnnComponent.
+/// The model files become about 4 times smaller.
+///
+/// The matrix multiplication is done in integer arithmetic: each row of the
+/// input is quantized on the fly to 7-bit unsigned values, with its own scale
+/// and zero point, and the dot products with the 8-bit signed parameters are
+/// accumulated in 32 bits.  Using 7 rather than 8 bits for the input means that
+/// the x86 instruction that multiplies pairs of bytes (pmaddubsw) cannot
+/// saturate; this is the same trade-off that other int8 inference libraries
+/// make.  The kernels are chosen at run time according to what the CPU
+/// supports.  When a GPU is in use the computation is done on the CPU, which
+/// is slow; these components are not intended for GPU use.
+///
+/// The backprop is supported (using the de-quantized parameters) so that the
+/// components behave like FixedAffineComponent, but they are not updatable.
+
+
+/**
+   QuantizedLinearParams stores a matrix as 8-bit integers with one scale
+   per row, and multiplies input vectors by it.  The columns of the matrix are
+   divided into 'num_blocks' blocks of equal size, each of which multiplies a
+   different row of the input; this is how TdnnComponent's time offsets are
+   handled.
+ */
+class QuantizedLinearParams {
+ public:
+  QuantizedLinearParams(): num_rows_(0), block_dim_(0), num_blocks_(0),
+                           block_stride_(0) { }
+
+  /// Quantizes 'params', whose NumCols() must be a multiple of 'num_blocks'.
+  void Init(const MatrixBase<BaseFloat> &params, int32 num_blocks);
+
+  int32 NumRows() const { return num_rows_; }
+  int32 NumCols() const { return block_dim_ * num_blocks_; }
+  int32 BlockDim() const { return block_dim_; }
+  int32 NumBlocks() const { return num_blocks_; }
+
+  /// Outputs the de-quantized matrix.
+  void GetParams(Matrix<BaseFloat> *params) const;
+
+  /// Returns the per-row scales: row i of the matrix is row_scales(i) times
+  /// the integers stored for it.
+  const Vector<BaseFloat> &RowScales() const { return row_scales_; }
+
+  /// Does, for each row r of 'out' and each block b:
+  ///   out->Row(r) += block_b * in.Row(row_offsets[b] + r * row_stride)
+  /// where block_b is the b'th block of columns of the matrix.  So if there
+  /// is only one block, with row_stride = 1 and row_offsets = [ 0 ], this
+  ///  is out += in * params^T.
+  void AddToOutput(const MatrixBase<BaseFloat> &in,
+                   int32 row_stride,
+                   const std::vector<int32> &row_offsets,
+                   MatrixBase<BaseFloat> *out) const;
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  // Sets up block_stride_, data_ and block_sums_ from 'values', which
+  // contains the integers in row-major order without any padding.
+  void SetData(const std::vector<int8> &values);
+
+  int32 num_rows_;
+  int32 block_dim_;
+  int32 num_blocks_;
+  // block_dim_ rounded up to a multiple of 32 bytes, so the kernels don't need
+  // to deal with partial vectors; the padding is zero.
+  int32 block_stride_;
+  // The quantized parameters, of dimension num_rows_ * num_blocks_ *
+  // block_stride_.
+  std::vector<int8> data_;
+  // The sum of the quantized parameters in each block of each row, indexed
+  // [row * num_blocks_ + block]; needed to correct for the zero point of the
+  // input.
+  std::vector<int32> block_sums_;
+  Vector<BaseFloat> row_scales_;
+};
+
+
+/**
+   QuantizedAffineComponent is an inference-only version of AffineComponent
+   (or NaturalGradientAffineComponent, or, without the bias, LinearComponent)
+   whose linear parameters are stored as 8-bit integers; see the comment at the
+   top of this file.
+
+   It would normally be created by nnet3-quantize, but it can also be
+   initialized from a config line:
+
+     matrix     Filename of a Kaldi-format matrix containing the linear
+                parameters, plus (if use-bias=true) the bias as the last
+                column.
+     use-bias   Defaults to true.
+ */
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent() { }
+  QuantizedAffineComponent(const QuantizedAffineComponent &other);
+
+  /// 'bias_params' may be empty, in which case there is no bias.
+  void Init(const MatrixBase<BaseFloat> &linear_params,
+            const VectorBase<BaseFloat> &bias_params);
+
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual int32 Properties() const { return kSimpleComponent|kBackpropAdds; }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                          const CuMatrixBase<BaseFloat> &in,
+                          CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &, // in_value
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *, // to_update
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const {
+    return new QuantizedAffineComponent(*this);
+  }
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const QuantizedLinearParams &LinearParams() const { return linear_params_; }
+  const Vector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  QuantizedLinearParams linear_params_;
+  // Empty if there is no bias.
+  Vector<BaseFloat> bias_params_;
+
+  QuantizedAffineComponent &operator = (
+      const QuantizedAffineComponent &other);  // Disallow.
+};
+
+
+/**
+   QuantizedTdnnComponent is an inference-only version of TdnnComponent whose
+   linear parameters are stored as 8-bit integers; see the comment at the top
+   of this file.
+
+   It would normally be created by nnet3-quantize, but it can also be
+   initialized from a config line:
+
+     time-offsets  E.g. time-offsets=-1,0,1, as for TdnnComponent.
+     matrix        Filename of a Kaldi-format matrix containing the linear
+                   parameters (of dimension output-dim by input-dim times the
+                   number of time offsets), plus (if use-bias=true) the bias as
+                   the last column.
+     use-bias      Defaults to true.
+ */
+class QuantizedTdnnComponent: public Component {
+ public:
+  QuantizedTdnnComponent() { }
+  QuantizedTdnnComponent(const QuantizedTdnnComponent &other);
+
+  /// 'linear_params' is as TdnnComponent::LinearParams(); 'bias_params' may be
+  /// empty, in which case there is no bias.
+  void Init(const std::vector<int32> &time_offsets,
+            const MatrixBase<BaseFloat> &linear_params,
+            const VectorBase<BaseFloat> &bias_params);
+
+  virtual std::string Type() const { return "QuantizedTdnnComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual int32 Properties() const {
+    return kReordersIndexes|kBackpropAdds;
+  }
+  virtual int32 InputDim() const { return linear_params_.BlockDim(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                          const CuMatrixBase<BaseFloat> &in,
+                          CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &, // in_value
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *, // to_update
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const {
+    return new QuantizedTdnnComponent(*this);
+  }
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  // The following functions are as for TdnnComponent, and the precomputed
+  // indexes are of type TdnnComponent::PrecomputedIndexes.
+  virtual void ReorderIndexes(std::vector<Index> *input_indexes,
+                              std::vector<Index> *output_indexes) const;
+  virtual void GetInputIndexes(const MiscComputationInfo &misc_info,
+                               const Index &output_index,
+                               std::vector<Index> *desired_indexes) const;
+  virtual bool IsComputable(const MiscComputationInfo &misc_info,
+                            const Index &output_index,
+                            const IndexSet &input_index_set,
+                            std::vector<Index> *used_inputs) const;
+  virtual ComponentPrecomputedIndexes* PrecomputeIndexes(
+      const MiscComputationInfo &misc_info,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes,
+      bool need_backprop) const;
+
+  const std::vector<int32> &TimeOffsets() const { return time_offsets_; }
+  const QuantizedLinearParams &LinearParams() const { return linear_params_; }
+  const Vector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  std::vector<int32> time_offsets_;
+  // One block of columns per time offset.
+  QuantizedLinearParams linear_params_;
+  // Empty if there is no bias.
+  Vector<BaseFloat> bias_params_;
+
+  QuantizedTdnnComponent &operator = (
+      const QuantizedTdnnComponent &other);  // Disallow.
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
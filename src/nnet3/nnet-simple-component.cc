@@ -2484,6 +2484,14 @@ void ScaleAndOffsetComponent::PropagateInternal(
   out->AddVecToRows(1.0, offsets_);
 }
 
+void ScaleAndOffsetComponent::GetScalesAndOffsets(
+    CuVector<BaseFloat> *scales,
+    CuVector<BaseFloat> *offsets) const {
+  scales->Resize(scales_.Dim(), kUndefined);
+  cu::EnsureNonzero(scales_, Epsilon(), scales);
+  *offsets = offsets_;
+}
+
 void ScaleAndOffsetComponent::Backprop(
     const std::string &debug_info,
     const ComponentPrecomputedIndexes *indexes,
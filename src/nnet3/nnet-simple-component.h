@@ -1170,6 +1170,7 @@ class FixedBiasComponent: public Component {
   virtual void Read(std::istream &is, bool binary);
   virtual void Write(std::ostream &os, bool binary) const;
 
+  const CuVector<BaseFloat> &Bias() const { return bias_; }
  protected:
   CuVector<BaseFloat> bias_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(FixedBiasComponent);
@@ -1903,6 +1904,13 @@ class ScaleAndOffsetComponent: public UpdatableComponent {
 
   // copy constructor
   explicit ScaleAndOffsetComponent(const ScaleAndOffsetComponent &other);
+
+  // Outputs the scales and offsets that Propagate() applies to each block of
+  // the input, i.e. y(i) = scales(i) * x(i) + offsets(i); these have dimension
+  // block-dim.  The scales are the stored ones with small values replaced as in
+  // Propagate(), so they are nonzero.
+  void GetScalesAndOffsets(CuVector<BaseFloat> *scales,
+                           CuVector<BaseFloat> *offsets) const;
  private:
   // Internal version of propagate, requires in.NumCols() equal to scales_.Dim()
   // (if batch-dim was set, this may require the caller to reshape the input and
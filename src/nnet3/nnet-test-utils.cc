@@ -23,6 +23,8 @@
 #include <sstream>
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-optimize.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -1900,6 +1902,33 @@ bool ExampleApproxEqual(const NnetExample &eg1,
   return true;
 }
 
+void ComputeSimpleOutput(const Nnet &nnet,
+                         const Matrix<BaseFloat> &input,
+                         Nnet *nnet_to_store_stats,
+                         Matrix<BaseFloat> *output) {
+  int32 left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+  int32 num_frames = input.NumRows() - left_context - right_context;
+  KALDI_ASSERT(num_frames > 0);
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", -left_context,
+                                           num_frames + right_context));
+  request.outputs.push_back(IoSpecification("output", 0, num_frames));
+  request.store_component_stats = (nnet_to_store_stats != NULL);
+  CachingOptimizingCompiler compiler(nnet);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler.Compile(request);
+  NnetComputer computer(NnetComputeOptions(), *computation, nnet,
+                        nnet_to_store_stats);
+  CuMatrix<BaseFloat> cu_input(input);
+  computer.AcceptInput("input", &cu_input);
+  computer.Run();
+  CuMatrix<BaseFloat> cu_output;
+  computer.GetOutputDestructive("output", &cu_output);
+  output->Resize(cu_output.NumRows(), cu_output.NumCols(), kUndefined);
+  cu_output.CopyToMat(output);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
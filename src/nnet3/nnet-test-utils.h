@@ -119,6 +119,16 @@ bool ExampleApproxEqual(const NnetExample &eg1,
                         const NnetExample &eg2,
                         BaseFloat delta);
 
+/** Computes the output of the simple nnet 'nnet' (one input named "input" and
+    one output named "output") for 'input', which must have enough frames for
+    the nnet's left and right context; 'output' will have that many fewer rows.
+    If 'nnet_to_store_stats' is non-NULL, components such as batch-norm
+    accumulate stats in it. */
+void ComputeSimpleOutput(const Nnet &nnet,
+                         const Matrix<BaseFloat> &input,
+                         Nnet *nnet_to_store_stats,
+                         Matrix<BaseFloat> *output);
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -55,13 +55,22 @@ NnetTrainer::NnetTrainer(const NnetTrainerOptions &config,
 
 
 void NnetTrainer::Train(const NnetExample &eg) {
+  std::shared_ptr<const NnetComputation> computation = GetComputation(eg);
+  Train(eg, *computation);
+}
+
+std::shared_ptr<const NnetComputation> NnetTrainer::GetComputation(
+    const NnetExample &eg) {
   bool need_model_derivative = true;
   ComputationRequest request;
   GetComputationRequest(*nnet_, eg, need_model_derivative,
                         config_.store_component_stats,
                         &request);
-  std::shared_ptr<const NnetComputation> computation = compiler_.Compile(request);
+  return compiler_.Compile(request);
+}
 
+void NnetTrainer::Train(const NnetExample &eg,
+                        const NnetComputation &computation) {
   if (config_.backstitch_training_scale > 0.0 &&
       num_minibatches_processed_ % config_.backstitch_training_interval ==
       srand_seed_ % config_.backstitch_training_interval) {
@@ -71,14 +80,14 @@ void NnetTrainer::Train(const NnetExample &eg) {
     bool is_backstitch_step1 = true;
     srand(srand_seed_ + num_minibatches_processed_);
     ResetGenerators(nnet_);
-    TrainInternalBackstitch(eg, *computation, is_backstitch_step1);
+    TrainInternalBackstitch(eg, computation, is_backstitch_step1);
     FreezeNaturalGradient(false, delta_nnet_); // un-freeze natural gradient
     is_backstitch_step1 = false;
     srand(srand_seed_ + num_minibatches_processed_);
     ResetGenerators(nnet_);
-    TrainInternalBackstitch(eg, *computation, is_backstitch_step1);
+    TrainInternalBackstitch(eg, computation, is_backstitch_step1);
   } else { // conventional training
-    TrainInternal(eg, *computation);
+    TrainInternal(eg, computation);
   }
   if (num_minibatches_processed_ == 0) {
     ConsolidateMemory(nnet_);
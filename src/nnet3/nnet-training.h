@@ -169,10 +169,11 @@ struct ObjectiveFunctionInfo {
     standard objective functions such as cross-entropy (implemented with
     logsoftmax nonlinearity and a linear objective function) and quadratic loss.
 
-    Something that we should do in the future is to make it possible to have
-    two different threads, one for the compilation, and one for the computation.
-    This would only improve efficiency in the cases where the structure of the
-    input example was different each time, which isn't what we expect to see in
+    It is possible to do the reading and compilation in a different thread
+    from the computation, using GetComputation() and the two-argument form of
+    Train(); see class ExamplePrefetcher in nnet-example-prefetcher.h.  The
+    compilation only takes much time when the structure of the input example is
+    different each time, which isn't what we expect to see in
     speech-recognition training.  (If the structure is the same each time,
     the CachingOptimizingCompiler notices this and uses the computation from
     last time).
@@ -185,6 +186,14 @@ class NnetTrainer {
   // train on one minibatch.
   void Train(const NnetExample &eg);
 
+  // Returns the compiled computation for training on 'eg'.  This may be
+  // called from a different thread than Train(), to compile ahead.
+  std::shared_ptr<const NnetComputation> GetComputation(const NnetExample &eg);
+
+  // train on one minibatch, using the computation returned by
+  // GetComputation(eg).
+  void Train(const NnetExample &eg, const NnetComputation &computation);
+
   // Prints out the final stats, and return true if there was a nonzero count.
   bool PrintTotalStats() const;
 
@@ -19,8 +19,11 @@
 // limitations under the License.
 
 #include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -100,6 +103,92 @@ void UnitTestConvertRepeatedToBlockAffineComposite() {
   }
 }
 
+void UnitTestCollapseModelDiagonal() {
+  // Per-dimension affine components both before and after affine, linear
+  // and TDNN components, including ones with a block-dim.
+  std::string config =
+      "input-node name=input dim=40\n"
+      "component name=scale0 type=FixedScaleComponent dim=40\n"
+      "component-node name=scale0 component=scale0 input=input\n"
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=40 output-dim=60\n"
+      "component-node name=affine1 component=affine1 input=scale0\n"
+      "component name=bn1 type=BatchNormComponent dim=60 block-dim=20\n"
+      "component-node name=bn1 component=bn1 input=affine1\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=60\n"
+      "component-node name=relu1 component=relu1 input=bn1\n"
+      "component name=bn2 type=BatchNormComponent dim=60\n"
+      "component-node name=bn2 component=bn2 input=relu1\n"
+      "component name=tdnn2 type=TdnnComponent input-dim=60 output-dim=50 "
+      "time-offsets=-1,0,1 use-bias=false\n"
+      "component-node name=tdnn2 component=tdnn2 input=bn2\n"
+      "component name=so2 type=ScaleAndOffsetComponent dim=50\n"
+      "component-node name=so2 component=so2 input=tdnn2\n"
+      "component name=relu2 type=RectifiedLinearComponent dim=50\n"
+      "component-node name=relu2 component=relu2 input=so2\n"
+      "component name=bias3 type=FixedBiasComponent dim=50\n"
+      "component-node name=bias3 component=bias3 input=relu2\n"
+      "component name=linear3 type=LinearComponent input-dim=100 "
+      "output-dim=30\n"
+      "component-node name=linear3 component=linear3 "
+      "input=Append(Offset(bias3, -2), bias3)\n"
+      "component name=bn3 type=BatchNormComponent dim=30\n"
+      "component-node name=bn3 component=bn3 input=linear3\n"
+      "output-node name=output input=bn3\n";
+  Nnet nnet;
+  {
+    std::istringstream is(config);
+    nnet.ReadConfig(is);
+  }
+  // ScaleAndOffsetComponent, FixedScaleComponent and FixedBiasComponent are
+  // initialized to the identity transform, so give them random parameters;
+  // otherwise folding them in would be a no-op.
+  dynamic_cast<UpdatableComponent*>(
+      nnet.GetComponent(nnet.GetComponentIndex("so2")))->PerturbParams(0.5);
+  {
+    CuVector<BaseFloat> scales(40);
+    scales.SetRandUniform();
+    scales.Add(0.5);  // scales in [0.5, 1.5].
+    dynamic_cast<FixedScaleComponent*>(
+        nnet.GetComponent(nnet.GetComponentIndex("scale0")))->Init(scales);
+    CuVector<BaseFloat> bias(50);
+    bias.SetRandn();
+    dynamic_cast<FixedBiasComponent*>(
+        nnet.GetComponent(nnet.GetComponentIndex("bias3")))->Init(bias);
+  }
+
+  int32 num_frames = 20, left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+  Matrix<BaseFloat> input(num_frames + left_context + right_context, 40);
+  input.SetRandn();
+  Matrix<BaseFloat> output, collapsed_output;
+  // Accumulate the batch-norm stats, so we can set test mode.
+  ComputeSimpleOutput(nnet, input, &nnet, &output);
+  SetBatchnormTestMode(true, &nnet);
+  ComputeSimpleOutput(nnet, input, NULL, &output);
+
+  Nnet collapsed_nnet(nnet);
+  CollapseModel(CollapseModelConfig(), &collapsed_nnet);
+  KALDI_LOG << "Collapsed nnet is: " << collapsed_nnet.Info();
+  for (int32 c = 0; c < collapsed_nnet.NumComponents(); c++) {
+    std::string type = collapsed_nnet.GetComponent(c)->Type();
+    KALDI_ASSERT(type != "BatchNormComponent" &&
+                 type != "FixedScaleComponent" &&
+                 type != "FixedBiasComponent" &&
+                 type != "ScaleAndOffsetComponent");
+  }
+  ComputeSimpleOutput(collapsed_nnet, input, NULL, &collapsed_output);
+  AssertEqual(output, collapsed_output, 1.0e-03);
+
+  // With collapse-diagonal and collapse-batchnorm off, nothing is folded.
+  CollapseModelConfig config_off;
+  config_off.collapse_diagonal = false;
+  config_off.collapse_batchnorm = false;
+  Nnet uncollapsed_nnet(nnet);
+  CollapseModel(config_off, &uncollapsed_nnet);
+  KALDI_ASSERT(uncollapsed_nnet.NumComponents() == nnet.NumComponents());
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -111,6 +200,7 @@ int main() {
   UnitTestNnetContext();
   UnitTestConvertRepeatedToBlockAffine();
   UnitTestConvertRepeatedToBlockAffineComposite();
+  UnitTestCollapseModelDiagonal();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
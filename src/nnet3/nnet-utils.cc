@@ -25,6 +25,7 @@
 #include "nnet3/nnet-normalize-component.h"
 #include "nnet3/nnet-general-component.h"
 #include "nnet3/nnet-convolutional-component.h"
+#include "nnet3/nnet-quantized-component.h"
 #include "nnet3/nnet-parse.h"
 #include "nnet3/nnet-computation-graph.h"
 #include "nnet3/nnet-diagnostics.h"
@@ -489,6 +490,48 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet) {
   }
 }
 
+int32 QuantizeNnet(const std::string &name_pattern, Nnet *nnet) {
+  int32 num_quantized = 0;
+  for (int32 i = 0; i < nnet->NumComponents(); i++) {
+    if (!NameMatchesPattern(nnet->GetComponentName(i).c_str(),
+                            name_pattern.c_str()))
+      continue;
+    const Component *c = nnet->GetComponent(i);
+    std::string type = c->Type();
+    Component *new_c = NULL;
+    if (type == "AffineComponent" ||
+        type == "NaturalGradientAffineComponent") {
+      const AffineComponent *ac = dynamic_cast<const AffineComponent*>(c);
+      KALDI_ASSERT(ac != NULL);
+      QuantizedAffineComponent *qac = new QuantizedAffineComponent();
+      qac->Init(Matrix<BaseFloat>(ac->LinearParams()),
+                Vector<BaseFloat>(ac->BiasParams()));
+      new_c = qac;
+    } else if (type == "LinearComponent") {
+      const LinearComponent *lc = dynamic_cast<const LinearComponent*>(c);
+      KALDI_ASSERT(lc != NULL);
+      QuantizedAffineComponent *qac = new QuantizedAffineComponent();
+      qac->Init(Matrix<BaseFloat>(lc->Params()), Vector<BaseFloat>());
+      new_c = qac;
+    } else if (type == "TdnnComponent") {
+      // We need the non-const GetComponent() for LinearParams() and
+      // BiasParams(), but we don't modify it.
+      TdnnComponent *tc = dynamic_cast<TdnnComponent*>(nnet->GetComponent(i));
+      KALDI_ASSERT(tc != NULL);
+      QuantizedTdnnComponent *qtc = new QuantizedTdnnComponent();
+      qtc->Init(tc->TimeOffsets(), Matrix<BaseFloat>(tc->LinearParams()),
+                Vector<BaseFloat>(tc->BiasParams()));
+      new_c = qtc;
+    }
+    if (new_c != NULL) {
+      // the following call deletes c.
+      nnet->SetComponent(i, new_c);
+      num_quantized++;
+    }
+  }
+  return num_quantized;
+}
+
 std::string NnetInfo(const Nnet &nnet) {
   std::ostringstream ostr;
   if (IsSimpleNnet(nnet)) {
@@ -1505,9 +1548,14 @@ class ModelCollapser {
      The function returns the component-index of a (newly created or existing)
      component that combines both of these components, if it's possible to
      combine them; or it returns -1 if it's not possible.
+
+     'input_is_private' should be true if the output of the first component is
+     used only as the (whole) input of the second component; only in that case
+     is it worthwhile to fold the second component into the first.
    */
   int32 CollapseComponents(int32 component_index1,
-                           int32 component_index2) {
+                           int32 component_index2,
+                           bool input_is_private) {
     int32 ans;
     if (config_.collapse_dropout &&
         (ans = CollapseComponentsDropout(component_index1,
@@ -1525,9 +1573,32 @@ class ModelCollapser {
         (ans = CollapseComponentsScale(component_index1,
                                        component_index2)) != -1)
       return ans;
+    if ((config_.collapse_diagonal || config_.collapse_batchnorm) &&
+        (ans = CollapseComponentsDiagonal(component_index1,
+                                          component_index2,
+                                          input_is_private)) != -1)
+      return ans;
     return -1;
   }
 
+  // Returns true if the only node that uses the output of node 'node_index' is
+  // 'consumer_node_index' (ignoring nodes that are no longer used to compute
+  // any output, which are removed at the end of Collapse()).
+  bool NodeHasSingleConsumer(int32 node_index, int32 consumer_node_index) {
+    std::vector<std::vector<int32> > graph;
+    NnetToDirectedGraph(*nnet_, &graph);
+    std::vector<int32> orphan_nodes;
+    FindOrphanNodes(*nnet_, &orphan_nodes);
+    const std::vector<int32> &consumers = graph[node_index];
+    for (size_t i = 0; i < consumers.size(); i++) {
+      if (consumers[i] != consumer_node_index &&
+          !std::binary_search(orphan_nodes.begin(), orphan_nodes.end(),
+                              consumers[i]))
+        return false;
+    }
+    return true;
+  }
+
 
   // If the SumDescriptor has exactly one part that is either a
   // SimpleForwardingDescriptor or an OffsetForwardingDescriptor containing a
@@ -1670,8 +1741,12 @@ class ModelCollapser {
     if (input_node.node_type != kComponent)
       return false;
     int32 input_component_index = input_node.u.component_index;
+    bool input_is_private = (descriptor.NumParts() == 1 &&
+                             NodeHasSingleConsumer(input_node_index,
+                                                   node_index));
     int32 combined_component_index = CollapseComponents(input_component_index,
-                                                        component_index);
+                                                        component_index,
+                                                        input_is_private);
     if (combined_component_index == -1)
       return false;  // these components were not of types that can be
                      // collapsed.
@@ -1755,7 +1830,10 @@ class ModelCollapser {
       return -1;
 
     if (batchnorm_component->Offset().Dim() == 0) {
-      KALDI_ERR << "Expected batch-norm components to have test-mode set.";
+      KALDI_WARN << "Not collapsing batch-norm component "
+                 << nnet_->GetComponentName(component_index1)
+                 << " because it is not in test mode.";
+      return -1;
     }
     std::string batchnorm_component_name = nnet_->GetComponentName(
         component_index1);
@@ -1911,12 +1989,90 @@ class ModelCollapser {
   }
 
 
+  /**
+     If the component 'component_index' is a per-dimension affine transform
+     y = a x + b that CollapseModel() is configured to fold (a BatchNormComponent
+     in test mode, FixedScaleComponent, FixedBiasComponent or
+     ScaleAndOffsetComponent), outputs 'b' to 'offset' and 'a' to 'scale' and
+     returns true; otherwise returns false.  The dimension of 'offset' and
+     'scale' may be a divisor of the component's dimension, in which case they
+     are repeated.
+   */
+  bool GetDiagonalTransform(int32 component_index,
+                            CuVector<BaseFloat> *offset,
+                            CuVector<BaseFloat> *scale) {
+    const Component *component = nnet_->GetComponent(component_index);
+    if (config_.collapse_batchnorm) {
+      const BatchNormComponent *batchnorm_component =
+          dynamic_cast<const BatchNormComponent*>(component);
+      if (batchnorm_component != NULL) {
+        if (batchnorm_component->Offset().Dim() == 0)
+          return false;  // not in test mode.
+        *offset = batchnorm_component->Offset();
+        *scale = batchnorm_component->Scale();
+        return true;
+      }
+    }
+    if (!config_.collapse_diagonal)
+      return false;
+    const FixedScaleComponent *fixed_scale_component =
+        dynamic_cast<const FixedScaleComponent*>(component);
+    const FixedBiasComponent *fixed_bias_component =
+        dynamic_cast<const FixedBiasComponent*>(component);
+    const ScaleAndOffsetComponent *scale_offset_component =
+        dynamic_cast<const ScaleAndOffsetComponent*>(component);
+    if (fixed_scale_component != NULL) {
+      *scale = fixed_scale_component->Scales();
+      offset->Resize(scale->Dim());
+    } else if (fixed_bias_component != NULL) {
+      *offset = fixed_bias_component->Bias();
+      scale->Resize(offset->Dim(), kUndefined);
+      scale->Set(1.0);
+    } else if (scale_offset_component != NULL) {
+      scale_offset_component->GetScalesAndOffsets(scale, offset);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  /**
+     Tries to produce a component that's equivalent to running the component
+     'component_index2' with input given by 'component_index1', where one of
+     them is a per-dimension affine transform (see GetDiagonalTransform()) and
+     the other is of type AffineComponent, NaturalGradientAffineComponent,
+     LinearComponent or TdnnComponent.  The case where the per-dimension
+     transform comes second is only handled if 'input_is_private' is true
+     (see CollapseComponents()), since otherwise the first component would
+     still have to be computed for its other uses.
+
+     Returns -1 if this code can't produce a combined component.
+   */
+  int32 CollapseComponentsDiagonal(int32 component_index1,
+                                   int32 component_index2,
+                                   bool input_is_private) {
+    CuVector<BaseFloat> offset, scale;
+    if (GetDiagonalTransform(component_index1, &offset, &scale)) {
+      int32 ans = GetDiagonallyPreModifiedComponentIndex(
+          offset, scale, nnet_->GetComponentName(component_index1),
+          component_index2);
+      if (ans != -1)
+        return ans;
+    }
+    if (input_is_private &&
+        GetDiagonalTransform(component_index2, &offset, &scale))
+      return GetDiagonallyPostModifiedComponentIndex(
+          offset, scale, nnet_->GetComponentName(component_index2),
+          component_index1);
+    return -1;
+  }
+
   /**
      This function finds, or creates, a component which is like
      'component_index' but is combined with a diagonal offset-and-scale
-     transform *before* the component.  (We may later create a function called
-     GetDiagonallyPostModifiedComponentIndex if we need to apply the
-     transform *after* the component.
+     transform *before* the component.  (See also
+     GetDiagonallyPostModifiedComponentIndex(), which applies the transform
+     *after* the component.)
 
      This function doesn't work for convolutional components, because
      due to zero-padding, it's not possible to represent an offset/scale
@@ -2010,6 +2166,76 @@ class ModelCollapser {
     return nnet_->AddComponent(new_component_name, new_component);
   }
 
+  /**
+     This function finds, or creates, a component which is like
+     'component_index' but is followed by a diagonal offset-and-scale transform
+     y = a x + b.  The arguments and return value are as for
+     GetDiagonallyPreModifiedComponentIndex(), except that the dimension of
+     'offset' and 'scale' should divide the component's output dimension.
+   */
+  int32 GetDiagonallyPostModifiedComponentIndex(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      const std::string &src_identifier,
+      int32 component_index) {
+    KALDI_ASSERT(offset.Dim() > 0 && offset.Dim() == scale.Dim());
+    const Component *component = nnet_->GetComponent(component_index);
+    if (component->OutputDim() % offset.Dim() != 0)
+      return -1;
+    if (offset.Max() == 0.0 && offset.Min() == 0.0 &&
+        scale.Max() == 1.0 && scale.Min() == 1.0)
+      return component_index;  // identity transform.
+    std::ostringstream new_component_name_os;
+    new_component_name_os << nnet_->GetComponentName(component_index)
+                          << "." << src_identifier;
+    std::string new_component_name = new_component_name_os.str();
+    int32 new_component_index = nnet_->GetComponentIndex(new_component_name);
+    if (new_component_index >= 0)
+      return new_component_index;  // we previously created this.
+
+    const AffineComponent *affine_component =
+        dynamic_cast<const AffineComponent*>(component);
+    const LinearComponent *linear_component =
+        dynamic_cast<const LinearComponent*>(component);
+    const TdnnComponent *tdnn_component =
+        dynamic_cast<const TdnnComponent*>(component);
+
+    Component *new_component = NULL;
+    if (affine_component != NULL) {
+      new_component = component->Copy();
+      AffineComponent *new_affine_component =
+          dynamic_cast<AffineComponent*>(new_component);
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_affine_component->BiasParams()),
+                                   &(new_affine_component->LinearParams()));
+    } else if (linear_component != NULL) {
+      CuVector<BaseFloat> bias_params(linear_component->OutputDim());
+      AffineComponent *new_affine_component =
+          new AffineComponent(linear_component->Params(),
+                              bias_params,
+                              linear_component->LearningRate());
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_affine_component->BiasParams()),
+                                   &(new_affine_component->LinearParams()));
+      new_component = new_affine_component;
+    } else if (tdnn_component != NULL) {
+      new_component = tdnn_component->Copy();
+      TdnnComponent *new_tdnn_component =
+          dynamic_cast<TdnnComponent*>(new_component);
+      if (new_tdnn_component->BiasParams().Dim() == 0) {
+        // make sure it has a bias even if it had none before.
+        new_tdnn_component->BiasParams().Resize(
+            new_tdnn_component->OutputDim());
+      }
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_tdnn_component->BiasParams()),
+                                   &(new_tdnn_component->LinearParams()));
+    } else {
+      return -1;  // we can't do this: this component isn't of the right type.
+    }
+    return nnet_->AddComponent(new_component_name, new_component);
+  }
+
   /**
      This helper function, used GetDiagonallyPreModifiedComponentIndex,
      modifies the linear and bias parameters of an affine transform to
@@ -2051,6 +2277,38 @@ class ModelCollapser {
 
   }
 
+  /**
+     This helper function, used in GetDiagonallyPostModifiedComponentIndex,
+     modifies the linear and bias parameters of an affine transform to
+     capture the effect of following it by a diagonal affine transform with
+     parameters 'offset' and 'scale'.  The dimension of 'offset' and 'scale'
+     must be the same and must divide the output dim of the affine transform,
+     i.e. must divide linear_params->NumRows().
+   */
+  static void PostMultiplyAffineParameters(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      CuVectorBase<BaseFloat> *bias_params,
+      CuMatrixBase<BaseFloat> *linear_params) {
+    int32 output_dim = linear_params->NumRows(),
+        transform_dim = offset.Dim();
+    KALDI_ASSERT(bias_params->Dim() == output_dim &&
+                 offset.Dim() == scale.Dim() &&
+                 output_dim % transform_dim == 0);
+    CuVector<BaseFloat> full_offset(output_dim),
+        full_scale(output_dim);
+    for (int32 d = 0; d < output_dim; d += transform_dim) {
+      full_offset.Range(d, transform_dim).CopyFromVec(offset);
+      full_scale.Range(d, transform_dim).CopyFromVec(scale);
+    }
+    // The affine component does y = a x + b, and we are replacing y with
+    // s y + o, so we have:
+    //  y = s a x + (s b + o).
+    bias_params->MulElements(full_scale);
+    bias_params->AddVec(1.0, full_offset);
+    linear_params->MulRowsVec(full_scale);
+  }
+
 
   /**
       Given a component 'component_index', returns a component which
@@ -164,6 +164,15 @@ void FreezeNaturalGradient(bool freeze, Nnet *nnet);
 /// NaturalGradientRepeatedAffineComponent to BlockAffineComponent in nnet.
 void ConvertRepeatedToBlockAffine(Nnet *nnet);
 
+/// Replaces components of type AffineComponent,
+/// NaturalGradientAffineComponent and LinearComponent with
+/// QuantizedAffineComponent, and TdnnComponent with QuantizedTdnnComponent
+/// (see nnet-quantized-component.h), if their names match
+/// 'name_pattern' (which may contain the wildcard '*', see
+/// NameMatchesPattern()).  The result is only usable for inference.  Returns
+/// the number of components replaced.
+int32 QuantizeNnet(const std::string &name_pattern, Nnet *nnet);
+
 /// This function returns various info about the neural net.
 /// If the nnet satisfied IsSimpleNnet(nnet), the info includes "left-context=5\nright-context=3\n...".  The info includes
 /// the output of nnet.Info().
@@ -234,18 +243,46 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
    are successive affine components it may also be possible to
    combine these under some circumstances.
 
+   Components that are per-dimension affine transforms at test time
+   (batch-norm in test mode, fixed-scale, fixed-bias and scale-and-offset) can
+   also be folded into an affine, linear or TDNN component that they follow,
+   if that component's output is not used anywhere else.
+
    It expects batch-norm components to be in test mode; you should probably call
    SetBatchnormTestMode() and SetDropoutTestMode() before CollapseModel().
+   Batch-norm components that are not in test mode are left alone.
  */
 struct CollapseModelConfig {
   bool collapse_dropout;  // dropout then affine/conv.
-  bool collapse_batchnorm;  // batchnorm then affine.
+  bool collapse_batchnorm;  // batchnorm then affine, or affine then batchnorm.
   bool collapse_affine;  // affine or fixed-affine then affine.
   bool collapse_scale;  // affine then fixed-scale.
+  // fixed-scale, fixed-bias or scale-and-offset before or after affine.
+  bool collapse_diagonal;
   CollapseModelConfig(): collapse_dropout(false),
-                         collapse_batchnorm(false),
+                         collapse_batchnorm(true),
                          collapse_affine(true),
-                         collapse_scale(true) { }
+                         collapse_scale(true),
+                         collapse_diagonal(true) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("collapse-dropout", &collapse_dropout, "If true, "
+                   "CollapseModel() folds dropout components (in test mode) "
+                   "into the following affine or convolutional component.");
+    opts->Register("collapse-batchnorm", &collapse_batchnorm, "If true, "
+                   "CollapseModel() folds batch-norm components (in test "
+                   "mode) into a neighboring affine, linear or TDNN "
+                   "component.");
+    opts->Register("collapse-affine", &collapse_affine, "If true, "
+                   "CollapseModel() combines successive affine components "
+                   "where this does not increase the computation.");
+    opts->Register("collapse-scale", &collapse_scale, "If true, "
+                   "CollapseModel() folds fixed-scale components into a "
+                   "preceding affine component.");
+    opts->Register("collapse-diagonal", &collapse_diagonal, "If true, "
+                   "CollapseModel() folds fixed-scale, fixed-bias and "
+                   "scale-and-offset components into a neighboring affine, "
+                   "linear or TDNN component.");
+  }
 };
 
 /**
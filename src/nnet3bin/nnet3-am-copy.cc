@@ -51,6 +51,7 @@ int main(int argc, char *argv[]) {
     bool convert_repeated_to_block = false;
     BaseFloat scale = 1.0;
     bool prepare_for_test = false;
+    CollapseModelConfig collapse_config;
     std::string nnet_config, edits_config, edits_str;
 
     ParseOptions po(usage);
@@ -87,6 +88,7 @@ int main(int argc, char *argv[]) {
                 "slightly.  Involves setting test mode in dropout and batch-norm "
                 "components, and calling CollapseModel() which may remove some "
                 "components.");
+    collapse_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -145,7 +147,7 @@ int main(int argc, char *argv[]) {
     if (prepare_for_test) {
       SetBatchnormTestMode(true, &am_nnet.GetNnet());
       SetDropoutTestMode(true, &am_nnet.GetNnet());
-      CollapseModel(CollapseModelConfig(), &am_nnet.GetNnet());
+      CollapseModel(collapse_config, &am_nnet.GetNnet());
     }
 
     if (raw) {
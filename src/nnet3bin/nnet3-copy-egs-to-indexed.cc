@@ -0,0 +1,83 @@
+// nnet3bin/nnet3-copy-egs-to-indexed.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-example.h"
+#include "nnet3/nnet-indexed-egs.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Copy examples (single frames or fixed-size groups of frames) for\n"
+        "neural network training into an indexed egs archive, which\n"
+        "nnet3-train can memory-map with --indexed-egs=true (see\n"
+        "nnet3/nnet-indexed-egs.h).  Since it is read in order, the input\n"
+        "would normally be shuffled and merged into minibatches already.\n"
+        "\n"
+        "Usage:  nnet3-copy-egs-to-indexed [options] <egs-rspecifier> <indexed-egs-wxfilename>\n"
+        "\n"
+        "e.g.\n"
+        "nnet3-shuffle-egs ark:1.egs ark:- | nnet3-merge-egs ark:- ark:- | \\\n"
+        "  nnet3-copy-egs-to-indexed ark:- 1.egs.idx\n";
+
+    bool uncompress = false;
+
+    ParseOptions po(usage);
+    po.Register("uncompress", &uncompress, "If true, store the features "
+                "uncompressed, so they don't have to be uncompressed every "
+                "time they are read (this takes about 4 times the space).");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string examples_rspecifier = po.GetArg(1),
+        examples_wxfilename = po.GetArg(2);
+
+    SequentialNnetExampleReader example_reader(examples_rspecifier);
+    IndexedEgsWriter<NnetExample> example_writer(examples_wxfilename);
+
+    int64 num_done = 0;
+    for (; !example_reader.Done(); example_reader.Next(), num_done++) {
+      if (uncompress) {
+        NnetExample eg(example_reader.Value());
+        for (size_t i = 0; i < eg.io.size(); i++)
+          eg.io[i].features.Uncompress();
+        example_writer.Write(example_reader.Key(), eg);
+      } else {
+        example_writer.Write(example_reader.Key(), example_reader.Value());
+      }
+    }
+    if (!example_writer.Close())
+      KALDI_ERR << "Error writing " << examples_wxfilename;
+    KALDI_LOG << "Copied " << num_done << " neural-network training examples "
+              << "to indexed egs archive " << examples_wxfilename;
+    return (num_done == 0 ? 1 : 0);
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -45,6 +45,7 @@ int main(int argc, char *argv[]) {
     std::string nnet_config, edits_config, edits_str;
     BaseFloat scale = 1.0;
     bool prepare_for_test = false;
+    CollapseModelConfig collapse_config;
     bool batchnorm_test_mode = false;
 
     ParseOptions po(usage);
@@ -71,6 +72,7 @@ int main(int argc, char *argv[]) {
                 "slightly.  Involves setting test mode in dropout and batch-norm "
                 "components, and calling CollapseModel() which may remove some "
                 "components.");
+    collapse_config.Register(&po);
     po.Register("batchnorm-test-mode", &batchnorm_test_mode,
                 "Batch-norm components' test mode is set to this value. "
                 "The deafult is false, but is overriden when --prepare-for-test is "
@@ -114,7 +116,7 @@ int main(int argc, char *argv[]) {
     if (prepare_for_test) {
       SetBatchnormTestMode(true, &nnet);
       SetDropoutTestMode(true, &nnet);
-      CollapseModel(CollapseModelConfig(), &nnet);
+      CollapseModel(collapse_config, &nnet);
     }
     else {
       SetBatchnormTestMode(batchnorm_test_mode, &nnet);
@@ -0,0 +1,227 @@
+// nnet3bin/nnet3-quantize.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns the size of 'nnet' when written in binary.
+static size_t BinarySize(const Nnet &nnet) {
+  std::ostringstream os;
+  nnet.Write(os, true);
+  return os.str().size();
+}
+
+// Runs 'nnet' on 'input' (and 'ivector', if nonempty) 'num_repeats' times
+// after one warm-up run, and returns the average time per run.
+static double TimeComputation(const Nnet &nnet,
+                              const NnetComputation &computation,
+                              const Matrix<BaseFloat> &input,
+                              const Matrix<BaseFloat> &ivector,
+                              int32 num_repeats,
+                              Matrix<BaseFloat> *output) {
+  double tot_time = 0.0;
+  for (int32 n = 0; n <= num_repeats; n++) {
+    Timer timer;
+    NnetComputer computer(NnetComputeOptions(), computation, nnet, NULL);
+    CuMatrix<BaseFloat> input_copy(input);
+    computer.AcceptInput("input", &input_copy);
+    if (ivector.NumRows() != 0) {
+      CuMatrix<BaseFloat> ivector_copy(ivector);
+      computer.AcceptInput("ivector", &ivector_copy);
+    }
+    computer.Run();
+    CuMatrix<BaseFloat> cu_output;
+    computer.GetOutputDestructive("output", &cu_output);
+    if (n > 0)
+      tot_time += timer.Elapsed();
+    else
+      output->Resize(cu_output.NumRows(), cu_output.NumCols(), kUndefined);
+    cu_output.CopyToMat(output);
+  }
+  return tot_time / num_repeats;
+}
+
+// Evaluates 'nnet' and 'quantized_nnet' on 'num_frames' frames of random
+// (unit-Gaussian) input and prints how much the outputs differ and how long
+// the computation took.  Random input is only a rough guide to the accuracy
+// on real data; to measure that, decode with both models.
+static void ReportQuantization(const Nnet &nnet_in,
+                               const Nnet &quantized_nnet_in,
+                               int32 num_frames) {
+  if (!IsSimpleNnet(nnet_in)) {
+    KALDI_WARN << "Not reporting on accuracy and speed since the network "
+        "does not have the standard 'input' and 'output' nodes.";
+    return;
+  }
+  Nnet nnet(nnet_in), quantized_nnet(quantized_nnet_in);
+  SetBatchnormTestMode(true, &nnet);
+  SetDropoutTestMode(true, &nnet);
+  SetBatchnormTestMode(true, &quantized_nnet);
+  SetDropoutTestMode(true, &quantized_nnet);
+
+  int32 left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", -left_context,
+                                           num_frames + right_context));
+  Matrix<BaseFloat> input(num_frames + left_context + right_context,
+                          nnet.InputDim("input")),
+      ivector;
+  input.SetRandn();
+  if (nnet.InputDim("ivector") > 0) {
+    request.inputs.push_back(IoSpecification("ivector", 0, 1));
+    ivector.Resize(1, nnet.InputDim("ivector"));
+    ivector.SetRandn();
+  }
+  request.outputs.push_back(IoSpecification("output", 0, num_frames));
+
+  const int32 num_repeats = 3;
+  Matrix<BaseFloat> output, quantized_output;
+  double time, quantized_time;
+  {
+    CachingOptimizingCompiler compiler(nnet);
+    time = TimeComputation(nnet, *compiler.Compile(request), input, ivector,
+                           num_repeats, &output);
+  }
+  {
+    CachingOptimizingCompiler compiler(quantized_nnet);
+    quantized_time = TimeComputation(quantized_nnet,
+                                     *compiler.Compile(request), input,
+                                     ivector, num_repeats, &quantized_output);
+  }
+  int32 num_same_argmax = 0;
+  for (int32 t = 0; t < output.NumRows(); t++) {
+    int32 i, j;
+    output.Row(t).Max(&i);
+    quantized_output.Row(t).Max(&j);
+    if (i == j)
+      num_same_argmax++;
+  }
+  BaseFloat output_norm = output.FrobeniusNorm();
+  quantized_output.AddMat(-1.0, output);
+  BaseFloat relative_error = quantized_output.FrobeniusNorm() /
+      (output_norm == 0.0 ? 1.0 : output_norm);
+  size_t size = BinarySize(nnet), quantized_size = BinarySize(quantized_nnet);
+  KALDI_LOG << "On " << num_frames << " frames of random input: relative "
+            << "difference in output is " << relative_error
+            << ", the largest output is the same on "
+            << (100.0 * num_same_argmax / output.NumRows())
+            << "% of frames.";
+  KALDI_LOG << "Time per computation is " << time << " seconds without "
+            << "quantization, " << quantized_time << " seconds with; speedup "
+            << "is " << (time / quantized_time);
+  KALDI_LOG << "Model size is " << size << " bytes without quantization, "
+            << quantized_size << " bytes with.";
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Converts a trained nnet3 model for faster inference on CPU, by\n"
+        "replacing its AffineComponent, NaturalGradientAffineComponent,\n"
+        "LinearComponent and TdnnComponent components with versions that\n"
+        "store the parameters as 8-bit integers (see\n"
+        "nnet3/nnet-quantized-component.h).  The result can be used for\n"
+        "decoding but not for training.  Works on both raw nnets and\n"
+        "acoustic models (with a transition model).  Unless\n"
+        "--report-frames=0, reports on the accuracy and speed of the result\n"
+        "on random input.\n"
+        "\n"
+        "Usage:  nnet3-quantize [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-quantize exp/chain/tdnn1a/final.mdl exp/chain/tdnn1a/final_q.mdl\n";
+
+    bool binary_write = true;
+    std::string components = "*";
+    int32 report_frames = 200;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("components", &components, "Only quantize components whose "
+                "names match this pattern, which may contain '*'; e.g. use "
+                "'tdnn*' to leave the output layers unquantized.");
+    po.Register("report-frames", &report_frames, "Number of frames of random "
+                "input on which to compare the outputs and speed of the "
+                "original and quantized models; 0 to disable.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    Nnet nnet;
+    bool is_am;
+    {
+      bool binary;
+      Input ki(nnet_rxfilename, &binary);
+      // Acoustic models start with <TransitionModel>, raw nnets with <Nnet3>.
+      is_am = (PeekToken(ki.Stream(), binary) == 'T');
+      if (is_am) {
+        trans_model.Read(ki.Stream(), binary);
+        am_nnet.Read(ki.Stream(), binary);
+      } else {
+        nnet.Read(ki.Stream(), binary);
+      }
+    }
+    Nnet *nnet_ptr = (is_am ? &(am_nnet.GetNnet()) : &nnet);
+    Nnet original_nnet(*nnet_ptr);
+
+    int32 num_quantized = QuantizeNnet(components, nnet_ptr);
+    KALDI_LOG << "Quantized " << num_quantized << " components.";
+    if (num_quantized > 0 && report_frames > 0)
+      ReportQuantization(original_nnet, *nnet_ptr, report_frames);
+
+    {
+      Output ko(nnet_wxfilename, binary_write);
+      if (is_am) {
+        trans_model.Write(ko.Stream(), binary_write);
+        am_nnet.Write(ko.Stream(), binary_write);
+      } else {
+        nnet.Write(ko.Stream(), binary_write);
+      }
+    }
+    KALDI_LOG << "Wrote quantized model to " << nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
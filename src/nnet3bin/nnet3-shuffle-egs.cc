@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-example.h"
+#include "nnet3/nnet-example-utils.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -34,7 +35,8 @@ int main(int argc, char *argv[]) {
         "Copy examples (typically single frames or small groups of frames) for\n"
         "neural network training, from the input to output, but randomly shuffle the order.\n"
         "This program will keep all of the examples in memory at once, unless you\n"
-        "use the --buffer-size option\n"
+        "use the --buffer-size option (partial randomization) or the --run-size\n"
+        "option (full randomization using temporary files)\n"
         "\n"
         "Usage:  nnet3-shuffle-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "\n"
@@ -42,11 +44,22 @@ int main(int argc, char *argv[]) {
 
     int32 srand_seed = 0;
     int32 buffer_size = 0;
+    int32 run_size = 0;
+    const char *tmpdir = getenv("TMPDIR");
+    std::string temp_dir = (tmpdir != NULL ? tmpdir : "/tmp");
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
     po.Register("buffer-size", &buffer_size, "If >0, size of a buffer we use "
                 "to do limited-memory partial randomization.  Otherwise, do "
                 "full randomization.");
+    po.Register("run-size", &run_size, "If >0, do full randomization while "
+                "keeping at most this many examples in memory: shuffled runs "
+                "of this many examples are written to temporary files in "
+                "--temp-dir, which are then merged in random order.  Use "
+                "this for archives that do not fit in memory.");
+    po.Register("temp-dir", &temp_dir, "Directory for the temporary files "
+                "used with --run-size; it needs space for a copy of the "
+                "input.  Defaults to $TMPDIR, or /tmp.");
 
     po.Read(argc, argv);
 
@@ -66,7 +79,13 @@ int main(int argc, char *argv[]) {
 
     SequentialNnetExampleReader example_reader(examples_rspecifier);
     NnetExampleWriter example_writer(examples_wspecifier);
-    if (buffer_size == 0) { // Do full randomization
+    if (run_size > 0) {
+      if (buffer_size > 0)
+        KALDI_ERR << "--buffer-size and --run-size cannot both be set.";
+      num_done = ShuffleWithTempFiles(run_size, temp_dir, srand_seed,
+                                      &example_reader,
+                                      &example_writer);
+    } else if (buffer_size == 0) { // Do full randomization
       // Putting in an extra level of indirection here to avoid excessive
       // computation and memory demands when we have to resize the vector.
 
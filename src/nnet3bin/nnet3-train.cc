@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-training.h"
+#include "nnet3/nnet-example-prefetcher.h"
 #include "cudamatrix/cu-allocator.h"
 
 int main(int argc, char *argv[]) {
@@ -39,12 +40,15 @@ int main(int argc, char *argv[]) {
         "Usage:  nnet3-train [options] <raw-model-in> <training-examples-in> <raw-model-out>\n"
         "\n"
         "e.g.:\n"
-        "nnet3-train 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n";
+        "nnet3-train 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n"
+        "or, with egs merged and written by nnet3-copy-egs-to-indexed:\n"
+        "nnet3-train --indexed-egs=true 1.raw 1.egs.idx 2.raw\n";
 
     int32 srand_seed = 0;
     bool binary_write = true;
     std::string use_gpu = "yes";
     NnetTrainerOptions train_config;
+    ExamplePrefetcherOptions prefetch_config;
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -53,6 +57,7 @@ int main(int argc, char *argv[]) {
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     train_config.Register(&po);
+    prefetch_config.Register(&po);
     RegisterCuAllocatorOptions(&po);
 
     po.Read(argc, argv);
@@ -65,6 +70,10 @@ int main(int argc, char *argv[]) {
     }
 
 #if HAVE_CUDA==1
+    // With --prefetch-minibatches, the computations are compiled (which
+    // allocates GPU memory) in a background thread.
+    if (prefetch_config.prefetch_minibatches > 0)
+      CuDevice::Instantiate().AllowMultithreading();
     CuDevice::Instantiate().SelectGpuId(use_gpu);
 #endif
 
@@ -77,10 +86,14 @@ int main(int argc, char *argv[]) {
 
     NnetTrainer trainer(train_config, &nnet);
 
-    SequentialNnetExampleReader example_reader(examples_rspecifier);
-
-    for (; !example_reader.Done(); example_reader.Next())
-      trainer.Train(example_reader.Value());
+    {
+      ExamplePrefetcher<NnetExample, NnetTrainer> prefetcher(
+          prefetch_config, examples_rspecifier, &trainer);
+      NnetExample eg;
+      std::shared_ptr<const NnetComputation> computation;
+      while (prefetcher.Next(&eg, &computation))
+        trainer.Train(eg, *computation);
+    }
 
     bool ok = trainer.PrintTotalStats();
 
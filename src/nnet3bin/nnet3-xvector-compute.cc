@@ -91,7 +91,6 @@ int main(int argc, char *argv[]) {
     Timer timer;
 
     NnetSimpleComputationOptions opts;
-    CachingOptimizingCompilerOptions compiler_config;
 
     opts.acoustic_scale = 1.0; // by default do no scaling in this recipe.
 
@@ -103,7 +102,6 @@ int main(int argc, char *argv[]) {
     bool pad_input = true;
 
     opts.Register(&po);
-    compiler_config.Register(&po);
 
     po.Register("use-gpu", &use_gpu,
       "yes|no|optional|wait, only has effect if compiled with CUDA");
@@ -144,7 +142,8 @@ int main(int argc, char *argv[]) {
     SetDropoutTestMode(true, &nnet);
     CollapseModel(CollapseModelConfig(), &nnet);
 
-    CachingOptimizingCompiler compiler(nnet, opts.optimize_config, compiler_config);
+    CachingOptimizingCompiler compiler(nnet, opts.optimize_config,
+                                       opts.compiler_config);
 
     if (!cached_compiler_in.empty()) {
         KALDI_LOG << "Reading cache from " << cached_compiler_in;
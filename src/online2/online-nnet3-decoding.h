@@ -66,7 +66,9 @@ class SingleUtteranceNnet3DecoderTpl {
   /// keep using the same decodable object, e.g. in case of an endpoint.
   void InitDecoding(int32 frame_offset = 0);
 
-  /// Advances the decoding as far as we can.
+  /// Advances the decoding as far as we can.  If the decodable options have
+  /// --lookahead-chunks > 0, the neural net is evaluated for the following
+  /// chunks in a background thread while the search is done in this one.
   void AdvanceDecoding();
 
   /// Finalizes the decoding. Cleans up and prunes remaining tokens, so the
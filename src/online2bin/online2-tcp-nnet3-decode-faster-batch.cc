@@ -0,0 +1,515 @@
+// online2bin/online2-tcp-nnet3-decode-faster-batch.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-semaphore.h"
+#include "util/kaldi-thread.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace kaldi {
+
+// One decoding request, i.e. the audio received from one client connection.
+// It is filled in by the connection thread, handed to the dispatcher thread
+// which feeds it to the NnetBatchDecoder, and handed back (via 'done') once
+// the transcript is known.
+struct ServerRequest {
+  std::string utterance_id;
+  Matrix<BaseFloat> features;
+  Matrix<BaseFloat> online_ivectors;  // Empty if not using iVectors.
+  bool success;
+  std::string sentence;
+  Semaphore done;  // Signaled by the dispatcher thread when decoding is done.
+
+  ServerRequest(): success(false) { }
+};
+
+
+/**
+   This class accepts many concurrent client connections and decodes them all
+   with a single shared model, decoding graph and NnetBatchDecoder.  Each
+   connection has its own thread, which receives the audio and computes the
+   features (and online iVectors); the neural-net evaluation of all active
+   requests is batched by the NnetBatchComputer, and the graph search is done
+   by the decoder threads of the NnetBatchDecoder.
+
+   The interface of NnetBatchDecoder may only be used from one thread, so all
+   calls to it are made from a single dispatcher thread, which takes requests
+   from a queue and routes the decoded output back to the connection threads.
+ */
+class BatchDecodeServer {
+ public:
+  BatchDecodeServer(const OnlineNnet2FeaturePipelineInfo &feature_info,
+                    nnet3::NnetBatchDecoder *decoder,
+                    bool determinize,
+                    BaseFloat samp_freq,
+                    int32 read_timeout,
+                    int32 max_connections):
+      feature_info_(feature_info), decoder_(decoder),
+      determinize_(determinize), samp_freq_(samp_freq),
+      read_timeout_(1000 * read_timeout),
+      connection_slots_(max_connections), server_desc_(-1),
+      utterance_counter_(0), is_finished_(false) { }
+
+  // Starts listening on the given port with the given backlog of pending
+  // connections.
+  void Listen(int32 port, int32 backlog);
+
+  // Accepts client connections forever, starting a thread for each of them.
+  // Blocks while --max-connections clients are already being served.
+  void Serve();
+
+  ~BatchDecodeServer();
+
+ private:
+  // Receives the audio of one client, gets it decoded and writes the
+  // transcript back.  Runs in its own (detached) thread.
+  void HandleConnection(int32 client_desc, std::string peer);
+
+  // Reads all the audio from the client into 'pipeline'; it stops at end of
+  // stream, on errors, or after --read-timeout seconds without data.
+  void ReadAudio(int32 client_desc, OnlineNnet2FeaturePipeline *pipeline);
+
+  // Waits until the request has been decoded; called from the connection
+  // thread.
+  void Submit(ServerRequest *request);
+
+  // This is the dispatcher thread, which is the only one that calls the
+  // interface of decoder_.
+  void Dispatch();
+  static void DispatchFunc(BatchDecodeServer *object) { object->Dispatch(); }
+
+  // Called from the dispatcher thread; gives any outputs that are ready back
+  // to the connection threads that are waiting for them.
+  void DeliverOutput();
+
+  // Called from the dispatcher thread; removes the oldest request from
+  // in_flight_ and signals it.
+  void FinishOldestRequest(bool success, const std::string &sentence);
+
+  static bool Write(int32 client_desc, const std::string &msg);
+
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  nnet3::NnetBatchDecoder *decoder_;
+  bool determinize_;
+  BaseFloat samp_freq_;
+  int32 read_timeout_;  // in milliseconds; negative means block.
+
+  // Limits the number of connections that are served at the same time.
+  Semaphore connection_slots_;
+  int32 server_desc_;
+
+  // queue_, utterance_counter_ and is_finished_ are guarded by mutex_.
+  std::mutex mutex_;
+  std::condition_variable queue_cond_;
+  // Requests waiting to be given to decoder_.
+  std::deque<ServerRequest*> queue_;
+  int64 utterance_counter_;
+  bool is_finished_;
+
+  // Requests that have been given to decoder_ and that have not been answered
+  // yet, in the order in which they were given to it (which is also the order
+  // in which the decoder produces its output).  Only accessed by the
+  // dispatcher thread.
+  std::deque<ServerRequest*> in_flight_;
+
+  std::thread dispatch_thread_;
+};
+
+
+void BatchDecodeServer::Listen(int32 port, int32 backlog) {
+  struct ::sockaddr_in h_addr;
+  h_addr.sin_addr.s_addr = INADDR_ANY;
+  h_addr.sin_port = htons(port);
+  h_addr.sin_family = AF_INET;
+
+  server_desc_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (server_desc_ == -1)
+    KALDI_ERR << "Cannot create TCP socket!";
+
+  int32 flag = 1;
+  if (setsockopt(server_desc_, SOL_SOCKET, SO_REUSEADDR, &flag,
+                 sizeof(flag)) == -1)
+    KALDI_ERR << "Cannot set socket options!";
+
+  if (bind(server_desc_, (struct sockaddr *) &h_addr, sizeof(h_addr)) == -1)
+    KALDI_ERR << "Cannot bind to port: " << port << " (is it taken?)";
+
+  if (listen(server_desc_, backlog) == -1)
+    KALDI_ERR << "Cannot listen on port!";
+
+  KALDI_LOG << "BatchDecodeServer: Listening on port: " << port;
+  dispatch_thread_ = std::thread(DispatchFunc, this);
+}
+
+
+void BatchDecodeServer::Serve() {
+  while (true) {
+    connection_slots_.Wait();
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int32 client_desc = accept(server_desc_, (struct sockaddr *) &addr, &len);
+    if (client_desc == -1) {
+      KALDI_WARN << "Error accepting connection.";
+      connection_slots_.Signal();
+      continue;
+    }
+    char ipstr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ipstr, sizeof(ipstr));
+    KALDI_VLOG(1) << "Accepted connection from: " << ipstr;
+    std::thread(&BatchDecodeServer::HandleConnection, this,
+                client_desc, std::string(ipstr)).detach();
+  }
+}
+
+
+void BatchDecodeServer::ReadAudio(int32 client_desc,
+                                  OnlineNnet2FeaturePipeline *pipeline) {
+  const size_t buf_size = 16384;
+  std::vector<char> buf(buf_size);
+  size_t num_buffered = 0;  // Number of bytes in 'buf' (at most one byte is
+                            // left over between reads, for odd-sized reads).
+  pollfd client_set[1];
+  client_set[0].fd = client_desc;
+  client_set[0].events = POLLIN;
+  Vector<BaseFloat> wave_part;
+  while (true) {
+    int poll_ret = poll(client_set, 1, read_timeout_);
+    if (poll_ret == 0) {
+      KALDI_WARN << "Socket timeout!";
+      break;
+    }
+    if (poll_ret < 0) {
+      KALDI_WARN << "Socket error!";
+      break;
+    }
+    ssize_t ret = read(client_desc, &(buf[num_buffered]),
+                       buf_size - num_buffered);
+    if (ret <= 0)
+      break;
+    num_buffered += ret;
+    size_t num_samp = num_buffered / sizeof(int16);
+    if (num_samp == 0)
+      continue;
+    wave_part.Resize(num_samp, kUndefined);
+    const int16 *samp = reinterpret_cast<const int16*>(&(buf[0]));
+    for (size_t i = 0; i < num_samp; i++)
+      wave_part(i) = static_cast<BaseFloat>(samp[i]);
+    pipeline->AcceptWaveform(samp_freq_, wave_part);
+    size_t num_used = num_samp * sizeof(int16);
+    if (num_buffered > num_used)
+      buf[0] = buf[num_used];
+    num_buffered -= num_used;
+  }
+  pipeline->InputFinished();
+}
+
+
+void BatchDecodeServer::HandleConnection(int32 client_desc,
+                                         std::string peer) {
+  try {
+    OnlineNnet2FeaturePipeline pipeline(feature_info_);
+    ReadAudio(client_desc, &pipeline);
+
+    ServerRequest request;
+    int32 num_frames = pipeline.NumFramesReady();
+    if (num_frames > 0) {
+      std::vector<int32> frames(num_frames);
+      for (int32 t = 0; t < num_frames; t++)
+        frames[t] = t;
+      OnlineFeatureInterface *input_feature = pipeline.InputFeature();
+      request.features.Resize(num_frames, input_feature->Dim(), kUndefined);
+      input_feature->GetFrames(frames, &(request.features));
+
+      OnlineIvectorFeature *ivector_feature = pipeline.IvectorFeature();
+      if (ivector_feature != NULL) {
+        int32 period = feature_info_.ivector_extractor_info.ivector_period,
+            num_ivectors = (num_frames + period - 1) / period;
+        request.online_ivectors.Resize(num_ivectors, ivector_feature->Dim(),
+                                       kUndefined);
+        for (int32 i = 0; i < num_ivectors; i++) {
+          SubVector<BaseFloat> ivector(request.online_ivectors, i);
+          ivector_feature->GetFrame(i * period, &ivector);
+        }
+      }
+      Submit(&request);
+    }
+    if (request.success) {
+      KALDI_VLOG(1) << "Sending transcript for " << request.utterance_id
+                    << " (" << peer << "): " << request.sentence;
+      Write(client_desc, request.sentence + "\n");
+    } else {
+      Write(client_desc, "\n");
+    }
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error serving client " << peer << ": " << e.what();
+  }
+  close(client_desc);
+  connection_slots_.Signal();
+}
+
+
+void BatchDecodeServer::Submit(ServerRequest *request) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::ostringstream os;
+    os << "utt-" << utterance_counter_++;
+    request->utterance_id = os.str();
+    queue_.push_back(request);
+  }
+  queue_cond_.notify_one();
+  request->done.Wait();
+}
+
+
+void BatchDecodeServer::Dispatch() {
+  // How long we wait for new requests before checking again whether the
+  // decoder has produced any output (GetOutput() does not block).
+  const std::chrono::milliseconds poll_interval(5);
+  int32 period = feature_info_.ivector_extractor_info.ivector_period;
+  while (true) {
+    ServerRequest *request = NULL;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (queue_.empty() && !is_finished_)
+        queue_cond_.wait_for(lock, poll_interval);
+      if (queue_.empty() && is_finished_)
+        break;
+      if (!queue_.empty()) {
+        request = queue_.front();
+        queue_.pop_front();
+      }
+    }
+    if (request != NULL) {
+      in_flight_.push_back(request);
+      // This blocks until one of the decoder threads is free; by the time it
+      // returns, the input has been consumed.
+      decoder_->AcceptInput(request->utterance_id, request->features, NULL,
+                            (request->online_ivectors.NumRows() != 0 ?
+                             &(request->online_ivectors) : NULL),
+                            period);
+      request->features.Resize(0, 0);
+      request->online_ivectors.Resize(0, 0);
+    }
+    DeliverOutput();
+  }
+  decoder_->Finished();
+  DeliverOutput();
+}
+
+
+void BatchDecodeServer::FinishOldestRequest(bool success,
+                                            const std::string &sentence) {
+  KALDI_ASSERT(!in_flight_.empty());
+  ServerRequest *request = in_flight_.front();
+  in_flight_.pop_front();
+  request->success = success;
+  request->sentence = sentence;
+  request->done.Signal();
+}
+
+
+void BatchDecodeServer::DeliverOutput() {
+  std::string utterance_id, sentence;
+  CompactLattice clat;
+  Lattice lat;
+  while (determinize_ ?
+         decoder_->GetOutput(&utterance_id, &clat, &sentence) :
+         decoder_->GetOutput(&utterance_id, &lat, &sentence)) {
+    // The decoder produces output in the same order as the input, but skips
+    // utterances for which decoding failed.
+    while (in_flight_.front()->utterance_id != utterance_id)
+      FinishOldestRequest(false, "");
+    FinishOldestRequest(true, sentence);
+  }
+  // Anything that is no longer pending inside the decoder but that we did not
+  // get output for must have failed.
+  while (in_flight_.size() > decoder_->NumPendingUtterances())
+    FinishOldestRequest(false, "");
+}
+
+
+bool BatchDecodeServer::Write(int32 client_desc, const std::string &msg) {
+  const char *p = msg.c_str();
+  size_t to_write = msg.size(), wrote = 0;
+  while (to_write > 0) {
+    ssize_t ret = write(client_desc, static_cast<const void *>(p + wrote),
+                        to_write);
+    if (ret <= 0)
+      return false;
+    to_write -= ret;
+    wrote += ret;
+  }
+  return true;
+}
+
+
+BatchDecodeServer::~BatchDecodeServer() {
+  if (dispatch_thread_.joinable()) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      is_finished_ = true;
+    }
+    queue_cond_.notify_one();
+    dispatch_thread_.join();
+  }
+  if (server_desc_ != -1)
+    close(server_desc_);
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Reads in audio from many concurrent network connections and decodes\n"
+        "them with neural nets (nnet3 setup), with iVector-based speaker\n"
+        "adaptation.  Unlike online2-tcp-nnet3-decode-faster, which serves one\n"
+        "client at a time, this program shares one model and decoding graph\n"
+        "between all clients, batches the neural-net computation of all active\n"
+        "requests together (see nnet3-latgen-faster-batch), and does the graph\n"
+        "search on --num-threads decoder threads.\n"
+        "Each client sends 16-bit signed-integer audio and then closes its\n"
+        "sending side (or stops sending for --read-timeout seconds); the server\n"
+        "replies with the transcript followed by a newline and then closes the\n"
+        "connection.\n"
+        "Note: some configuration values and inputs are set via config\n"
+        "files whose filenames are passed as options\n"
+        "\n"
+        "Usage: online2-tcp-nnet3-decode-faster-batch [options] <nnet3-in> "
+        "<fst-in> <word-symbol-table>\n";
+
+    ParseOptions po(usage);
+
+    // feature_opts includes configuration for the iVector adaptation,
+    // as well as the basic features.
+    OnlineNnet2FeaturePipelineConfig feature_opts;
+    nnet3::NnetBatchComputerOptions compute_opts;
+    LatticeFasterDecoderConfig decoder_opts;
+
+    BaseFloat samp_freq = 16000.0;
+    int32 port_num = 5050;
+    int32 read_timeout = 3;
+    int32 num_threads = 1;
+    int32 max_connections = 256;
+    int32 listen_backlog = 128;
+    bool allow_partial = true;
+
+    po.Register("samp-freq", &samp_freq,
+                "Sampling frequency of the input signal (coded as 16-bit slinear).");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+    po.Register("read-timeout", &read_timeout,
+                "Number of seconds of timeout for TCP audio data to appear on "
+                "the stream. Use -1 for blocking.");
+    po.Register("port-num", &port_num,
+                "Port number the server will listen on.");
+    po.Register("num-threads", &num_threads, "Number of decoder (i.e. "
+                "graph-search) threads.  The neural net is evaluated on one "
+                "more thread, in batches that combine all active requests.");
+    po.Register("max-connections", &max_connections, "Maximum number of "
+                "clients that are served at the same time; further "
+                "connections wait in the listen queue.");
+    po.Register("listen-backlog", &listen_backlog, "Size of the queue of "
+                "pending connections passed to listen().");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+
+    feature_opts.Register(&po);
+    compute_opts.Register(&po);
+    decoder_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      return 1;
+    }
+    if (num_threads < 1 || max_connections < 1 || listen_backlog < 1)
+      KALDI_ERR << "Invalid --num-threads, --max-connections or "
+                << "--listen-backlog option.";
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        word_syms_filename = po.GetArg(3);
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_opts);
+
+    KALDI_VLOG(1) << "Loading AM...";
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    KALDI_VLOG(1) << "Loading FST...";
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+      KALDI_ERR << "Could not read symbol table from file "
+                << word_syms_filename;
+
+    signal(SIGPIPE, SIG_IGN); // ignore SIGPIPE to avoid crashing when socket forcefully disconnected
+
+    nnet3::NnetBatchComputer computer(compute_opts, am_nnet.GetNnet(),
+                                      am_nnet.Priors());
+    nnet3::NnetBatchDecoder decoder(*decode_fst, decoder_opts,
+                                    trans_model, word_syms, allow_partial,
+                                    num_threads, &computer);
+
+    BatchDecodeServer server(feature_info, &decoder,
+                             decoder_opts.determinize_lattice, samp_freq,
+                             read_timeout, max_connections);
+    server.Listen(port_num, listen_backlog);
+    server.Serve();  // Never returns.
+    return 0;
+  } catch (const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
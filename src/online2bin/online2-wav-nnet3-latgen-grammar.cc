@@ -180,7 +180,7 @@ int main(int argc, char *argv[]) {
                                                         &am_nnet);
 
     fst::ConstGrammarFst fst;
-    ReadKaldiObject(fst_rxfilename, &fst);
+    fst.ReadMapped(fst_rxfilename);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
@@ -24,6 +24,9 @@
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
 #include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
@@ -1882,6 +1885,297 @@ class RandomAccessTableReaderScriptImpl:
 
 
 
+// This is the implementation of RandomAccessTableReader for a script file when
+// the "bg" (background) option is given.  It predicts that the keys will be
+// requested in the order in which they appear in the (sorted) script file,
+// possibly with gaps, which is what happens when a program iterates over a
+// sorted sequential table and looks up each key here.  After each lookup, a
+// background thread reads and parses the next kPrefetchSize objects in the
+// script, so that when the caller asks for one of them it is usually ready.
+// If the prediction is wrong we just read the object in the foreground as
+// RandomAccessTableReaderScriptImpl would; the only cost is some wasted I/O.
+//
+// Note: the code for reading the script in Open() is the same as in
+// RandomAccessTableReaderScriptImpl: try to keep them in sync.
+template<class Holder>
+class RandomAccessTableReaderScriptBackgroundImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderScriptBackgroundImpl():
+      is_open_(false), cur_pos_(kNoPos), cur_holder_(NULL),
+      window_begin_(0), window_end_(0), loading_pos_(kNoPos), stop_(false) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (is_open_)
+      KALDI_ERR << " Opening already open RandomAccessTableReader:"
+                   " call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier,
+                                           &script_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kScriptRspecifier);  // or wrongly called.
+    KALDI_ASSERT(script_.empty());
+    if (!ReadScriptFile(script_rxfilename_, true, &script_))
+      return false;
+    if (!opts_.sorted)
+      std::sort(script_.begin(), script_.end());
+    for (size_t i = 0; i + 1 < script_.size(); i++) {
+      if (script_[i].first.compare(script_[i+1].first) >= 0) {
+        bool same = (script_[i].first == script_[i+1].first);
+        KALDI_WARN << "Script file " << PrintableRxfilename(script_rxfilename_)
+                   << (same ? " contains duplicate key: " :
+                       " is not sorted (remove s, option or add ns, option):"
+                       " key is ") << script_[i].first;
+        script_.clear();
+        return false;
+      }
+    }
+    stop_ = false;
+    thread_ = std::thread(
+        RandomAccessTableReaderScriptBackgroundImpl<Holder>::run, this);
+    is_open_ = true;
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    KALDI_ASSERT(is_open_);
+    size_t pos;
+    if (!LookupKey(key, &pos))
+      return false;
+    if (!opts_.permissive)
+      return true;
+    // In permissive mode we have to check that we can read the object.
+    return GetObject(pos) != NULL;
+  }
+
+  virtual const T& Value(const std::string &key) {
+    KALDI_ASSERT(is_open_);
+    size_t pos;
+    Holder *holder = NULL;
+    if (LookupKey(key, &pos))
+      holder = GetObject(pos);
+    if (holder == NULL)
+      KALDI_ERR << "Could not get item for key " << key
+                << ", rspecifier is " << rspecifier_ << " [to ignore this, "
+                << "add the p, (permissive) option to the rspecifier.";
+    return holder->Value();
+  }
+
+  virtual bool Close() {
+    if (!is_open_)
+      KALDI_ERR << "Close() called on RandomAccessTableReader that was not"
+                   " open.";
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+      cond_.notify_all();
+    }
+    thread_.join();
+    for (typename CacheType::iterator iter = cache_.begin();
+         iter != cache_.end(); ++iter)
+      delete iter->second;
+    cache_.clear();
+    delete cur_holder_;
+    cur_holder_ = NULL;
+    cur_pos_ = kNoPos;
+    window_begin_ = window_end_ = 0;
+    script_.clear();
+    is_open_ = false;
+    // As for RandomAccessTableReaderScriptImpl, this cannot fail.
+    return true;
+  }
+
+  virtual ~RandomAccessTableReaderScriptBackgroundImpl() {
+    if (is_open_)
+      Close();
+  }
+
+ private:
+  // The number of objects after the last one asked for that we read ahead.
+  static const size_t kPrefetchSize = 8;
+  static const size_t kNoPos = static_cast<size_t>(-1);
+
+  static void run(RandomAccessTableReaderScriptBackgroundImpl<Holder> *object) {
+    object->RunInBackground();
+  }
+
+  // The main function of the background thread: reads the objects in the
+  // window [window_begin_, window_end_) that are not yet in the cache.
+  void RunInBackground() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      size_t pos = window_begin_;
+      while (pos < window_end_ && cache_.count(pos) != 0)
+        pos++;
+      if (pos >= window_end_) {
+        cond_.wait(lock);
+        continue;
+      }
+      loading_pos_ = pos;
+      lock.unlock();
+      Holder *holder = ReadObject(pos, &background_input_);
+      lock.lock();
+      loading_pos_ = kNoPos;
+      if (pos >= window_begin_ && pos < window_end_)
+        cache_[pos] = holder;
+      else
+        delete holder;  // The caller has moved on.
+      cond_.notify_all();
+    }
+  }
+
+  // Reads the object at position 'pos' of the script (extracting the range, if
+  // there is one), using 'input' to read it.  Returns a newly allocated
+  // holder, or NULL if the object could not be read (in which case it prints a
+  // warning).  Called from both threads; it only uses members that don't
+  // change while the table is open.
+  Holder *ReadObject(size_t pos, Input *input) const {
+    const std::string &entry = script_[pos].second;
+    std::string data_rxfilename, range;
+    if (!entry.empty() && entry[entry.size() - 1] == ']') {
+      if (!ExtractRangeSpecifier(entry, &data_rxfilename, &range)) {
+        KALDI_WARN << "TableReader: failed to parse range in '"
+                   << entry << "'";
+        return NULL;
+      }
+    } else {
+      data_rxfilename = entry;
+    }
+    Holder *holder = new Holder;
+    try {
+      if (!input->Open(data_rxfilename)) {
+        KALDI_WARN << "Error opening stream "
+                   << PrintableRxfilename(data_rxfilename);
+        delete holder;
+        return NULL;
+      }
+      if (!holder->Read(input->Stream())) {
+        KALDI_WARN << "Error reading object from "
+                      "stream " << PrintableRxfilename(data_rxfilename);
+        delete holder;
+        return NULL;
+      }
+      if (!range.empty()) {
+        Holder *range_holder = new Holder;
+        bool ok = range_holder->ExtractRange(*holder, range);
+        delete holder;
+        if (!ok) {
+          KALDI_WARN << "Failed to load object from "
+                     << PrintableRxfilename(data_rxfilename)
+                     << "[" << range << "]";
+          delete range_holder;
+          return NULL;
+        }
+        holder = range_holder;
+      }
+    } catch (...) {
+      KALDI_WARN << "Exception caught reading object from "
+                 << PrintableRxfilename(data_rxfilename);
+      delete holder;
+      return NULL;
+    }
+    return holder;
+  }
+
+  // Makes the object at position 'pos' of the script the current object
+  // (taking it from the cache, waiting for the background thread, or reading
+  // it directly, as appropriate), moves the prefetch window to just after it,
+  // and returns its holder, or NULL if it could not be read.
+  Holder *GetObject(size_t pos) {
+    if (pos == cur_pos_)
+      return cur_holder_;
+    delete cur_holder_;
+    cur_holder_ = NULL;
+    cur_pos_ = pos;
+    bool have_object = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (loading_pos_ == pos)  // The background thread is reading it.
+        cond_.wait(lock);
+      typename CacheType::iterator iter = cache_.find(pos);
+      if (iter != cache_.end()) {
+        cur_holder_ = iter->second;
+        have_object = true;
+        cache_.erase(iter);
+      }
+      window_begin_ = pos + 1;
+      window_end_ = std::min(pos + 1 + kPrefetchSize, script_.size());
+      // Discard anything that we no longer expect to be asked for.
+      for (iter = cache_.begin(); iter != cache_.end(); ) {
+        if (iter->first < window_begin_ || iter->first >= window_end_) {
+          delete iter->second;
+          cache_.erase(iter++);
+        } else {
+          ++iter;
+        }
+      }
+      cond_.notify_all();
+    }
+    if (!have_object)
+      cur_holder_ = ReadObject(pos, &input_);
+    return cur_holder_;
+  }
+
+  // Looks up 'key' in the sorted array script_; returns true and sets
+  // 'script_offset' if found.
+  bool LookupKey(const std::string &key, size_t *script_offset) {
+    // The usual case is that we are asked for the current or the next key.
+    if (cur_pos_ != kNoPos) {
+      for (size_t pos = cur_pos_; pos <= cur_pos_ + 1 &&
+               pos < script_.size(); pos++) {
+        if (script_[pos].first == key) {
+          *script_offset = pos;
+          return true;
+        }
+      }
+    }
+    std::pair<std::string, std::string> pr(key, "");
+    typedef typename std::vector<std::pair<std::string, std::string> >
+                     ::const_iterator IterType;
+    IterType iter = std::lower_bound(script_.begin(), script_.end(), pr);
+    if (iter != script_.end() && iter->first == key) {
+      *script_offset = iter - script_.begin();
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  bool is_open_;
+  RspecifierOptions opts_;
+  std::string rspecifier_;  // used in error messages.
+  std::string script_rxfilename_;
+  // Sorted (key, rxfilename) pairs; constant while the table is open.
+  std::vector<std::pair<std::string, std::string> > script_;
+
+  // These are only accessed by the calling thread.
+  Input input_;
+  size_t cur_pos_;  // The script position of the current object, or kNoPos.
+  Holder *cur_holder_;  // The current object (NULL if it couldn't be read);
+                        // it remains valid till the next lookup.
+
+  // This is only accessed by the background thread.
+  Input background_input_;
+
+  std::thread thread_;
+  std::mutex mutex_;  // Guards the following members.
+  std::condition_variable cond_;
+  // Objects that have been read ahead, indexed by script position; all are in
+  // the window [window_begin_, window_end_).  NULL means the object could not
+  // be read.
+  typedef std::map<size_t, Holder*> CacheType;
+  CacheType cache_;
+  size_t window_begin_;
+  size_t window_end_;
+  size_t loading_pos_;  // Position the background thread is reading, or
+                        // kNoPos.
+  bool stop_;
+};
+
+
+
 
 // This is the base-class (with some implemented functions) for the
 // implementations of RandomAccessTableReader when it's an archive.  This
@@ -2521,7 +2815,10 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
   RspecifierType rs = ClassifyRspecifier(rspecifier, NULL, &opts);
   switch (rs) {
     case kScriptRspecifier:
-      impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
+      if (opts.background)
+        impl_ = new RandomAccessTableReaderScriptBackgroundImpl<Holder>();
+      else
+        impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
       if (opts.sorted) {
@@ -17,6 +17,9 @@
 // MERCHANTABLITY OR NON-INFRINGEMENT.
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
+
+#include <fstream>
+
 #include "base/io-funcs.h"
 #include "util/kaldi-io.h"
 #include "base/kaldi-math.h"
@@ -803,6 +806,7 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
   else if (Rand()%2 == 0) name += "ncs,";
   if (once) name += "o,";
   else if (Rand()%2 == 0) name += "no,";
+  if (Rand()%2 == 0) name += "bg,";
   name += std::string(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
 
   RandomAccessDoubleReader sbr(name);
@@ -930,9 +934,10 @@ void UnitTestRangesMatrix(bool binary) {
 
   {  // test random-access reading.
     bool permissive = (RandInt(0, 1) == 0);
-    RandomAccessDoubleMatrixReader reader(permissive ?
-                                          "scp,p:tmpf_ranges.scp" :
-                                          "scp:tmpf_ranges.scp");
+    bool background = (RandInt(0, 1) == 0);
+    RandomAccessDoubleMatrixReader reader(
+        std::string(background ? "bg," : "") +
+        (permissive ? "scp,p:tmpf_ranges.scp" : "scp:tmpf_ranges.scp"));
 
     int32 num_queries = RandInt(0, 10);
     for (int32 n = 0; n < num_queries; n++) {
@@ -1011,6 +1016,7 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
   else if (Rand()%2 == 0) name += "ncs,";
   if (once) name += "o,";
   else if (Rand()%2 == 0) name += "no,";
+  if (Rand()%2 == 0) name += "bg,";
   name += std::string(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
   RandomAccessDoubleMatrixReader sbr(name);
 
@@ -1045,6 +1051,43 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
   unlink("tmpf.scp");
 }
 
+// Tests the read-ahead of random-access script readers with the "bg" option,
+// asking for keys mostly in sorted order with gaps, as programs typically do.
+void UnitTestTableRandomScriptBackground() {
+  int32 sz = RandInt(0, 40);
+  std::vector<std::string> keys(sz);
+  std::vector<Matrix<BaseFloat> > values(sz);
+  {
+    BaseFloatMatrixWriter writer("ark,scp:tmpf,tmpf.scp");
+    for (int32 i = 0; i < sz; i++) {
+      std::ostringstream os;
+      os << "key" << (100 + i);  // so that the sorted order is the same.
+      keys[i] = os.str();
+      values[i].Resize(RandInt(1, 10), RandInt(1, 10));
+      values[i].SetRandn();
+      writer.Write(keys[i], values[i]);
+    }
+  }
+  {  // add a key whose object can't be read.
+    std::ofstream os("tmpf.scp", std::ios_base::app);
+    os << "key999 nonexistent_file\n";
+  }
+  RandomAccessBaseFloatMatrixReader reader("p,bg,scp:tmpf.scp");
+  for (int32 i = 0; i < sz; i++) {
+    if (RandInt(0, 2) == 0)
+      continue;
+    int32 j = i;
+    if (RandInt(0, 4) == 0) j = RandInt(0, sz - 1);  // out of order.
+    if (RandInt(0, 1) == 0)
+      KALDI_ASSERT(reader.HasKey(keys[j]));
+    KALDI_ASSERT(reader.Value(keys[j]).ApproxEqual(values[j]));
+  }
+  KALDI_ASSERT(!reader.HasKey("key999") && !reader.HasKey("foo"));
+  reader.Close();
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
 void UnitTestTableNumpyArray() {
   const char* wspecifier = "ark,scp:numpy_array.ark,numpy_array.scp";
 
@@ -1159,6 +1202,8 @@ int main() {
       }
     }
   }
+  for (int i = 0; i < 10; i++)
+    UnitTestTableRandomScriptBackground();
   UnitTestTableNumpyArray();
   std::cout << "Test OK.\n";
   return 0;
@@ -184,11 +184,15 @@ bool WriteScriptFile(std::ostream &os,
 //       [any of the above options can be prefixed by n to negate them, e.g. no,
 //       ns, ncs, np; but these aren't currently useful as you could just omit
 //       the option].
-//   bg means "background".  It currently has no effect for random-access readers,
-//       but for sequential readers it will cause it to "read ahead" to the next
-//       value, in a background thread.  Recommended when reading larger objects
-//       such as neural-net training examples, especially when you want to
-//       maximize GPU usage.
+//   bg means "background".  For sequential readers it will cause it to "read
+//       ahead" to the next value, in a background thread.  Recommended when
+//       reading larger objects such as neural-net training examples, especially
+//       when you want to maximize GPU usage.  For random-access readers of
+//       script files, it will cause the objects that follow the last one asked
+//       for (in the order of the sorted script file) to be read ahead in a
+//       background thread; this helps when the program will ask for the keys
+//       in sorted order, e.g. because it is iterating over another sorted
+//       table.  It has no effect for random-access readers of archives.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -208,9 +212,9 @@ struct  RspecifierOptions {
   // scp files that can't be read as if the corresponding key were not there.
   // For archive files it will suppress errors getting thrown if the archive
   // is corrupted and can't be read to the end.
-  bool background;  // For sequential readers, if the background option ("bg")
-                    // is provided, it will read ahead to the next object in a
-                    // background thread.
+  bool background;  // If the background option ("bg") is provided, sequential
+                    // readers, and random-access readers of script files,
+                    // read ahead in a background thread.
   RspecifierOptions(): once(false), sorted(false),
                        called_sorted(false), permissive(false),
                        background(false) { }